@@ -125,9 +125,15 @@ void DoCrossValidate(const ConfigParameters& config)
     std::vector<std::vector<double>> cvErrorResults;
     std::vector<std::wstring> cvModels;
 
+    // single pass: read the CV data once per group of up to maxModelsPerPass models (0 = all), and evaluate the models of a group on it together
+    bool singlePass = config(L"singlePass", "false");
+    size_t maxModelsPerPass = config(L"maxModelsPerPass", "0");
+    size_t parallelModels = config(L"parallelModels", "1"); // #threads to evaluate the models of a group concurrently on (CPU only)
+
     DataReader<ElemType> cvDataReader(readerConfig);
 
     bool finalModelEvaluated = false;
+    std::vector<std::wstring> cvModelPaths;
     for (size_t i = cvInterval[0]; i <= cvInterval[2]; i += cvInterval[1])
     {
         wstring cvModelPath = msra::strfun::wstrprintf(L"%ls.%lld", modelPath.c_str(), i);
@@ -143,17 +149,50 @@ void DoCrossValidate(const ConfigParameters& config)
                 finalModelEvaluated = true;
             }
         }
+        cvModelPaths.push_back(cvModelPath);
+    }
 
-        cvModels.push_back(cvModelPath);
-        auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, cvModelPath);
+    if (singlePass)
+    {
+        if (maxModelsPerPass == 0)
+            maxModelsPerPass = cvModelPaths.size();
+        for (size_t first = 0; first < cvModelPaths.size(); first += maxModelsPerPass)
+        {
+            std::vector<ComputationNetworkPtr> nets;
+            std::vector<std::wstring> groupModels;
+            for (size_t k = first; k < cvModelPaths.size() && k < first + maxModelsPerPass; k++)
+            {
+                nets.push_back(ComputationNetwork::CreateFromFile<ElemType>(deviceId, cvModelPaths[k]));
+                groupModels.push_back(cvModelPaths[k]);
+            }
 
-        SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel);
+            fprintf(stderr, "evaluating %d models in a single pass over the data\n", (int) nets.size());
+            auto groupErrors = SimpleEvaluator<ElemType>::EvaluateModels(nets, groupModels, &cvDataReader, evalNodeNamesVector, mbSize[0], epochSize,
+                                                                         numMBsToShowResult, traceLevel, parallelModels);
+            for (size_t k = 0; k < nets.size(); k++)
+            {
+                cvModels.push_back(groupModels[k]);
+                cvErrorResults.push_back(groupErrors[k]);
+            }
 
-        fprintf(stderr, "model %ls --> \n", cvModelPath.c_str());
-        auto evalErrors = eval.Evaluate(&cvDataReader, evalNodeNamesVector, mbSize[0], epochSize);
-        cvErrorResults.push_back(evalErrors);
+            ::Sleep(1000 * sleepSecondsBetweenRuns);
+        }
+    }
+    else
+    {
+        for (const auto& cvModelPath : cvModelPaths)
+        {
+            cvModels.push_back(cvModelPath);
+            auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, cvModelPath);
 
-        ::Sleep(1000 * sleepSecondsBetweenRuns);
+            SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel);
+
+            fprintf(stderr, "model %ls --> \n", cvModelPath.c_str());
+            auto evalErrors = eval.Evaluate(&cvDataReader, evalNodeNamesVector, mbSize[0], epochSize);
+            cvErrorResults.push_back(evalErrors);
+
+            ::Sleep(1000 * sleepSecondsBetweenRuns);
+        }
     }
 
     // find best model
@@ -240,7 +279,9 @@ void DoWriteOutput(const ConfigParameters& config)
     else if (config.Exists("outputPath"))
     {
         wstring outputPath = config(L"outputPath"); // crashes if no default given?
-        writer.WriteOutput(testDataReader, mbSize[0], outputPath, outputNodeNamesVector, epochSize);
+        wstring outputFormat = config(L"outputFormat", L"text"); // text, binary, or htk
+        bool roundTrip = config(L"outputRoundTrip", "false");    // text: all digits needed to read back the identical value, instead of 6
+        writer.WriteOutput(testDataReader, mbSize[0], outputPath, outputNodeNamesVector, epochSize, ParseOutputValueFormat(outputFormat), roundTrip);
     }
     // writer.WriteOutput(testDataReader, mbSize[0], testDataWriter, outputNodeNamesVector, epochSize);
 }
@@ -93,6 +93,17 @@ shared_ptr<C> CreateObject(const ConfigParameters& config, const wchar_t* id)
     return make_shared<C>(readerConfig);                           // old CNTK config specifies a dictionary which then must be explicitly instantiated
 }
 
+// text of the reader configuration, which identifies the training data (e.g. for caching the PreCompute statistics)
+// BrainScript records have no textual form, hence nothing is returned for them.
+static wstring GetReaderConfigText(const ScriptableObjects::IConfigRecord&)
+{
+    return wstring();
+}
+static wstring GetReaderConfigText(const ConfigParameters& config)
+{
+    return msra::strfun::utf16(static_cast<const std::string&>(config(L"reader")));
+}
+
 template <class ConfigRecordType, typename ElemType>
 void DoTrain(const ConfigRecordType& config)
 {
@@ -172,6 +183,7 @@ void DoTrain(const ConfigRecordType& config)
         optimizer = make_shared<SGD<ElemType>>(configSGD);
     }
 
+    optimizer->SetPreComputeCacheKey(GetReaderConfigText(config));
     optimizer->Train(createNetworkFn, deviceId, dataReader.get(), cvDataReader.get(), makeMode);
 }
 
@@ -123,7 +123,7 @@ wstring computationNodes = // TODO: use actual TypeName() here? would first need
     UnaryStandardNode(SumElements, matrix)
     UnaryStandardNode(Tanh, z)
     UnaryStandardNode(TimeReverse, vectorSequence)
-    BinaryStandardNode(Times, leftMatrix, rightMatrix)
+    L"Times(leftMatrix, rightMatrix, transpose = false, tag='') = if transpose then TransposeTimes(leftMatrix, rightMatrix, tag=tag) else new ComputationNode [ operation = 'Times' ; inputs = (leftMatrix : rightMatrix) /*plus the function args*/ ]\n" // transpose: leftMatrix' * rightMatrix
 #ifdef COMING_SOON
     UnaryStandardNode(Transpose, matrix)
 #endif
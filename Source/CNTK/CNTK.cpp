@@ -19,6 +19,9 @@
 #include "SynchronousExecutionEngine.h"
 #include "ModelEditLanguage.h"
 #include "CPUMatrix.h" // used for SetNumThreads()
+#include "VectorMath.h"
+#include "NumaPlacement.h"
+#include "CPUMatrixAllocator.h"
 #include "CommonMatrix.h"
 #include "SGD.h"
 #include "MPIWrapper.h"
@@ -27,6 +30,7 @@
 #include "SimpleOutputWriter.h"
 #include "BestGpu.h"
 #include "ProgressTracing.h"
+#include "PerformanceProfiler.h"
 #include "fileutil.h"
 #include "ScriptableObjects.h"
 #include "BrainScriptEvaluator.h"
@@ -145,6 +149,14 @@ static void DisableLegacyUsage(const ConfigParameters& TopLevelConfig, const Con
     }
 }
 
+// enable built-in profiling; with several MPI ranks, each writes its own timeline
+static void EnableProfiling(wstring traceFile)
+{
+    if (!traceFile.empty() && g_mpi != nullptr && g_mpi->NumNodesInUse() > 1)
+        traceFile += msra::strfun::wstrprintf(L".rank%d", (int) g_mpi->CurrentNodeRank());
+    PerformanceProfiler::Enable(traceFile);
+}
+
 // process the command
 template <typename ElemType>
 void DoCommands(const ConfigParameters& config)
@@ -159,6 +171,49 @@ void DoCommands(const ConfigParameters& config)
         std::cerr << "Using " << numCPUThreads << " CPU threads" << endl;
     }
 
+    // execute independent nodes concurrently (CPU only)
+    int parallelNodeExecution = config(L"parallelNodeExecution", "0");
+    ComputationNetwork::SetNumParallelNodeExecutionThreads(max(0, parallelNodeExecution));
+
+    // trade compute for memory: release values needed by backprop after forward prop, and recompute them when needed
+    bool recomputeActivations = config(L"recomputeActivations", false);
+    int recomputeSegmentLength = config(L"recomputeSegmentLength", "0"); // every this-many-th value is kept (0: sqrt of their number)
+    ComputationNetwork::SetActivationRecomputation(recomputeActivations, max(0, recomputeSegmentLength));
+
+    // parallel, thread-count independent random numbers on the CPU (changes the random values, hence off by default)
+    bool counterBasedRNG = config(L"counterBasedRNG", false);
+    CPUMatrix<ElemType>::SetCounterBasedRNG(counterBasedRNG);
+
+    // vectorized exp/log/tanh/sigmoid on the CPU: "accurate" (within a few ulp) or "fast" (float only, ~1e-6 relative)
+    // off by default since results differ slightly from the C library's
+    wstring vectorMath = config(L"vectorMath", L"none");
+    VectorMath::SetMode(VectorMath::ParseMode(msra::strfun::utf8(vectorMath).c_str()));
+
+    // NUMA placement: of large CPU matrix buffers ("firstTouch" or "interleave"), and of threads (pinThreads: pin the
+    // OpenMP threads to CPUs, and give each localParallelTrain worker or concurrently evaluated model its own node)
+    wstring numaPolicy = config(L"numaPolicy", L"none");
+    NumaPlacement::SetPolicy(NumaPlacement::ParsePolicy(msra::strfun::utf8(numaPolicy).c_str()));
+    bool pinThreads = config(L"pinThreads", false);
+    NumaPlacement::SetPinThreads(pinThreads);
+    NumaPlacement::PinOpenMPThreads();
+    if (numaPolicy != L"none" || pinThreads)
+        fprintf(stderr, "NUMA: %d nodes, numaPolicy=%ls, pinThreads=%s\n", (int) NumaPlacement::NumNodes(), numaPolicy.c_str(), pinThreads ? "true" : "false");
+
+    // where CPU matrix buffers come from: "default" (the system, each time) or "caching" (freed buffers are reused,
+    // up to cpuMatrixCacheSizeMB, 0 = no limit); hugePages: back large buffers by transparent huge pages (Linux)
+    wstring cpuMatrixAllocator = config(L"cpuMatrixAllocator", L"default");
+    int cpuMatrixCacheSizeMB = config(L"cpuMatrixCacheSizeMB", "0");
+    bool hugePages = config(L"hugePages", false);
+    CPUMatrixAllocator::SetCurrent(CPUMatrixAllocator::Create(msra::strfun::utf8(cpuMatrixAllocator).c_str(), hugePages, (size_t) max(0, cpuMatrixCacheSizeMB) << 20));
+
+    // built-in profiling of nodes and training phases
+    bool profiling = config(L"profiling", false);
+    if (profiling)
+    {
+        wstring profilingTraceFile = config(L"profilingTraceFile", L"");
+        EnableProfiling(profilingTraceFile);
+    }
+
     bool progressTracing = config(L"progressTracing", false);
 
     // temporary hack to prevent users from failling for a small breaking change related to the "truncated" flag (will be redone bigger and better some day)
@@ -274,6 +329,10 @@ void DoCommands(const ConfigParameters& config)
             ndlScript.ClearGlobal(); // clear global macros between commands
         }
     }
+
+    PerformanceProfiler::Report();
+    if (cpuMatrixAllocator != L"default")
+        fprintf(stderr, "CPU matrix allocator (%ls): %s\n", cpuMatrixAllocator.c_str(), CPUMatrixAllocator::Current().GetStatistics().ToString().c_str());
 }
 
 std::string TimeDateStamp()
@@ -456,6 +515,32 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     numCPUThreads = CPUMatrix<float /*any will do*/>::SetNumThreads(numCPUThreads);
     if (numCPUThreads > 0)
         fprintf(stderr, "Using %d CPU threads.\n", numCPUThreads);
+    int parallelNodeExecution = config(L"parallelNodeExecution", 0);
+    ComputationNetwork::SetNumParallelNodeExecutionThreads(max(0, parallelNodeExecution));
+    bool recomputeActivations = config(L"recomputeActivations", false);
+    int recomputeSegmentLength = config(L"recomputeSegmentLength", 0);
+    ComputationNetwork::SetActivationRecomputation(recomputeActivations, max(0, recomputeSegmentLength));
+    bool counterBasedRNG = config(L"counterBasedRNG", false);
+    CPUMatrix<float /*any will do*/>::SetCounterBasedRNG(counterBasedRNG);
+    wstring vectorMath = config(L"vectorMath", L"none");
+    VectorMath::SetMode(VectorMath::ParseMode(msra::strfun::utf8(vectorMath).c_str()));
+    wstring numaPolicy = config(L"numaPolicy", L"none");
+    NumaPlacement::SetPolicy(NumaPlacement::ParsePolicy(msra::strfun::utf8(numaPolicy).c_str()));
+    bool pinThreads = config(L"pinThreads", false);
+    NumaPlacement::SetPinThreads(pinThreads);
+    NumaPlacement::PinOpenMPThreads();
+    if (numaPolicy != L"none" || pinThreads)
+        fprintf(stderr, "NUMA: %d nodes, numaPolicy=%ls, pinThreads=%s\n", (int) NumaPlacement::NumNodes(), numaPolicy.c_str(), pinThreads ? "true" : "false");
+    wstring cpuMatrixAllocator = config(L"cpuMatrixAllocator", L"default");
+    int cpuMatrixCacheSizeMB = config(L"cpuMatrixCacheSizeMB", 0);
+    bool hugePages = config(L"hugePages", false);
+    CPUMatrixAllocator::SetCurrent(CPUMatrixAllocator::Create(msra::strfun::utf8(cpuMatrixAllocator).c_str(), hugePages, (size_t) max(0, cpuMatrixCacheSizeMB) << 20));
+    bool profiling = config(L"profiling", false);
+    if (profiling)
+    {
+        wstring profilingTraceFile = config(L"profilingTraceFile", L"");
+        EnableProfiling(profilingTraceFile);
+    }
 
     bool progressTracing = config(L"progressTracing", false);
     size_t fullTotalMaxEpochs = 1; // BUGBUG: BS does not allow me to read out the max epochs parameters, as that would instantiate and thus execute the objects
@@ -480,6 +565,10 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     }
     // else action has already been executed, see comment above
 
+    PerformanceProfiler::Report();
+    if (cpuMatrixAllocator != L"default")
+        fprintf(stderr, "CPU matrix allocator (%ls): %s\n", cpuMatrixAllocator.c_str(), CPUMatrixAllocator::Current().GetStatistics().ToString().c_str());
+
     // write a doneFile if requested
     wstring doneFile = config(L"doneFile", L"");
     if (doneFile != L"")
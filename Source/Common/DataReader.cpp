@@ -38,6 +38,24 @@ std::string GetReaderName(double)
     return name;
 }
 
+template <class ElemType>
+std::string GetCachingReaderName(ElemType)
+{
+    return std::string();
+}
+template <>
+std::string GetCachingReaderName(float)
+{
+    std::string name = "GetCachingReaderF";
+    return name;
+}
+template <>
+std::string GetCachingReaderName(double)
+{
+    std::string name = "GetCachingReaderD";
+    return name;
+}
+
 template <class ElemType>
 template <class ConfigRecordType>
 void DataReader<ElemType>::InitFromConfig(const ConfigRecordType& /*config*/)
@@ -101,6 +119,17 @@ DataReader<ElemType>::DataReader(const ConfigRecordType& config)
         const ConfigRecordType& thisIO = hasMultipleReaders ? config(ioName) : config /*legacy*/;
         m_dataReaders[ioName]->Init(thisIO);
 
+        // optionally cache what the reader delivers in a binary file, from which later epochs are read (CachingReader in BinaryReader)
+        if (thisIO.Exists(L"cache"))
+        {
+            typedef void (*GetCachingReaderProc)(IDataReader<ElemType>* source, IDataReader<ElemType>** preader);
+            GetCachingReaderProc getCachingReaderProc = (GetCachingReaderProc) Plugin::Load(L"BinaryReader", GetCachingReaderName((ElemType) 0));
+            IDataReader<ElemType>* source = m_dataReaders[ioName];
+            getCachingReaderProc(source, &m_dataReaders[ioName]); // (takes ownership of the reader)
+            const ConfigRecordType& cacheConfig = thisIO(L"cache");
+            m_dataReaders[ioName]->Init(cacheConfig);
+        }
+
         // pass on some global option    --TODO: Why is this not done inside each reader??
         size_t nbrUttPerMinibatch = config(L"nbruttsineachrecurrentiter", (size_t) 1);
         m_dataReaders[ioName]->SetNumParallelSequences(nbrUttPerMinibatch);
@@ -285,13 +285,13 @@ public:
         }
     }
 
-    // for raw pointer
+    // for raw pointer; 'op' can be MPI_MIN or MPI_MAX instead of the sum
     template <class ElemType>
-    void AllReduce(ElemType *pData, size_t nData)
+    void AllReduce(ElemType *pData, size_t nData, MPI_Op op = MPI_SUM)
     {
         if ((NumNodesInUse() > 1 && (Communicator() != MPI_COMM_NULL)))
         {
-            MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), MPI_SUM, Communicator()) || MpiFail("Allreduce: MPI_Allreduce");
+            MPI_Allreduce(MPI_IN_PLACE, pData, (int) nData, GetDataType(pData), op, Communicator()) || MpiFail("Allreduce: MPI_Allreduce");
         }
     }
 
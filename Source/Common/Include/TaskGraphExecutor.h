@@ -0,0 +1,298 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TaskGraphExecutor.h -- execute a DAG of tasks on a persistent pool of worker threads
+//
+// Tasks become ready once all their predecessors have completed. Each worker owns a deque of ready tasks;
+// it pushes tasks it made ready onto its own deque and pops from the back (good locality, the inputs were
+// just computed by this thread), and idle workers steal from the front of other workers' deques.
+// A worker that finds nothing to do sleeps until a task becomes ready, or until the run is over.
+// The thread calling Run() participates as worker 0, so a pool of N threads uses N-1 background threads.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ---------------------------------------------------------------------------
+// TaskGraph -- dependencies between tasks 0..size()-1
+// Edges must form a DAG (a cycle makes Run() hang); duplicate edges are allowed but wasteful.
+// ---------------------------------------------------------------------------
+
+class TaskGraph
+{
+    std::vector<std::vector<size_t>> m_successors;
+    std::vector<size_t> m_numPredecessors;
+
+public:
+    TaskGraph(size_t numTasks = 0)
+        : m_successors(numTasks), m_numPredecessors(numTasks, 0)
+    {
+    }
+    size_t size() const
+    {
+        return m_successors.size();
+    }
+    // 'to' must not start before 'from' has completed
+    void AddEdge(size_t from, size_t to)
+    {
+        m_successors[from].push_back(to);
+        m_numPredecessors[to]++;
+    }
+    const std::vector<size_t>& Successors(size_t task) const
+    {
+        return m_successors[task];
+    }
+    size_t NumPredecessors(size_t task) const
+    {
+        return m_numPredecessors[task];
+    }
+};
+
+// ---------------------------------------------------------------------------
+// TaskGraphExecutor -- work-stealing executor for a TaskGraph
+// Run() is not reentrant. If a task throws, no further tasks are started, and the first exception is
+// rethrown by Run() once all workers have gone idle.
+// ---------------------------------------------------------------------------
+
+class TaskGraphExecutor
+{
+    struct TaskQueue
+    {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+    std::vector<std::unique_ptr<TaskQueue>> m_queues; // [workerIndex]; [0] belongs to the thread calling Run()
+    std::vector<std::thread> m_threads;               // background workers 1..N-1
+
+    // state of the current Run()
+    std::mutex m_runLock;
+    std::condition_variable m_runStarted;
+    std::condition_variable m_runDone;
+    size_t m_runId;   // incremented by each Run() to wake up the workers
+    size_t m_numBusy; // #background workers that have not yet finished the current Run()
+    bool m_shutdown;
+    bool m_running;
+    const TaskGraph* m_graph;
+    const std::function<void(size_t)>* m_task;
+    std::unique_ptr<std::atomic<size_t>[]> m_pending; // [task] #predecessors not yet completed
+    std::atomic<size_t> m_remaining;                  // #tasks not yet completed
+    std::atomic<bool> m_failed;
+    std::exception_ptr m_exception;
+
+    // idle workers wait for m_numQueued > 0 or the end of the run; changes they wait for are notified under m_workLock
+    std::mutex m_workLock;
+    std::condition_variable m_workAvailable;
+    std::atomic<long> m_numQueued; // #tasks in all queues (may be off by the few being pushed/popped right now)
+
+    void NotifyAll()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_workLock);
+        }
+        m_workAvailable.notify_all();
+    }
+
+    void Push(size_t w, size_t task)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_queues[w]->lock);
+            m_queues[w]->tasks.push_back(task);
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_workLock);
+            m_numQueued++;
+        }
+        m_workAvailable.notify_one();
+    }
+    bool Pop(size_t w, size_t& task)
+    {
+        std::lock_guard<std::mutex> guard(m_queues[w]->lock);
+        if (m_queues[w]->tasks.empty())
+            return false;
+        task = m_queues[w]->tasks.back();
+        m_queues[w]->tasks.pop_back();
+        m_numQueued--;
+        return true;
+    }
+    bool Steal(size_t w, size_t& task)
+    {
+        for (size_t k = 1; k < m_queues.size(); k++)
+        {
+            auto& victim = *m_queues[(w + k) % m_queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                m_numQueued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // execute tasks until all are done or one has failed
+    void Work(size_t w)
+    {
+        while (m_remaining.load() > 0 && !m_failed.load())
+        {
+            size_t task;
+            if (!Pop(w, task) && !Steal(w, task))
+            {
+                // tasks are still running elsewhere; sleep until one of them makes a successor ready
+                std::unique_lock<std::mutex> lock(m_workLock);
+                m_workAvailable.wait(lock, [&]
+                                     {
+                                         return m_numQueued.load() > 0 || m_remaining.load() == 0 || m_failed.load();
+                                     });
+                continue;
+            }
+            try
+            {
+                (*m_task)(task);
+            }
+            catch (...)
+            {
+                {
+                    std::lock_guard<std::mutex> guard(m_runLock);
+                    if (!m_exception)
+                        m_exception = std::current_exception();
+                    m_failed = true;
+                }
+                NotifyAll();
+                return;
+            }
+            for (size_t succ : m_graph->Successors(task))
+            {
+                if (--m_pending[succ] == 0)
+                    Push(w, succ);
+            }
+            if (--m_remaining == 0)
+                NotifyAll();
+        }
+    }
+
+    void WorkerThread(size_t w, std::function<void(size_t)> threadInit)
+    {
+        if (threadInit)
+            threadInit(w);
+        size_t lastRunId = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_runLock);
+                m_runStarted.wait(lock, [&]
+                                  {
+                                      return m_shutdown || m_runId != lastRunId;
+                                  });
+                if (m_shutdown)
+                    return;
+                lastRunId = m_runId;
+            }
+            Work(w);
+            {
+                std::lock_guard<std::mutex> guard(m_runLock);
+                if (--m_numBusy == 0)
+                    m_runDone.notify_all();
+            }
+        }
+    }
+
+    // disallow copying (we own threads)
+    TaskGraphExecutor(const TaskGraphExecutor&);
+    TaskGraphExecutor& operator=(const TaskGraphExecutor&);
+
+public:
+    // 'threadInit' is called once on each background thread with its worker index, e.g. to limit its OpenMP/BLAS threads
+    TaskGraphExecutor(size_t numThreads, const std::function<void(size_t)>& threadInit = std::function<void(size_t)>())
+        : m_runId(0), m_numBusy(0), m_shutdown(false), m_running(false), m_graph(nullptr), m_task(nullptr), m_remaining(0), m_failed(false), m_numQueued(0)
+    {
+        if (numThreads < 1)
+            InvalidArgument("TaskGraphExecutor: number of threads must be at least 1");
+        for (size_t w = 0; w < numThreads; w++)
+            m_queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+        for (size_t w = 1; w < numThreads; w++)
+            m_threads.push_back(std::thread(&TaskGraphExecutor::WorkerThread, this, w, threadInit));
+    }
+    ~TaskGraphExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_runLock);
+            m_shutdown = true;
+        }
+        m_runStarted.notify_all();
+        for (auto& thread : m_threads)
+            thread.join();
+    }
+
+    size_t NumThreads() const
+    {
+        return m_queues.size();
+    }
+
+    // execute task(t) for all tasks of 'graph', each after all of its predecessors; returns when all are done
+    void Run(const TaskGraph& graph, const std::function<void(size_t)>& task)
+    {
+        const size_t numTasks = graph.size();
+        if (numTasks == 0)
+            return;
+        if (m_running)
+            LogicError("TaskGraphExecutor::Run: must not be called recursively from a task");
+        m_running = true;
+
+        m_graph = &graph;
+        m_task = &task;
+        m_pending.reset(new std::atomic<size_t>[numTasks]);
+        m_remaining = numTasks;
+        m_failed = false;
+        m_exception = nullptr;
+        for (auto& queue : m_queues)
+            queue->tasks.clear(); // (left over from a failed run)
+        m_numQueued = 0;
+        size_t w = 0;
+        for (size_t t = 0; t < numTasks; t++)
+        {
+            m_pending[t] = graph.NumPredecessors(t);
+            if (graph.NumPredecessors(t) == 0) // initially ready tasks are dealt round-robin
+            {
+                m_queues[w]->tasks.push_back(t);
+                m_numQueued++;
+                w = (w + 1) % m_queues.size();
+            }
+        }
+
+        // wake up the background workers and join in
+        {
+            std::lock_guard<std::mutex> guard(m_runLock);
+            m_numBusy = m_threads.size();
+            m_runId++;
+        }
+        m_runStarted.notify_all();
+        Work(0);
+        {
+            std::unique_lock<std::mutex> lock(m_runLock);
+            m_runDone.wait(lock, [&]
+                           {
+                               return m_numBusy == 0;
+                           });
+        }
+        m_running = false;
+
+        if (m_exception)
+            std::rethrow_exception(m_exception);
+    }
+};
+} } }
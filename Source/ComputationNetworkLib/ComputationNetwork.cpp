@@ -44,6 +44,18 @@ vector<shared_ptr<Matrix<double>>>& MatrixPool::GetReleasedMatrices<double>()
     return m_releasedDoubleMatrices;
 }
 
+template <>
+vector<shared_ptr<Matrix<float>>>& MatrixPool::GetAllocatedMatrices<float>()
+{
+    return m_allocatedFloatMatrices;
+}
+
+template <>
+vector<shared_ptr<Matrix<double>>>& MatrixPool::GetAllocatedMatrices<double>()
+{
+    return m_allocatedDoubleMatrices;
+}
+
 // -----------------------------------------------------------------------
 // construction
 // -----------------------------------------------------------------------
@@ -231,6 +243,45 @@ void ComputationNetwork::ReadPersistableParameters(File& fstream, bool create)
     fstream.GetMarker(FileMarker::fileMarkerEndSection, L"ENodeList");
 }
 
+// keep the persistable state of all nodes in memory: the values that Save() writes (of the parameters and the precomputed
+// statistics), and the other state that training changes (e.g. the minibatch count of BatchNormalization)
+template <class ElemType>
+void ComputationNetwork::SavePersistableState(PersistableState& state) const
+{
+    state.nodes = GetAllNodes();
+    state.nodeStates.clear();
+    state.values.clear();
+    for (const auto& node : state.nodes)
+    {
+        auto nodeState = ComputationNetworkBuilder<ElemType>::NewNode(node->OperationName(), m_deviceId, node->NodeName());
+        node->CopyTrainingStateTo(nodeState);
+        state.nodeStates.push_back(nodeState);
+
+        shared_ptr<Matrix<ElemType>> value;
+        if (node->OperationName() == OperationNameOf(LearnableParameter) || node->RequiresPreCompute())
+        {
+            const auto& nodeValue = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+            value = make_shared<Matrix<ElemType>>(nodeValue, nodeValue.GetDeviceId()); // (deep copy)
+        }
+        state.values.push_back(value);
+    }
+}
+
+// go back to a state kept by SavePersistableState()
+// Like RereadPersistableParameters(), this requires the same network, as it was when the state was kept.
+template <class ElemType>
+void ComputationNetwork::RestorePersistableState(const PersistableState& state)
+{
+    if (state.nodes != GetAllNodes())
+        LogicError("RestorePersistableState: The nodes of the network have changed since the state was saved.");
+    for (size_t i = 0; i < state.nodes.size(); i++)
+    {
+        state.nodeStates[i]->CopyTrainingStateTo(state.nodes[i]);
+        if (state.values[i])
+            dynamic_pointer_cast<ComputationNode<ElemType>>(state.nodes[i])->Value().SetValue(*static_pointer_cast<Matrix<ElemType>>(state.values[i]));
+    }
+}
+
 // deserialize the model
 // This does not post-process the model (CompileNetwork()). Use Load() instead.
 template <class ElemType>
@@ -1026,6 +1077,8 @@ void ComputationNetwork::PerformSVDecomposition(const map<wstring, float>& SVDCo
 template void ComputationNetwork::InitLearnableParameters<float>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const float initValueScale, bool initOnCPUOnly);
 template void ComputationNetwork::Read<float>(const wstring& fileName, const FileOptions fileFormat, const bool bAllowNoCriterionNode, ComputationNetwork* anotherNetwork);
 template void ComputationNetwork::ReadPersistableParameters<float>(File& fstream, bool create);
+template void ComputationNetwork::SavePersistableState<float>(PersistableState& state) const;
+template void ComputationNetwork::RestorePersistableState<float>(const PersistableState& state);
 template void ComputationNetwork::PerformSVDecomposition<float>(const map<wstring, float>& SVDConfig, size_t alignedsize);
 template /*static*/ void ComputationNetwork::SetDropoutRate<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, unsigned long& dropOutSeed);
 template void ComputationNetwork::SetSeqParam<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
@@ -1034,6 +1087,8 @@ template void ComputationNetwork::SetSeqParam<float>(ComputationNetworkPtr net,
 template void ComputationNetwork::InitLearnableParameters<double>(const ComputationNodeBasePtr& node, const bool uniformInit, const unsigned long randomSeed, const double initValueScale, bool initOnCPUOnly);
 template void ComputationNetwork::Read<double>(const wstring& fileName, const FileOptions fileFormat, const bool bAllowNoCriterionNode, ComputationNetwork* anotherNetwork);
 template void ComputationNetwork::ReadPersistableParameters<double>(File& fstream, bool create);
+template void ComputationNetwork::SavePersistableState<double>(PersistableState& state) const;
+template void ComputationNetwork::RestorePersistableState<double>(const PersistableState& state);
 template void ComputationNetwork::PerformSVDecomposition<double>(const map<wstring, float>& SVDConfig, size_t alignedsize);
 template /*static*/ void ComputationNetwork::SetDropoutRate<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double dropoutRate, double& prevDropoutRate, unsigned long& dropOutSeed);
 template void ComputationNetwork::SetSeqParam<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
@@ -12,6 +12,7 @@
 
 #include "ComputationNode.h"
 #include "ScriptableObjects.h"
+#include "TaskGraphExecutor.h"
 
 #include <map>
 #include <string>
@@ -86,6 +87,17 @@ public:
         File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
         ReadPersistableParameters<ElemType>(fstream, false);
     }
+    // in-memory copy of what RereadPersistableParameters() restores, e.g. used by SGD to go back to the start of an epoch without a model file
+    struct PersistableState
+    {
+        std::vector<ComputationNodeBasePtr> nodes;      // the nodes, in GetAllNodes() order
+        std::vector<ComputationNodeBasePtr> nodeStates; // for each node, a node of the same type that holds its CopyTrainingStateTo() state
+        std::vector<shared_ptr<MatrixBase>> values;     // for each node, a copy of its value if Save() persists it, otherwise null
+    };
+    template <class ElemType>
+    void SavePersistableState(PersistableState& state) const;
+    template <class ElemType>
+    void RestorePersistableState(const PersistableState& state);
     // design BUGBUG: binary files do not know whether they are float or double.
     // TODO: modify file format to know this; then eliminate the <ElemType> dependency (and in some future, allow nodes to be different)
     template <class ElemType>
@@ -185,8 +197,64 @@ private:
 public:
     void AllocateAllMatrices(const std::vector<ComputationNodeBasePtr>& evalRootNodes, const std::vector<ComputationNodeBasePtr>& outValueRootNodes, ComputationNodeBasePtr trainRootNode);
 
+    // execute nodes that do not depend on each other concurrently, using this many threads (0 or 1: serial execution)
+    // Applies to networks on the CPU only. The CPU threads set by numCPUThreads are divided among the node threads.
+    static void SetNumParallelNodeExecutionThreads(size_t numThreads);
+    static bool IsParallelNodeExecutionEnabled()
+    {
+        return s_nodeExecutor != nullptr;
+    }
+
+    // trade compute for memory: keep only every segmentLength-th of the values needed for backprop (0: about the square
+    // root of their number), and recompute the others during backprop from the nearest kept ones
+    // Only nodes that opt in (CanBeRecomputed()) outside of recurrent loops are recomputed, and only with shareNodeValueMatrices.
+    static void SetActivationRecomputation(bool enable, size_t segmentLength);
+    bool RecomputesActivations() const
+    {
+        return m_recomputationRoot != nullptr;
+    }
+
+    // the memory that node values and gradients from the matrix pool take (see AllocateAllMatrices()); this excludes
+    // parameters, their gradients, and inputs
+    size_t GetNumMatrixPoolBytes() const
+    {
+        return m_matrixPool.GetNumAllocatedBytes();
+    }
+    // the (unordered) pairs of nodes that use the same matrix from the pool, which parallel node execution keeps in serial order
+    const std::set<std::pair<const ComputationNodeBase*, const ComputationNodeBase*>>& GetMatrixSharingConflicts() const
+    {
+        return m_matrixPool.GetConflicts();
+    }
+    // the task graph by which parallel node execution runs ForwardProp() or Backprop() of 'rootNode', as last built
+    // (empty before the first parallel run); task i executes node i of GetNestedNetwork(rootNode)
+    const TaskGraph& GetParallelTaskGraph(const ComputationNodeBasePtr& rootNode, bool backprop);
+
+    // the values to recompute before, and to release after, the backprop of one node or loop
+    struct RecomputationStep
+    {
+        std::vector<ComputationNodeBasePtr> recompute; // in evaluation order
+        std::vector<ComputationNodeBasePtr> restore;   // (the value computed by ForwardProp() is swapped back in)
+    };
+
 private:
-    void ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount);
+    static std::unique_ptr<TaskGraphExecutor> s_nodeExecutor; // for parallel node execution, or null
+    static int s_numThreadsPerNode;                             // OpenMP/BLAS threads each node-executing thread may use
+    static bool s_recomputeActivations;
+    static size_t s_recomputeSegmentLength;
+
+    void SelectRecomputedNodes(const std::vector<ComputationNodeBasePtr>& evalOrder, const std::vector<ComputationNodeBasePtr>& roots,
+                               const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                               std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp);
+    void ScheduleRecomputation(const ComputationNodeBasePtr& trainRootNode);
+
+    void ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount,
+                                             const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap);
+    void ReleaseMatricesAfterEvalForNode(ComputationNodeBasePtr pNode, std::unordered_map<ComputationNodeBasePtr, int>& parentCount,
+                                         const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap);
+    static bool CanRunInPlace(const ComputationNodeBasePtr& node, const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                              const std::vector<ComputationNodeBasePtr>& roots);
+    static void AddMatrixUsers(const ComputationNodeBasePtr& node, const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                               std::vector<const ComputationNodeBase*>& users);
     void AllocateGradientMatricesForInputs(ComputationNodeBasePtr parentNode);
 
 public:
@@ -847,6 +915,29 @@ protected:
         virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool);
         virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool);
 
+        // same as ForwardProp() and Backprop(), but nodes that do not depend on each other run concurrently
+        // The matrix pool tells which nodes share memory; those are kept in their serial order.
+        void ForwardPropInParallel(const FrameRange& fr, TaskGraphExecutor& executor, const MatrixPool& matrixPool);
+        void BackpropInParallel(const FrameRange& fr, TaskGraphExecutor& executor, const MatrixPool& matrixPool);
+        const TaskGraph& GetTaskGraph(bool backprop) const
+        {
+            return backprop ? m_backpropTaskGraph : m_forwardTaskGraph;
+        }
+
+        // same as Backprop(), but recomputes the values that were released after ForwardProp() where they are needed
+        void BackpropWithRecomputation(const FrameRange& fr, const std::map<ComputationNodeBasePtr, RecomputationStep>& steps);
+
+    private:
+        static void ForwardPropNode(const ComputationNodeBasePtr& node, const FrameRange& fr);
+        static void BackpropNode(const ComputationNodeBasePtr& node, const FrameRange& fr);
+        void BuildTaskGraphs(const MatrixPool& matrixPool);
+        void PrepareLayoutsForParallelExecution();
+
+        TaskGraph m_forwardTaskGraph;            // [i] refers to m_nestedNodes[i]
+        TaskGraph m_backpropTaskGraph;           // same, for gradient computation
+        size_t m_taskGraphPoolGeneration;        // matrix-pool generation the task graphs were built for
+        std::vector<MBLayoutPtr> m_nestedLayouts; // all distinct layouts used by the nested nodes
+
     public:
         // this special constructor constructs the top-level network node
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
@@ -919,6 +1010,10 @@ private:
     // pool for matrices that can be shared across nodes
     // TODO: does this apply to anything else besides temporary node-internal intermediate results? What, for example?
     MatrixPool m_matrixPool;
+
+    // activation recomputation for m_recomputationRoot, as planned by AllocateAllMatrices()
+    std::map<ComputationNodeBasePtr, RecomputationStep> m_recomputationSteps; // [node or loop in backprop order]
+    ComputationNodeBasePtr m_recomputationRoot;
 };
 typedef ComputationNetwork::ComputationNetworkPtr ComputationNetworkPtr;
 
@@ -48,6 +48,8 @@ void ComputationNetwork::FormRecurrentLoops(const ComputationNodeBasePtr& rootNo
     // determine the strongly connected cliques -> m_allSEQNodes[]
     DetermineSCCs(rootNode);
     // now we have formed all loops, with all nodes assigned to a loop or none
+    // Only nodes on a cycle become part of a loop. Loop inputs that are not, e.g. W*x(t) feeding a recurrence, are
+    // evaluated outside the loop, as one operation over the whole minibatch, before the loop is iterated frame by frame.
 
     // recover m_visitedOrder in original depth-first traversal order
     size_t i = 0;
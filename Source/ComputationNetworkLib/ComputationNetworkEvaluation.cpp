@@ -10,12 +10,16 @@
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
 #include "InputAndParamNodes.h"
+#include "CPUMatrix.h" // used for SetNumThreadsForCurrentThread()
+#include "PerformanceProfiler.h"
 #include <string>
 #include <vector>
 #include <list>
 #include <set>
 #include <algorithm>
 #include <map>
+#include <functional>
+#include <math.h>
 
 using namespace std;
 
@@ -27,6 +31,20 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 // forward and backward propagation
 // -----------------------------------------------------------------------
 
+// limit the calling thread to its share of the CPU threads while it executes nodes
+struct ThreadsPerNodeGuard
+{
+    int m_prevNumThreads;
+    ThreadsPerNodeGuard(int numThreads)
+        : m_prevNumThreads(CPUMatrix<float>::SetNumThreadsForCurrentThread(numThreads))
+    {
+    }
+    ~ThreadsPerNodeGuard()
+    {
+        CPUMatrix<float>::SetNumThreadsForCurrentThread(m_prevNumThreads);
+    }
+};
+
 // MAIN ENTRY POINT for evaluating one minibatch (forward prop)
 // This calls ForwardProp() on all nodes in order of data flow through the network.
 // By default, the network is applied concurrently on all frames in a minibatch in parallel (PAR mode, a "map" operation)
@@ -40,7 +58,13 @@ void ComputationNetwork::ForwardProp(const ComputationNodeBasePtr rootNode)
     VerifyIsCompiled("ForwardProp");
 
     // traverse all nodes in the pre-determined evaluation order
-    GetNestedNetwork(rootNode)->ForwardProp(FrameRange(nullptr));
+    if (s_nodeExecutor && m_deviceId < 0)
+    {
+        ThreadsPerNodeGuard guard(s_numThreadsPerNode);
+        dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode))->ForwardPropInParallel(FrameRange(nullptr), *s_nodeExecutor, m_matrixPool);
+    }
+    else
+        GetNestedNetwork(rootNode)->ForwardProp(FrameRange(nullptr));
 }
 
 // set the gradient matrix of a node to an 1x1 matrix containing 1.0
@@ -74,7 +98,68 @@ void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode) // trai
         LogicError("Backprop: Training criterion is neither ComputationNode<float> nor ComputationNode<double>.");
 
     // backpropagate through the network
-    GetNestedNetwork(rootNode)->Backprop(FrameRange(nullptr), true, true);
+    if (!m_recomputationSteps.empty() && rootNode == m_recomputationRoot) // (serially: the steps swap values that other nodes read)
+        dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode))->BackpropWithRecomputation(FrameRange(nullptr), m_recomputationSteps);
+    else if (s_nodeExecutor && m_deviceId < 0)
+    {
+        ThreadsPerNodeGuard guard(s_numThreadsPerNode);
+        dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode))->BackpropInParallel(FrameRange(nullptr), *s_nodeExecutor, m_matrixPool);
+    }
+    else
+        GetNestedNetwork(rootNode)->Backprop(FrameRange(nullptr), true, true);
+}
+
+// -----------------------------------------------------------------------
+// parallel node execution
+//
+// Nodes that do not depend on each other (e.g. the branches of a multi-stream
+// network, or the gradients of independent inputs) can be computed concurrently.
+// This is opt-in, and useful on the CPU where a single node often cannot keep all
+// cores busy. The CPU threads are divided among the node-executing threads.
+// -----------------------------------------------------------------------
+
+std::unique_ptr<TaskGraphExecutor> ComputationNetwork::s_nodeExecutor;
+int ComputationNetwork::s_numThreadsPerNode = 0;
+
+/*static*/ void ComputationNetwork::SetNumParallelNodeExecutionThreads(size_t numThreads)
+{
+    s_nodeExecutor.reset();
+    if (numThreads <= 1)
+        return;
+    int numCPUThreads = CPUMatrix<float /*any will do*/>::SetNumThreadsForCurrentThread(0); // (0 = just query)
+    s_numThreadsPerNode = max(1, numCPUThreads / (int) numThreads);
+    s_nodeExecutor.reset(new TaskGraphExecutor(numThreads, [](size_t)
+                                               {
+                                                   CPUMatrix<float>::SetNumThreadsForCurrentThread(s_numThreadsPerNode);
+                                               }));
+    fprintf(stderr, "Executing independent nodes concurrently on %d threads, with %d CPU threads each.\n", (int) numThreads, s_numThreadsPerNode);
+}
+
+// -----------------------------------------------------------------------
+// activation recomputation
+//
+// Backprop needs many of the values computed by ForwardProp(), which therefore
+// all live until backprop, so that their memory grows with the depth of the
+// network. Optionally, only some of them (checkpoints) are kept; the others are
+// released after ForwardProp() like values that backprop does not need, and
+// recomputed from the checkpoints right before backprop needs them.
+// -----------------------------------------------------------------------
+
+bool ComputationNetwork::s_recomputeActivations = false;
+size_t ComputationNetwork::s_recomputeSegmentLength = 0;
+
+/*static*/ void ComputationNetwork::SetActivationRecomputation(bool enable, size_t segmentLength)
+{
+    s_recomputeActivations = enable;
+    s_recomputeSegmentLength = segmentLength;
+    if (!enable)
+        return;
+    if (segmentLength > 0)
+        fprintf(stderr, "Recomputing activations during backprop, keeping every %d-th value.\n", (int) segmentLength);
+    else
+        fprintf(stderr, "Recomputing activations during backprop, keeping about the square root of the number of values.\n");
+    if (!g_shareNodeValueMatrices)
+        fprintf(stderr, "WARNING: Activation recomputation saves no memory without shareNodeValueMatrices=true, and is disabled.\n");
 }
 
 void ComputationNetwork::FormNestedNetwork(const ComputationNodeBasePtr& rootNode)
@@ -92,6 +177,11 @@ ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNod
     return m_nestedNetworks[rootNode];
 }
 
+const TaskGraph& ComputationNetwork::GetParallelTaskGraph(const ComputationNodeBasePtr& rootNode, bool backprop)
+{
+    return dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode))->GetTaskGraph(backprop);
+}
+
 // -----------------------------------------------------------------------
 // PARTraversalFlowControlNode methods -- implements PAR traversal
 //
@@ -101,6 +191,7 @@ ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNod
 // -----------------------------------------------------------------------
 
 ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes /*must be in eval order*/)
+    : m_taskGraphPoolGeneration(SIZE_MAX)
 {
     // traverse the network in evaluation order and create a new list that replaces all recurrence by a SEQTraversalFlowControlNode
     set<shared_ptr<IComputationNode>> loopsSeen; // for consistency check only
@@ -125,37 +216,196 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         }
     }
 }
-/*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
+/*static*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardPropNode(const ComputationNodeBasePtr& node, const FrameRange& fr)
 {
-    for (auto& node : m_nestedNodes)
+    if (node->IsOutputOlderThanInputs())
     {
-        if (node->IsOutputOlderThanInputs())
-        {
-            auto recInfo = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
-            if (recInfo)
-                assert(recInfo->m_sourceNode->GetMBLayout() == node->GetMBLayout());
+        auto recInfo = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
+        if (recInfo)
+            assert(recInfo->m_sourceNode->GetMBLayout() == node->GetMBLayout());
 
-            node->BeginForwardProp();
-            node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
-            node->EndForwardProp();
+        ProfileNode profile(*node, false /*isBackprop*/);
+        node->BeginForwardProp();
+        node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+        node->EndForwardProp();
 
-            node->BumpEvalTimeStamp();
-        }
+        node->BumpEvalTimeStamp();
     }
 }
 
+/*static*/ void ComputationNetwork::PARTraversalFlowControlNode::BackpropNode(const ComputationNodeBasePtr& node, const FrameRange& fr)
+{
+    ProfileNode profile(*node, true /*isBackprop*/);
+    node->BeginBackprop();
+    node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+    node->EndBackprop();
+}
+
+/*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
+{
+    for (auto& node : m_nestedNodes)
+        ForwardPropNode(node, fr);
+}
+
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop; // TODO: think through what these mean when coming from PAR mode
     // process nodes in pre-determined order
     for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
+        BackpropNode(*pnode, fr);
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::BackpropWithRecomputation(const FrameRange& fr, const std::map<ComputationNodeBasePtr, RecomputationStep>& steps)
+{
+    for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++)
+    {
+        auto step = steps.find(*pnode);
+        if (step != steps.end())
+        {
+            // recompute into the node's own matrix for backprop; timestamps are not bumped since the value did not change
+            for (auto& node : step->second.recompute)
+            {
+                node->SwapRecomputedValue();
+                ProfileNode profile(*node, false /*isBackprop*/);
+                node->BeginForwardProp();
+                node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+                node->EndForwardProp();
+            }
+        }
+        BackpropNode(*pnode, fr);
+        if (step != steps.end())
+        {
+            for (auto& node : step->second.restore)
+                node->SwapRecomputedValue();
+        }
+    }
+}
+
+// determine which of our nested nodes must wait for which
+// A SEQ loop counts as a single task. Besides data flow, two rules keep the results identical to serial execution:
+//  - nodes whose matrices are shared through the matrix pool execute in serial order
+//  - gradients of a node are accumulated by its parents in the same order as in serial backprop
+void ComputationNetwork::PARTraversalFlowControlNode::BuildTaskGraphs(const MatrixPool& matrixPool)
+{
+    const size_t numTasks = m_nestedNodes.size();
+
+    // map all nodes, including loop members, to their task
+    std::unordered_map<const ComputationNodeBase*, size_t> taskOf;
+    std::set<MBLayoutPtr> layouts;
+    for (size_t t = 0; t < numTasks; t++)
+    {
+        auto recInfo = dynamic_pointer_cast<SEQTraversalFlowControlNode>(m_nestedNodes[t]);
+        if (recInfo)
+        {
+            for (auto& node : recInfo->m_nestedNodes)
+            {
+                taskOf[node.get()] = t;
+                layouts.insert(node->GetMBLayout());
+            }
+        }
+        else
+            taskOf[m_nestedNodes[t].get()] = t;
+        layouts.insert(m_nestedNodes[t]->GetMBLayout());
+    }
+    layouts.erase(nullptr);
+    m_nestedLayouts.assign(layouts.begin(), layouts.end());
+
+    // edges are collected as (earlier, later) in terms of the serial evaluation order
+    std::set<std::pair<size_t, size_t>> dataFlow;        // (input task, consumer task)
+    std::map<const ComputationNodeBase*, std::set<size_t>> gradientWriters; // [node] tasks that write into its gradient
+    for (auto& keyValue : taskOf)
+    {
+        const ComputationNodeBase* node = keyValue.first;
+        const size_t t = keyValue.second;
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+        {
+            const ComputationNodeBase* input = node->GetInputs()[i].get();
+            auto iter = taskOf.find(input);
+            if (iter == taskOf.end() || iter->second == t)
+                continue;
+            dataFlow.insert(make_pair(iter->second, t));
+            gradientWriters[input].insert(t);
+        }
+    }
+    // the gradient of a view is that of its input, so their writers are one chain
+    for (auto& keyValue : taskOf)
+    {
+        const ComputationNodeBase* view = keyValue.first;
+        if (!view->IsValueViewOfInput() || gradientWriters.find(view) == gradientWriters.end())
+            continue;
+        const ComputationNodeBase* input = view;
+        while (input->IsValueViewOfInput())
+            input = input->GetInputs()[0].get();
+        gradientWriters[input].insert(gradientWriters[view].begin(), gradientWriters[view].end());
+    }
+
+    std::set<std::pair<size_t, size_t>> sharing;
+    for (auto& conflict : matrixPool.GetConflicts())
     {
-        auto& node = *pnode;
+        auto iter1 = taskOf.find(conflict.first);
+        auto iter2 = taskOf.find(conflict.second);
+        if (iter1 != taskOf.end() && iter2 != taskOf.end() && iter1->second != iter2->second)
+            sharing.insert(make_pair(min(iter1->second, iter2->second), max(iter1->second, iter2->second)));
+    }
 
-        node->BeginBackprop();
-        node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
-        node->EndBackprop();
+    // forward: inputs before consumers, shared matrices in evaluation order
+    std::set<std::pair<size_t, size_t>> forwardEdges(dataFlow);
+    forwardEdges.insert(sharing.begin(), sharing.end());
+    m_forwardTaskGraph = TaskGraph(numTasks);
+    for (auto& edge : forwardEdges)
+        m_forwardTaskGraph.AddEdge(edge.first, edge.second);
+
+    // backprop: everything runs in reverse order; consumers before inputs, shared matrices in reverse evaluation order,
+    // and the writers of the same gradient chained in the order serial backprop would apply them
+    std::set<std::pair<size_t, size_t>> backpropEdges(dataFlow);
+    backpropEdges.insert(sharing.begin(), sharing.end());
+    for (auto& keyValue : gradientWriters)
+    {
+        const auto& writers = keyValue.second; // (sorted ascending)
+        for (auto iter = writers.begin(); std::next(iter) != writers.end(); iter++)
+            backpropEdges.insert(make_pair(*iter, *std::next(iter)));
     }
+    m_backpropTaskGraph = TaskGraph(numTasks);
+    for (auto& edge : backpropEdges)
+        m_backpropTaskGraph.AddEdge(edge.second, edge.first);
+
+    m_taskGraphPoolGeneration = matrixPool.GetGeneration();
+}
+
+// MBLayout computes its validity mask lazily; do that now, before several threads ask for it concurrently
+void ComputationNetwork::PARTraversalFlowControlNode::PrepareLayoutsForParallelExecution()
+{
+    for (auto& layout : m_nestedLayouts)
+    {
+        if (layout->HasGaps())
+            layout->GetColumnsValidityMask(CPUDEVICE);
+    }
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::ForwardPropInParallel(const FrameRange& fr, TaskGraphExecutor& executor, const MatrixPool& matrixPool)
+{
+    if (matrixPool.GetGeneration() == 0) // matrices not allocated through the pool yet: we know nothing about sharing
+        return ForwardProp(fr);
+    if (m_taskGraphPoolGeneration != matrixPool.GetGeneration())
+        BuildTaskGraphs(matrixPool);
+    PrepareLayoutsForParallelExecution();
+    executor.Run(m_forwardTaskGraph, [&](size_t t)
+                 {
+                     ForwardPropNode(m_nestedNodes[t], fr);
+                 });
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::BackpropInParallel(const FrameRange& fr, TaskGraphExecutor& executor, const MatrixPool& matrixPool)
+{
+    if (matrixPool.GetGeneration() == 0)
+        return Backprop(fr, true, true);
+    if (m_taskGraphPoolGeneration != matrixPool.GetGeneration())
+        BuildTaskGraphs(matrixPool);
+    PrepareLayoutsForParallelExecution();
+    executor.Run(m_backpropTaskGraph, [&](size_t t)
+                 {
+                     BackpropNode(m_nestedNodes[t], fr);
+                 });
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
 {
@@ -211,10 +461,12 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     // Note: Currently, this is limited to linear-time loops. But nothing stops the iteration below to, e.g., be a 2D iteration over an image
     // if we implement an according FrameRangeIteration.
     FrameRangeIteration range(GetMBLayout(), m_steppingDirection);
+    const double timeStepFraction = 1.0 / max((size_t) 1, GetMBLayout()->GetNumTimeSteps()); // (for profiling)
     for (auto t = range.begin(); t != range.end(); t++)
     {
         for (auto& node : m_nestedNodes)
         {
+            ProfileNode profile(*node, false /*isBackprop*/, timeStepFraction);
             node->ForwardProp(t);
             node->BumpEvalTimeStamp();
         }
@@ -241,11 +493,13 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     const auto& recurrentNodes = m_nestedNodes; // BUGBUG: -ForForward?? Does this mean we can remove non-ForForward?
     auto pMBLayout = recurrentNodes[0]->GetMBLayout();
     FrameRangeIteration range(pMBLayout, m_steppingDirection);
+    const double timeStepFraction = 1.0 / max((size_t) 1, pMBLayout->GetNumTimeSteps()); // (for profiling)
     for (auto t = range.rbegin(); t != range.rend(); t++) // note: reverse iteration
     {
         for (auto nodeIter2 = recurrentNodes.rbegin(); nodeIter2 != recurrentNodes.rend(); ++nodeIter2)
         {
             auto& node2 = *nodeIter2;
+            ProfileNode profile(*node2, true /*isBackprop*/, timeStepFraction);
             node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
             // The above flags tell Backprop() to skip back-propagation from inside a node into
             // a node that is outside the loop, which is done later in EndBackprop() in PAR mode.
@@ -754,6 +1008,15 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         parentCount[keyValue.first] = keyValue.second.size();
     }
 
+    // Below, we tell the matrix pool on whose behalf matrices are requested and released.
+    // It uses this to determine which nodes share memory and hence cannot be executed concurrently.
+    auto nodeAndParents = [&parentsMap](const ComputationNodeBasePtr& node)
+    {
+        std::vector<const ComputationNodeBase*> nodes;
+        AddMatrixUsers(node, parentsMap, nodes);
+        return nodes;
+    };
+
     // Construct the composite forward prop eval order by enumerating the
     // nodes corresponding to each of our roots and then arranging them in the
     // relative order that they appear in the global evaluation order
@@ -768,6 +1031,43 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         }
     }
 
+    // a view (see IsValueViewOfInput()) reads and writes its input's matrices, so the input's value must be kept whenever the view's is
+    auto keepInputsOfViews = [&]()
+    {
+        for (auto iter = compositeForwardPropEvalOrder.rbegin(); iter != compositeForwardPropEvalOrder.rend(); iter++)
+        {
+            if ((*iter)->IsValueViewOfInput() && outputValueNeededDuringBackProp[*iter])
+                outputValueNeededDuringBackProp[(*iter)->GetInputs()[0]] = true;
+        }
+    };
+    keepInputsOfViews();
+
+    // activation recomputation: most values that backprop needs are released after ForwardProp(), too (see SetActivationRecomputation())
+    auto numElementsNeededDuringBackprop = [&]()
+    {
+        size_t numElements = 0;
+        for (auto& node : compositeForwardPropEvalOrder)
+        {
+            if (outputValueNeededDuringBackProp[node] && !node->IsLeaf() && !node->IsValueViewOfInput())
+                numElements += node->GetSampleLayout().GetNumElements();
+        }
+        return numElements;
+    };
+    for (auto& node : compositeForwardPropEvalOrder)
+        node->m_recomputesValue = false;
+    m_recomputationSteps.clear();
+    m_recomputationRoot = nullptr;
+    size_t numElementsKeptBefore = 0, numElementsKeptAfter = 0;
+    if (performingBackPropagation && s_recomputeActivations && g_shareNodeValueMatrices)
+    {
+        numElementsKeptBefore = numElementsNeededDuringBackprop();
+        SelectRecomputedNodes(compositeForwardPropEvalOrder, forwardPropRoots, parentsMap, outputValueNeededDuringBackProp);
+        keepInputsOfViews(); // (for views whose values recomputation reads)
+        numElementsKeptAfter = numElementsNeededDuringBackprop();
+    }
+
+    size_t numNodesInPlace = 0;
+    size_t numElementsInPlace = 0; // per sample: value memory (and as much gradient memory) not allocated thanks to in-place nodes
     set<ComputationNodeBasePtr> completedEvaluate;
     for (auto& nodeIter : compositeForwardPropEvalOrder)
     {
@@ -780,23 +1080,36 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
             assert(recInfo != nullptr);
             if (completedEvaluate.insert(recInfo).second)
             {
+                m_matrixPool.SetRequestingNode(recInfo->m_nestedNodes.front().get()); // (the loop executes as a whole)
                 recInfo->RequestMatricesBeforeForwardProp(m_matrixPool);
 
                 for (auto& nodeLoopIter : recInfo->m_nestedNodes)
                 {
-                    ReleaseMatricesAfterEvalForChildren(nodeLoopIter, parentCount);
+                    ReleaseMatricesAfterEvalForChildren(nodeLoopIter, parentCount, parentsMap);
                 }
             }
         }
         else
         {
+            m_matrixPool.SetRequestingNode(nodeIter.get());
+            nodeIter->m_runsInPlace = CanRunInPlace(nodeIter, parentsMap, forwardPropRoots);
             nodeIter->RequestMatricesBeforeForwardProp(m_matrixPool);
+            if (nodeIter->RunsInPlace()) // (the node may still have declined)
+            {
+                nodeIter->GetInputs()[0]->MarkValueNonSharable(); // (the value now belongs to the node, which releases it)
+                numNodesInPlace++;
+                numElementsInPlace += nodeIter->GetSampleLayout().GetNumElements();
+            }
             // we only release matrices for the children since the root node's informatioin will be used and should not be shared
             // with others
-            ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount);
+            ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount, parentsMap);
         }
     }
 
+    if (numNodesInPlace > 0)
+        fprintf(stderr, "%d nodes run in place, saving value memory of %llu elements per sample%s.\n",
+                (int) numNodesInPlace, (unsigned long long) numElementsInPlace, performingBackPropagation ? ", and as much gradient memory" : "");
+
     if (trainRootNode != nullptr)
     {
         std::list<ComputationNodeBasePtr>& backPropNodes = GetEvalOrder(trainRootNode);
@@ -804,7 +1117,35 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         // now, simulate the gradient computation order to determine how to allocate matrices
         set<ComputationNodeBasePtr> completedGradient;
 
+        // recomputed values live from the first to the last step of backprop that reads them (see ScheduleRecomputation())
+        ScheduleRecomputation(trainRootNode);
+        size_t numElementsRecomputed = 0, maxNumElementsRecomputed = 0;
+        auto beginRecomputationStep = [&](const ComputationNodeBasePtr& stepNode)
+        {
+            auto step = m_recomputationSteps.find(stepNode);
+            if (step == m_recomputationSteps.end())
+                return;
+            for (auto& node : step->second.recompute)
+            {
+                node->RequestRecomputedValue(m_matrixPool);
+                numElementsRecomputed += node->GetSampleLayout().GetNumElements();
+            }
+            maxNumElementsRecomputed = max(maxNumElementsRecomputed, numElementsRecomputed);
+        };
+        auto endRecomputationStep = [&](const ComputationNodeBasePtr& stepNode)
+        {
+            auto step = m_recomputationSteps.find(stepNode);
+            if (step == m_recomputationSteps.end())
+                return;
+            for (auto& node : step->second.restore)
+            {
+                node->ReleaseRecomputedValue(m_matrixPool);
+                numElementsRecomputed -= node->GetSampleLayout().GetNumElements();
+            }
+        };
+
         // we need to call it here since we always compute gradients for children and root node is not children of other node
+        m_matrixPool.SetRequestingNode(trainRootNode.get());
         trainRootNode->RequestMatricesBeforeBackprop(m_matrixPool);
 
         for (auto iter = backPropNodes.rbegin(); iter != backPropNodes.rend(); iter++) // for gradient computation, traverse in reverse order
@@ -819,31 +1160,241 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                     // SEQ mode: allocate all in loop first, then deallocate again
                     // TODO: next step: use PARTraversalFlowControlNode::AllocateGradientMatricesForInputs() and ReleaseMatricesAfterBackprop()...
                     // BUGBUG: naw, ^^ would not work! Wrong order! Need to rethink this. Need to make AllocateEvalMatrices() and AllocateGradientMatrices() the virtual functions.
+                    m_matrixPool.SetRequestingNode(recInfo->m_nestedNodes.front().get());
+                    beginRecomputationStep(recInfo);
                     recInfo->AllocateGradientMatricesForInputs(m_matrixPool);
                     // Loops are computed sample by sample so we have to allocate them all
+                    std::vector<const ComputationNodeBase*> loopNodesAndParents;
+                    for (auto& nodeLoopIter : recInfo->m_nestedNodes)
+                    {
+                        auto nodes = nodeAndParents(nodeLoopIter);
+                        loopNodesAndParents.insert(loopNodesAndParents.end(), nodes.begin(), nodes.end());
+                    }
+                    m_matrixPool.SetReleasingNodes(loopNodesAndParents);
                     recInfo->ReleaseMatricesAfterBackprop(m_matrixPool);
+                    endRecomputationStep(recInfo);
                 }
             }
             else
             {
                 // PAR mode: we can allocate and immediately deallocate one by one
+                m_matrixPool.SetRequestingNode(n.get());
+                m_matrixPool.SetReleasingNodes(nodeAndParents(n)); // (parents read our value during their backprop)
+                beginRecomputationStep(n);
                 n->AllocateGradientMatricesForInputs(m_matrixPool);
                 // Root node's information will be used and should not be shared with others, also it's small (1x1)
                 if ((n != trainRootNode) && n->NeedGradient())
                     n->ReleaseMatricesAfterBackprop(m_matrixPool);
+                endRecomputationStep(n);
             }
         }
+
+        if (m_recomputationRoot)
+            fprintf(stderr, "Recomputing values during backprop: values kept for backprop take %llu elements per sample, down from %llu, plus up to %llu elements being recomputed.\n",
+                    (unsigned long long) numElementsKeptAfter, (unsigned long long) numElementsKeptBefore, (unsigned long long) maxNumElementsRecomputed);
     }
+
+    m_matrixPool.SetRequestingNode(nullptr);
+    m_matrixPool.SetReleasingNodes(std::vector<const ComputationNodeBase*>());
 }
 
-void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount)
+void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount,
+                                                             const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap)
 {
     for (int i = 0; i < n->GetNumInputs(); i++)
     {
-        ComputationNodeBasePtr pNode = n->GetInputs()[i];
-        parentCount[pNode]--;
-        if (parentCount[pNode] == 0)
-            pNode->ReleaseMatricesAfterForwardProp(m_matrixPool);
+        // a view holds on to its input's matrices until the view's own parents are done
+        if (i == 0 && n->IsValueViewOfInput())
+            continue;
+        ReleaseMatricesAfterEvalForNode(n->GetInputs()[i], parentCount, parentsMap);
+    }
+}
+
+// Can 'node' overwrite the value of its Input(0), and compute that input's gradient into its own gradient (see CanRunInPlace())?
+// Only if nobody else reads that value: the input has no other parent, is no root, and its value is not needed for backprop.
+// Nor may a root run in place: its gradient is seeded before backprop, and sharing it with Input(0) would have the
+// input's lazy zeroing wipe it out.
+// A node whose value is recomputed reads its input's value again then, which is fine if the input is recomputed as well:
+// recomputation goes into matrices of their own (see RequestRecomputedValue()).
+/*static*/ bool ComputationNetwork::CanRunInPlace(const ComputationNodeBasePtr& node, const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                                  const std::vector<ComputationNodeBasePtr>& roots)
+{
+    if (!node->CanRunInPlace() || !node->HasSameMatrixAsInput() || std::find(roots.begin(), roots.end(), node) != roots.end())
+        return false;
+    const auto& input = node->GetInputs()[0];
+    if ((node->RecomputesValue() && !input->RecomputesValue()) || input->IsLeaf() || input->RequiresPreCompute() || !input->isValueSharable() ||
+        input->IsValueViewOfInput() || input->IsOutputNeededDuringBackprop()) // (always true if memory sharing is disabled)
+        return false;
+    auto iter = parentsMap.find(input);
+    if (iter == parentsMap.end() || iter->second.size() != 1 || std::find(roots.begin(), roots.end(), input) != roots.end())
+        return false;
+    for (size_t i = 1; i < node->GetNumInputs(); i++) // (e.g. Plus(x, x))
+    {
+        if (node->GetInputs()[i] == input)
+            return false;
+    }
+    return true;
+}
+
+// choose the nodes whose values are released after ForwardProp() although backprop needs them, to recompute them during backprop
+// Of the values needed during backprop that can be recomputed, every segment-length-th is kept as a checkpoint. Recomputing
+// the others also reads their inputs: those released after ForwardProp() are recomputed as well where possible, else kept.
+void ComputationNetwork::SelectRecomputedNodes(const std::vector<ComputationNodeBasePtr>& evalOrder, const std::vector<ComputationNodeBasePtr>& roots,
+                                               const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                               std::unordered_map<ComputationNodeBasePtr, bool>& outputValueNeededDuringBackProp)
+{
+    // Loops are computed as a whole and hence kept (their values are checkpoints). So are views, and nodes that are viewed,
+    // since a view would not see the recomputed value, and roots, whose values are used after backprop.
+    auto canBeRecomputed = [&](const ComputationNodeBasePtr& node)
+    {
+        if (!node->CanBeRecomputed() || node->IsLeaf() || node->IsPartOfLoop() || node->RequiresPreCompute() || !node->isValueSharable() ||
+            node->IsValueViewOfInput() || std::find(roots.begin(), roots.end(), node) != roots.end())
+            return false;
+        auto iter = parentsMap.find(node);
+        if (iter != parentsMap.end())
+        {
+            for (auto& parent : iter->second)
+            {
+                if (parent->IsValueViewOfInput() && parent->GetInputs()[0] == node)
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    std::vector<ComputationNodeBasePtr> candidates;
+    for (auto& node : evalOrder)
+    {
+        if (outputValueNeededDuringBackProp[node] && canBeRecomputed(node))
+            candidates.push_back(node);
+    }
+    size_t segmentLength = s_recomputeSegmentLength > 0 ? s_recomputeSegmentLength : max((size_t) 1, (size_t) round(sqrt((double) candidates.size())));
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        if ((i + 1) % segmentLength != 0) // (every segmentLength-th one is a checkpoint)
+        {
+            candidates[i]->m_recomputesValue = true;
+            outputValueNeededDuringBackProp[candidates[i]] = false;
+        }
+    }
+
+    // inputs come before the nodes in evaluation order, hence we go backwards to catch those that are recomputed for recomputation
+    for (auto iter = evalOrder.rbegin(); iter != evalOrder.rend(); iter++)
+    {
+        if (!(*iter)->RecomputesValue())
+            continue;
+        for (auto& input : (*iter)->GetInputs())
+        {
+            if (input->IsLeaf() || input->RequiresPreCompute() || !input->isValueSharable() || input->RecomputesValue() || outputValueNeededDuringBackProp[input])
+                continue; // (kept anyway)
+            if (canBeRecomputed(input))
+                input->m_recomputesValue = true;
+            else
+                outputValueNeededDuringBackProp[input] = true;
+        }
+    }
+}
+
+// plan when to recompute the values released by SelectRecomputedNodes(): right before the first step of backprop (a node,
+// or a loop as a whole) that reads them, inputs first; and when to release them again: after the last such step
+void ComputationNetwork::ScheduleRecomputation(const ComputationNodeBasePtr& trainRootNode)
+{
+    // the steps of backprop, and the nodes each consists of
+    std::vector<ComputationNodeBasePtr> steps;
+    std::vector<std::vector<ComputationNodeBasePtr>> stepNodes;
+    set<ComputationNodeBasePtr> loopsSeen;
+    std::list<ComputationNodeBasePtr>& backPropNodes = GetEvalOrder(trainRootNode);
+    for (auto iter = backPropNodes.rbegin(); iter != backPropNodes.rend(); iter++)
+    {
+        if ((*iter)->IsPartOfLoop())
+        {
+            shared_ptr<SEQTraversalFlowControlNode> recInfo = FindInRecurrentLoops(m_allSEQNodes, *iter);
+            if (loopsSeen.insert(recInfo).second)
+            {
+                steps.push_back(recInfo);
+                stepNodes.push_back(recInfo->m_nestedNodes);
+            }
+        }
+        else
+        {
+            steps.push_back(*iter);
+            stepNodes.push_back(std::vector<ComputationNodeBasePtr>(1, *iter));
+        }
+    }
+
+    std::vector<ComputationNodeBasePtr> recomputed;     // in the order of their recomputation
+    std::unordered_map<ComputationNodeBasePtr, size_t> lastUse; // [recomputed node] the last step that reads its value
+    std::function<void(const ComputationNodeBasePtr&, size_t)> use = [&](const ComputationNodeBasePtr& node, size_t step)
+    {
+        if (!node->RecomputesValue())
+            return;
+        if (lastUse.find(node) == lastUse.end())
+        {
+            for (auto& input : node->GetInputs())
+                use(input, step);
+            m_recomputationSteps[steps[step]].recompute.push_back(node);
+            recomputed.push_back(node);
+        }
+        lastUse[node] = step;
+    };
+    for (size_t step = 0; step < steps.size(); step++)
+    {
+        for (auto& node : stepNodes[step])
+        {
+            // a node's backprop only reads values if it computes the gradient of any of its inputs
+            const auto& inputs = node->GetInputs();
+            if (std::none_of(inputs.begin(), inputs.end(), [](const ComputationNodeBasePtr& input) { return input->NeedGradient(); }))
+                continue;
+            if (node->OutputUsedInComputingInputNodesGradients())
+                use(node, step);
+            for (size_t i = 0; i < inputs.size(); i++)
+            {
+                if (node->InputUsedInComputingInputNodesGradients(i))
+                    use(inputs[i], step);
+            }
+        }
+    }
+    for (auto& node : recomputed)
+        m_recomputationSteps[steps[lastUse[node]]].restore.push_back(node);
+
+    if (!recomputed.empty())
+        m_recomputationRoot = trainRootNode;
+}
+
+// called when one more parent of 'pNode' is done; releases its matrices after the last one
+void ComputationNetwork::ReleaseMatricesAfterEvalForNode(ComputationNodeBasePtr pNode, std::unordered_map<ComputationNodeBasePtr, int>& parentCount,
+                                                         const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap)
+{
+    parentCount[pNode]--;
+    if (parentCount[pNode] == 0)
+    {
+        // a view has no matrices of its own; now that it is done, so is the parent of its input
+        if (pNode->IsValueViewOfInput())
+            return ReleaseMatricesAfterEvalForNode(pNode->GetInputs()[0], parentCount, parentsMap);
+
+        // the matrices were last read by the parents
+        std::vector<const ComputationNodeBase*> users;
+        AddMatrixUsers(pNode, parentsMap, users);
+        m_matrixPool.SetReleasingNodes(users);
+        pNode->ReleaseMatricesAfterForwardProp(m_matrixPool);
+    }
+}
+
+// collect the nodes that access the matrices of 'node': the node itself and its parents,
+// and, for parents that are views of it (see IsValueViewOfInput()), the users of those views
+/*static*/ void ComputationNetwork::AddMatrixUsers(const ComputationNodeBasePtr& node, const std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap,
+                                                   std::vector<const ComputationNodeBase*>& users)
+{
+    users.push_back(node.get());
+    auto iter = parentsMap.find(node);
+    if (iter == parentsMap.end())
+        return;
+    for (auto& parent : iter->second)
+    {
+        if (parent->IsValueViewOfInput() && parent->GetInputs()[0] == node)
+            AddMatrixUsers(parent, parentsMap, users);
+        else
+            users.push_back(parent.get());
     }
 }
 } } }
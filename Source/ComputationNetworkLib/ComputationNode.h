@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <mutex>
 
 #define DEFAULT_HIDDEN_ACTIVATION 0.1
 
@@ -100,6 +101,9 @@ struct /*interface*/ IComputationNode
     virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) = 0;
     virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) = 0; // request matrices that are needed for gradient computation
     virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) = 0;  // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
+    virtual void RequestRecomputedValue(MatrixPool& matrixPool) = 0;        // request the matrix the value is recomputed into during backprop (see CanBeRecomputed())
+    virtual void ReleaseRecomputedValue(MatrixPool& matrixPool) = 0;        // release it after the last node that reads it is done
+    virtual void SwapRecomputedValue() = 0;                                 // exchange it with the value computed by ForwardProp()
 
     // --- optional overrides that describe a feature or property of the node
 
@@ -142,7 +146,7 @@ struct ComputationNetworkOwnedNodeState
     friend class ComputationNetwork;
 
     ComputationNetworkOwnedNodeState()
-        : m_needsGradient(false), m_valueSharable(true)
+        : m_needsGradient(false), m_valueSharable(true), m_runsInPlace(false), m_recomputesValue(false)
     {
         PurgeStateForFormingRecurrentLoops();
         m_isPartOfLoop = false;
@@ -161,6 +165,12 @@ struct ComputationNetworkOwnedNodeState
     virtual void MarkValueSharable() { m_valueSharable = true; }
     bool isValueSharable() const { return m_valueSharable; }
 
+    // true if the node overwrites its Input(0)'s value with its own, and computes the input's gradient in place of its own
+    bool RunsInPlace() const { return m_runsInPlace; }
+
+    // true if the node's value is released after ForwardProp() and recomputed during Backprop() where it is needed
+    bool RecomputesValue() const { return m_recomputesValue; }
+
 protected:                // TODO: should be fully encapsulated here
 
     bool m_needsGradient; // true if this node or any children need a gradient to be computed (for own consumption or propagation to somewhere in the child tree)
@@ -168,6 +178,9 @@ protected:                // TODO: should be fully encapsulated here
     bool m_valueSharable; // a flag is needed for memory share.
                           // If it is false (e.g., learnableParameters/InputValue and those nodes are solely induced by learnableParameters),
                           // it will never be released to memory pool
+
+    bool m_runsInPlace;   // decided by ComputationNetwork::AllocateAllMatrices(), see CanRunInPlace()
+    bool m_recomputesValue; // same, see CanBeRecomputed()
 private:
 
     bool m_isPartOfLoop; // true if this loop is part of a recurrent loop
@@ -306,6 +319,12 @@ public:
         fstream << OperationName() << NodeName();
     }
 
+    // copy the state that training changes and Save() persists, other than the value, to a node of the same type
+    // This is what ComputationNetwork::SavePersistableState() keeps in memory besides the values.
+    virtual void CopyTrainingStateTo(const ComputationNodeBasePtr& /*node*/) const
+    {
+    }
+
     std::wstring CreateUniqNodeName() const
     {
 #ifdef USE_GUID_AS_NAME
@@ -393,6 +412,21 @@ public:
         else
             return 1; // no layout: treat as 1-sample minibatch that is meant to broadcast
     }
+    // determine the size that we should set our Matrix storage to
+    void DetermineDataSize(size_t& rows, size_t& cols) const
+    {
+        if (HasMBLayout())
+        {
+            rows = GetSampleMatrixNumRows();
+            cols = GetSampleMatrixNumCols();
+        }
+        else
+        {
+            const auto& shape = GetSampleLayout();
+            rows = shape.GetRank() > 0 ? shape[0] : 0;
+            cols = rows > 0 ? shape.GetNumElements() / rows : 0;
+        }
+    }
     // determine if we are the output of an op over 'other', whether that would be a reduction, so that we need to mask
     bool ReducesInTimeWrt(const ComputationNodeBasePtr& other) const
     {
@@ -701,6 +735,51 @@ public:
     void SetOutputNeededDuringBackprop(bool f) { m_outputNeededDuringBackprop = f; }
     bool IsOutputNeededDuringBackprop() const { return !g_shareNodeValueMatrices || m_outputNeededDuringBackprop; }
 
+    // Is the output value that of Input(0), unchanged, only seen under a different tensor shape or MBLayout (e.g. Reshape)?
+    // Such a node can be a view of its input: it shares the Matrix objects of Input(0) for value and gradient instead of
+    // copying between them. Base-class version says no. Override if so.
+    virtual bool CanBeValueViewOfInput() const { return false; }
+
+    // Does this node share value and gradient with Input(0)? That requires the same matrix dimensions.
+    // Loops are allocated and evaluated as a whole, so their members never are views (nor can they be viewed).
+    bool IsValueViewOfInput() const
+    {
+        return CanBeValueViewOfInput() && HasSameMatrixAsInput();
+    }
+
+    // Can the node compute its value elementwise into the memory of Input(0)'s value, and Input(0)'s gradient from its own
+    // gradient into the memory of that? The network lets it do so if nobody else needs these (see AllocateAllMatrices()).
+    // Base-class version says no. Override if so.
+    virtual bool CanRunInPlace() const { return false; }
+
+    // Can the node's value be recomputed during backprop, by calling ForwardProp() again on the same inputs? This requires
+    // that ForwardProp() has no side effects (no state, no random numbers) and uses no temp matrices from the pool.
+    // The network then may release the value after ForwardProp() to save memory (see ComputationNetwork::SetActivationRecomputation()).
+    // Base-class version says no. Override if so.
+    virtual bool CanBeRecomputed() const { return false; }
+
+    // value and gradient have the dimensions of those of Input(0), and neither is part of a loop
+    bool HasSameMatrixAsInput() const
+    {
+        if (m_inputs.empty() || IsPartOfLoop() || m_inputs[0]->IsPartOfLoop() || HasMBLayout() != m_inputs[0]->HasMBLayout())
+            return false;
+        size_t rows, cols, inputRows, inputCols;
+        DetermineDataSize(rows, cols);
+        m_inputs[0]->DetermineDataSize(inputRows, inputCols);
+        return rows == inputRows && (HasMBLayout() || cols == inputCols);
+    }
+
+    // -----------------------------------------------------------------------
+    // cost estimates (for profiling only)
+    // -----------------------------------------------------------------------
+
+    // rough number of floating-point operations of ForwardProp() over the whole minibatch
+    // 0 (unknown) here since there is no value matrix at this level; ComputationNode<> assumes an elementwise
+    // operation, i.e. one operation per output element. Override where that is far off.
+    virtual double EstimateForwardFlops() const { return 0; }
+    // rough number of bytes read and written by ForwardProp() over the whole minibatch
+    virtual double EstimateBytesTouched() const { return 0; }
+
     // -----------------------------------------------------------------------
     // helpers for network traversal
     // -----------------------------------------------------------------------
@@ -1061,27 +1140,41 @@ public:
         MaskMissingColumnsTo(matrixToBeMasked, pMBLayout, fr, (ElemType) 0);
     }
 
+    // The value and gradient of a view (or of a node that runs in place) are its input's, laid out by the input's
+    // MBLayout, which may differ from ours (ReconcileMBLayout). Their gaps are therefore the input's to mask.
     void /*ComputationNodeBase::*/ MaskMissingValueColumnsToZero(const FrameRange& fr) override final
     {
         // fprintf(stderr, "%ls %ls m_value ", NodeName().c_str(), OperationName().c_str());
-        MaskMissingColumnsToZero(*m_value, m_pMBLayout, fr);
+        if (IsValueOfInput())
+            Input(0)->MaskMissingValueColumnsToZero(fr.WithLayout(Input(0)->GetMBLayout()));
+        else
+            MaskMissingColumnsToZero(*m_value, m_pMBLayout, fr);
     }
     void /*ComputationNodeBase::*/ MaskMissingGradientColumnsToZero(const FrameRange& fr) override final
     {
         // fprintf(stderr, "%ls %ls m_gradient ", NodeName().c_str(), OperationName().c_str());
-        MaskMissingColumnsToZero(*m_gradient, m_pMBLayout, fr);
+        if (IsGradientOfInput())
+            Input(0)->MaskMissingGradientColumnsToZero(fr.WithLayout(Input(0)->GetMBLayout()));
+        else
+            MaskMissingColumnsToZero(*m_gradient, m_pMBLayout, fr);
     }
 
     // for debugging, set the gaps to NaN instead (to track whether it bubbles up somewhere)
     void InvalidateMissingValueColumns(const FrameRange& fr) override final
     {
         // fprintf(stderr, "invalidating %ls %ls m_value column range %d\n", NodeName().c_str(), OperationName().c_str(), (int)fr.timeIdxInSeq);
-        MaskMissingColumnsTo(*m_value, m_pMBLayout, fr, Matrix<ElemType>::MakeNan(__LINE__));
+        if (IsValueOfInput())
+            Input(0)->InvalidateMissingValueColumns(fr.WithLayout(Input(0)->GetMBLayout()));
+        else
+            MaskMissingColumnsTo(*m_value, m_pMBLayout, fr, Matrix<ElemType>::MakeNan(__LINE__));
     }
     void InvalidateMissingGradientColumns(const FrameRange& fr) override final
     {
         // fprintf(stderr, "invalidating %ls %ls m_gradient column range %d\n", NodeName().c_str(), OperationName().c_str(), (int)fr.timeIdxInSeq);
-        MaskMissingColumnsTo(*m_gradient, m_pMBLayout, fr, Matrix<ElemType>::MakeNan(__LINE__));
+        if (IsGradientOfInput())
+            Input(0)->InvalidateMissingGradientColumns(fr.WithLayout(Input(0)->GetMBLayout()));
+        else
+            MaskMissingColumnsTo(*m_gradient, m_pMBLayout, fr, Matrix<ElemType>::MakeNan(__LINE__));
     }
 
     // -----------------------------------------------------------------------
@@ -1094,6 +1187,15 @@ public:
     const Matrix<ElemType>& Gradient() const { return *m_gradient; }
     Matrix<ElemType>&       Gradient()       { return *m_gradient; }
 
+    // use the very Matrix object of 'other' as our value, e.g. for the replicas of a network that update the same
+    // LearnableParameters from several threads (see SGD, localParallelTrain); only for nodes whose value is not pooled
+    void ShareValueOf(const ComputationNode<ElemType>& other)
+    {
+        if (isValueSharable() || other.isValueSharable())
+            LogicError("ShareValueOf: %ls %ls operation: only non-sharable values (e.g. of LearnableParameters) can be shared across networks.", NodeName().c_str(), OperationName().c_str());
+        m_value = other.m_value;
+    }
+
 private:
 
     // map a tensor to a matrix
@@ -1178,24 +1280,6 @@ public:
     {
     }
 
-private:
-
-    // determine the size that we should set our Matrix storage to
-    void DetermineDataSize(size_t& rows, size_t& cols) const
-    {
-        if (HasMBLayout())
-        {
-            rows = GetSampleMatrixNumRows();
-            cols = GetSampleMatrixNumCols();
-        }
-        else
-        {
-            const auto& shape = GetSampleLayout();
-            rows = shape.GetRank() > 0 ? shape[0] : 0;
-            cols = rows > 0 ? shape.GetNumElements() / rows : 0;
-        }
-    }
-
 protected:
 
     // set the size of the underlying Matrix object to match node dimensions
@@ -1239,6 +1323,10 @@ public:
         // give nodes a chance to update their internal state that may also have to match MB size
         UpdateFunctionMBSize();
 
+        // running in place, we have overwritten our input's value the last time, so it must have been recomputed since
+        if (RunsInPlace() && IsValueOfInput() && !IsOlderThan(*m_inputs[0]))
+            LogicError("%ls %ls operation runs in place, but its input %ls was not recomputed.", NodeName().c_str(), OperationName().c_str(), m_inputs[0]->NodeName().c_str());
+
         // and make sure dimensions are what we expect
         VerifyDataSize(Value());
     }
@@ -1347,12 +1435,31 @@ public:
         if (m_gradientInitialized)
             return;
 
-        UpdateDataSize(Gradient());
-        Gradient().SetValue(0);
+        // the gradient of a view, or of a node that runs in place, is its input's; it may already hold gradients from
+        // the input's other parents, or it will be overwritten in place by BackpropTo()
+        if (IsGradientOfInput())
+            Input(0)->LazyZeroGradient();
+        else
+        {
+            UpdateDataSize(Gradient());
+            Gradient().SetValue(0);
+        }
 
         m_gradientInitialized = true;
     }
 
+    // value and gradient of a view are the Matrix objects of Input(0) (see IsValueViewOfInput()), so that
+    // ForwardProp() and BackpropTo() of the view have nothing to do
+    // The same holds for a node that runs in place (see RunsInPlace()), which overwrites them instead.
+    bool IsValueOfInput() const
+    {
+        return !m_inputs.empty() && m_value && m_value == Input(0)->m_value;
+    }
+    bool IsGradientOfInput() const
+    {
+        return !m_inputs.empty() && m_gradient && m_gradient == Input(0)->m_gradient;
+    }
+
     // -----------------------------------------------------------------------
     // memory sharing
     // -----------------------------------------------------------------------
@@ -1360,19 +1467,31 @@ public:
     // request matrices needed to do node function value evaluation
     virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
     {
-        RequestMatrixFromPool(m_value, matrixPool);
+        if (IsValueViewOfInput())
+            m_value = Input(0)->m_value; // (kept alive by the network until the view's parents are done, see AllocateAllMatrices())
+        else if (RunsInPlace() && Input(0)->m_value->GetMatrixType() != SPARSE)
+            m_value = Input(0)->m_value; // (taken over from the input, which no longer needs it)
+        else
+        {
+            m_runsInPlace = false;
+            RequestMatrixFromPool(m_value, matrixPool);
+        }
     }
 
     // release temp matrices that are only used by forward computation
     // don't release matrices that need to be used in the gradient computation
     virtual void ReleaseMatricesAfterForwardProp(MatrixPool& matrixPool) override
     {
-        if (!IsOutputNeededDuringBackprop() && (m_value->GetMatrixType() != SPARSE) && isValueSharable())
+        if (!IsOutputNeededDuringBackprop() && (m_value->GetMatrixType() != SPARSE) && isValueSharable() && !IsValueViewOfInput())
             ReleaseMatrixToPool(m_value, matrixPool);
     }
 
     virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
     {
+        // running in place, we compute the input's gradient into our own (never as a root, whose gradient is seeded, see CanRunInPlace())
+        if (RunsInPlace() && m_inputs[0]->NeedGradient() && !Input(0)->m_gradient && m_gradient && m_gradient->GetMatrixType() != SPARSE)
+            Input(0)->m_gradient = m_gradient;
+
         for (int i = 0; i < m_inputs.size(); i++)
         {
             if (m_inputs[i]->NeedGradient())
@@ -1383,7 +1502,15 @@ public:
     // request matrices that are needed for gradient computation
     virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
     {
-        RequestMatrixFromPool(m_gradient, matrixPool);
+        if (IsValueViewOfInput() && Input(0)->NeedGradient())
+        {
+            Input(0)->RequestMatricesBeforeBackprop(matrixPool); // (our parents write into it, so it is needed from now on)
+            m_gradient = Input(0)->m_gradient;
+        }
+        else if (IsLeaf()) // (a parameter's gradient is never released; from the pool, it would take a matrix others could share)
+            CreateMatrixIfNull(m_gradient);
+        else
+            RequestMatrixFromPool(m_gradient, matrixPool);
     }
 
     // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
@@ -1391,16 +1518,32 @@ public:
     {
         if (!IsLeaf() && !RequiresPreCompute())
         {
-            if (m_gradient != nullptr && m_gradient->GetMatrixType() != SPARSE) // since we don't have a sparse pool yet
+            if (m_gradient != nullptr && m_gradient->GetMatrixType() != SPARSE && !IsGradientOfInput()) // since we don't have a sparse pool yet
                 ReleaseMatrixToPool(m_gradient, matrixPool);
 
             // Release the Value matrix only if the output value is needed during backprop
             // since in the case it isn't used, we release it during forward prop itself
-            if (IsOutputNeededDuringBackprop() && m_value->GetMatrixType() != SPARSE && isValueSharable())
+            if (IsOutputNeededDuringBackprop() && m_value->GetMatrixType() != SPARSE && isValueSharable() && !IsValueViewOfInput())
                 ReleaseMatrixToPool(m_value, matrixPool);
         }
     }
 
+    // during backprop, the value is recomputed into a matrix of its own, since the one ForwardProp() used is shared
+    virtual void RequestRecomputedValue(MatrixPool& matrixPool) override
+    {
+        RequestMatrixFromPool(m_recomputedValue, matrixPool);
+    }
+    virtual void ReleaseRecomputedValue(MatrixPool& matrixPool) override
+    {
+        ReleaseMatrixToPool(m_recomputedValue, matrixPool);
+    }
+    virtual void SwapRecomputedValue() override
+    {
+        if (!m_recomputedValue)
+            LogicError("SwapRecomputedValue: %ls %ls operation has no matrix to recompute its value into.", NodeName().c_str(), OperationName().c_str());
+        m_value.swap(m_recomputedValue);
+    }
+
     void CreateGradientMatrixIfNull()
     {
         CreateMatrixIfNull(m_gradient);
@@ -1439,6 +1582,29 @@ protected:
 
 public:
 
+    // -----------------------------------------------------------------------
+    // cost estimates (for profiling only)
+    // -----------------------------------------------------------------------
+
+    // default: one operation per output element
+    virtual double EstimateForwardFlops() const override
+    {
+        return m_value ? (double) m_value->GetNumElements() : 0.0;
+    }
+
+    // default: all inputs are read once and the output is written once
+    virtual double EstimateBytesTouched() const override
+    {
+        double numElements = m_value ? (double) m_value->GetNumElements() : 0.0;
+        for (size_t i = 0; i < m_inputs.size(); i++)
+        {
+            const auto& input = Input(i);
+            if (input->m_value)
+                numElements += (double) input->m_value->GetNumElements();
+        }
+        return numElements * sizeof(ElemType);
+    }
+
     // -----------------------------------------------------------------------
     // miscellaneous
     // -----------------------------------------------------------------------
@@ -1520,13 +1686,16 @@ public:
         }
     }
 
-    // NOTE: we should reimplement this to be thread-safe and use a larger than requested initialized memory block
+    // NOTE: we should reimplement this to use a larger than requested initialized memory block
     // we can then just wrap that memory block in a matrix of the correct dimensions since it will be const no one can change it
     // should only need one memory block per device
-    // Thread-safety could be achieved by changing this to a shared_ptr.
+    // The lookup is serialized, since nodes may run on several threads: independent nodes run concurrently (TaskGraphExecutor),
+    // models are evaluated concurrently (SimpleEvaluator::EvaluateModels()), and SGD's localParallelTrain workers each run a network.
     // When using the TensorView interface, one could instead just use a 1x1 matrix with a view that broadcasts its columns (stride 0).
     static const Matrix<ElemType>& ConstOnes(const size_t rows, const size_t cols, const DEVICEID_TYPE deviceId)
     {
+        static std::mutex constOnesMutex;
+        std::lock_guard<std::mutex> lock(constOnesMutex);
         if (s_constOnes.find(rows) == s_constOnes.end() ||
             s_constOnes[rows].find(cols) == s_constOnes[rows].end()) // not found
         {
@@ -1548,6 +1717,7 @@ public:
 protected:
 
     shared_ptr<Matrix<ElemType>> m_value, m_gradient;
+    shared_ptr<Matrix<ElemType>> m_recomputedValue; // (only if RecomputesValue()) the value during backprop, see SwapRecomputedValue()
 
     static std::map<size_t, std::map<size_t, Matrix<ElemType>*>> s_constOnes;
 };
@@ -1634,6 +1804,9 @@ public:
     virtual void InvalidateMissingGradientColumns(const Microsoft::MSR::CNTK::FrameRange&) override { NOT_IMPLEMENTED; }
     virtual void NotifyFunctionValuesMBSizeModified(void) override { NOT_IMPLEMENTED; }
     virtual std::wstring ToString(void) const override { NOT_IMPLEMENTED; }
+    virtual void RequestRecomputedValue(MatrixPool&) override { NOT_IMPLEMENTED; }
+    virtual void ReleaseRecomputedValue(MatrixPool&) override { NOT_IMPLEMENTED; }
+    virtual void SwapRecomputedValue() override { NOT_IMPLEMENTED; }
     // these are meant to be called during computation, so provide dummy implementations
     virtual bool RequiresPreCompute() const override { return false; } // return true if the node's value should be computed before the normal training. e.g., mean and invStd of input features.
     virtual void PrintSelfBeforeValidation() const override { }
@@ -1735,8 +1908,10 @@ protected:
     using Base::InputUsedInComputingInputNodesGradients;                                                                                                 \
     using Base::InvalidateMissingGradientColumns;                                                                                                        \
     using Base::InvalidateMissingValueColumns;                                                                                                           \
+    using Base::IsGradientOfInput;                                                                                                                       \
     using Base::IsLeaf;                                                                                                                                  \
     using Base::IsOutputOlderThanInputs;                                                                                                                 \
+    using Base::IsValueOfInput;                                                                                                                          \
     using Base::LinkToMBLayout;                                                                                                                          \
     using Base::Load;                                                                                                                                    \
     using Base::LoadValue;                                                                                                                               \
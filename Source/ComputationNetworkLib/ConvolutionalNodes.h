@@ -177,6 +177,12 @@ public:
         return false;
     }
 
+    // each output element is a dot product with a kernel of [kernelWidth x kernelHeight x inputChannels] weights
+    virtual double EstimateForwardFlops() const override
+    {
+        return 2.0 * Base::EstimateForwardFlops() * Input(0)->GetAsMatrixNumCols();
+    }
+
     void ForwardProp(const FrameRange& fr) override
     {
         const Matrix<ElemType>& input0 = Input(0)->ValueAsMatrix();
@@ -46,6 +46,9 @@ public:
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
+        if (inputIndex == 0 && IsGradientOfInput()) // (running in place: our gradient is the input's)
+            return;
+
         size_t rank = DetermineElementwiseTensorRank();
         auto gradient = GradientTensorFor(rank, fr);
         auto inputGradient = Input(inputIndex)->GradientTensorFor(rank, fr.AllowBroadcast());
@@ -66,6 +69,15 @@ public:
         auto input1 = Input(1)->ValueTensorFor(rank, fr.AllowBroadcast());
         result.AssignSumOf(input0, input1);
     }
+
+    virtual bool CanRunInPlace() const override
+    {
+        return true; // (into the first summand, if it is not broadcast)
+    }
+    virtual bool CanBeRecomputed() const override
+    {
+        return true;
+    }
 };
 
 template class PlusNode<float>;
@@ -94,6 +106,9 @@ public:
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
+        if (inputIndex == 0 && IsGradientOfInput()) // (running in place: our gradient is the input's)
+            return;
+
         ElemType sign = inputIndex == 0 ? 1.0f : -1.0f;
         size_t rank = DetermineElementwiseTensorRank();
         auto gradient = GradientTensorFor(rank, fr);
@@ -114,6 +129,15 @@ public:
         auto input1 = Input(1)->ValueTensorFor(rank, fr.AllowBroadcast());
         result.AssignDifferenceOf(input0, input1);
     }
+
+    virtual bool CanRunInPlace() const override
+    {
+        return true; // (into the minuend, if it is not broadcast)
+    }
+    virtual bool CanBeRecomputed() const override
+    {
+        return true;
+    }
 };
 
 template class MinusNode<float>;
@@ -228,6 +252,18 @@ public:
         return false;
     }
 
+    virtual bool CanBeRecomputed() const override
+    {
+        return true;
+    }
+
+    // a matrix product: one multiply-add per output element and inner dimension
+    virtual double EstimateForwardFlops() const override
+    {
+        size_t innerDim = m_transpose ? Input(0)->GetAsMatrixNumRows() : Input(0)->GetAsMatrixNumCols();
+        return 2.0 * Base::EstimateForwardFlops() * innerDim;
+    }
+
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
         // right operand and output can have MB layout, while left operand cannot
@@ -405,6 +441,11 @@ public:
         auto input1 = Input(1)->ValueTensorFor(rank, fr.AllowBroadcast());
         result.AssignElementwiseProductOf(input0, input1);
     }
+
+    virtual bool CanBeRecomputed() const override
+    {
+        return true;
+    }
 };
 
 template class ElementTimesNode<float>;
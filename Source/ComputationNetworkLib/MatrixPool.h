@@ -9,6 +9,9 @@
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
 #include <stdlib.h>
 
 #include "Basics.h"
@@ -17,15 +20,86 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+class ComputationNodeBase;
+
 class MatrixPool
 {
     vector<shared_ptr<Matrix<float>>> m_releasedFloatMatrices;
     vector<shared_ptr<Matrix<double>>> m_releasedDoubleMatrices;
+    vector<shared_ptr<Matrix<float>>> m_allocatedFloatMatrices; // all matrices created so far, to report their memory
+    vector<shared_ptr<Matrix<double>>> m_allocatedDoubleMatrices;
 
     template <class ElemType>
     vector<shared_ptr<Matrix<ElemType>>>& GetReleasedMatrices();
+    template <class ElemType>
+    vector<shared_ptr<Matrix<ElemType>>>& GetAllocatedMatrices();
+
+    // Sharing information for parallel node execution:
+    // The allocation simulation tells us on whose behalf a matrix is requested or released. Every node that
+    // ever touched a matrix is remembered, and when the matrix is handed out again, the new user and all previous
+    // users are recorded as conflicting. Conflicting nodes must execute in their serial order, never concurrently.
+    const ComputationNodeBase* m_requestingNode;
+    vector<const ComputationNodeBase*> m_releasingNodes;
+    map<const void*, vector<const ComputationNodeBase*>> m_matrixUsers;          // [matrix] all nodes that used it so far
+    set<pair<const ComputationNodeBase*, const ComputationNodeBase*>> m_conflicts; // (unordered) pairs of nodes sharing a matrix
+    size_t m_generation;                                                          // incremented whenever m_conflicts may have changed
+
+    void NoteRequest(const void* matrix)
+    {
+        m_generation++;
+        if (!m_requestingNode)
+            return;
+        auto& users = m_matrixUsers[matrix];
+        for (auto& user : users)
+        {
+            if (user != m_requestingNode)
+                m_conflicts.insert(make_pair(min(user, m_requestingNode), max(user, m_requestingNode)));
+        }
+        users.push_back(m_requestingNode);
+    }
+    void NoteRelease(const void* matrix)
+    {
+        auto& users = m_matrixUsers[matrix];
+        users.insert(users.end(), m_releasingNodes.begin(), m_releasingNodes.end());
+    }
 
 public:
+    MatrixPool()
+        : m_requestingNode(nullptr), m_generation(0)
+    {
+    }
+
+    // set the node on whose behalf subsequent Request() calls are made (nullptr: not tracked)
+    void SetRequestingNode(const ComputationNodeBase* node)
+    {
+        m_requestingNode = node;
+    }
+    // set the nodes that have last accessed the matrices given to subsequent Release() calls
+    void SetReleasingNodes(const vector<const ComputationNodeBase*>& nodes)
+    {
+        m_releasingNodes = nodes;
+    }
+    const set<pair<const ComputationNodeBase*, const ComputationNodeBase*>>& GetConflicts() const
+    {
+        return m_conflicts;
+    }
+    size_t GetGeneration() const
+    {
+        return m_generation;
+    }
+
+    // the memory held by all matrices handed out so far
+    // Matrices are created empty; this grows as the nodes size them for the minibatches they process.
+    size_t GetNumAllocatedBytes() const
+    {
+        size_t numBytes = 0;
+        for (const auto& matrix : m_allocatedFloatMatrices)
+            numBytes += matrix->BufferSize();
+        for (const auto& matrix : m_allocatedDoubleMatrices)
+            numBytes += matrix->BufferSize();
+        return numBytes;
+    }
+
     // release here means the matrix can be put back and shared by others
     template <class ElemType>
     void Release(shared_ptr<Matrix<ElemType>> freeMatrix)
@@ -41,6 +115,7 @@ public:
         }
 
 #endif
+        NoteRelease(freeMatrix.get());
         releasedMatrices.push_back(freeMatrix);
     }
 
@@ -52,6 +127,7 @@ public:
         if (releasedMatrices.empty())
         {
             matrixPtr = make_shared<Matrix<ElemType>>(deviceId);
+            GetAllocatedMatrices<ElemType>().push_back(matrixPtr);
         }
         else
         {
@@ -62,6 +138,7 @@ public:
         if (!matrixPtr) // this can't really happen
             LogicError("MatrixPool::Request: failed to get a valid matrix.");
 
+        NoteRequest(matrixPtr.get());
         return matrixPtr;
     }
 };
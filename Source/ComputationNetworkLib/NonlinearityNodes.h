@@ -60,7 +60,8 @@ public:
                               Input(0)->ValueTensorFor(rank, fr);
         // If gradient can be compute from output rather than input, then that's better for mem sharing (and faster in most cases).
         // Not possible for Cos().
-        sliceInputGrad.DoBinaryOpOf(1, sliceOutputGrad, sliceValue, 1, opBackward);
+        // Running in place, the input gradient is our gradient, which is overwritten rather than added to.
+        sliceInputGrad.DoBinaryOpOf(IsGradientOfInput() ? 0 : 1, sliceOutputGrad, sliceValue, 1, opBackward);
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
@@ -76,6 +77,14 @@ public:
     {
         return !gradientFromOutput;
     }
+    virtual bool CanRunInPlace() const override
+    {
+        return true;
+    }
+    virtual bool CanBeRecomputed() const override
+    {
+        return true;
+    }
 };
 
 #define UnaryElementWiseWithOpCodeNodeBaseMembers UsingComputationNodeMembersBoilerplate;
@@ -169,6 +178,11 @@ public:
     // derived class implement the actual non-linear operation
     virtual void ForwardPropV(Matrix<ElemType>& functionValues, const Matrix<ElemType>& inputFunctionValues) = 0;
 
+    virtual bool CanBeRecomputed() const override
+    {
+        return true; // (the temps are only used by backprop)
+    }
+
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         ValidateUnaryMap(isFinalValidationPass);
@@ -0,0 +1,264 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PerformanceProfiler.cpp -- built-in timing of node evaluation and training phases (see PerformanceProfiler.h)
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "PerformanceProfiler.h"
+#include "ComputationNode.h"
+#include "fileutil.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+bool PerformanceProfiler::s_enabled = false;
+
+namespace {
+
+struct Stats
+{
+    size_t calls;
+    double time; // [microseconds]
+    double flops;
+    double bytes;
+    Stats()
+        : calls(0), time(0), flops(0), bytes(0)
+    {
+    }
+    void Add(double t, double f, double b)
+    {
+        calls++;
+        time += t;
+        flops += f;
+        bytes += b;
+    }
+};
+
+struct NodeStats
+{
+    wstring operation;
+    Stats forward, backprop;
+};
+
+struct TraceEvent
+{
+    string name;
+    const char* category;
+    double beginTime, duration;
+    int threadIndex;
+    double flops, bytes;
+    string operation;
+};
+
+// all profiler state; RecordXXX() may be called concurrently from parallel node execution
+struct ProfilerState
+{
+    mutex lock;
+    chrono::steady_clock::time_point startTime;
+    wstring traceFile;
+    size_t maxTraceEvents;
+    map<wstring, NodeStats> nodes;     // [node name]
+    map<wstring, NodeStats> operations; // [operation name]
+    map<string, Stats> phases;          // [phase name]
+    vector<TraceEvent> traceEvents;
+    size_t numDroppedTraceEvents;
+    map<thread::id, int> threads; // for small thread ids in the timeline
+
+    ProfilerState()
+        : startTime(chrono::steady_clock::now()), maxTraceEvents(0), numDroppedTraceEvents(0)
+    {
+    }
+    int ThreadIndex()
+    {
+        auto iter = threads.find(this_thread::get_id());
+        if (iter != threads.end())
+            return iter->second;
+        int index = (int) threads.size();
+        threads[this_thread::get_id()] = index;
+        return index;
+    }
+    void AddTraceEvent(TraceEvent&& ev)
+    {
+        if (traceFile.empty())
+            return;
+        if (traceEvents.size() < maxTraceEvents)
+            traceEvents.push_back(move(ev));
+        else
+            numDroppedTraceEvents++;
+    }
+};
+
+ProfilerState& State()
+{
+    static ProfilerState state;
+    return state;
+}
+
+string JsonEscape(const string& s)
+{
+    string out;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out.push_back('\\'), out.push_back(c);
+        else if ((unsigned char) c < 0x20)
+            out += msra::strfun::strprintf("\\u%04x", (int) c);
+        else
+            out.push_back(c);
+    }
+    return out;
+}
+
+void PrintStatsTable(const char* title, const map<wstring, NodeStats>& table, double totalTime, size_t maxRows)
+{
+    vector<pair<wstring, const NodeStats*>> rows;
+    for (auto& entry : table)
+        rows.push_back(make_pair(entry.first, &entry.second));
+    sort(rows.begin(), rows.end(), [](const pair<wstring, const NodeStats*>& a, const pair<wstring, const NodeStats*>& b)
+         {
+             return a.second->forward.time + a.second->backprop.time > b.second->forward.time + b.second->backprop.time;
+         });
+    fprintf(stderr, "\n%s:\n", title);
+    fprintf(stderr, "%-40s %-28s %9s %12s %12s %7s %10s %10s %9s\n", "name", "operation", "calls", "forward ms", "backprop ms", "% time", "GFLOP", "GB", "GFLOP/s");
+    for (size_t i = 0; i < rows.size() && i < maxRows; i++)
+    {
+        const auto& s = *rows[i].second;
+        double time = s.forward.time + s.backprop.time;
+        double flops = s.forward.flops + s.backprop.flops;
+        fprintf(stderr, "%-40ls %-28ls %9d %12.3f %12.3f %6.2f%% %10.3f %10.3f %9.2f\n",
+                rows[i].first.c_str(), s.operation.c_str(), (int) (s.forward.calls + s.backprop.calls),
+                s.forward.time * 1e-3, s.backprop.time * 1e-3, totalTime > 0 ? 100.0 * time / totalTime : 0.0,
+                flops * 1e-9, (s.forward.bytes + s.backprop.bytes) * 1e-9, time > 0 ? flops / time * 1e-3 : 0.0);
+    }
+    if (rows.size() > maxRows)
+        fprintf(stderr, "(%d more)\n", (int) (rows.size() - maxRows));
+}
+
+}
+
+/*static*/ void PerformanceProfiler::Enable(const wstring& traceFile, size_t maxTraceEvents)
+{
+    auto& state = State();
+    lock_guard<mutex> guard(state.lock);
+    state.startTime = chrono::steady_clock::now();
+    state.traceFile = traceFile;
+    state.maxTraceEvents = maxTraceEvents;
+    s_enabled = true;
+    fprintf(stderr, "Performance profiling enabled%s%ls.\n", traceFile.empty() ? "" : ", timeline will be written to ", traceFile.c_str());
+}
+
+/*static*/ double PerformanceProfiler::Now()
+{
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - State().startTime).count();
+}
+
+/*static*/ void PerformanceProfiler::RecordNode(const ComputationNodeBase& node, bool isBackprop, double beginTime, double endTime, double fraction)
+{
+    auto& state = State();
+    if (dynamic_cast<const FlowControlNode*>(&node)) // a loop: its members are recorded individually
+    {
+        lock_guard<mutex> guard(state.lock);
+        TraceEvent ev = {msra::strfun::utf8(node.NodeName()), isBackprop ? "loop backprop" : "loop forward", beginTime, endTime - beginTime, state.ThreadIndex(), 0, 0, msra::strfun::utf8(node.OperationName())};
+        state.AddTraceEvent(move(ev));
+        return;
+    }
+
+    // estimate the cost; for backprop, we assume each input's gradient costs about as much as the forward computation
+    double flops = 0, bytes = 0;
+    try
+    {
+        flops = node.EstimateForwardFlops() * fraction;
+        bytes = node.EstimateBytesTouched() * fraction;
+        if (isBackprop)
+        {
+            size_t numGradients = 0;
+            for (size_t i = 0; i < node.GetNumInputs(); i++)
+                numGradients += node.GetInputs()[i]->NeedGradient() ? 1 : 0;
+            flops *= max((size_t) 1, numGradients);
+            bytes *= 2; // gradients in addition to values
+        }
+    }
+    catch (...) // (no estimate is better than failing from a destructor)
+    {
+    }
+
+    const double duration = endTime - beginTime;
+    lock_guard<mutex> guard(state.lock);
+    auto& nodeStats = state.nodes[node.NodeName()];
+    auto& opStats = state.operations[node.OperationName()];
+    nodeStats.operation = opStats.operation = node.OperationName();
+    (isBackprop ? nodeStats.backprop : nodeStats.forward).Add(duration, flops, bytes);
+    (isBackprop ? opStats.backprop : opStats.forward).Add(duration, flops, bytes);
+    if (fraction == 1.0) // (single time steps of loops would flood the timeline)
+    {
+        TraceEvent ev = {msra::strfun::utf8(node.NodeName()), isBackprop ? "backprop" : "forward", beginTime, duration, state.ThreadIndex(), flops, bytes, msra::strfun::utf8(node.OperationName())};
+        state.AddTraceEvent(move(ev));
+    }
+}
+
+/*static*/ void PerformanceProfiler::RecordPhase(const char* name, double beginTime, double endTime)
+{
+    auto& state = State();
+    lock_guard<mutex> guard(state.lock);
+    state.phases[name].Add(endTime - beginTime, 0, 0);
+    TraceEvent ev = {name, "phase", beginTime, endTime - beginTime, state.ThreadIndex(), 0, 0, string()};
+    state.AddTraceEvent(move(ev));
+}
+
+/*static*/ void PerformanceProfiler::Report()
+{
+    if (!s_enabled)
+        return;
+    auto& state = State();
+    lock_guard<mutex> guard(state.lock);
+
+    // summary tables
+    double totalNodeTime = 0;
+    for (auto& entry : state.operations)
+        totalNodeTime += entry.second.forward.time + entry.second.backprop.time;
+    fprintf(stderr, "\nPerformance profile (total time in nodes %.3f s):\n", totalNodeTime * 1e-6);
+    if (!state.phases.empty())
+    {
+        fprintf(stderr, "\n%-28s %9s %12s %12s\n", "phase", "calls", "total ms", "average ms");
+        for (auto& entry : state.phases)
+            fprintf(stderr, "%-28s %9d %12.3f %12.3f\n", entry.first.c_str(), (int) entry.second.calls, entry.second.time * 1e-3, entry.second.time * 1e-3 / max((size_t) 1, entry.second.calls));
+    }
+    PrintStatsTable("by operation", state.operations, totalNodeTime, SIZE_MAX);
+    PrintStatsTable("by node (top 50)", state.nodes, totalNodeTime, 50);
+    fflush(stderr);
+
+    // timeline
+    if (state.traceFile.empty())
+        return;
+    FILE* f = fopenOrDie(state.traceFile, L"w");
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < state.traceEvents.size(); i++)
+    {
+        const auto& ev = state.traceEvents[i];
+        fprintf(f, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d",
+                JsonEscape(ev.name).c_str(), ev.category, ev.beginTime, ev.duration, ev.threadIndex);
+        if (!ev.operation.empty())
+            fprintf(f, ",\"args\":{\"op\":\"%s\",\"flops\":%.0f,\"bytes\":%.0f}", JsonEscape(ev.operation).c_str(), ev.flops, ev.bytes);
+        fprintf(f, "}%s\n", i + 1 < state.traceEvents.size() ? "," : "");
+    }
+    fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+    if (fclose(f) != 0)
+        RuntimeError("PerformanceProfiler: error writing '%ls'", state.traceFile.c_str());
+    fprintf(stderr, "\nPerformance timeline with %d events written to %ls", (int) state.traceEvents.size(), state.traceFile.c_str());
+    if (state.numDroppedTraceEvents > 0)
+        fprintf(stderr, " (%d later events dropped)", (int) state.numDroppedTraceEvents);
+    fprintf(stderr, ".\n");
+}
+} } }
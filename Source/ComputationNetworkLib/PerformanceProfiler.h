@@ -0,0 +1,96 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PerformanceProfiler.h -- built-in timing of node evaluation and training phases
+//
+// When enabled, every ForwardProp() and Backprop() of a node, and the phases of the training loop (reading,
+// gradient aggregation, weight update), are timed. Per node and per operation type we accumulate calls, wall time,
+// and rough estimates of FLOPs and bytes touched. Report() prints a summary and writes a timeline in Chrome's
+// trace-event format (load it in chrome://tracing).
+//
+// When disabled, each instrumentation point costs one test of a static flag, so it stays compiled in.
+// Note that GPU operations are asynchronous; on a GPU the times reflect when the work was issued, not done.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include <string>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class ComputationNodeBase;
+
+class PerformanceProfiler
+{
+    static bool s_enabled;
+
+public:
+    // start collecting; if 'traceFile' is not empty, Report() writes the timeline there (at most 'maxTraceEvents' events)
+    static void Enable(const std::wstring& traceFile, size_t maxTraceEvents = 1000000);
+    static bool IsEnabled()
+    {
+        return s_enabled;
+    }
+    // time in microseconds since Enable()
+    static double Now();
+
+    // record one ForwardProp() or Backprop() call of a node
+    // 'fraction' is the share of the minibatch processed by the call (e.g. 1/T for one time step of a loop).
+    // Flow-control nodes (loops) only show up in the timeline. Individual time steps are not written to the timeline.
+    static void RecordNode(const ComputationNodeBase& node, bool isBackprop, double beginTime, double endTime, double fraction = 1.0);
+    // record a phase of the training loop, such as "ReadMinibatch"
+    static void RecordPhase(const char* name, double beginTime, double endTime);
+
+    // print the summary tables to stderr and write the timeline file
+    static void Report();
+};
+
+// ---------------------------------------------------------------------------
+// ProfilePhase, ProfileNode -- scoped instrumentation points
+// ---------------------------------------------------------------------------
+
+class ProfilePhase
+{
+    const char* m_name;
+    double* m_elapsedSeconds;
+    double m_beginTime;
+
+public:
+    // if 'elapsedSeconds' is given, the duration of the scope is added to it, also when profiling is disabled
+    ProfilePhase(const char* name, double* elapsedSeconds = nullptr)
+        : m_name(name), m_elapsedSeconds(elapsedSeconds), m_beginTime(PerformanceProfiler::IsEnabled() || elapsedSeconds ? PerformanceProfiler::Now() : 0)
+    {
+    }
+    ~ProfilePhase()
+    {
+        if (!PerformanceProfiler::IsEnabled() && !m_elapsedSeconds)
+            return;
+        double endTime = PerformanceProfiler::Now();
+        if (m_elapsedSeconds)
+            *m_elapsedSeconds += (endTime - m_beginTime) * 1e-6;
+        if (PerformanceProfiler::IsEnabled())
+            PerformanceProfiler::RecordPhase(m_name, m_beginTime, endTime);
+    }
+};
+
+class ProfileNode
+{
+    const ComputationNodeBase& m_node;
+    bool m_isBackprop;
+    double m_fraction;
+    double m_beginTime;
+
+public:
+    ProfileNode(const ComputationNodeBase& node, bool isBackprop, double fraction = 1.0)
+        : m_node(node), m_isBackprop(isBackprop), m_fraction(fraction), m_beginTime(PerformanceProfiler::IsEnabled() ? PerformanceProfiler::Now() : 0)
+    {
+    }
+    ~ProfileNode()
+    {
+        if (PerformanceProfiler::IsEnabled())
+            PerformanceProfiler::RecordNode(m_node, m_isBackprop, m_beginTime, PerformanceProfiler::Now(), m_fraction);
+    }
+};
+} } }
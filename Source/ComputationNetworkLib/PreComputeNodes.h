@@ -13,6 +13,8 @@
 #include <string>
 #include <stdexcept>
 #include <list>
+#include <vector>
+#include <memory>
 #include <iostream>
 
 // this file will contain computation nodes that require several atomic computation.
@@ -109,6 +111,13 @@ public:
         }
     }
 
+    virtual void CopyTrainingStateTo(const ComputationNodeBasePtr& nodeP) const override
+    {
+        Base::CopyTrainingStateTo(nodeP);
+        auto node = dynamic_pointer_cast<PreComputedNodeBase<ElemType>>(nodeP);
+        node->m_hasComputed = m_hasComputed;
+    }
+
     // this is for the special case: convertDBN needs this; because we initialize values directly from another well-trained model
     virtual void SideLoadFromMatrix(const Matrix<ElemType>& value)
     {
@@ -120,6 +129,19 @@ public:
         SetDims(TensorShape(value.GetNumRows()), false);
     }
 
+    // The statistics accumulated between MarkComputed(false) and MarkComputed(true) can be combined with those of
+    // accumulations over other data, e.g. on other workers: GetAccumulatedStatistics() returns them as a vector whose
+    // elementwise sum over several accumulations, passed to SetAccumulatedStatistics(), continues as if all data had
+    // been seen by one accumulation.
+    virtual void GetAccumulatedStatistics(std::vector<double>& /*stats*/) const
+    {
+        LogicError("%ls %ls operation: accumulated statistics cannot be combined.", NodeName().c_str(), OperationName().c_str());
+    }
+    virtual void SetAccumulatedStatistics(const std::vector<double>& /*stats*/)
+    {
+        LogicError("%ls %ls operation: accumulated statistics cannot be combined.", NodeName().c_str(), OperationName().c_str());
+    }
+
 public:
     bool m_hasComputed;
 };
@@ -196,19 +218,55 @@ public:
         }
     }
 
+    virtual void CopyTrainingStateTo(const ComputationNodeBasePtr& nodeP) const override
+    {
+        Base::CopyTrainingStateTo(nodeP);
+        if (m_numSamples != SIZE_MAX)
+            LogicError("%ls %ls operation: CopyTrainingStateTo() called while accumulating.", NodeName().c_str(), OperationName().c_str());
+        auto node = dynamic_pointer_cast<MeanInvStdDevNodeBase<ElemType>>(nodeP);
+        node->m_numSamples = SIZE_MAX; // (as after Load())
+    }
+
 protected:
     size_t m_numSamples; // (SIZE_MAX while outside accumulation state)
     bool IsAccumulating() const
     {
         return m_numSamples != SIZE_MAX;
     }
+
+    // helpers for Get/SetAccumulatedStatistics()
+    void VerifyIsAccumulating(const char* where) const
+    {
+        if (!IsAccumulating())
+            LogicError("%ls %ls operation: %s called while not accumulating.", NodeName().c_str(), OperationName().c_str(), where);
+    }
+    // append weight * m to 'stats'
+    static void AppendWeighted(std::vector<double>& stats, const Matrix<ElemType>& m, double weight)
+    {
+        std::unique_ptr<ElemType[]> values(m.CopyToArray());
+        for (size_t i = 0; i < m.GetNumElements(); i++)
+            stats.push_back(weight * values[i]);
+    }
+    // set column vector m to stats[first..first+m.GetNumRows()-1] / weight
+    static void SetFromWeighted(Matrix<ElemType>& m, const std::vector<double>& stats, size_t first, double weight)
+    {
+        if (first + m.GetNumRows() > stats.size())
+            LogicError("SetAccumulatedStatistics: statistics vector too short.");
+        std::vector<ElemType> values(m.GetNumRows());
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = weight != 0 ? (ElemType)(stats[first + i] / weight) : 0;
+        m.SetValue(values.size(), 1, m.GetDeviceId(), values.data());
+    }
 };
 
 #define UsingMeanInvStdDevNodeBaseNodeMembers \
     ComputationNodeBoilerplate;               \
     UsingPreComputedNodeMembers;              \
     using Base::m_numSamples;                 \
-    using Base::IsAccumulating
+    using Base::IsAccumulating;               \
+    using Base::VerifyIsAccumulating;         \
+    using Base::AppendWeighted;               \
+    using Base::SetFromWeighted
 
 // -----------------------------------------------------------------------
 // MeanNode (features)
@@ -277,6 +335,20 @@ public:
 
         m_numSamples += numNewSamples;
     }
+
+    // statistics: count, followed by count * mean
+    virtual void GetAccumulatedStatistics(std::vector<double>& stats) const override
+    {
+        VerifyIsAccumulating("GetAccumulatedStatistics()");
+        stats.assign(1, (double) m_numSamples);
+        AppendWeighted(stats, Value(), (double) m_numSamples);
+    }
+    virtual void SetAccumulatedStatistics(const std::vector<double>& stats) override
+    {
+        VerifyIsAccumulating("SetAccumulatedStatistics()");
+        m_numSamples = (size_t) stats[0];
+        SetFromWeighted(Value(), stats, 1, stats[0]);
+    }
 };
 
 template class MeanNode<float>;
@@ -390,6 +462,37 @@ public:
 #endif
     }
 
+    // statistics: count, followed by count * mean and count * (variance + mean^2), i.e. the sums of x and x^2
+    virtual void GetAccumulatedStatistics(std::vector<double>& stats) const override
+    {
+        VerifyIsAccumulating("GetAccumulatedStatistics()");
+        stats.assign(1, (double) m_numSamples);
+        AppendWeighted(stats, m_mean, (double) m_numSamples);
+        Matrix<ElemType> secondMoment(m_mean.GetDeviceId());
+        secondMoment.AssignElementPowerOf(m_mean, 2);
+        secondMoment += m_var;
+        AppendWeighted(stats, secondMoment, (double) m_numSamples);
+    }
+    virtual void SetAccumulatedStatistics(const std::vector<double>& stats) override
+    {
+        VerifyIsAccumulating("SetAccumulatedStatistics()");
+        const size_t dim = m_mean.GetNumRows();
+        if (stats.size() != 1 + 2 * dim)
+            LogicError("%ls %ls operation: SetAccumulatedStatistics() expects %d values.", NodeName().c_str(), OperationName().c_str(), (int) (1 + 2 * dim));
+        m_numSamples = (size_t) stats[0];
+        // variance = E[x^2] - E[x]^2, computed in double precision
+        std::vector<double> moments(stats.begin() + 1, stats.end());
+        for (size_t i = 0; i < dim; i++)
+        {
+            double mean = stats[0] != 0 ? stats[1 + i] / stats[0] : 0;
+            double meanOfSquares = stats[0] != 0 ? stats[1 + dim + i] / stats[0] : 0;
+            moments[i] = mean;
+            moments[dim + i] = std::max(meanOfSquares - mean * mean, 0.0);
+        }
+        SetFromWeighted(m_mean, moments, 0, 1);
+        SetFromWeighted(m_var, moments, dim, 1);
+    }
+
     virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
     {
         Base::CopyTo(nodeP, newName, flags);
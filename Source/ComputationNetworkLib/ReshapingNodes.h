@@ -158,12 +158,14 @@ public:
 
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
-        ValueFor(fr).SetValue(Input(0)->ValueFor(fr));
+        if (!IsValueOfInput()) // (as a view, our value already is the input's)
+            ValueFor(fr).SetValue(Input(0)->ValueFor(fr));
     }
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
-        Input(inputIndex)->GradientFor(fr).SetValue(GradientFor(fr));
+        if (!IsGradientOfInput())
+            Input(inputIndex)->GradientFor(fr) += GradientFor(fr);
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
@@ -174,6 +176,10 @@ public:
     {
         return false;
     }
+    virtual bool CanBeValueViewOfInput() const override
+    {
+        return true; // only the tensor shape changes
+    }
 
 private:
     TensorShape m_replacementSampleLayout; // user-specified dimensions to replace dimensions [beginDim, endDim]
@@ -211,8 +217,8 @@ public:
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t /*inputIndex*/, const FrameRange& fr) override
     {
-        Input(0)->GradientFor(fr.WithLayout(Input(0)->GetMBLayout())) += GradientFor(fr);
-        // TODO: Once we do in-place, the above must include a copy-to-self check (pay special attention to adding vs. copying).
+        if (!IsGradientOfInput()) // (as a view, our gradient already is the input's)
+            Input(0)->GradientFor(fr.WithLayout(Input(0)->GetMBLayout())) += GradientFor(fr);
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
@@ -223,6 +229,10 @@ public:
     {
         return false;
     }
+    virtual bool CanBeValueViewOfInput() const override
+    {
+        return true; // only the MBLayout object changes, its content is the same
+    }
 
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
@@ -234,9 +244,9 @@ public:
                             Input(0)->NodeName().c_str(), Input(0)->OperationName().c_str(),
                             Input(1)->NodeName().c_str(), Input(1)->OperationName().c_str());
 
-        // copy the data from 'dataInput'
-        ValueFor(fr).SetValue(Input(0)->ValueFor(fr.WithLayout(Input(0)->GetMBLayout()))); // just propagate through
-        // TODO: Once we do in-place, the above must include a copy-to-self check (either here or inside the matrix lib).
+        // copy the data from 'dataInput', unless we are a view of it
+        if (!IsValueOfInput())
+            ValueFor(fr).SetValue(Input(0)->ValueFor(fr.WithLayout(Input(0)->GetMBLayout()))); // just propagate through
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
@@ -304,9 +314,22 @@ public:
         fstream >> m_startIndex >> m_sliceHeight;
     }
 
+private:
+
+    // our rows of each column of 'data' (the input's value or gradient for a FrameRange), as a tensor narrowed to them
+    // This is a strided view into the input's matrix, so nothing is sliced out into a temporary.
+    TensorView<ElemType> RowSliceOf(const Matrix<ElemType>& data) const
+    {
+        TensorShape shape(data.GetNumRows(), data.GetNumCols());
+        shape.NarrowTo(0, m_startIndex, m_startIndex + m_sliceHeight);
+        return TensorView<ElemType>(data, shape);
+    }
+
+public:
+
     virtual void /*ComputationNode::*/ BackpropTo(const size_t /*inputIndex*/, const FrameRange& fr) override
     {
-        Input(0)->GradientFor(fr).AddToRowSliceValuesOf(GradientFor(fr), m_startIndex, m_sliceHeight);
+        RowSliceOf(Input(0)->GradientFor(fr)).AddCopyOf(TensorView<ElemType>(GradientFor(fr)));
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override
@@ -326,7 +349,7 @@ public:
 
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
-        ValueFor(fr).AssignRowSliceValuesOf(Input(0)->ValueFor(fr), m_startIndex, m_sliceHeight);
+        TensorView<ElemType>(ValueFor(fr)).AssignCopyOf(RowSliceOf(Input(0)->ValueFor(fr)));
     }
 
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
@@ -1462,6 +1462,8 @@ template class LogisticNode<double>;
 // -----------------------------------------------------------------------
 // DropoutNode (input) -- perform drop-out
 // Output is scaled such that no post-scaling is necessary.
+// With counter-based random numbers on the CPU (Matrix::SetCounterBasedRNG()), the mask is not stored but
+// regenerated in backprop from a per-minibatch seed and the position of the frame in the minibatch.
 // -----------------------------------------------------------------------
 
 template <class ElemType>
@@ -1478,7 +1480,8 @@ public:
     DeclareConstructorFromConfigWithNumInputs(DropoutNode);
     DropoutNode(DEVICEID_TYPE deviceId, const wstring& name)
         : Base(deviceId, name),
-          m_dropoutRate(0)
+          m_dropoutRate(0),
+          m_maskSeed(0)
     {
         m_randomSeed = (unsigned long) CreateUniqId();
     }
@@ -1488,7 +1491,16 @@ public:
         Matrix<ElemType> sliceInput0Grad = Input(0)->GradientFor(fr);
         Matrix<ElemType> sliceOutputGrad = GradientFor(fr);
 
-        if (m_dropoutRate > 0)
+        if (IsGradientOfInput()) // running in place: apply the mask to our gradient, which is the input's
+        {
+            if (m_dropoutRate > 0 && RegeneratesMask())
+                sliceInput0Grad.AssignDropoutOf(sliceOutputGrad, (ElemType) m_dropoutRate, (ElemType)(1.0 / (1.0 - m_dropoutRate)), m_maskSeed, MaskOffsetFor(fr));
+            else if (m_dropoutRate > 0)
+                sliceInput0Grad.AssignElementProductOf(sliceOutputGrad, DataFor(*m_maskOfDropout, fr));
+        }
+        else if (m_dropoutRate > 0 && RegeneratesMask())
+            sliceInput0Grad.AddDropoutOf(sliceOutputGrad, (ElemType) m_dropoutRate, (ElemType)(1.0 / (1.0 - m_dropoutRate)), m_maskSeed, MaskOffsetFor(fr));
+        else if (m_dropoutRate > 0)
             sliceInput0Grad.AddElementProductOf(sliceOutputGrad, DataFor(*m_maskOfDropout, fr));
         else
             sliceInput0Grad += sliceOutputGrad;
@@ -1513,16 +1525,31 @@ public:
     {
         Base::UpdateFunctionMBSize();
         // resize temporaries to their proper size
-        if (m_dropoutRate > 0)
+        if (m_dropoutRate > 0 && !RegeneratesMask())
             m_maskOfDropout->Resize(Input(0)->Value());
     }
 
+    virtual void /*IComputationNode::*/ BeginForwardProp() override
+    {
+        Base::BeginForwardProp();
+        // one mask seed for the whole minibatch, so that all frames of a loop draw from the same stream
+        if (m_dropoutRate > 0 && RegeneratesMask())
+        {
+            m_maskSeed = m_randomSeed;
+            m_randomSeed += 1073807359;
+        }
+    }
+
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
     {
         Matrix<ElemType> sliceInput0Value = Input(0)->ValueFor(fr);
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
 
-        if (m_dropoutRate > 0)
+        if (m_dropoutRate > 0 && RegeneratesMask())
+        {
+            sliceOutputValue.AssignDropoutOf(sliceInput0Value, (ElemType) m_dropoutRate, (ElemType)(1.0 / (1.0 - m_dropoutRate)) /*pre-scaled*/, m_maskSeed, MaskOffsetFor(fr));
+        }
+        else if (m_dropoutRate > 0)
         {
             // determine drop-out mask for this minibatch
             auto sliceMask = DataFor(*m_maskOfDropout, fr);
@@ -1531,12 +1558,17 @@ public:
             // apply dropout mask
             sliceOutputValue.AssignElementProductOf(sliceMask, sliceInput0Value);
         }
-        else
+        else if (!IsValueOfInput())
         {
             sliceOutputValue.SetValue(sliceInput0Value);
         }
     }
 
+    virtual bool CanRunInPlace() const override
+    {
+        return true;
+    }
+
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
     {
         ValidateUnaryMap(isFinalValidationPass);
@@ -1563,6 +1595,7 @@ public:
             auto node = dynamic_pointer_cast<DropoutNode<ElemType>>(nodeP);
             node->m_dropoutRate = m_dropoutRate;
             node->m_randomSeed = m_randomSeed;
+            node->m_maskSeed = m_maskSeed;
             node->m_maskOfDropout = m_maskOfDropout;
         }
     }
@@ -1570,19 +1603,33 @@ public:
     virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool)
     {
         Base::RequestMatricesBeforeForwardProp(matrixPool);
-        RequestMatrixFromPool(m_maskOfDropout, matrixPool);
+        if (!RegeneratesMask())
+            RequestMatrixFromPool(m_maskOfDropout, matrixPool);
     }
 
     // release gradient and temp matrices that no longer needed after all the children's gradients are computed.
     virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool)
     {
         Base::ReleaseMatricesAfterBackprop(matrixPool);
-        ReleaseMatrixToPool(m_maskOfDropout, matrixPool);
+        if (!RegeneratesMask())
+            ReleaseMatrixToPool(m_maskOfDropout, matrixPool);
     }
 
 private:
+    // counter-based masks are only implemented on the CPU
+    bool RegeneratesMask() const
+    {
+        return Matrix<ElemType>::IsCounterBasedRNG() && m_deviceId < 0;
+    }
+    // position of the first mask value of a frame range within the minibatch's stream
+    size_t MaskOffsetFor(const FrameRange& fr) const
+    {
+        return ColumnRangeWithMBLayoutFor(Value().GetNumCols(), fr, GetMBLayout()).first * Value().GetNumRows();
+    }
+
     double m_dropoutRate;
     unsigned long m_randomSeed;
+    unsigned long m_maskSeed; // seed of the current minibatch's mask when regenerating it
 
     shared_ptr<Matrix<ElemType>> m_maskOfDropout;
 };
@@ -1675,9 +1722,19 @@ public:
             node->m_eval = m_eval;
             node->m_spatial = m_spatial;
             node->m_expAvgFactor = m_expAvgFactor;
+            node->m_imageLayoutKind = m_imageLayoutKind;
+            node->m_mbCount = m_mbCount;
         }
     }
 
+    void CopyTrainingStateTo(const ComputationNodeBasePtr& nodeP) const override
+    {
+        Base::CopyTrainingStateTo(nodeP);
+        auto node = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(nodeP);
+        assert(node != nullptr);
+        node->m_mbCount = m_mbCount;
+    }
+
     void BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
         if (m_eval)
@@ -11,6 +11,9 @@
 
 #include "CPUMatrix.h"
 #include "TensorOps.h"
+#include "PhiloxRNG.h"
+#include "VectorMath.h"
+#include "CPUMatrixAllocator.h"
 #include <assert.h>
 #include <stdexcept>
 #include <omp.h>
@@ -151,6 +154,22 @@ static ElemType* NewArray(size_t n)
     return p;
 }
 
+// helpers to allocate and free the buffer that a CPUMatrix owns
+// These come from the current CPUMatrixAllocator: zero-initialized like NewArray()'s, but aligned, possibly reused,
+// and placed on the NUMA nodes as configured (see CPUMatrixAllocator.h, NumaPlacement.h).
+// (NewArray() remains for arrays that are handed to the caller, who frees them with delete[].)
+template <class ElemType>
+static ElemType* NewBuffer(size_t n)
+{
+    return (ElemType*) CPUMatrixAllocator::Current().Malloc(n * sizeof(ElemType));
+}
+
+template <class ElemType>
+static void DeleteBuffer(ElemType* p, size_t n)
+{
+    CPUMatrixAllocator::Current().Free(p, n * sizeof(ElemType));
+}
+
 template <class ElemType>
 CPUMatrix<ElemType>::CPUMatrix(const size_t numRows, const size_t numCols)
 {
@@ -161,7 +180,7 @@ CPUMatrix<ElemType>::CPUMatrix(const size_t numRows, const size_t numCols)
     m_elemSizeAllocated = GetNumElements();
 
     if (m_elemSizeAllocated != 0)
-        m_pArray = NewArray<ElemType>(m_elemSizeAllocated);
+        m_pArray = NewBuffer<ElemType>(m_elemSizeAllocated);
 }
 
 template <class ElemType>
@@ -215,7 +234,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::operator=(CPUMatrix<ElemType>&& moveFr
     if (this != &moveFrom)
     {
         if (OwnBuffer() && m_pArray != nullptr)
-            delete[] m_pArray; // always delete the data pointer since we will use the pointer from moveFrom
+            DeleteBuffer(m_pArray, m_elemSizeAllocated); // always delete the data pointer since we will use the pointer from moveFrom
 
         m_computeDevice = moveFrom.m_computeDevice;
         m_numRows = moveFrom.m_numRows;
@@ -242,7 +261,7 @@ void CPUMatrix<ElemType>::Clear()
 {
     if (m_pArray != nullptr && OwnBuffer())
     {
-        delete[] m_pArray;
+        DeleteBuffer(m_pArray, m_elemSizeAllocated);
         m_pArray = nullptr;
         m_elemSizeAllocated = 0;
     }
@@ -847,8 +866,8 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     if (matrixFlags & matrixFlagDontOwnBuffer)
     {
         // free previous array allocation if any before overwriting
-        if (m_pArray != nullptr)
-            delete[] m_pArray;
+        if (m_pArray != nullptr && OwnBuffer())
+            DeleteBuffer(m_pArray, m_elemSizeAllocated);
 
         m_pArray = pArray;
         m_numRows = numRows;
@@ -990,12 +1009,69 @@ void CPUMatrix<ElemType>::SetDiagonalValue(const CPUMatrix<ElemType>& vector)
     }
 }
 
+// ---------------------------------------------------------------------------
+// counter-based random numbers (PhiloxRNG.h)
+// With SetCounterBasedRNG(true), the random fills below are computed in parallel, and value #i of a fill is a function of
+// only the seed and i, independent of the number of threads. The default remains the sequential std:: generators,
+// which produce different values, so that existing setups reproduce.
+// ---------------------------------------------------------------------------
+
+static bool s_counterBasedRNG = false;
+
+template <class ElemType>
+/*static*/ void CPUMatrix<ElemType>::SetCounterBasedRNG(bool enable)
+{
+    s_counterBasedRNG = enable;
+}
+
+template <class ElemType>
+/*static*/ bool CPUMatrix<ElemType>::IsCounterBasedRNG()
+{
+    return s_counterBasedRNG;
+}
+
+// call f(i, value) for i in [0, n), with value #(offset + i) of the uniform [0,1) or standard-normal stream of 'seed'
+template <class ElemType, class F>
+static void ForEachCounterBasedRandomValue(size_t n, unsigned long seed, size_t offset, bool normal, const F& f)
+{
+    typedef PhiloxRandom<ElemType> Random;
+    const size_t valuesPerCounter = Random::ValuesPerCounter;
+    const uint64_t key = seed == USE_TIME_BASED_SEED ? (uint64_t) time(NULL) : (uint64_t) seed;
+    const long firstCounter = (long) (offset / valuesPerCounter);
+    const long endCounter = (long) ((offset + n + valuesPerCounter - 1) / valuesPerCounter);
+#pragma omp parallel for if (endCounter - firstCounter > 1024)
+    for (long c = firstCounter; c < endCounter; c++)
+    {
+        ElemType values[4];
+        if (normal)
+            Random::Normal(key, (uint64_t) c, values);
+        else
+            Random::Uniform(key, (uint64_t) c, values);
+        for (size_t k = 0; k < valuesPerCounter; k++)
+        {
+            const size_t index = c * valuesPerCounter + k; // (the first and last counter may straddle the range)
+            if (index >= offset && index < offset + n)
+                f(index - offset, values[k]);
+        }
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::SetUniformRandomValue(const ElemType low, const ElemType high, unsigned long seed)
 {
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
 
+    if (s_counterBasedRNG)
+    {
+        ElemType* data = m_pArray;
+        ForEachCounterBasedRandomValue<ElemType>(GetNumElements(), seed, 0, /*normal=*/false, [=](size_t i, ElemType v)
+                                                 {
+                                                     data[i] = low + (high - low) * v;
+                                                 });
+        return;
+    }
+
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
     std::ranlux64_base_01 generator;
     generator.seed(seed == USE_TIME_BASED_SEED ? (unsigned long) time(NULL) : seed);
@@ -1029,6 +1105,16 @@ void CPUMatrix<ElemType>::SetGaussianRandomValue(const ElemType mean, const Elem
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
 
+    if (s_counterBasedRNG)
+    {
+        ElemType* data = m_pArray;
+        ForEachCounterBasedRandomValue<ElemType>(GetNumElements(), seed, 0, /*normal=*/true, [=](size_t i, ElemType v)
+                                                 {
+                                                     data[i] = mean + sigma * v;
+                                                 });
+        return;
+    }
+
     auto& us = *this;
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
     std::ranlux64_base_01 generator;
@@ -1053,6 +1139,16 @@ void CPUMatrix<ElemType>::AddGaussianRandomValue(const ElemType mean, const Elem
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
 
+    if (s_counterBasedRNG)
+    {
+        ElemType* data = m_pArray;
+        ForEachCounterBasedRandomValue<ElemType>(GetNumElements(), seed, 0, /*normal=*/true, [=](size_t i, ElemType v)
+                                                 {
+                                                     data[i] += mean + sigma * v;
+                                                 });
+        return;
+    }
+
     auto& us = *this;
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
     std::ranlux64_base_01 generator;
@@ -1089,6 +1185,16 @@ void CPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
     if (IsEmpty())
         LogicError("SetUniformRandomValue: Matrix is empty.");
 
+    if (s_counterBasedRNG)
+    {
+        ElemType* data = m_pArray;
+        ForEachCounterBasedRandomValue<ElemType>(GetNumElements(), seed, 0, /*normal=*/false, [=](size_t i, ElemType v)
+                                                 {
+                                                     data[i] = v <= maskRate ? 0 : scaleValue;
+                                                 });
+        return;
+    }
+
     auto& us = *this;
 #ifdef _MSC_VER // TODO: check if available under GCC/Linux
     std::ranlux64_base_01 generator;
@@ -1123,11 +1229,69 @@ void CPUMatrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const El
     }
 }
 
+// this = mask .* a, where the mask is that of SetUniformRandomMask() with counter-based random numbers, starting at value #offset of the stream 'seed'
+// The mask is never stored: backprop calls AddDropoutOf() with the same seed and offset to regenerate it.
 template <class ElemType>
-ElemType CPUMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignDropoutOf(const CPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, unsigned long seed, size_t offset)
 {
-    ElemType aveMultiplier = 0;
+    if (a.IsEmpty())
+        LogicError("AssignDropoutOf: Matrix a is empty.");
+    if (this != &a)
+        Resize(a.GetNumRows(), a.GetNumCols());
+
+    ElemType* us = m_pArray;
+    const ElemType* in = a.m_pArray;
+    ForEachCounterBasedRandomValue<ElemType>(a.GetNumElements(), seed, offset, /*normal=*/false, [=](size_t i, ElemType v)
+                                             {
+                                                 us[i] = v <= maskRate ? 0 : scaleValue * in[i];
+                                             });
+    return *this;
+}
+
+// this += mask .* a, see AssignDropoutOf()
+template <class ElemType>
+CPUMatrix<ElemType>& CPUMatrix<ElemType>::AddDropoutOf(const CPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, unsigned long seed, size_t offset)
+{
+    if (a.IsEmpty() || a.GetNumRows() != GetNumRows() || a.GetNumCols() != GetNumCols())
+        InvalidArgument("AddDropoutOf: The input matrix dimensions do not match.");
+
+    ElemType* us = m_pArray;
+    const ElemType* in = a.m_pArray;
+    ForEachCounterBasedRandomValue<ElemType>(a.GetNumElements(), seed, offset, /*normal=*/false, [=](size_t i, ElemType v)
+                                             {
+                                                 if (v > maskRate)
+                                                     us[i] += scaleValue * in[i];
+                                             });
+    return *this;
+}
 
+// The learners below (and MultiTensorLearnerUpdate()) sum the per-element multipliers (for 'needAveMultiplier') over blocks
+// of a fixed size, in parallel, and then add up the block sums in block order. Unlike a shared (atomic) sum, this gives the
+// same result for any number of threads.
+static const long learnerBlockSize = 4096;
+
+static long NumLearnerBlocks(size_t n)
+{
+    return (long) ((n + learnerBlockSize - 1) / learnerBlockSize);
+}
+
+// sum of the 'numBlocks' block sums starting at 'blockSums'
+static double SumOfLearnerBlocks(const double* blockSums, size_t numBlocks)
+{
+    double sum = 0;
+    for (size_t b = 0; b < numBlocks; b++)
+        sum += blockSums[b];
+    return sum;
+}
+
+static double SumOfLearnerBlocks(const std::vector<double>& blockSums)
+{
+    return SumOfLearnerBlocks(blockSums.data(), blockSums.size());
+}
+
+template <class ElemType>
+ElemType CPUMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& gradients, const bool needAveMultiplier)
+{
     if (IsEmpty() || gradients.GetNumCols() != GetNumCols() || gradients.GetNumRows() != GetNumRows())
     {
         Resize(gradients.GetNumRows(), gradients.GetNumCols());
@@ -1137,52 +1301,29 @@ ElemType CPUMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& gradients, const bool
     assert(GetNumRows() == gradients.GetNumRows() && GetNumCols() == gradients.GetNumCols());
 
     ElemType *a = m_pArray, *d_v = gradients.m_pArray;
-    size_t n = GetNumElements();
-
+    const size_t n = GetNumElements();
     const ElemType floor = 1e-16f;
-    ElemType a0, a1, a2, a3;
 
-    // disable omp here because aveMultiper needs to be added atomically. however, it seems the result is incorrect even if rmp atomic and amp critical are used.
-    // #pragma omp parallel for
-    for (long i = 0; i < (n & ~3); i += 4) // four-way unrolling
+    const long numBlocks = NumLearnerBlocks(n);
+    std::vector<double> blockSums(numBlocks, 0.0);
+#pragma omp parallel for if (numBlocks > 1)
+    for (long b = 0; b < numBlocks; b++)
     {
-        a[i] += d_v[i] * d_v[i];
-        a[i + 1] += d_v[i + 1] * d_v[i + 1];
-        a[i + 2] += d_v[i + 2] * d_v[i + 2];
-        a[i + 3] += d_v[i + 3] * d_v[i + 3];
-
-        a0 = sqrt(a[i] + floor);
-        a1 = sqrt(a[i + 1] + floor);
-        a2 = sqrt(a[i + 2] + floor);
-        a3 = sqrt(a[i + 3] + floor);
-
-        d_v[i] /= a0;
-        d_v[i + 1] /= a1;
-        d_v[i + 2] /= a2;
-        d_v[i + 3] /= a3;
-
-        if (needAveMultiplier)
-        {
-            aveMultiplier += 1 / a0 + 1 / a1 + 1 / a2 + 1 / a3;
-        }
-    }
-
-    // get the last few elements if any
-    for (long i = n & ~3; i < n; i++)
-    {
-        a[i] += d_v[i] * d_v[i];
-
-        a0 = sqrt(a[i] + floor);
-        d_v[i] /= a0;
-
-        if (needAveMultiplier)
+        const long end = min((long) n, (b + 1) * learnerBlockSize);
+        ElemType aveMultiplier = 0;
+        for (long i = b * learnerBlockSize; i < end; i++) // (no branches, so that the compiler can vectorize)
         {
-            aveMultiplier += 1 / a0;
+            const ElemType accumulated = a[i] + d_v[i] * d_v[i];
+            const ElemType denom = sqrt(accumulated + floor);
+            a[i] = accumulated;
+            d_v[i] /= denom;
+            aveMultiplier += 1 / denom;
         }
+        blockSums[b] = aveMultiplier;
     }
 
     if (needAveMultiplier && n > 0)
-        return aveMultiplier / n;
+        return (ElemType)(SumOfLearnerBlocks(blockSums) / n);
     else
         return 1;
 }
@@ -1205,36 +1346,28 @@ void CPUMatrix<ElemType>::FSAdagrad(CPUMatrix<ElemType>& gradients,
 
     assert((GetNumRows() == gradients.GetNumRows()) && (GetNumCols() == numColsNeeded));
 
-    size_t n = gradients.GetNumElements();
+    const long n = (long) gradients.GetNumElements();
     ElemType* grad = gradients.m_pArray;
     ElemType* smoothAda = m_pArray;
     ElemType* smoothMom = m_pArray + n;
     ElemType* val = functionValues.m_pArray;
+    const bool useMomentum = momentum > 0.0f;
 #pragma omp parallel for
-    // TODO: Unroll 4-times for better performance leveraging vectorization
-    for (long i = 0; i < n; i++)
+    for (long i = 0; i < n; i++) // (branches are selects or loop-invariant, so that the compiler can vectorize)
     {
         ElemType g = grad[i];
-        ElemType adaSqr = adaWeight * smoothAda[i] + (1.0f - adaWeight) * g * g;
+        const ElemType adaSqr = adaWeight * smoothAda[i] + (1.0f - adaWeight) * g * g;
         smoothAda[i] = adaSqr;
-        if (adaSqr != 0.0f)
-        {
-            ElemType ada = sqrt(adaSqr);
-            ElemType w = adaMul * ((ElemType) 1.0 / ada);
-
-            if (w > 10.0f)
-                w = 10.0f;
-            g *= w;
-        }
+        const ElemType w = adaMul * ((ElemType) 1.0 / sqrt(adaSqr));
+        g *= adaSqr != 0.0f ? min(w, (ElemType) 10.0f) : (ElemType) 1.0f;
 
-        if (momentum > 0.0f)
+        if (useMomentum)
         {
             g = momentum * smoothMom[i] + (1.0f - momentum) * g;
             smoothMom[i] = g;
         }
 
-        g *= learnRatePerSample;
-        val[i] -= g;
+        val[i] -= g * learnRatePerSample;
     }
 }
 
@@ -1249,7 +1382,7 @@ ElemType CPUMatrix<ElemType>::RmsProp(CPUMatrix<ElemType>& gradients,
 {
     const ElemType floor = 1e-6f;
 
-    size_t n = gradients.GetNumElements();
+    const size_t n = gradients.GetNumElements();
     ElemType* curr_grad = gradients.m_pArray;
 
     if (IsEmpty() || GetNumCols() < gradients.GetNumCols() * 3)
@@ -1260,13 +1393,13 @@ ElemType CPUMatrix<ElemType>::RmsProp(CPUMatrix<ElemType>& gradients,
         ElemType* avars = m_pArray;         // accumulated variances for RMS scaling
         ElemType* steps = m_pArray + 2 * n; // current step size
 
-        // initialize moving average of gradient-squared
-        for (long i = 0; i < n; i++)
+        // initialize moving average of gradient-squared, and starting step size
+#pragma omp parallel for
+        for (long i = 0; i < (long) n; i++)
+        {
             avars[i] = curr_grad[i] * curr_grad[i];
-
-        // initialize starting step size
-        for (long i = 0; i < n; i++)
             steps[i] = ElemType(0.02);
+        }
     }
 
     ElemType* avars = m_pArray;         // accumulated variances for RMS scaling
@@ -1275,65 +1408,261 @@ ElemType CPUMatrix<ElemType>::RmsProp(CPUMatrix<ElemType>& gradients,
 
     assert(GetNumRows() == gradients.GetNumRows() && GetNumCols() == gradients.GetNumCols() * 3);
 
-    ElemType ONE_MINUS_GAMMA = ElemType(1.0) - RMS_GAMMA;
-    // int upd[] = {
-    //    2,2,0,
-    //    2,2,0,
-    //    1,1,1,
-    //    2,2,0,
-    //    1,2,1,
-    //    0,2,2,
-    //    1,1,1,
-    //    0,2,2,
-    //    0,2,2,
-    // };
-
-    //      for (long i=0; i<n; i++)
-    //      {
-    //          avars[i] = RMS_GAMMA * avars[i] + ONE_MINUS_GAMMA * (curr_grad[i] * curr_grad[i]);
-    //    // grad sign base 3: 0->neg, 1->zero, 2->pos
-    //    const int grad_sign = 1 + (ElemType(0) < curr_grad[i]) - (curr_grad[i] < ElemType(0));
-
-    //    // signs[i] contains three consecutive grad_sign
-    //    signs[i]  = 3*(int(signs[i]) % 9) + grad_sign;
-
-    //    switch(upd[int(signs[i])])
-    //    {
-    //    case 0:
-    //        steps[i] = max(steps[i] * RMS_WGT_DEC, RMS_WGT_MIN);
-    //        break;
-    //    case 2:
-    //        steps[i] = min(steps[i] * RMS_WGT_INC, RMS_WGT_MAX);
-    //        break;
-    //    }
-    //    curr_grad[i] *= steps[i] / sqrt(avars[i] + floor);
-    //      }
-
-    ElemType aveMultiplier = 0, a;
-    for (long i = 0; i < n; i++)
-    {
-        avars[i] = RMS_GAMMA * avars[i] + ONE_MINUS_GAMMA * (curr_grad[i] * curr_grad[i]);
-        const int grad_sign = (ElemType(0) < curr_grad[i]) - (curr_grad[i] < ElemType(0));
-
-        if (signs[i] * grad_sign > 0)
-            steps[i] = min(steps[i] * RMS_WGT_INC, RMS_WGT_MAX);
-        else
-            steps[i] = max(steps[i] * RMS_WGT_DEC, RMS_WGT_MIN);
+    const ElemType ONE_MINUS_GAMMA = ElemType(1.0) - RMS_GAMMA;
 
-        a = steps[i] / sqrt(avars[i] + floor);
-        curr_grad[i] *= a;
-        signs[i] = (ElemType) grad_sign;
+    const long numBlocks = NumLearnerBlocks(n);
+    std::vector<double> blockSums(numBlocks, 0.0);
+#pragma omp parallel for if (numBlocks > 1)
+    for (long b = 0; b < numBlocks; b++)
+    {
+        const long end = min((long) n, (b + 1) * learnerBlockSize);
+        ElemType aveMultiplier = 0;
+        for (long i = b * learnerBlockSize; i < end; i++) // (branches are selects, so that the compiler can vectorize)
+        {
+            const ElemType g = curr_grad[i];
+            avars[i] = RMS_GAMMA * avars[i] + ONE_MINUS_GAMMA * (g * g);
+            // grow the step size while the gradient keeps its sign, shrink it otherwise
+            const ElemType gradSign = (ElemType)((ElemType(0) < g) - (g < ElemType(0)));
+            const ElemType step = signs[i] * gradSign > 0 ? min(steps[i] * RMS_WGT_INC, RMS_WGT_MAX) : max(steps[i] * RMS_WGT_DEC, RMS_WGT_MIN);
+            steps[i] = step;
 
-        if (needAveMultiplier)
+            const ElemType a = step / sqrt(avars[i] + floor);
+            curr_grad[i] = g * a;
+            signs[i] = gradSign;
             aveMultiplier += a;
+        }
+        blockSums[b] = aveMultiplier;
     }
 
-    if (needAveMultiplier)
-        return aveMultiplier / n;
+    if (needAveMultiplier && n > 0)
+        return (ElemType)(SumOfLearnerBlocks(blockSums) / n);
     else
         return 1;
 }
 
+// apply a learner's complete parameter update to many parameters in one parallel sweep (see LearnerUpdateParams)
+// Per element, this does what the sequence clipping, L2, NormalGrad()/Adagrad()/FSAdagrad()/RmsProp(), and L1 does in separate passes.
+// All parameters are cut into blocks that are processed by a single parallel loop, so that small parameters do not pay for a parallel region each.
+// Reductions (gradient norms, average multipliers) are summed per block and then in block order, so results do not depend on the number of threads.
+// The gradients serve as scratch space; their content is undefined afterwards.
+// 'fsAdaWeight' and 'fsAdaMultipliers' (one per parameter) are FSAdaGrad's smoothing weight and normalization (cf. Matrix::FSAdagrad()).
+template <class ElemType>
+/*static*/ void CPUMatrix<ElemType>::MultiTensorLearnerUpdate(const std::vector<CPUMatrix<ElemType>*>& values, const std::vector<CPUMatrix<ElemType>*>& gradients,
+                                                            const std::vector<CPUMatrix<ElemType>*>& smoothedGradients, const LearnerUpdateParams& params,
+                                                            ElemType fsAdaWeight, const std::vector<ElemType>& fsAdaMultipliers)
+{
+    const size_t numTensors = values.size();
+    const size_t stateCols = params.NumStateColumnsPerColumn();
+    if (gradients.size() != numTensors || smoothedGradients.size() != numTensors)
+        InvalidArgument("MultiTensorLearnerUpdate: number of values, gradients, and smoothed gradients must be the same.");
+    if (params.type == LearnerUpdateType::FSAdaGrad && fsAdaMultipliers.size() != numTensors)
+        InvalidArgument("MultiTensorLearnerUpdate: one FSAdaGrad multiplier per parameter required.");
+    for (size_t t = 0; t < numTensors; t++)
+    {
+        if (values[t]->GetNumRows() != gradients[t]->GetNumRows() || values[t]->GetNumCols() != gradients[t]->GetNumCols())
+            LogicError("MultiTensorLearnerUpdate: gradient dimensions do not match those of the parameter.");
+        if (smoothedGradients[t]->GetNumRows() != gradients[t]->GetNumRows() || smoothedGradients[t]->GetNumCols() < stateCols * gradients[t]->GetNumCols())
+            LogicError("MultiTensorLearnerUpdate: smoothed gradient has not been initialized for this learner.");
+    }
+
+    // cut all parameters into blocks, the same as the single-tensor learners do; the blocks of a parameter are consecutive
+    struct Block
+    {
+        size_t tensor, begin, end;
+    };
+    std::vector<Block> blocks;
+    std::vector<size_t> firstBlocks(numTensors);
+    for (size_t t = 0; t < numTensors; t++)
+    {
+        const size_t n = values[t]->GetNumElements();
+        firstBlocks[t] = blocks.size();
+        for (size_t begin = 0; begin < n; begin += learnerBlockSize)
+            blocks.push_back(Block{t, begin, min(n, begin + learnerBlockSize)});
+    }
+    const long numBlocks = (long) blocks.size();
+    std::vector<double> blockSums(blocks.size(), 0.0);
+
+    // per-tensor totals of 'blockSums'
+    auto sumPerTensor = [&]() -> std::vector<double>
+    {
+        std::vector<double> sums(numTensors, 0.0);
+        for (size_t t = 0; t < numTensors; t++)
+            sums[t] = SumOfLearnerBlocks(blockSums.data() + firstBlocks[t], NumLearnerBlocks(values[t]->GetNumElements()));
+        return sums;
+    };
+
+    // clipping by the norm requires the norms beforehand
+    std::vector<ElemType> clipFactors(numTensors, 1);
+    const bool clip = params.clippingThreshold != std::numeric_limits<double>::infinity();
+    if (clip && !params.clipWithTruncation)
+    {
+#pragma omp parallel for schedule(dynamic)
+        for (long b = 0; b < numBlocks; b++)
+        {
+            const ElemType* g = gradients[blocks[b].tensor]->m_pArray;
+            double sum = 0;
+            for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+                sum += (double) g[i] * g[i];
+            blockSums[b] = sum;
+        }
+        std::vector<double> sqrNorms = sumPerTensor();
+        if (params.clipByGlobalNorm)
+        {
+            double globalSqrNorm = 0;
+            for (double sqrNorm : sqrNorms)
+                globalSqrNorm += sqrNorm;
+            const double norm = sqrt(globalSqrNorm);
+            if (norm > params.clippingThreshold)
+                clipFactors.assign(numTensors, (ElemType)(params.clippingThreshold / norm));
+        }
+        else
+        {
+            for (size_t t = 0; t < numTensors; t++)
+            {
+                const double norm = sqrt(sqrNorms[t]);
+                if (norm > params.clippingThreshold)
+                    clipFactors[t] = (ElemType)(params.clippingThreshold / norm);
+            }
+        }
+    }
+    const ElemType truncation = (ElemType) fabs(params.clippingThreshold);
+    const bool truncate = clip && params.clipWithTruncation;
+
+    const ElemType learnRate = (ElemType) params.learnRatePerSample;
+    const ElemType momentum = (ElemType) params.momentum;
+    const ElemType l2Weight = (ElemType)(params.L2RegWeight * params.mbSize);
+    const ElemType l1Threshold = (ElemType)(params.learnRatePerSample * params.L1RegWeight * params.mbSize);
+    const bool useL1 = params.L1RegWeight > 0;
+    // AdaGrad and RmsProp with the average multiplier need the whole parameter's multipliers before they can update it
+    const bool needAveMultiplier = params.needAveMultiplier && (params.type == LearnerUpdateType::AdaGrad || params.type == LearnerUpdateType::RmsProp);
+
+    // value update and L1 soft threshold
+    auto apply = [=](ElemType& value, ElemType update)
+    {
+        ElemType v = value - update;
+        if (useL1)
+            v = v > l1Threshold ? v - l1Threshold : v < -l1Threshold ? v + l1Threshold : 0;
+        value = v;
+    };
+
+#pragma omp parallel for schedule(dynamic)
+    for (long b = 0; b < numBlocks; b++)
+    {
+        const size_t t = blocks[b].tensor;
+        const size_t n = values[t]->GetNumElements();
+        ElemType* val = values[t]->m_pArray;
+        ElemType* grad = gradients[t]->m_pArray;
+        ElemType* state = smoothedGradients[t]->m_pArray;
+        const ElemType clipFactor = clipFactors[t];
+        double aveMultiplierSum = 0;
+        for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+        {
+            ElemType g = grad[i];
+            if (truncate)
+                g = g > truncation ? truncation : g < -truncation ? -truncation : g;
+            else
+                g *= clipFactor;
+            if (l2Weight > 0)
+                g += l2Weight * val[i];
+
+            switch (params.type)
+            {
+            case LearnerUpdateType::Momentum:
+            {
+                ElemType& smoothed = state[i];
+                smoothed = (1 - momentum) * learnRate * g + momentum * smoothed;
+                if (params.useNesterovMomentum)
+                    apply(val[i], momentum * smoothed + (1 - momentum) * learnRate * g);
+                else
+                    apply(val[i], smoothed);
+                break;
+            }
+            case LearnerUpdateType::AdaGrad:
+            {
+                ElemType& accumulated = state[i];
+                accumulated += g * g;
+                const ElemType a = sqrt(accumulated + (ElemType) 1e-16f);
+                g /= a;
+                if (needAveMultiplier)
+                {
+                    grad[i] = g;
+                    aveMultiplierSum += 1 / a;
+                }
+                else
+                    apply(val[i], learnRate * g);
+                break;
+            }
+            case LearnerUpdateType::FSAdaGrad:
+            {
+                ElemType& smoothAda = state[i];
+                ElemType& smoothMom = state[n + i];
+                const ElemType adaSqr = fsAdaWeight * smoothAda + (1.0f - fsAdaWeight) * g * g;
+                smoothAda = adaSqr;
+                if (adaSqr != 0.0f)
+                {
+                    ElemType w = fsAdaMultipliers[t] * ((ElemType) 1.0 / sqrt(adaSqr));
+                    if (w > 10.0f)
+                        w = 10.0f;
+                    g *= w;
+                }
+                if (momentum > 0.0f)
+                {
+                    g = momentum * smoothMom + (1.0f - momentum) * g;
+                    smoothMom = g;
+                }
+                apply(val[i], learnRate * g);
+                break;
+            }
+            case LearnerUpdateType::RmsProp:
+            {
+                ElemType& avar = state[i];
+                ElemType& sign = state[n + i];
+                ElemType& step = state[2 * n + i];
+                avar = (ElemType) params.rmsGamma * avar + (ElemType)(1 - params.rmsGamma) * (g * g);
+                const int gradSign = (ElemType(0) < g) - (g < ElemType(0));
+                if (sign * gradSign > 0)
+                    step = min(step * (ElemType) params.rmsWgtInc, (ElemType) params.rmsWgtMax);
+                else
+                    step = max(step * (ElemType) params.rmsWgtDec, (ElemType) params.rmsWgtMin);
+                const ElemType a = step / sqrt(avar + (ElemType) 1e-6f);
+                g *= a;
+                sign = (ElemType) gradSign;
+                if (needAveMultiplier)
+                {
+                    grad[i] = g;
+                    aveMultiplierSum += a;
+                }
+                else
+                    apply(val[i], learnRate * g);
+                break;
+            }
+            }
+        }
+        blockSums[b] = aveMultiplierSum;
+    }
+
+    if (!needAveMultiplier)
+        return;
+
+    // apply the scaled gradients, with the learning rate normalized by the average multiplier
+    std::vector<double> aveMultipliers = sumPerTensor();
+    std::vector<ElemType> learnRates(numTensors);
+    for (size_t t = 0; t < numTensors; t++)
+    {
+        const size_t n = values[t]->GetNumElements();
+        learnRates[t] = n > 0 ? (ElemType)(params.learnRatePerSample / (aveMultipliers[t] / n)) : 0;
+    }
+#pragma omp parallel for schedule(dynamic)
+    for (long b = 0; b < numBlocks; b++)
+    {
+        const size_t t = blocks[b].tensor;
+        ElemType* val = values[t]->m_pArray;
+        const ElemType* grad = gradients[t]->m_pArray;
+        for (size_t i = blocks[b].begin; i < blocks[b].end; i++)
+            apply(val[i], learnRates[t] * grad[i]);
+    }
+}
+
 template <class ElemType>
 void CPUMatrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
 {
@@ -1367,11 +1696,11 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
         {
             if (!OwnBuffer())
                 LogicError("Resize: Resizing an matrix you don't own is not supported.");
-            pArray = NewArray<ElemType>(numElements);
+            pArray = NewBuffer<ElemType>(numElements);
         }
         // success: update the object
         if (OwnBuffer())
-            delete[] m_pArray;
+            DeleteBuffer(m_pArray, m_elemSizeAllocated);
         else
             assert(pArray == nullptr); // (if !OwnBuffer we can still resize to 0)
         m_pArray = pArray;
@@ -2057,6 +2386,57 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignElementInverseOf(const CPUMatrix
     return *this;
 }
 
+// ---------------------------------------------------------------------------
+// elementwise functions with VectorMath (enabled by VectorMath::SetMode())
+// ---------------------------------------------------------------------------
+
+// c = beta * c + alpha * fn(a) for n contiguous elements, in parallel chunks; Log is clipped like ClippedLog()
+template <class ElemType>
+static void ApplyVectorMath(void (*fn)(const ElemType*, ElemType*, size_t, bool), bool isLog,
+                            ElemType beta, const ElemType* pa, ElemType* pc, size_t n, ElemType alpha)
+{
+    const bool fast = VectorMath::GetMode() == VectorMath::Mode::Fast;
+    const size_t chunkSize = 1024;
+    const long numChunks = (long) ((n + chunkSize - 1) / chunkSize);
+#pragma omp parallel for if (numChunks > 1)
+    for (long k = 0; k < numChunks; k++)
+    {
+        const size_t begin = k * chunkSize;
+        const size_t count = min(chunkSize, n - begin);
+        ElemType values[chunkSize];
+        fn(pa + begin, values, count, fast);
+        if (isLog)
+            for (size_t i = 0; i < count; i++)
+                values[i] = pa[begin + i] < EPS_IN_LOG ? LOG_OF_EPS_IN_LOG : values[i];
+        // (we must not read pc if beta is 0, it may be uninitialized)
+        if (beta != 0)
+            for (size_t i = 0; i < count; i++)
+                pc[begin + i] = beta * pc[begin + i] + alpha * values[i];
+        else
+            for (size_t i = 0; i < count; i++)
+                pc[begin + i] = alpha * values[i];
+    }
+}
+
+// the VectorMath function for an ElementWiseOperator, or nullptr if none
+template <class ElemType>
+static void (*VectorMathFunction(ElementWiseOperator op))(const ElemType*, ElemType*, size_t, bool)
+{
+    switch (op)
+    {
+    case ElementWiseOperator::opExp:
+        return &VectorMath::Exp;
+    case ElementWiseOperator::opLog:
+        return &VectorMath::Log;
+    case ElementWiseOperator::opTanh:
+        return &VectorMath::Tanh;
+    case ElementWiseOperator::opSigmoid:
+        return &VectorMath::Sigmoid;
+    default:
+        return nullptr;
+    }
+}
+
 //[this]=sigmoid([this]) element wise
 template <class ElemType>
 CPUMatrix<ElemType>& CPUMatrix<ElemType>::InplaceSigmoid()
@@ -2074,6 +2454,12 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignSigmoidOf(const CPUMatrix<ElemTy
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
+    if (VectorMath::GetMode() != VectorMath::Mode::None)
+    {
+        ApplyVectorMath<ElemType>(&VectorMath::Sigmoid, false, 0, a.m_pArray, m_pArray, GetNumElements(), 1);
+        return *this;
+    }
+
 #pragma omp parallel for
     foreach_coord (i, j, us)
     {
@@ -2190,6 +2576,12 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignTanhOf(const CPUMatrix<ElemType>
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
+    if (VectorMath::GetMode() != VectorMath::Mode::None)
+    {
+        ApplyVectorMath<ElemType>(&VectorMath::Tanh, false, 0, a.m_pArray, m_pArray, GetNumElements(), 1);
+        return *this;
+    }
+
     long m = (long) GetNumRows(), n = (long) GetNumCols();
 #pragma omp parallel for
     for (long j = 0; j < n; j++)
@@ -2229,7 +2621,22 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogSoftmaxOf(const CPUMatrix<Ele
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
-    if (isColWise)
+    if (isColWise && VectorMath::GetMode() != VectorMath::Mode::None)
+    {
+        const bool fast = VectorMath::GetMode() == VectorMath::Mode::Fast;
+#pragma omp parallel for
+        foreach_column (j, a)
+        {
+            ElemType maxV = a(0, j);
+            foreach_row (i, a)
+                maxV = max(maxV, a(i, j));
+
+            const ElemType shift = maxV + log(VectorMath::SumOfExp(&a(0, j), maxV, a.GetNumRows(), fast));
+            foreach_row (i, us)
+                us(i, j) = a(i, j) - shift;
+        }
+    }
+    else if (isColWise)
     {
 #pragma omp parallel for
         foreach_column (j, a)
@@ -2391,6 +2798,12 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignExpOf(const CPUMatrix<ElemType>&
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
+    if (VectorMath::GetMode() != VectorMath::Mode::None)
+    {
+        ApplyVectorMath<ElemType>(&VectorMath::Exp, false, 0, a.m_pArray, m_pArray, GetNumElements(), 1);
+        return *this;
+    }
+
     long m = (long) GetNumRows(), n = (long) GetNumCols();
 #pragma omp parallel for
     for (long j = 0; j < n; j++)
@@ -2476,6 +2889,12 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignLogOf(const CPUMatrix<ElemType>&
     if (this != &a)
         Resize(a.GetNumRows(), a.GetNumCols());
 
+    if (VectorMath::GetMode() != VectorMath::Mode::None)
+    {
+        ApplyVectorMath<ElemType>(&VectorMath::Log, true, 0, a.m_pArray, m_pArray, GetNumElements(), 1);
+        return *this;
+    }
+
 #pragma omp parallel for
     foreach_coord (i, j, a)
     {
@@ -4188,6 +4607,27 @@ void CPUMatrix<ElemType>::AssignNCEUnnormalizedEval(const CPUMatrix<ElemType>& a
     c(0, 0) = -log_likelihood;
 }
 
+// NCE sample matrices hold [word id; log prob] pairs per column, the first pair being the target word.
+// Returns true if all columns carry the same noise words (reader option noise_shared), in which case
+// the noise words' embedding columns are gathered into 'noiseEmbeddings' so they can be scored with a single GEMM.
+template <class ElemType>
+static bool GatherSharedNoiseEmbeddings(const CPUMatrix<ElemType>& samples, const CPUMatrix<ElemType>& embeddings, CPUMatrix<ElemType>& noiseEmbeddings)
+{
+    size_t sample_size = samples.GetNumRows() / 2;
+    size_t batch_size = samples.GetNumCols();
+    if (sample_size < 2 || batch_size < 2)
+        return false;
+    for (size_t instance_id = 1; instance_id < batch_size; instance_id++)
+        for (size_t sample_id = 1; sample_id < sample_size; sample_id++)
+            if (samples(2 * sample_id, instance_id) != samples(2 * sample_id, 0))
+                return false;
+
+    noiseEmbeddings.Resize(embeddings.GetNumRows(), sample_size - 1);
+    for (size_t sample_id = 1; sample_id < sample_size; sample_id++)
+        noiseEmbeddings.SetColumn(embeddings.ColumnSlice((size_t) samples(2 * sample_id, 0), 1), sample_id - 1);
+    return true;
+}
+
 //samples+prob                         gradient           hidden               embedding          embedding/hidden
 //a.m_CPUMatrix->AssignNCEDerivative(*tmp.m_CPUMatrix, *a.m_CPUMatrix, *b.m_CPUMatrix, inputIndex, *c.m_CPUMatrix);
 template <class ElemType>
@@ -4195,6 +4635,50 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignNCEDerivative(const CPUMatrix<El
 {
     size_t sample_size = this->GetNumRows() / 2;
     size_t batch_size = this->GetNumCols();
+
+    // shared noise words: the noise part of the gradient is a single GEMM
+    CPUMatrix<ElemType> noiseEmbeddings;
+    if ((inputIndex == 1 || inputIndex == 2) && GatherSharedNoiseEmbeddings(*this, b, noiseEmbeddings))
+    {
+        // noise rows of tmp, [num noise samples x batch size]
+        CPUMatrix<ElemType> noiseWeights(sample_size - 1, batch_size);
+        foreach_coord (i, j, noiseWeights)
+            noiseWeights(i, j) = tmp(i + 1, j);
+
+        if (inputIndex == 1)
+        {
+            // c -= b(:, noise words) * noiseWeights, plus the target word per instance
+            MultiplyAndWeightedAdd(-1, noiseEmbeddings, false, noiseWeights, false, 1, c);
+#pragma omp parallel for
+            for (int instance_id = 0; instance_id < batch_size; instance_id++)
+            {
+                int sample = (int) (*this)(0, instance_id);
+                for (int dim = 0; dim < b.GetNumRows(); dim++)
+                    c(dim, instance_id) -= b(dim, sample) * tmp(0, instance_id);
+            }
+        }
+        else
+        {
+            // column k of a * noiseWeights^T is the gradient w.r.t. the k-th noise word's embedding;
+            // scatter serially since a noise word may have been drawn more than once
+            CPUMatrix<ElemType> embeddingGradient(a.GetNumRows(), sample_size - 1);
+            Multiply(a, false, noiseWeights, true, embeddingGradient);
+            for (int sample_id = 1; sample_id < sample_size; sample_id++)
+            {
+                int sample = (int) (*this)(2 * sample_id, 0);
+                for (int dim = 0; dim < b.GetNumRows(); dim++)
+                    c(dim, sample) -= embeddingGradient(dim, sample_id - 1);
+            }
+            for (int instance_id = 0; instance_id < batch_size; instance_id++)
+            {
+                int sample = (int) (*this)(0, instance_id);
+                for (int dim = 0; dim < b.GetNumRows(); dim++)
+                    c(dim, sample) -= a(dim, instance_id) * tmp(0, instance_id);
+            }
+        }
+        return *this;
+    }
+
     if (inputIndex == 1)
     {
 #pragma omp parallel for
@@ -4251,14 +4735,29 @@ void CPUMatrix<ElemType>::AssignNoiseContrastiveEstimation(const CPUMatrix<ElemT
     size_t batch_size = this->GetNumCols();
     size_t num_noise_samples = sample_size - 1;
     double log_num_noise_samples = std::log(num_noise_samples);
+
+    // shared noise words: score all (instance, noise word) pairs at once as a^T * b(:, noise words)
+    CPUMatrix<ElemType> noiseEmbeddings, noiseScores;
+    bool sharedNoise = GatherSharedNoiseEmbeddings(*this, b, noiseEmbeddings);
+    if (sharedNoise)
+    {
+        noiseScores.Resize(batch_size, num_noise_samples);
+        Multiply(a, true, noiseEmbeddings, false, noiseScores);
+    }
+
 #pragma omp parallel for reduction(+ : log_likelihood)
     for (int instance_id = 0; instance_id < batch_size; instance_id++)
         for (int sample_id = 0; sample_id < sample_size; sample_id++)
         {
             int sample = (int) (*this)(2 * sample_id, instance_id);
             double score = bias(0, sample);
-            for (int dim = 0; dim < b.GetNumRows(); dim++)
-                score += a(dim, instance_id) * b(dim, sample);
+            if (sharedNoise && sample_id > 0)
+                score += noiseScores(instance_id, sample_id - 1);
+            else
+            {
+                for (int dim = 0; dim < b.GetNumRows(); dim++)
+                    score += a(dim, instance_id) * b(dim, sample);
+            }
             double sample_prob = -(*this)(2 * sample_id + 1, instance_id);
             if (sample_id == 0)
                 sample_prob = -sample_prob;
@@ -5486,6 +5985,27 @@ int CPUMatrix<ElemType>::SetNumThreads(int numThreads)
     return numThreads;
 }
 
+// like SetNumThreads(), but only for the calling thread, e.g. for worker threads that execute nodes concurrently
+// Returns the previous setting; 0 leaves the setting unchanged. ACML has no per-thread setting, so only OpenMP and MKL are affected.
+template <class ElemType>
+int CPUMatrix<ElemType>::SetNumThreadsForCurrentThread(int numThreads)
+{
+#ifdef _OPENMP
+    int prevNumThreads = omp_get_max_threads();
+    if (numThreads > 0)
+    {
+        omp_set_num_threads(numThreads); // (OpenMP's thread count is a per-thread setting)
+#ifdef USE_MKL
+        mkl_set_num_threads_local(numThreads);
+#endif
+    }
+    return prevNumThreads;
+#else
+    numThreads;
+    return 1;
+#endif
+}
+
 // =======================================================================
 // TensorView support
 // =======================================================================
@@ -5721,6 +6241,15 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               },                                                       \
                               offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
+    // contiguous elementwise exp, log, tanh and sigmoid go to VectorMath
+    if (VectorMath::GetMode() != VectorMath::Mode::None && reducingOpDims.empty() &&
+        regularOpDims.size() == 1 && regularStrides[0][0] == 1 && regularStrides[1][0] == 1)
+    {
+        auto fn = VectorMathFunction<ElemType>(op);
+        if (fn)
+            return ApplyVectorMath<ElemType>(fn, op == ElementWiseOperator::opLog, beta, a.m_pArray + offsets[0], m_pArray + offsets[1], regularOpDims[0], alpha);
+    }
+
     array<ElemType*, 2> pointers = {a.m_pArray, m_pArray};
     switch (op)
     {
@@ -83,6 +83,9 @@ public:
                      ElemType RMS_WGT_DEC,
                      ElemType RMS_WGT_MIN,
                      const bool needAveMultiplier);
+    static void MultiTensorLearnerUpdate(const std::vector<CPUMatrix<ElemType>*>& values, const std::vector<CPUMatrix<ElemType>*>& gradients,
+                                         const std::vector<CPUMatrix<ElemType>*>& smoothedGradients, const LearnerUpdateParams& params,
+                                         ElemType fsAdaWeight, const std::vector<ElemType>& fsAdaMultipliers);
 
     void Reshape(const size_t numRows, const size_t numCols);
     void Resize(const size_t numRows, const size_t numCols, bool growOnly = true); // by default we only reallocate if need to grow
@@ -119,6 +122,9 @@ public:
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, unsigned long seed = USE_TIME_BASED_SEED);
     void AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
+    // dropout with a counter-based mask that is generated on the fly; element #i uses mask value #(offset + i) of the stream 'seed'
+    CPUMatrix<ElemType>& AssignDropoutOf(const CPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, unsigned long seed, size_t offset);
+    CPUMatrix<ElemType>& AddDropoutOf(const CPUMatrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, unsigned long seed, size_t offset);
 
     CPUMatrix<ElemType> Transpose();
     CPUMatrix<ElemType>& AssignTransposeOf(const CPUMatrix<ElemType>& a);
@@ -318,6 +324,10 @@ public:
 
 public:
     static int SetNumThreads(int numThreads); // note: this does not depend on <ElemType>, i.e. you can call it on any <ElemType>
+    static int SetNumThreadsForCurrentThread(int numThreads);
+    // use the counter-based generator (PhiloxRNG.h) for random values and masks (does not depend on <ElemType>)
+    static void SetCounterBasedRNG(bool enable);
+    static bool IsCounterBasedRNG();
 
     // static BLAS functions
     static void SVD(const CPUMatrix<ElemType>& A, CPUMatrix<ElemType>& SIGMA, CPUMatrix<ElemType>& U, CPUMatrix<ElemType>& VT, CPUMatrix<ElemType>& W);
@@ -0,0 +1,311 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUMatrixAllocator.cpp -- see CPUMatrixAllocator.h
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "CPUMatrixAllocator.h"
+#include "NumaPlacement.h"
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// ---------------------------------------------------------------------------
+// statistics
+// ---------------------------------------------------------------------------
+
+CPUMatrixAllocatorStatistics::CPUMatrixAllocatorStatistics()
+    : numAllocations(0), numFrees(0), numCacheHits(0), numSystemAllocations(0), numSystemFrees(0), bytesInUse(0), bytesAllocated(0), bytesCached(0), peakBytes(0)
+{
+}
+
+double CPUMatrixAllocatorStatistics::Fragmentation() const
+{
+    const size_t bytesHeld = bytesAllocated + bytesCached;
+    return bytesHeld == 0 ? 0.0 : 1.0 - (double) bytesInUse / bytesHeld;
+}
+
+std::string CPUMatrixAllocatorStatistics::ToString() const
+{
+    const double MB = 1024.0 * 1024.0;
+    return msra::strfun::strprintf("%d allocations (%d from the cache, %d from the system), %d frees (%d to the system); "
+                                   "%.1f MB in use in %.1f MB of blocks, %.1f MB cached, peak %.1f MB; fragmentation %.1f%%",
+                                   (int) numAllocations, (int) numCacheHits, (int) numSystemAllocations, (int) numFrees, (int) numSystemFrees,
+                                   bytesInUse / MB, bytesAllocated / MB, bytesCached / MB, peakBytes / MB, 100.0 * Fragmentation());
+}
+
+// ---------------------------------------------------------------------------
+// the current allocator
+// ---------------------------------------------------------------------------
+
+static std::shared_ptr<CPUMatrixAllocator>& CurrentAllocator()
+{
+    // (created on first use, since CPUMatrix objects may be constructed during static initialization)
+    static std::once_flag once;
+    static std::shared_ptr<CPUMatrixAllocator>* current;
+    std::call_once(once, []()
+                   {
+                       current = new std::shared_ptr<CPUMatrixAllocator>(std::make_shared<DefaultCPUMatrixAllocator>());
+                   });
+    return *current;
+}
+
+/*static*/ void CPUMatrixAllocator::SetCurrent(const std::shared_ptr<CPUMatrixAllocator>& allocator)
+{
+    CurrentAllocator() = allocator ? allocator : std::make_shared<DefaultCPUMatrixAllocator>();
+}
+
+/*static*/ CPUMatrixAllocator& CPUMatrixAllocator::Current()
+{
+    return *CurrentAllocator();
+}
+
+/*static*/ std::shared_ptr<CPUMatrixAllocator> CPUMatrixAllocator::Create(const char* name, bool hugePages, size_t maxCachedBytes)
+{
+    if (strcmp(name, "default") == 0)
+        return std::make_shared<DefaultCPUMatrixAllocator>(hugePages);
+    else if (strcmp(name, "caching") == 0)
+        return std::make_shared<CachingCPUMatrixAllocator>(maxCachedBytes, hugePages);
+    InvalidArgument("Invalid cpuMatrixAllocator '%s'; must be 'default' or 'caching'.", name);
+}
+
+// ---------------------------------------------------------------------------
+// DefaultCPUMatrixAllocator
+// ---------------------------------------------------------------------------
+
+// (atomic counters rather than a lock, since the allocator is used by all threads)
+struct DefaultCPUMatrixAllocator::State
+{
+    bool hugePages;
+    std::atomic<size_t> numAllocations;
+    std::atomic<size_t> numFrees;
+    std::atomic<size_t> bytesInUse;
+    std::atomic<size_t> peakBytes;
+
+    State(bool hugePages)
+        : hugePages(hugePages), numAllocations(0), numFrees(0), bytesInUse(0), peakBytes(0)
+    {
+    }
+};
+
+DefaultCPUMatrixAllocator::DefaultCPUMatrixAllocator(bool hugePages)
+    : m_state(new State(hugePages))
+{
+}
+
+DefaultCPUMatrixAllocator::~DefaultCPUMatrixAllocator()
+{
+}
+
+void* DefaultCPUMatrixAllocator::Malloc(size_t bytes)
+{
+    void* p = NumaPlacement::Allocate(bytes, m_state->hugePages);
+    m_state->numAllocations++;
+    size_t bytesInUse = m_state->bytesInUse += bytes;
+    size_t peakBytes = m_state->peakBytes;
+    while (bytesInUse > peakBytes && !m_state->peakBytes.compare_exchange_weak(peakBytes, bytesInUse))
+        ;
+    return p;
+}
+
+void DefaultCPUMatrixAllocator::Free(void* p, size_t bytes)
+{
+    if (!p)
+        return;
+    NumaPlacement::Free(p, bytes);
+    m_state->numFrees++;
+    size_t bytesInUse = m_state->bytesInUse; // (the buffer may be from another allocator, so do not go below 0)
+    while (!m_state->bytesInUse.compare_exchange_weak(bytesInUse, bytesInUse - std::min(bytes, bytesInUse)))
+        ;
+}
+
+CPUMatrixAllocatorStatistics DefaultCPUMatrixAllocator::GetStatistics() const
+{
+    CPUMatrixAllocatorStatistics stats;
+    stats.numAllocations = stats.numSystemAllocations = m_state->numAllocations;
+    stats.numFrees = stats.numSystemFrees = m_state->numFrees;
+    stats.bytesInUse = stats.bytesAllocated = m_state->bytesInUse;
+    stats.peakBytes = m_state->peakBytes;
+    return stats;
+}
+
+// ---------------------------------------------------------------------------
+// CachingCPUMatrixAllocator
+// ---------------------------------------------------------------------------
+
+struct CachingCPUMatrixAllocator::State
+{
+    struct Block
+    {
+        size_t bytes;      // asked for
+        size_t classBytes; // actual size
+        int node;          // NUMA node it was allocated for (the thread's binding), or -1
+    };
+
+    size_t maxCachedBytes;
+    bool hugePages;
+    std::mutex mutex;
+    std::map<std::pair<int, size_t>, std::vector<void*>> cache; // (node, size class) -> free blocks
+    std::unordered_map<void*, Block> inUse;
+    CPUMatrixAllocatorStatistics stats;
+
+    State(size_t maxCachedBytes, bool hugePages)
+        : maxCachedBytes(maxCachedBytes), hugePages(hugePages)
+    {
+    }
+};
+
+CachingCPUMatrixAllocator::CachingCPUMatrixAllocator(size_t maxCachedBytes, bool hugePages)
+    : m_state(new State(maxCachedBytes, hugePages))
+{
+}
+
+CachingCPUMatrixAllocator::~CachingCPUMatrixAllocator()
+{
+    ReleaseCachedMemory();
+    // (blocks still in use are returned to the system by whichever allocator frees them)
+}
+
+/*static*/ size_t CachingCPUMatrixAllocator::SizeClass(size_t bytes)
+{
+    if (bytes <= 1024)
+        return bytes <= 64 ? 64 : (bytes + 63) / 64 * 64;
+    // bytes in (2^k, 2^(k+1)]: round up to a multiple of 2^(k-2)
+    size_t k = 0;
+    while (((size_t) 2 << k) < bytes)
+        k++;
+    const size_t step = (size_t) 1 << (k - 2);
+    return (bytes + step - 1) / step * step;
+}
+
+// clear a reused block, with all threads if it is large
+static void ZeroFill(void* p, size_t bytes)
+{
+    const size_t chunk = 1 << 16;
+    if (bytes < 4 * chunk)
+    {
+        memset(p, 0, bytes);
+        return;
+    }
+    char* c = (char*) p;
+    const long numChunks = (long) ((bytes + chunk - 1) / chunk);
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < numChunks; i++)
+    {
+        const size_t begin = i * chunk;
+        memset(c + begin, 0, std::min(chunk, bytes - begin));
+    }
+}
+
+void* CachingCPUMatrixAllocator::Malloc(size_t bytes)
+{
+    auto& state = *m_state;
+    const size_t classBytes = SizeClass(bytes);
+    const int node = NumaPlacement::GetCurrentThreadNode();
+
+    void* p = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        auto iter = state.cache.find(std::make_pair(node, classBytes));
+        if (iter != state.cache.end() && !iter->second.empty())
+        {
+            p = iter->second.back();
+            iter->second.pop_back();
+            state.stats.bytesCached -= classBytes;
+            state.stats.numCacheHits++;
+        }
+    }
+    const bool fromCache = p != nullptr;
+    if (!fromCache)
+    {
+        // a new block (zero-initialized); if there is no memory left, the cached blocks of other sizes are given up first
+        try
+        {
+            p = NumaPlacement::Allocate(classBytes, state.hugePages);
+        }
+        catch (const std::bad_alloc&)
+        {
+            ReleaseCachedMemory();
+            p = NumaPlacement::Allocate(classBytes, state.hugePages);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        State::Block block = {bytes, classBytes, node};
+        state.inUse[p] = block;
+        state.stats.numAllocations++;
+        if (!fromCache)
+            state.stats.numSystemAllocations++;
+        state.stats.bytesInUse += bytes;
+        state.stats.bytesAllocated += classBytes;
+        state.stats.peakBytes = std::max(state.stats.peakBytes, state.stats.bytesAllocated + state.stats.bytesCached);
+    }
+    if (fromCache)
+        ZeroFill(p, bytes); // (the rest of the block is cleared when a larger request gets it)
+    return p;
+}
+
+void CachingCPUMatrixAllocator::Free(void* p, size_t bytes)
+{
+    if (!p)
+        return;
+    auto& state = *m_state;
+    State::Block block;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        auto iter = state.inUse.find(p);
+        if (iter != state.inUse.end())
+        {
+            block = iter->second;
+            state.inUse.erase(iter);
+            state.stats.numFrees++;
+            state.stats.bytesInUse -= block.bytes;
+            state.stats.bytesAllocated -= block.classBytes;
+            if (state.maxCachedBytes == 0 || state.stats.bytesCached + block.classBytes <= state.maxCachedBytes)
+            {
+                state.cache[std::make_pair(block.node, block.classBytes)].push_back(p);
+                state.stats.bytesCached += block.classBytes;
+                return;
+            }
+            state.stats.numSystemFrees++;
+        }
+        else // allocated by another allocator, before this one became current
+            block.classBytes = bytes;
+    }
+    NumaPlacement::Free(p, block.classBytes);
+}
+
+CPUMatrixAllocatorStatistics CachingCPUMatrixAllocator::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->stats;
+}
+
+void CachingCPUMatrixAllocator::ReleaseCachedMemory()
+{
+    auto& state = *m_state;
+    std::vector<std::pair<void*, size_t>> blocks;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (auto& iter : state.cache)
+            for (void* p : iter.second)
+                blocks.push_back(std::make_pair(p, iter.first.second));
+        state.cache.clear();
+        state.stats.bytesCached = 0;
+        state.stats.numSystemFrees += blocks.size();
+    }
+    for (const auto& block : blocks)
+        NumaPlacement::Free(block.first, block.second);
+}
+} } }
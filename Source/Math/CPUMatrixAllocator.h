@@ -0,0 +1,123 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUMatrixAllocator.h -- where CPUMatrix gets its buffers from
+//
+// Every buffer that a CPUMatrix owns comes from the current allocator (CPUMatrixAllocator::SetCurrent(), config
+// option cpuMatrixAllocator):
+//  - DefaultCPUMatrixAllocator ('default'): each buffer from the system and back to it when freed
+//  - CachingCPUMatrixAllocator ('caching'): freed buffers are kept, by size class, and handed out again for later
+//    requests of the same class. This saves the system allocation (and page faults) of each shape change, e.g. with
+//    variable-length minibatches, at the price of memory held in the cache.
+// Both return zero-initialized buffers aligned to 64 bytes, placed on the NUMA nodes as configured (NumaPlacement.h).
+// With 'hugePages', large buffers are backed by transparent huge pages where the OS supports it (Linux, MADV_HUGEPAGE).
+//
+// Unlike MemAllocator, Free() is passed the size of the buffer, which placed buffers need. A buffer may be freed
+// through any allocator, also through one that was made current after the buffer was allocated.
+//
+
+#pragma once
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct MATH_API CPUMatrixAllocatorStatistics
+{
+    size_t numAllocations;       // Malloc() calls
+    size_t numFrees;             // Free() calls
+    size_t numCacheHits;         // Malloc() calls served from the cache
+    size_t numSystemAllocations; // blocks obtained from the system
+    size_t numSystemFrees;       // blocks returned to it
+    size_t bytesInUse;           // bytes asked for by the buffers in use
+    size_t bytesAllocated;       // bytes of the blocks of the buffers in use (rounded up to their size class)
+    size_t bytesCached;          // bytes of the free blocks kept for reuse
+    size_t peakBytes;            // peak of bytesAllocated + bytesCached, i.e. of what is held from the system
+
+    CPUMatrixAllocatorStatistics();
+    // share of the bytes held from the system that no buffer asked for: rounding up to size classes, and the cache
+    double Fragmentation() const;
+    std::string ToString() const;
+};
+
+class MATH_API CPUMatrixAllocator
+{
+public:
+    virtual ~CPUMatrixAllocator()
+    {
+    }
+
+    // a zero-initialized buffer of 'bytes' bytes; throws std::bad_alloc if there is no memory
+    virtual void* Malloc(size_t bytes) = 0;
+    // release a buffer; 'bytes' is the size it was allocated with
+    virtual void Free(void* p, size_t bytes) = 0;
+    virtual CPUMatrixAllocatorStatistics GetStatistics() const = 0;
+    // return cached blocks to the system
+    virtual void ReleaseCachedMemory()
+    {
+    }
+
+    // the allocator of all CPUMatrix buffers; the default one unless set otherwise
+    // Set it while no other thread allocates matrices. nullptr restores the default.
+    static void SetCurrent(const std::shared_ptr<CPUMatrixAllocator>& allocator);
+    static CPUMatrixAllocator& Current();
+
+    // from a config string "default" or "caching"; 'maxCachedBytes' limits the cache of 'caching' (0: no limit)
+    static std::shared_ptr<CPUMatrixAllocator> Create(const char* name, bool hugePages, size_t maxCachedBytes);
+};
+
+class MATH_API DefaultCPUMatrixAllocator : public CPUMatrixAllocator
+{
+public:
+    DefaultCPUMatrixAllocator(bool hugePages = false);
+    ~DefaultCPUMatrixAllocator();
+
+    void* Malloc(size_t bytes) override;
+    void Free(void* p, size_t bytes) override;
+    CPUMatrixAllocatorStatistics GetStatistics() const override;
+
+private:
+    DefaultCPUMatrixAllocator(const DefaultCPUMatrixAllocator&);
+    DefaultCPUMatrixAllocator& operator=(const DefaultCPUMatrixAllocator&);
+
+    struct State;
+    std::unique_ptr<State> m_state;
+};
+
+class MATH_API CachingCPUMatrixAllocator : public CPUMatrixAllocator
+{
+public:
+    // Freed blocks that would make the cache exceed 'maxCachedBytes' go back to the system (0: no limit).
+    CachingCPUMatrixAllocator(size_t maxCachedBytes = 0, bool hugePages = false);
+    ~CachingCPUMatrixAllocator(); // (returns the cached blocks to the system)
+
+    void* Malloc(size_t bytes) override;
+    void Free(void* p, size_t bytes) override;
+    CPUMatrixAllocatorStatistics GetStatistics() const override;
+    void ReleaseCachedMemory() override;
+
+    // size of the blocks that a request of 'bytes' bytes is served with: a multiple of 64 bytes up to 1 KB, above that
+    // 1, 1.25, 1.5 or 1.75 times a power of 2, i.e. less than 25% are wasted
+    static size_t SizeClass(size_t bytes);
+
+private:
+    CachingCPUMatrixAllocator(const CachingCPUMatrixAllocator&);
+    CachingCPUMatrixAllocator& operator=(const CachingCPUMatrixAllocator&);
+
+    struct State;
+    std::unique_ptr<State> m_state;
+};
+} } }
@@ -622,91 +622,271 @@ void CPUSparseMatrix<ElemType>::Reset()
     m_blockIdShift = 0;
 }
 
-//c = alpha*op(lhs) * op(rhs) + beta*c
+// -----------------------------------------------------------------------
+// sparse x dense products
+// The kernels below operate on the CSC representation. A CSR matrix is the CSC representation of its
+// transpose, so CSR operands are handled by flipping their transpose flag.
+// Work is partitioned over disjoint parts of the output--columns, or blocks of rows where the target column
+// of an update depends on the data--so accumulation is race-free without atomics. Loops over the dense
+// dimension run over contiguous memory so that the compiler can vectorize them.
+// -----------------------------------------------------------------------
+
+// CSC view of a sparse matrix (see above)
 template <class ElemType>
-void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& lhs, const bool transposeA,
-                                                       const CPUSparseMatrix<ElemType>& rhs, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c)
+struct CSCView
 {
-    if (lhs.IsEmpty() || rhs.IsEmpty())
-        LogicError("MultiplyAndWeightedAdd:  one of the input matrix is empty.");
+    const CPUSPARSE_INDEX_TYPE* colStart; // [numCols+1] start of each column in rowIndex/values
+    const CPUSPARSE_INDEX_TYPE* rowIndex;
+    const ElemType* values;
+    size_t numRows;
+    size_t numCols;
+};
 
-    int m = transposeA ? (int) lhs.GetNumCols() : (int) lhs.GetNumRows();
-    int k = transposeA ? (int) lhs.GetNumRows() : (int) lhs.GetNumCols();
-    int l = transposeB ? (int) rhs.GetNumCols() : (int) rhs.GetNumRows();
-    int n = transposeB ? (int) rhs.GetNumRows() : (int) rhs.GetNumCols();
+// number of rows per block for kernels that partition the output by rows
+// Large enough for long vector loops, small enough that a block of the output stays in L2, and enough blocks to keep all threads busy.
+static size_t SparseKernelRowBlockSize(size_t rows, size_t cols, size_t elemSize)
+{
+    const size_t l2CacheBytes = 256 * 1024;
+    const size_t numThreads = (size_t) omp_get_max_threads();
+    size_t block = l2CacheBytes / max(cols * elemSize, (size_t) 1);
+    block = min(block, (rows + numThreads - 1) / numThreads);
+    block = max(block, (size_t) 64);
+    block = (block + 15) / 16 * 16;
+    return min(block, rows);
+}
 
-    assert(m > 0 && k > 0 && l > 0 && n > 0); // converting from size_t to int may cause overflow
-    assert(k == l);
-    if (k != l)
+// c += alpha * op(a) * op(s), a dense [lda x *], s sparse; c is [m x n], column-major with leading dimension m
+template <class ElemType>
+static void DenseTimesSparse(ElemType alpha, const ElemType* a, size_t lda, bool transposeA, const CSCView<ElemType>& s, bool transposeS,
+                             ElemType* c, size_t m, size_t n)
+{
+    if (!transposeA && !transposeS)
     {
-        InvalidArgument("CPUSparseMatrix::MultiplyAndWeightedAdd: The inner dimensions of a and b must match.");
+        // c(:,j) += alpha * sum_p s(i_p,j) * a(:,i_p)
+#pragma omp parallel for schedule(dynamic, 4)
+        for (long j = 0; j < (long) s.numCols; j++)
+        {
+            ElemType* cj = c + j * m;
+            for (size_t p = s.colStart[j]; p < (size_t) s.colStart[j + 1]; p++)
+            {
+                const ElemType v = alpha * s.values[p];
+                const ElemType* ai = a + s.rowIndex[p] * lda;
+                for (size_t h = 0; h < m; h++)
+                    cj[h] += v * ai[h];
+            }
+        }
     }
-
-    if (beta == 0)
-        c.Resize(m, n);
-    else
-        c.VerifySize(m, n); // Can't resize if beta != 0
-
-    if (beta == 0)
+    else if (!transposeA && transposeS)
     {
-        memset(c.GetArray(), 0, sizeof(ElemType) * c.GetNumElements());
+        // c(:,i_p) += alpha * s(i_p,j) * a(:,j); columns of c are hit by many j, so partition by rows of c
+        const size_t blockRows = SparseKernelRowBlockSize(m, n, sizeof(ElemType));
+        const long numBlocks = (long) ((m + blockRows - 1) / blockRows);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (long b = 0; b < numBlocks; b++)
+        {
+            const size_t h0 = b * blockRows;
+            const size_t h1 = min(h0 + blockRows, m);
+            for (size_t j = 0; j < s.numCols; j++)
+            {
+                const ElemType* aj = a + j * lda;
+                for (size_t p = s.colStart[j]; p < (size_t) s.colStart[j + 1]; p++)
+                {
+                    const ElemType v = alpha * s.values[p];
+                    ElemType* ci = c + s.rowIndex[p] * m;
+                    for (size_t h = h0; h < h1; h++)
+                        ci[h] += v * aj[h];
+                }
+            }
+        }
     }
-    else if (beta != 1)
+    else if (transposeA && !transposeS)
     {
-#pragma omp parallel for
-        foreach_coord (i, j, c)
+        // c(h,j) += alpha * sum_p s(i_p,j) * a(i_p,h), a sparse dot product with column h of a
+#pragma omp parallel for schedule(dynamic, 4)
+        for (long j = 0; j < (long) s.numCols; j++)
         {
-            c(i, j) = beta * c(i, j);
+            ElemType* cj = c + j * m;
+            const size_t pBegin = s.colStart[j];
+            const size_t pEnd = s.colStart[j + 1];
+            if (pBegin == pEnd)
+                continue;
+            for (size_t h = 0; h < m; h++)
+            {
+                const ElemType* ah = a + h * lda;
+                ElemType sum = 0;
+                for (size_t p = pBegin; p < pEnd; p++)
+                    sum += s.values[p] * ah[s.rowIndex[p]];
+                cj[h] += alpha * sum;
+            }
         }
     }
-
-    if (rhs.GetFormat() != matrixFormatSparseCSC)
-        NOT_IMPLEMENTED;
-
-    if (!transposeA && !transposeB)
+    else
     {
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
+        // c(h,i_p) += alpha * s(i_p,j) * a(j,h); partition by rows of c, reading row h of op(a) = column h of a contiguously
+        const size_t blockRows = SparseKernelRowBlockSize(m, n, sizeof(ElemType));
+        const long numBlocks = (long) ((m + blockRows - 1) / blockRows);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (long b = 0; b < numBlocks; b++)
         {
-            size_t start = rhs.m_compIndex[j]; // ColLocation
-            size_t end = rhs.m_compIndex[j + 1];
-            for (size_t p = start; p < end; p++)
+            const size_t h0 = b * blockRows;
+            const size_t h1 = min(h0 + blockRows, m);
+            for (size_t h = h0; h < h1; h++)
             {
-                size_t i = rhs.m_unCompIndex[p]; // RowLocation
-                ElemType val = rhs.m_pArray[p];
-
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
+                const ElemType* ah = a + h * lda;
+                for (size_t j = 0; j < s.numCols; j++)
                 {
-                    c(h, j) += alpha * lhs(h, i) * val;
+                    const ElemType ajh = alpha * ah[j];
+                    for (size_t p = s.colStart[j]; p < (size_t) s.colStart[j + 1]; p++)
+                        c[s.rowIndex[p] * m + h] += s.values[p] * ajh;
                 }
             }
         }
     }
-    else if (!transposeA && transposeB)
+}
+
+// c += alpha * op(s) * op(d), s sparse, d dense [ldd x *]; c is [m x n], column-major with leading dimension m
+// All cases are partitioned by columns of c, which are written by one thread only.
+template <class ElemType>
+static void SparseTimesDense(ElemType alpha, const CSCView<ElemType>& s, bool transposeS, const ElemType* d, size_t ldd, bool transposeD,
+                             ElemType* c, size_t m, size_t n)
+{
+#pragma omp parallel for schedule(dynamic, 4)
+    for (long j = 0; j < (long) n; j++)
     {
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
+        ElemType* cj = c + j * m;
+        // element q of column j of op(d)
+        const ElemType* dj = transposeD ? d + j : d + j * ldd;
+        const size_t dStride = transposeD ? ldd : 1;
+        if (!transposeS)
         {
-            size_t start = rhs.m_compIndex[j];
-            size_t end = rhs.m_compIndex[j + 1];
-
-            for (size_t p = start; p < end; p++)
+            // c(:,j) += alpha * sum_q op(d)(q,j) * s(:,q)
+            for (size_t q = 0; q < s.numCols; q++)
             {
-                size_t i = rhs.m_unCompIndex[p];
-                ElemType val = rhs.m_pArray[p];
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
-                {
-                    c(h, i) += alpha * lhs(h, j) * val;
-                }
+                const ElemType dqj = dj[q * dStride];
+                if (dqj == 0)
+                    continue;
+                const ElemType v = alpha * dqj;
+                for (size_t p = s.colStart[q]; p < (size_t) s.colStart[q + 1]; p++)
+                    cj[s.rowIndex[p]] += v * s.values[p];
+            }
+        }
+        else
+        {
+            // c(i,j) += alpha * sum_p s(k_p,i) * op(d)(k_p,j), a sparse dot product per output element
+            for (size_t i = 0; i < s.numCols; i++)
+            {
+                ElemType sum = 0;
+                for (size_t p = s.colStart[i]; p < (size_t) s.colStart[i + 1]; p++)
+                    sum += s.values[p] * dj[s.rowIndex[p] * dStride];
+                cj[i] += alpha * sum;
             }
         }
     }
-    else if (transposeA && !transposeB)
+}
+
+// CSC view of a CSC or CSR matrix; flips 'transpose' for CSR
+template <class ElemType>
+static CSCView<ElemType> GetCSCView(const CPUSPARSE_INDEX_TYPE* compIndex, const CPUSPARSE_INDEX_TYPE* unCompIndex, const ElemType* values,
+                                    MatrixFormat format, size_t numRows, size_t numCols, bool& transpose)
+{
+    CSCView<ElemType> view;
+    view.colStart = compIndex;
+    view.rowIndex = unCompIndex;
+    view.values = values;
+    if (format == matrixFormatSparseCSC)
+    {
+        view.numRows = numRows;
+        view.numCols = numCols;
+    }
+    else if (format == matrixFormatSparseCSR)
     {
+        view.numRows = numCols;
+        view.numCols = numRows;
+        transpose = !transpose;
+    }
+    else
         NOT_IMPLEMENTED;
+    return view;
+}
+
+// c *= beta, c = 0 if beta == 0
+template <class ElemType>
+static void ScaleForWeightedAdd(ElemType beta, CPUMatrix<ElemType>& c)
+{
+    if (beta == 0)
+    {
+        memset(c.BufferPointer(), 0, sizeof(ElemType) * c.GetNumElements());
+    }
+    else if (beta != 1)
+    {
+        ElemType* pc = c.BufferPointer();
+        const long n = (long) c.GetNumElements();
+#pragma omp parallel for
+        for (long i = 0; i < n; i++)
+            pc[i] *= beta;
     }
+}
+
+//c = alpha*op(lhs) * op(rhs) + beta*c
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUMatrix<ElemType>& lhs, const bool transposeA,
+                                                       const CPUSparseMatrix<ElemType>& rhs, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c)
+{
+    if (lhs.IsEmpty() || rhs.IsEmpty())
+        LogicError("MultiplyAndWeightedAdd:  one of the input matrix is empty.");
+
+    int m = transposeA ? (int) lhs.GetNumCols() : (int) lhs.GetNumRows();
+    int k = transposeA ? (int) lhs.GetNumRows() : (int) lhs.GetNumCols();
+    int l = transposeB ? (int) rhs.GetNumCols() : (int) rhs.GetNumRows();
+    int n = transposeB ? (int) rhs.GetNumRows() : (int) rhs.GetNumCols();
+
+    assert(m > 0 && k > 0 && l > 0 && n > 0); // converting from size_t to int may cause overflow
+    assert(k == l);
+    if (k != l)
+    {
+        InvalidArgument("CPUSparseMatrix::MultiplyAndWeightedAdd: The inner dimensions of a and b must match.");
+    }
+
+    if (beta == 0)
+        c.Resize(m, n);
     else
+        c.VerifySize(m, n); // Can't resize if beta != 0
+
+    ScaleForWeightedAdd(beta, c);
+
+    bool transposeS = transposeB;
+    CSCView<ElemType> s = GetCSCView(rhs.m_compIndex, rhs.m_unCompIndex, (const ElemType*) rhs.m_pArray, rhs.GetFormat(), rhs.GetNumRows(), rhs.GetNumCols(), transposeS);
+    DenseTimesSparse(alpha, lhs.BufferPointer(), lhs.GetNumRows(), transposeA, s, transposeS, c.BufferPointer(), (size_t) m, (size_t) n);
+}
+
+//c = alpha*op(lhs) * op(rhs) + beta*c, with a sparse lhs
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPUSparseMatrix<ElemType>& lhs, const bool transposeA,
+                                                       const CPUMatrix<ElemType>& rhs, const bool transposeB, ElemType beta, CPUMatrix<ElemType>& c)
+{
+    if (lhs.IsEmpty() || rhs.IsEmpty())
+        LogicError("MultiplyAndWeightedAdd:  one of the input matrix is empty.");
+
+    size_t m = transposeA ? lhs.GetNumCols() : lhs.GetNumRows();
+    size_t k = transposeA ? lhs.GetNumRows() : lhs.GetNumCols();
+    size_t l = transposeB ? rhs.GetNumCols() : rhs.GetNumRows();
+    size_t n = transposeB ? rhs.GetNumRows() : rhs.GetNumCols();
+
+    if (k != l)
     {
-        NOT_IMPLEMENTED;
+        InvalidArgument("CPUSparseMatrix::MultiplyAndWeightedAdd: The inner dimensions of a and b must match.");
     }
+
+    if (beta == 0)
+        c.Resize(m, n);
+    else
+        c.VerifySize(m, n); // Can't resize if beta != 0
+
+    ScaleForWeightedAdd(beta, c);
+
+    bool transposeS = transposeA;
+    CSCView<ElemType> s = GetCSCView(lhs.m_compIndex, lhs.m_unCompIndex, (const ElemType*) lhs.m_pArray, lhs.GetFormat(), lhs.GetNumRows(), lhs.GetNumCols(), transposeS);
+    SparseTimesDense(alpha, s, transposeS, rhs.BufferPointer(), rhs.GetNumRows(), transposeB, c.BufferPointer(), m, n);
 }
 
 //c = alpha * op(lhs) * op(rhs)
@@ -749,42 +929,19 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
         c.SetFormat(matrixFormatSparseBlockCol);
         c.Resize(m, n, m * min(n, rhs.m_nz), true, false);
 
-        map<size_t, size_t> w2Id;
+        // assign a block to each word (row of rhs) in order of first occurrence
+        vector<long> w2Id(rhs.GetNumRows(), -1);
         for (size_t j = 0; j < rhs.GetNumCols(); j++)
         { // j ranges over batches
-            size_t start = rhs.m_compIndex[j];
-            size_t end = rhs.m_compIndex[j + 1];
-
-            for (size_t p = start; p < end; p++)
+            for (size_t p = rhs.m_compIndex[j]; p < rhs.m_compIndex[j + 1]; p++)
             {
                 size_t i = rhs.m_unCompIndex[p]; // i ranges over words
-                ElemType val = rhs.m_pArray[p];  // 1 for(i, j)
-
-                bool first = true;
-                if (w2Id.find(i) == w2Id.end())
+                if (w2Id[i] < 0)
                 {
-                    size_t id = w2Id.size();
-                    w2Id[i] = id;
+                    w2Id[i] = (long) c.m_blockSize;
                     c.m_blockIds[c.m_blockSize] = i;
                     c.m_blockSize++;
                 }
-                else
-                {
-                    first = false;
-                }
-                size_t pos = w2Id[i] * lhs.GetNumRows();
-                for (size_t h = 0; h < lhs.GetNumRows(); h++)
-                { // h range over hidden layer
-                    if (first == true)
-                    {
-                        c.m_pArray[pos] = alpha * lhs(h, j) * val;
-                    }
-                    else
-                    {
-                        c.m_pArray[pos] += alpha * lhs(h, j) * val;
-                    }
-                    pos++;
-                }
             }
         }
         c.m_nz = c.m_blockSize * m;
@@ -793,6 +950,29 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
         {
             LogicError("sparse matrix out of range.");
         }
+        memset(c.m_pArray, 0, sizeof(ElemType) * c.m_nz);
+
+        // accumulate; several batch columns may hit the same block, so partition by rows (h ranges over hidden layer)
+        const ElemType* a = lhs.BufferPointer();
+        const size_t blockRows = SparseKernelRowBlockSize(m, c.m_blockSize, sizeof(ElemType));
+        const long numBlocks = (long) ((m + blockRows - 1) / blockRows);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (long b = 0; b < numBlocks; b++)
+        {
+            const size_t h0 = b * blockRows;
+            const size_t h1 = min(h0 + blockRows, m);
+            for (size_t j = 0; j < rhs.GetNumCols(); j++)
+            {
+                const ElemType* aj = a + j * lhs.GetNumRows();
+                for (size_t p = rhs.m_compIndex[j]; p < rhs.m_compIndex[j + 1]; p++)
+                {
+                    const ElemType v = alpha * rhs.m_pArray[p]; // 1 for(i, j)
+                    ElemType* ci = c.m_pArray + w2Id[rhs.m_unCompIndex[p]] * m;
+                    for (size_t h = h0; h < h1; h++)
+                        ci[h] += v * aj[h];
+                }
+            }
+        }
         // c.SetFormat(matrixFormatSparseBlockCol);
     }
     else if (transposeA && !transposeB)
@@ -16,6 +16,7 @@
 
 #include "Basics.h"
 #include <string>
+#include <limits>
 #include <stdint.h>
 
 #define DEVICEID_TYPE int
@@ -206,6 +207,51 @@ enum MatrixFlags
     matrixFlagSetValueOnDevice = 1 << bitPosSetValueOnDevice, // SetValue() call has a buffer that is already on the device
 };
 
+// -----------------------------------------------------------------------
+// LearnerUpdateParams -- settings for Matrix<ElemType>::MultiTensorLearnerUpdate(),
+// which applies the complete parameter update of a learner to many parameters at once:
+// gradient clipping, L2 regularization, adaptive scaling, momentum, the update itself, and L1 regularization
+// -----------------------------------------------------------------------
+
+enum class LearnerUpdateType
+{
+    Momentum,  // plain SGD with (optionally Nesterov) momentum, cf. Matrix::NormalGrad()
+    AdaGrad,   // cf. Matrix::Adagrad()
+    FSAdaGrad, // cf. Matrix::FSAdagrad()
+    RmsProp    // cf. Matrix::RmsProp()
+};
+
+struct LearnerUpdateParams
+{
+    LearnerUpdateType type;
+    double learnRatePerSample;
+    double momentum; // per minibatch
+    bool useNesterovMomentum;
+    size_t mbSize;
+    double clippingThreshold; // per minibatch; infinity to disable clipping
+    bool clipWithTruncation;  // clip each element to the threshold, rather than scaling the gradient down to a norm of the threshold
+    bool clipByGlobalNorm;    // norm clipping uses the norm of all gradients together rather than of each by itself
+    double L2RegWeight;       // added to the gradient as L2RegWeight * mbSize * value
+    double L1RegWeight;       // values are soft-thresholded by learnRatePerSample * L1RegWeight * mbSize after the update
+    bool needAveMultiplier;   // AdaGrad, RmsProp: divide the learning rate by the parameter's average scaling factor
+    double rmsGamma, rmsWgtInc, rmsWgtMax, rmsWgtDec, rmsWgtMin; // RmsProp
+    double* fsAdaSmoothedFrames; // FSAdaGrad: the learner's smoothed #frames (cf. Matrix::FSAdagrad()), advanced by the update
+
+    LearnerUpdateParams()
+        : type(LearnerUpdateType::Momentum), learnRatePerSample(0), momentum(0), useNesterovMomentum(false), mbSize(1),
+          clippingThreshold(std::numeric_limits<double>::infinity()), clipWithTruncation(true), clipByGlobalNorm(false),
+          L2RegWeight(0), L1RegWeight(0), needAveMultiplier(true),
+          rmsGamma(0.99), rmsWgtInc(1.2), rmsWgtMax(10.0), rmsWgtDec(0.75), rmsWgtMin(0.1), fsAdaSmoothedFrames(nullptr)
+    {
+    }
+
+    // #columns of the smoothed-gradient (learner state) matrix per column of the parameter
+    size_t NumStateColumnsPerColumn() const
+    {
+        return type == LearnerUpdateType::FSAdaGrad ? 2 : type == LearnerUpdateType::RmsProp ? 3 : 1;
+    }
+};
+
 // -----------------------------------------------------------------------
 // BaseMatrix -- base class for all matrix types (CPU, GPU) x (dense, sparse)
 // -----------------------------------------------------------------------
@@ -1372,6 +1372,60 @@ void Matrix<ElemType>::SetUniformRandomMask(const ElemType maskRate, const ElemT
                             NOT_IMPLEMENTED);
 }
 
+//[this]=mask .* a, with a mask that is regenerated from the counter-based random stream (seed, offset) (CPU only)
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AssignDropoutOf(const Matrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, unsigned long seed, size_t offset)
+{
+    if (a.IsEmpty())
+        LogicError("AssignDropoutOf: Matrix is empty.");
+
+    DecideAndMoveToRightDevice(a, *this);
+    SwitchToMatrixType(a.GetMatrixType(), a.GetFormat(), false);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            this,
+                            m_CPUMatrix->AssignDropoutOf(*a.m_CPUMatrix, maskRate, scaleValue, seed, offset),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
+//[this]+=mask .* a, see AssignDropoutOf()
+template <class ElemType>
+Matrix<ElemType>& Matrix<ElemType>::AddDropoutOf(const Matrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, unsigned long seed, size_t offset)
+{
+    if (a.IsEmpty())
+        LogicError("AddDropoutOf: Matrix is empty.");
+
+    if (!(a.GetNumRows() == GetNumRows() && a.GetNumCols() == GetNumCols()))
+        InvalidArgument("The input matrix dimensions do not match [this].");
+
+    DecideAndMoveToRightDevice(*this, a);
+
+    DISPATCH_MATRIX_ON_FLAG(this,
+                            nullptr,
+                            m_CPUMatrix->AddDropoutOf(*a.m_CPUMatrix, maskRate, scaleValue, seed, offset),
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED,
+                            NOT_IMPLEMENTED);
+
+    return *this;
+}
+
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::SetCounterBasedRNG(bool enable)
+{
+    CPUMatrix<ElemType>::SetCounterBasedRNG(enable);
+}
+
+template <class ElemType>
+/*static*/ bool Matrix<ElemType>::IsCounterBasedRNG()
+{
+    return CPUMatrix<ElemType>::IsCounterBasedRNG();
+}
+
 template <class ElemType>
 void Matrix<ElemType>::NormalGrad(Matrix<ElemType>& gradients,
                                   Matrix<ElemType>& functionValues,
@@ -1450,18 +1504,27 @@ ElemType Matrix<ElemType>::Adagrad(Matrix<ElemType>& gradients, const bool needA
                             SetDataLocation(GPU));
 }
 
+// FSAdaGrad's smoothing weight and normalization for the next update
+// 'smoothedFrames' is the learner's smoothed #frames, which all its parameters share; it is advanced by every call.
 template <class ElemType>
-void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum)
+/*static*/ void Matrix<ElemType>::FSAdagradParameters(size_t mbSize, double& smoothedFrames, ElemType& adagradkeepweight, ElemType& targetadagradavdenom_x_sqrtadagradsqrframes)
 {
     // TODO: The values of 'adagradT' and 'targetadagradavdenom' are currently hardcoded constants taken from DBN (empirically determined).
     // These should be made configurable if needed
     const size_t adagradT = 2 * 3600 * 100;
     const ElemType targetadagradavdenom = 0.0025; // 1/400 magic constant
-    const ElemType adagradkeepweight = static_cast<ElemType>(exp(-1.0 * mbSize / adagradT));
+    adagradkeepweight = static_cast<ElemType>(exp(-1.0 * mbSize / adagradT));
+
+    smoothedFrames = adagradkeepweight * smoothedFrames + (1.0f - adagradkeepweight) * mbSize;
+    targetadagradavdenom_x_sqrtadagradsqrframes = static_cast<ElemType>(targetadagradavdenom * sqrt(smoothedFrames));
+}
 
-    static ElemType aggadagradsqrframes = 0;
-    aggadagradsqrframes = adagradkeepweight * aggadagradsqrframes + (1.0f - adagradkeepweight) * mbSize;
-    const ElemType targetadagradavdenom_x_sqrtadagradsqrframes = static_cast<ElemType>(targetadagradavdenom * sqrt(aggadagradsqrframes));
+template <class ElemType>
+void Matrix<ElemType>::FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum,
+                                 double& smoothedFrames)
+{
+    ElemType adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes;
+    FSAdagradParameters(mbSize, smoothedFrames, adagradkeepweight, targetadagradavdenom_x_sqrtadagradsqrframes);
 
     DISPATCH_MATRIX_ON_FLAG(&gradients,
                             &gradients,
@@ -1494,6 +1557,52 @@ ElemType Matrix<ElemType>::RmsProp(Matrix<ElemType>& gradients,
                             NOT_IMPLEMENTED);
 }
 
+// apply a learner's parameter update (see LearnerUpdateParams) to all given parameters in one go
+// This is equivalent to clipping, L2 regularization, NormalGrad()/Adagrad()/FSAdagrad()/RmsProp(), and L1 regularization on each parameter in turn,
+// up to rounding, but streams over each parameter once (twice for AdaGrad and RmsProp with the average multiplier).
+// Only CPU dense matrices are supported. Returns false, without touching anything, if some matrix is not,
+// or if a smoothed gradient does not have the learner's state yet (RmsProp and FSAdaGrad initialize it in their first update);
+// the caller then updates the parameters one by one.
+template <class ElemType>
+/*static*/ bool Matrix<ElemType>::MultiTensorLearnerUpdate(const std::vector<Matrix<ElemType>*>& values, const std::vector<Matrix<ElemType>*>& gradients,
+                                                         const std::vector<Matrix<ElemType>*>& smoothedGradients, const LearnerUpdateParams& params)
+{
+    if (gradients.size() != values.size() || smoothedGradients.size() != values.size())
+        InvalidArgument("MultiTensorLearnerUpdate: number of values, gradients, and smoothed gradients must be the same.");
+
+    auto isCPUDense = [](const Matrix<ElemType>* m)
+    {
+        return m->GetCurrentMatrixLocation() == CurrentDataLocation::CPU && m->GetMatrixType() == MatrixType::DENSE;
+    };
+    std::vector<CPUMatrix<ElemType>*> cpuValues, cpuGradients, cpuSmoothedGradients;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (!isCPUDense(values[i]) || !isCPUDense(gradients[i]) || !isCPUDense(smoothedGradients[i]))
+            return false;
+        if (smoothedGradients[i]->GetNumRows() != gradients[i]->GetNumRows() ||
+            smoothedGradients[i]->GetNumCols() < params.NumStateColumnsPerColumn() * gradients[i]->GetNumCols())
+            return false;
+        cpuValues.push_back(values[i]->m_CPUMatrix);
+        cpuGradients.push_back(gradients[i]->m_CPUMatrix);
+        cpuSmoothedGradients.push_back(smoothedGradients[i]->m_CPUMatrix);
+    }
+
+    // FSAdaGrad advances its normalization once per parameter, like a sequence of FSAdagrad() calls
+    ElemType fsAdaWeight = 0;
+    std::vector<ElemType> fsAdaMultipliers;
+    if (params.type == LearnerUpdateType::FSAdaGrad)
+    {
+        if (!params.fsAdaSmoothedFrames)
+            InvalidArgument("MultiTensorLearnerUpdate: FSAdaGrad needs the learner's smoothed #frames.");
+        fsAdaMultipliers.resize(values.size());
+        for (auto& multiplier : fsAdaMultipliers)
+            FSAdagradParameters(params.mbSize, *params.fsAdaSmoothedFrames, fsAdaWeight, multiplier);
+    }
+
+    CPUMatrix<ElemType>::MultiTensorLearnerUpdate(cpuValues, cpuGradients, cpuSmoothedGradients, params, fsAdaWeight, fsAdaMultipliers);
+    return true;
+}
+
 template <class ElemType>
 void Matrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
 {
@@ -4051,8 +4160,13 @@ void Matrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const Matrix<ElemT
     if (c.GetDeviceId() < 0) // CPU
     {
         if (a.GetMatrixType() == MatrixType::SPARSE)
-            NOT_IMPLEMENTED;
-        if (b.GetMatrixType() == MatrixType::SPARSE)
+        {
+            if (b.GetMatrixType() == MatrixType::SPARSE || c.GetMatrixType() != MatrixType::DENSE)
+                NOT_IMPLEMENTED;
+            CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(alpha, *a.m_CPUSparseMatrix, transposeA, *b.m_CPUMatrix, transposeB, beta, *c.m_CPUMatrix);
+            c.SetDataLocation(CPU, DENSE);
+        }
+        else if (b.GetMatrixType() == MatrixType::SPARSE)
         {
             if (c.GetMatrixType() == MatrixType::DENSE)
             {
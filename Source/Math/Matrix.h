@@ -85,6 +85,7 @@ private:
     static void DecideAndMoveToRightDevice(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& c);
     static void DecideAndMoveToRightDevice(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& c, const Matrix<ElemType>& d);
     static void CopyElementsFromDenseToSparse(CPUMatrix<ElemType>& from, CPUSparseMatrix<ElemType>& dest);
+    static void FSAdagradParameters(size_t mbSize, double& smoothedFrames, ElemType& adagradkeepweight, ElemType& targetadagradavdenom_x_sqrtadagradsqrframes);
 
 public:
     // Constructors, destructors and other static matrix builders
@@ -196,8 +197,10 @@ public:
     // TODO: all these scalars should be passed as doubles and cast down inside
     void NormalGrad(Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum, const bool useNAG);
     ElemType Adagrad(Matrix<ElemType>& gradients, const bool needAveMultiplier);
-    void FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum);
+    void FSAdagrad(size_t mbSize, Matrix<ElemType>& gradients, Matrix<ElemType>& functionValues, const ElemType learnRatePerSample, const ElemType momentum, double& smoothedFrames);
     ElemType RmsProp(Matrix<ElemType>& gradients, ElemType RMS_GAMMA, ElemType RMS_WGT_INC, ElemType RMS_WGT_MAX, ElemType RMS_WGT_DEC, ElemType RMS_WGT_MIN, const bool needAveMultiplier);
+    static bool MultiTensorLearnerUpdate(const std::vector<Matrix<ElemType>*>& values, const std::vector<Matrix<ElemType>*>& gradients,
+                                         const std::vector<Matrix<ElemType>*>& smoothedGradients, const LearnerUpdateParams& params);
 
     void Resize(const size_t numRows, const size_t numCols, const size_t numNZElemToReserve = 10000, bool growOnly = true); // by default we only reallocate if need to grow
     void Resize(const Matrix<ElemType>& other)
@@ -268,6 +271,12 @@ public:
     void SetGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
     void SetUniformRandomMask(const ElemType maskRate, const ElemType scaleValue, unsigned long seed = USE_TIME_BASED_SEED);
     void AddGaussianRandomValue(const ElemType mean, const ElemType sigma, unsigned long seed = USE_TIME_BASED_SEED);
+    // dropout with a mask that is regenerated from (seed, offset) instead of stored; CPU only, see CPUMatrix::AssignDropoutOf()
+    Matrix<ElemType>& AssignDropoutOf(const Matrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, unsigned long seed, size_t offset);
+    Matrix<ElemType>& AddDropoutOf(const Matrix<ElemType>& a, const ElemType maskRate, const ElemType scaleValue, unsigned long seed, size_t offset);
+    // use counter-based random numbers on the CPU (thread-count independent, parallel); see PhiloxRNG.h
+    static void SetCounterBasedRNG(bool enable);
+    static bool IsCounterBasedRNG();
     Matrix<ElemType>& AssignNoiseContrastiveEstimation(const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& c, const Matrix<ElemType>& bias, Matrix<ElemType>& tmp);
 
     Matrix<ElemType>& AssignNCEDerivative(const Matrix<ElemType>& tmp, const Matrix<ElemType>& a, const Matrix<ElemType>& b, const Matrix<ElemType>& c, size_t inputIndex);
@@ -0,0 +1,540 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NumaPlacement.cpp -- see NumaPlacement.h
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "NumaPlacement.h"
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _WIN32
+#include "Windows.h"
+#elif defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fstream>
+#include <string>
+#endif
+
+#ifdef _MSC_VER
+#define NUMA_THREAD_LOCAL __declspec(thread)
+#else
+#define NUMA_THREAD_LOCAL __thread
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace NumaPlacement {
+
+static Policy s_policy = Policy::None;
+static bool s_pinThreads = false;
+static NUMA_THREAD_LOCAL int t_node = -1; // node that the calling thread is bound to (ScopedNodeBinding), or -1
+
+void SetPolicy(Policy policy)
+{
+    s_policy = policy;
+}
+
+Policy GetPolicy()
+{
+    return s_policy;
+}
+
+Policy ParsePolicy(const char* name)
+{
+    if (strcmp(name, "none") == 0)
+        return Policy::None;
+    else if (strcmp(name, "firstTouch") == 0)
+        return Policy::FirstTouch;
+    else if (strcmp(name, "interleave") == 0)
+        return Policy::Interleave;
+    InvalidArgument("Invalid numaPolicy '%s'; must be 'none', 'firstTouch' or 'interleave'.", name);
+}
+
+void SetPinThreads(bool pinThreads)
+{
+    s_pinThreads = pinThreads;
+}
+
+bool GetPinThreads()
+{
+    return s_pinThreads;
+}
+
+// ---------------------------------------------------------------------------
+// topology (determined once)
+// ---------------------------------------------------------------------------
+
+struct Topology
+{
+    std::vector<int> nodeIds;            // OS ids of the nodes, ascending (they need not be contiguous)
+    std::vector<std::vector<int>> cpus;  // [node index] -> CPUs
+};
+
+#ifdef __linux__
+// parse a list like "0-15,32-47" as found in /sys
+static std::vector<int> ParseCPUList(const std::string& list)
+{
+    std::vector<int> result;
+    size_t pos = 0;
+    while (pos < list.size())
+    {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        if (!range.empty() && isdigit((unsigned char) range[0]))
+        {
+            int first = atoi(range.c_str());
+            int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+            for (int i = first; i <= last; i++)
+                result.push_back(i);
+        }
+        pos = end + 1;
+    }
+    return result;
+}
+
+static bool ReadLine(const std::string& path, std::string& line)
+{
+    std::ifstream f(path);
+    return f && std::getline(f, line);
+}
+#endif
+
+static Topology DetermineTopology()
+{
+    Topology topology;
+#ifdef __linux__
+    std::string online;
+    if (ReadLine("/sys/devices/system/node/online", online))
+    {
+        for (int node : ParseCPUList(online))
+        {
+            std::string cpuList;
+            if (!ReadLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", cpuList))
+                continue;
+            auto cpus = ParseCPUList(cpuList);
+            if (cpus.empty()) // (memory-only node)
+                continue;
+            topology.nodeIds.push_back(node);
+            topology.cpus.push_back(cpus);
+        }
+    }
+#elif defined(_WIN32)
+    ULONG highestNode;
+    if (GetNumaHighestNodeNumber(&highestNode))
+    {
+        for (ULONG node = 0; node <= highestNode; node++)
+        {
+            ULONGLONG mask;
+            if (!GetNumaNodeProcessorMask((UCHAR) node, &mask) || mask == 0) // (only the first processor group)
+                continue;
+            std::vector<int> cpus;
+            for (int i = 0; i < 64; i++)
+                if (mask & (1ull << i))
+                    cpus.push_back(i);
+            topology.nodeIds.push_back((int) node);
+            topology.cpus.push_back(cpus);
+        }
+    }
+#endif
+    if (topology.nodeIds.empty()) // unknown: one node with no CPU list
+    {
+        topology.nodeIds.push_back(0);
+        topology.cpus.push_back(std::vector<int>());
+    }
+    return topology;
+}
+
+static const Topology& GetTopology()
+{
+    static std::once_flag once;
+    static Topology* topology;
+    std::call_once(once, []()
+                   {
+                       topology = new Topology(DetermineTopology());
+                   });
+    return *topology;
+}
+
+size_t NumNodes()
+{
+    return GetTopology().nodeIds.size();
+}
+
+std::vector<int> CPUsOfNode(size_t node)
+{
+    const auto& topology = GetTopology();
+    if (node >= topology.cpus.size())
+        InvalidArgument("CPUsOfNode: node %d does not exist.", (int) node);
+    return topology.cpus[node];
+}
+
+// ---------------------------------------------------------------------------
+// threads
+// ---------------------------------------------------------------------------
+
+// the OS affinity of the calling thread, as an opaque byte array
+static bool GetThreadAffinity(std::vector<char>& affinity)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return false;
+    affinity.assign((const char*) &set, (const char*) &set + sizeof(set));
+    return true;
+#elif defined(_WIN32)
+    // Windows can only query it by setting it, so set it to itself
+    DWORD_PTR processMask, systemMask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        return false;
+    DWORD_PTR mask = SetThreadAffinityMask(GetCurrentThread(), processMask);
+    if (mask == 0)
+        return false;
+    SetThreadAffinityMask(GetCurrentThread(), mask);
+    affinity.assign((const char*) &mask, (const char*) &mask + sizeof(mask));
+    return true;
+#else
+    affinity;
+    return false;
+#endif
+}
+
+static bool SetThreadAffinity(const std::vector<char>& affinity)
+{
+#ifdef __linux__
+    if (affinity.size() != sizeof(cpu_set_t))
+        return false;
+    return sched_setaffinity(0, sizeof(cpu_set_t), (const cpu_set_t*) affinity.data()) == 0;
+#elif defined(_WIN32)
+    if (affinity.size() != sizeof(DWORD_PTR))
+        return false;
+    return SetThreadAffinityMask(GetCurrentThread(), *(const DWORD_PTR*) affinity.data()) != 0;
+#else
+    affinity;
+    return false;
+#endif
+}
+
+static bool SetThreadAffinity(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus)
+        if (cpu < (int) (8 * sizeof(mask)))
+            mask |= (DWORD_PTR) 1 << cpu;
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    cpus;
+    return false;
+#endif
+}
+
+// the CPUs the calling thread may run on, node by node (CPUs of no known node last)
+static std::vector<int> AllowedCPUsByNode()
+{
+    std::vector<int> allowed;
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return allowed;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            allowed.push_back(cpu);
+#elif defined(_WIN32)
+    std::vector<char> affinity;
+    if (!GetThreadAffinity(affinity))
+        return allowed;
+    DWORD_PTR mask = *(const DWORD_PTR*) affinity.data();
+    for (int cpu = 0; cpu < (int) (8 * sizeof(mask)); cpu++)
+        if (mask & ((DWORD_PTR) 1 << cpu))
+            allowed.push_back(cpu);
+#endif
+    std::vector<int> result;
+    for (const auto& nodeCPUs : GetTopology().cpus)
+        for (int cpu : nodeCPUs)
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+                result.push_back(cpu);
+    for (int cpu : allowed)
+        if (std::find(result.begin(), result.end(), cpu) == result.end())
+            result.push_back(cpu);
+    return result;
+}
+
+void PinOpenMPThreads()
+{
+#ifdef _OPENMP
+    if (!s_pinThreads)
+        return;
+    const std::vector<int> cpus = AllowedCPUsByNode();
+    if (cpus.size() <= 1)
+        return;
+#pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        if (t > 0) // (the master stays free, see header)
+            SetThreadAffinity(std::vector<int>(1, cpus[t % cpus.size()]));
+    }
+#endif
+}
+
+int NodeOfWorker(size_t worker, size_t numWorkers)
+{
+    const size_t numNodes = NumNodes();
+    if (!s_pinThreads || numNodes <= 1 || numWorkers == 0)
+        return -1;
+    return (int) (worker * numNodes / numWorkers);
+}
+
+int GetCurrentThreadNode()
+{
+    return t_node;
+}
+
+ScopedNodeBinding::ScopedNodeBinding(int node)
+    : m_node(node), m_prevNode(t_node)
+{
+    if (m_node < 0)
+        return;
+    if (!GetThreadAffinity(m_prevAffinity))
+        m_prevAffinity.clear();
+    Bind(m_node);
+}
+
+ScopedNodeBinding::~ScopedNodeBinding()
+{
+    if (m_node < 0)
+        return;
+    if (!m_prevAffinity.empty())
+        SetThreadAffinity(m_prevAffinity);
+    t_node = m_prevNode;
+}
+
+bool ScopedNodeBinding::Bind(int node)
+{
+    if (node < 0)
+        return false;
+    const auto& topology = GetTopology();
+    if ((size_t) node >= topology.nodeIds.size())
+        InvalidArgument("ScopedNodeBinding: node %d does not exist.", node);
+    t_node = node; // (allocations go to the node even if the thread cannot be confined to its CPUs)
+    return !topology.cpus[node].empty() && SetThreadAffinity(topology.cpus[node]);
+}
+
+// ---------------------------------------------------------------------------
+// memory
+// ---------------------------------------------------------------------------
+
+// Buffers of at least this size are placed: they get pages of their own (mmap/VirtualAlloc), so that they
+// are not placed already through memory that the heap recycles. Smaller ones are always on the heap.
+static const size_t placedBufferSize = 1 << 20;
+// transparent huge pages (x86-64) that buffers with 'hugePages' are aligned to
+static const size_t hugePageSize = 2 << 20;
+
+// the placed buffers and their sizes, to tell them from heap buffers when freed (the policy may have changed since)
+static std::mutex s_placedBuffersMutex;
+static std::unordered_map<void*, size_t> s_placedBuffers;
+static std::atomic<size_t> s_numPlacedBuffers(0);
+
+#ifdef __linux__
+// mbind() modes, from linux/mempolicy.h
+static const int mpolPreferred = 1;
+static const int mpolInterleave = 3;
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+
+// set the memory policy of a range of pages; fails e.g. on kernels without NUMA support, which is fine
+static bool MBind(void* p, size_t bytes, int mode, const std::vector<int>& nodeIds)
+{
+    const size_t bitsPerLong = 8 * sizeof(unsigned long);
+    int maxNodeId = *std::max_element(nodeIds.begin(), nodeIds.end());
+    std::vector<unsigned long> mask(maxNodeId / bitsPerLong + 1, 0);
+    for (int id : nodeIds)
+        mask[id / bitsPerLong] |= 1ul << (id % bitsPerLong);
+    return syscall(SYS_mbind, p, bytes, mode, mask.data(), mask.size() * bitsPerLong + 1, 0) == 0;
+}
+
+// mmap() 'bytes' bytes, starting at a multiple of 'alignment' (a multiple of the page size)
+static void* MapAligned(size_t bytes, size_t alignment)
+{
+    const size_t mappedBytes = bytes + alignment;
+    char* mapped = (char*) mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == (char*) MAP_FAILED)
+        return nullptr;
+    char* p = (char*) (((size_t) mapped + alignment - 1) & ~(alignment - 1));
+    char* end = p + bytes;
+    if (p > mapped)
+        munmap(mapped, p - mapped);
+    if (mapped + mappedBytes > end)
+        munmap(end, mapped + mappedBytes - end);
+    return p;
+}
+#endif
+
+static size_t PageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#elif defined(__linux__)
+    return (size_t) sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+}
+
+// fresh zero pages, placed for the calling thread's node or by the policy; nullptr if the OS does not give any
+// 'bytes' is a multiple of the page size.
+static void* AllocatePlaced(size_t bytes, int node, Policy policy, bool hugePages)
+{
+    const auto& topology = GetTopology();
+#if defined(_WIN32)
+    hugePages; // (large pages need a privilege that processes do not normally have)
+    void* p = node >= 0 ? VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, topology.nodeIds[node])
+                        : VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!p)
+        return nullptr;
+    if (policy == Policy::Interleave) // (not available; the next best thing)
+        policy = Policy::FirstTouch;
+#elif defined(__linux__)
+    void* p;
+    if (hugePages && bytes >= hugePageSize)
+    {
+        // aligned, so that all of it can be huge pages; the advice must come before the pages are touched
+        p = MapAligned(bytes, hugePageSize);
+        if (p)
+            madvise(p, bytes, MADV_HUGEPAGE); // (fails without transparent huge page support, which is fine)
+    }
+    else
+    {
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            p = nullptr;
+    }
+    if (!p)
+        return nullptr;
+    if (node >= 0)
+        MBind(p, bytes, mpolPreferred, std::vector<int>(1, topology.nodeIds[node]));
+    else if (policy == Policy::Interleave && topology.nodeIds.size() > 1)
+        MBind(p, bytes, mpolInterleave, topology.nodeIds);
+#else
+    return nullptr;
+#endif
+    // 'firstTouch': fault the pages in with the static schedule of the CPU kernels' loops, so that each thread's
+    // part of the buffer is on its node (a bound thread's buffers are on its node already, whoever touches them)
+    if (node < 0 && policy == Policy::FirstTouch)
+    {
+        const size_t pageSize = PageSize();
+        const long numPages = (long) (bytes / pageSize);
+        char* pages = (char*) p;
+#pragma omp parallel for schedule(static)
+        for (long i = 0; i < numPages; i++)
+            pages[i * pageSize] = 0;
+    }
+    return p;
+}
+
+void* Allocate(size_t bytes, bool hugePages)
+{
+    const int node = t_node;
+    const Policy policy = s_policy;
+    if (bytes >= placedBufferSize && (node >= 0 || policy != Policy::None || hugePages))
+    {
+        const size_t pageSize = PageSize();
+        const size_t placedBytes = (bytes + pageSize - 1) / pageSize * pageSize;
+        void* p = AllocatePlaced(placedBytes, node, policy, hugePages);
+        if (p)
+        {
+            std::lock_guard<std::mutex> lock(s_placedBuffersMutex);
+            s_placedBuffers[p] = placedBytes;
+            s_numPlacedBuffers++;
+            return p;
+        }
+    }
+    // aligned for SIMD and to cache lines; the C library's heap only guarantees 16 bytes
+    const size_t heapBytes = bytes > 0 ? bytes : 1;
+#ifdef _WIN32
+    void* p = _aligned_malloc(heapBytes, alignment);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, alignment, heapBytes) != 0)
+        p = nullptr;
+#endif
+    if (!p)
+        throw std::bad_alloc();
+    memset(p, 0, bytes);
+    return p;
+}
+
+void Free(void* p, size_t bytes)
+{
+    if (!p)
+        return;
+    // (a buffer of a caching allocator may be passed with the size that was asked for, at least half of that of the block)
+    if (bytes >= placedBufferSize / 2 && s_numPlacedBuffers > 0)
+    {
+        std::unique_lock<std::mutex> lock(s_placedBuffersMutex);
+        auto iter = s_placedBuffers.find(p);
+        if (iter != s_placedBuffers.end())
+        {
+            const size_t placedBytes = iter->second;
+            s_placedBuffers.erase(iter);
+            s_numPlacedBuffers--;
+            lock.unlock();
+#ifdef _WIN32
+            placedBytes;
+            VirtualFree(p, 0, MEM_RELEASE);
+#elif defined(__linux__)
+            munmap(p, placedBytes);
+#endif
+            return;
+        }
+    }
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+int NodeOfAddress(const void* p)
+{
+#ifdef __linux__
+    // move_pages() without target nodes reports where the pages are
+    const size_t pageSize = PageSize();
+    void* page = (void*) ((size_t) p & ~(pageSize - 1));
+    int status = -1;
+    if (syscall(SYS_move_pages, 0, 1, &page, nullptr, &status, 0) != 0 || status < 0)
+        return -1;
+    const auto& nodeIds = GetTopology().nodeIds;
+    auto iter = std::find(nodeIds.begin(), nodeIds.end(), status);
+    return iter == nodeIds.end() ? -1 : (int) (iter - nodeIds.begin());
+#else
+    p;
+    return -1;
+#endif
+}
+
+} } } }
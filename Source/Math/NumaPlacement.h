@@ -0,0 +1,121 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NumaPlacement.h -- where CPUMatrix buffers and CPU threads are placed on machines with several NUMA nodes
+//
+// On a multi-socket machine, each socket accesses its own memory faster than that of the others, and a thread that
+// the OS moves to another socket leaves its data behind. The functions here let
+//  - large CPUMatrix buffers be placed on purpose: spread over the threads that will use them ('firstTouch'),
+//    or page by page over all nodes ('interleave');
+//  - OpenMP threads be pinned to CPUs, so that they stay close to the pages they first touched;
+//  - pools of worker threads (localParallelTrain workers, concurrently evaluated models) be partitioned over the
+//    nodes, each worker with its threads and its replica's memory on one node.
+// The default is none of this, i.e. the behavior of the C library and the OS.
+//
+// On Linux, the topology is read from /sys and memory is placed with the mbind() system call (no libnuma needed).
+// On Windows, 'interleave' is not available and falls back to 'firstTouch'. Elsewhere, everything is a no-op.
+//
+
+#pragma once
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+#include <stddef.h>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace NumaPlacement {
+
+// ---------------------------------------------------------------------------
+// Policy -- how large CPUMatrix buffers (see Allocate()) are placed
+// ---------------------------------------------------------------------------
+
+enum class Policy
+{
+    None,       // zero-initialized on the heap by the allocating thread, as new[] does
+    FirstTouch, // fresh pages, zero-filled by the OpenMP threads in the static schedule that the CPU kernels use
+    Interleave  // fresh pages, interleaved over all nodes
+};
+MATH_API void SetPolicy(Policy policy);
+MATH_API Policy GetPolicy();
+// from a config string "none", "firstTouch" or "interleave"
+MATH_API Policy ParsePolicy(const char* name);
+
+// ---------------------------------------------------------------------------
+// topology
+// ---------------------------------------------------------------------------
+
+// number of NUMA nodes; 1 if the machine has only one, or it cannot be determined
+MATH_API size_t NumNodes();
+// the CPUs of a node (0 <= node < NumNodes()), as the OS numbers them
+MATH_API std::vector<int> CPUsOfNode(size_t node);
+
+// ---------------------------------------------------------------------------
+// threads
+// ---------------------------------------------------------------------------
+
+// whether threads are pinned (config option pinThreads); off by default
+MATH_API void SetPinThreads(bool pinThreads);
+MATH_API bool GetPinThreads();
+
+// if pinning is on: pin each thread of the OpenMP team of the calling thread to one of the CPUs the calling thread
+// may run on, the next ones to the next CPUs, node by node. The calling thread itself (the team's master) is left
+// free within its CPUs, so that threads it creates later are not confined to one CPU.
+// OpenMP runtimes keep a team's threads between parallel regions, so this lasts until the team size changes;
+// call it again after CPUMatrix::SetNumThreads[ForCurrentThread]().
+MATH_API void PinOpenMPThreads();
+
+// node of worker 'worker' out of 'numWorkers' in a thread pool that is partitioned over the nodes (contiguous
+// blocks of workers per node), or -1 if pinning is off or there is only one node
+MATH_API int NodeOfWorker(size_t worker, size_t numWorkers);
+
+// binds the calling thread to a NUMA node for the lifetime of the object: it only runs on the node's CPUs, and
+// buffers it allocates go to the node's memory (also with policy 'none'). Restores the previous state when
+// destroyed. node < 0 does nothing.
+// A pool thread that stays on its node for good can simply keep the object alive for its whole life, or call Bind().
+class MATH_API ScopedNodeBinding
+{
+public:
+    ScopedNodeBinding(int node);
+    ~ScopedNodeBinding();
+
+    // bind the calling thread for good (no restore); returns false if binding is not supported here
+    static bool Bind(int node);
+
+private:
+    ScopedNodeBinding(const ScopedNodeBinding&);
+    ScopedNodeBinding& operator=(const ScopedNodeBinding&);
+
+    int m_node;
+    int m_prevNode;
+    std::vector<char> m_prevAffinity; // saved OS affinity of the thread (opaque)
+};
+
+// node that the calling thread's allocations go to, or -1
+MATH_API int GetCurrentThreadNode();
+
+// ---------------------------------------------------------------------------
+// memory
+// ---------------------------------------------------------------------------
+
+// buffers from Allocate() are aligned to this (a cache line, and the widest SIMD registers)
+const size_t alignment = 64;
+
+// allocate a zero-initialized buffer of 'bytes' bytes according to the policy and the calling thread's node binding
+// Small buffers are always on the heap. With 'hugePages', large ones get pages of their own also without a policy,
+// and are backed by transparent huge pages where the OS supports it (Linux). Release with Free(), passing the same size.
+MATH_API void* Allocate(size_t bytes, bool hugePages = false);
+MATH_API void Free(void* p, size_t bytes);
+
+// node that holds the page at address p, or -1 if it cannot be determined (e.g. the page has not been touched yet)
+MATH_API int NodeOfAddress(const void* p);
+
+} } } }
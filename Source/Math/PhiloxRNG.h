@@ -0,0 +1,123 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// PhiloxRNG.h -- counter-based random number generation
+//
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC 2011) maps a (key, counter)
+// pair to four 32-bit random words through ten rounds of multiply/xor, without any state carried from one call to
+// the next. Value #i of a stream is therefore a pure function of the seed and i: a matrix can be filled in any order
+// and on any number of threads with identical results, and a dropout mask can be regenerated instead of stored.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct Philox4x32
+{
+    // the four random words for 'counter' of the stream 'key'
+    static inline void Generate(uint64_t key, uint64_t counter, uint32_t out[4])
+    {
+        uint32_t c0 = (uint32_t) counter, c1 = (uint32_t)(counter >> 32), c2 = 0, c3 = 0;
+        uint32_t k0 = (uint32_t) key, k1 = (uint32_t)(key >> 32);
+        for (int round = 0; round < 10; round++)
+        {
+            const uint64_t p0 = (uint64_t) 0xD2511F53 * c0;
+            const uint64_t p1 = (uint64_t) 0xCD9E8D57 * c2;
+            c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+            c1 = (uint32_t) p1;
+            c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+            c3 = (uint32_t) p0;
+            k0 += 0x9E3779B9; // Weyl sequence for the key schedule
+            k1 += 0xBB67AE85;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// PhiloxRandom<ElemType> -- uniform and normal values from Philox words
+// One counter yields ValuesPerCounter values: four for float (24 random bits each), two for double (53 bits).
+// Value #i of a stream comes from counter i / ValuesPerCounter.
+// ---------------------------------------------------------------------------
+
+template <class ElemType>
+struct PhiloxRandom;
+
+template <>
+struct PhiloxRandom<float>
+{
+    static const size_t ValuesPerCounter = 4;
+
+    // uniform in [0,1)
+    static inline float Uniform(const uint32_t* w)
+    {
+        return (w[0] >> 8) * (1.0f / 16777216.0f);
+    }
+    // uniform in (0,1], for log()
+    static inline float UniformNonZero(const uint32_t* w)
+    {
+        return ((w[0] >> 8) + 1) * (1.0f / 16777216.0f);
+    }
+    static inline void Uniform(uint64_t key, uint64_t counter, float out[4])
+    {
+        uint32_t w[4];
+        Philox4x32::Generate(key, counter, w);
+        for (size_t k = 0; k < 4; k++)
+            out[k] = Uniform(w + k);
+    }
+    // standard normal, by Box-Muller on pairs of words
+    static inline void Normal(uint64_t key, uint64_t counter, float out[4])
+    {
+        uint32_t w[4];
+        Philox4x32::Generate(key, counter, w);
+        for (size_t k = 0; k < 4; k += 2)
+        {
+            const float radius = sqrtf(-2.0f * logf(UniformNonZero(w + k)));
+            const float angle = 6.283185307179586f * Uniform(w + k + 1);
+            out[k] = radius * cosf(angle);
+            out[k + 1] = radius * sinf(angle);
+        }
+    }
+};
+
+template <>
+struct PhiloxRandom<double>
+{
+    static const size_t ValuesPerCounter = 2;
+
+    // uniform in [0,1), from two words
+    static inline double Uniform(const uint32_t* w)
+    {
+        return (((uint64_t) w[0] << 21) ^ (w[1] >> 11)) * (1.0 / 9007199254740992.0);
+    }
+    // uniform in (0,1], for log()
+    static inline double UniformNonZero(const uint32_t* w)
+    {
+        return ((((uint64_t) w[0] << 21) ^ (w[1] >> 11)) + 1) * (1.0 / 9007199254740992.0);
+    }
+    static inline void Uniform(uint64_t key, uint64_t counter, double out[2])
+    {
+        uint32_t w[4];
+        Philox4x32::Generate(key, counter, w);
+        out[0] = Uniform(w);
+        out[1] = Uniform(w + 2);
+    }
+    static inline void Normal(uint64_t key, uint64_t counter, double out[2])
+    {
+        uint32_t w[4];
+        Philox4x32::Generate(key, counter, w);
+        const double radius = sqrt(-2.0 * log(UniformNonZero(w)));
+        const double angle = 6.283185307179586 * Uniform(w + 2);
+        out[0] = radius * cos(angle);
+        out[1] = radius * sin(angle);
+    }
+};
+} } }
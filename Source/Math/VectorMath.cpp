@@ -0,0 +1,92 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// VectorMath.cpp -- array versions of the functions in VectorMath.h
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "VectorMath.h"
+
+// With gcc on x86-64 Linux, each array function is compiled for several instruction sets, and the dynamic loader
+// binds the best one for the CPU (via CPUID) on first use. Other compilers use the build's target instruction set.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && defined(__x86_64__) && defined(__linux__)
+#define VECTORMATH_MULTIVERSIONED __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define VECTORMATH_MULTIVERSIONED
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace VectorMath {
+
+static Mode s_mode = Mode::None;
+
+void SetMode(Mode mode)
+{
+    s_mode = mode;
+}
+
+Mode GetMode()
+{
+    return s_mode;
+}
+
+Mode ParseMode(const char* name)
+{
+    if (strcmp(name, "none") == 0)
+        return Mode::None;
+    else if (strcmp(name, "accurate") == 0)
+        return Mode::Accurate;
+    else if (strcmp(name, "fast") == 0)
+        return Mode::Fast;
+    InvalidArgument("Invalid vectorMath mode '%s'; must be 'none', 'accurate' or 'fast'.", name);
+}
+
+// the loops are kept trivial (no aliasing between a and c other than identity, unit stride) so that they vectorize
+#define DefArrayFunction(fn, ElemType)                                                                   \
+    VECTORMATH_MULTIVERSIONED void fn(const ElemType* a, ElemType* c, size_t n, bool fast)            \
+    {                                                                                                  \
+        if (fast)                                                                                      \
+            for (size_t i = 0; i < n; i++)                                                             \
+                c[i] = fn<true>(a[i]);                                                                 \
+        else                                                                                           \
+            for (size_t i = 0; i < n; i++)                                                             \
+                c[i] = fn<false>(a[i]);                                                                \
+    }
+
+DefArrayFunction(Exp, float);
+DefArrayFunction(Exp, double);
+DefArrayFunction(Log, float);
+DefArrayFunction(Log, double);
+DefArrayFunction(Tanh, float);
+DefArrayFunction(Tanh, double);
+DefArrayFunction(Sigmoid, float);
+DefArrayFunction(Sigmoid, double);
+DefArrayFunction(Log1p, float);
+DefArrayFunction(Log1p, double);
+#undef DefArrayFunction
+
+template <bool fast, class ElemType>
+static inline ElemType SumOfExpT(const ElemType* a, ElemType shift, size_t n)
+{
+    // 8 partial sums, so that the vectorized loop does not depend on the order of additions being changed
+    ElemType sums[8] = {0};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        for (size_t k = 0; k < 8; k++)
+            sums[k] += Exp<fast>(a[i + k] - shift);
+    for (; i < n; i++)
+        sums[0] += Exp<fast>(a[i] - shift);
+    return ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+}
+
+VECTORMATH_MULTIVERSIONED float SumOfExp(const float* a, float shift, size_t n, bool fast)
+{
+    return fast ? SumOfExpT<true>(a, shift, n) : SumOfExpT<false>(a, shift, n);
+}
+
+VECTORMATH_MULTIVERSIONED double SumOfExp(const double* a, double shift, size_t n, bool fast)
+{
+    return fast ? SumOfExpT<true>(a, shift, n) : SumOfExpT<false>(a, shift, n);
+}
+} } } }
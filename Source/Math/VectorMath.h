@@ -0,0 +1,288 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// VectorMath.h -- exp, log, tanh, sigmoid and log1p for the CPU that vectorize
+//
+// libm's functions are opaque calls, so loops over them run one element at a time. The functions here are
+// branch-free polynomial approximations (range reduction plus Cephes polynomials) written in plain C++; loops that
+// call them are vectorized by the compiler. The array versions in VectorMath.cpp are compiled for several
+// instruction sets (AVX-512, AVX2, baseline SSE) where the compiler supports it (gcc on x86-64 Linux), and
+// the best one is picked at load time from the CPUID; elsewhere they are compiled for the build's target.
+// (The double versions need AVX2 to vectorize; on baseline SSE they run scalar, still without branches.)
+//
+// Maximum error, measured against long-double libm over the whole input range:
+//
+//  function   accurate float   accurate double   fast float
+//  Exp        1 ulp            2 ulp             3.5e-6 relative
+//  Log        1 ulp            1 ulp             (as accurate)
+//  Tanh       2 ulp            2 ulp             1e-6 absolute
+//  Sigmoid    3 ulp            3 ulp             3.5e-6 relative
+//  Log1p      3 ulp            3 ulp             (as accurate)
+//
+// The accurate versions handle infinities, NaNs and denormals like libm. The fast versions (float only; for double
+// they are the accurate ones) use a shorter exp polynomial, clamp their inputs to the finite range, do not
+// propagate NaNs, and flush denormal results to zero.
+//
+
+#pragma once
+
+#ifdef _WIN32
+#ifdef MATH_EXPORTS
+#define MATH_API __declspec(dllexport)
+#else
+#define MATH_API __declspec(dllimport)
+#endif
+#else // no DLLs on Linux
+#define MATH_API
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace VectorMath {
+
+// ---------------------------------------------------------------------------
+// Mode -- whether CPU kernels (CPUMatrix, TensorOp, lattice forward-backward) use these functions
+// The default is libm, whose results existing setups were tuned and tested with.
+// ---------------------------------------------------------------------------
+
+enum class Mode
+{
+    None,     // libm
+    Accurate, // the accurate versions below
+    Fast      // the fast versions below
+};
+MATH_API void SetMode(Mode mode);
+MATH_API Mode GetMode();
+// from a config string "none", "accurate" or "fast"
+MATH_API Mode ParseMode(const char* name);
+
+// ---------------------------------------------------------------------------
+// bit-level helpers
+// ---------------------------------------------------------------------------
+
+static inline int32_t AsInt(float x)
+{
+    int32_t i;
+    memcpy(&i, &x, sizeof(i));
+    return i;
+}
+static inline float AsFloat(int32_t i)
+{
+    float x;
+    memcpy(&x, &i, sizeof(x));
+    return x;
+}
+static inline int64_t AsInt(double x)
+{
+    int64_t i;
+    memcpy(&i, &x, sizeof(i));
+    return i;
+}
+static inline double AsDouble(int64_t i)
+{
+    double x;
+    memcpy(&x, &i, sizeof(x));
+    return x;
+}
+
+// c ? a : b, as bit operations
+// Conditionals whose arms contain floating-point operations keep gcc from vectorizing a loop (they may trap), so
+// all values are computed unconditionally and then picked with Select().
+static inline float Select(bool c, float a, float b)
+{
+    const int32_t mask = -(int32_t) c;
+    return AsFloat((AsInt(a) & mask) | (AsInt(b) & ~mask));
+}
+static inline double Select(bool c, double a, double b)
+{
+    const int64_t mask = -(int64_t) c;
+    return AsDouble((AsInt(a) & mask) | (AsInt(b) & ~mask));
+}
+
+// 2^n for integral n in [-126, 127] resp. [-1022, 1023]
+static inline float Pow2f(int32_t n)
+{
+    return AsFloat((n + 127) << 23);
+}
+static inline double Pow2(int32_t n)
+{
+    return AsDouble((int64_t)(n + 1023) << 52);
+}
+
+// round to nearest (halfway away from zero); a conversion the compiler can vectorize, unlike floor()
+static inline int32_t RoundToInt(float x)
+{
+    return (int32_t)(x + Select(x >= 0, 0.5f, -0.5f));
+}
+static inline int32_t RoundToInt(double x)
+{
+    return (int32_t)(x + Select(x >= 0, 0.5, -0.5));
+}
+
+// ---------------------------------------------------------------------------
+// Exp
+// exp(x) = 2^n * exp(r) with r = x - n ln 2, |r| <= ln(2)/2. The scale 2^n is applied as two factors, so that
+// results near overflow and denormal results come out right.
+// ---------------------------------------------------------------------------
+
+template <bool fast>
+static inline float Exp(float x)
+{
+    const float hi = 88.72284f, lo = fast ? -87.33654f : -103.97208f; // fast: no denormal results
+    const float xc = Select(x < lo, lo, Select(x > hi, hi, Select(x != x, 0.0f, x)));
+    const int32_t n = RoundToInt(xc * 1.44269504088896341f);
+    const float r = (xc - n * 0.693359375f) - n * -2.12194440e-4f; // ln 2 in two parts, so that n ln 2 is exact
+    float p;
+    if (fast) // Taylor series up to r^5
+        p = ((((8.3333333e-3f * r + 4.1666667e-2f) * r + 1.6666667e-1f) * r + 0.5f) * r + 1.0f) * r + 1.0f;
+    else
+        p = (((((1.9875691500E-4f * r + 1.3981999507E-3f) * r + 8.3334519073E-3f) * r + 4.1665795894E-2f) * r + 1.6666665459E-1f) * r + 5.0000001201E-1f) * (r * r) + r + 1.0f;
+    const int32_t n1 = n >> 1;
+    const float y = Select(x < lo, 0.0f, p * Pow2f(n1) * Pow2f(n - n1));
+    if (fast)
+        return y;
+    return Select(x != x, x, Select(x > hi, AsFloat(0x7f800000) /*inf*/, y));
+}
+
+template <bool fast>
+static inline double Exp(double x)
+{
+    const double hi = 709.782712893384, lo = -745.1332191019412;
+    const double xc = Select(x < lo, lo, Select(x > hi, hi, Select(x != x, 0.0, x)));
+    const int32_t n = RoundToInt(xc * 1.4426950408889634073599);
+    const double r = (xc - n * 6.93145751953125E-1) - n * 1.42860682030941723212E-6;
+    // exp(r) = 1 + 2 r P(r^2) / (Q(r^2) - r P(r^2))
+    const double rr = r * r;
+    const double px = r * ((1.26177193074810590878E-4 * rr + 3.02994407707441961300E-2) * rr + 9.99999999999999999910E-1);
+    const double qx = ((3.00198505138664455042E-6 * rr + 2.52448340349684104192E-3) * rr + 2.27265548208155028766E-1) * rr + 2.00000000000000000009E0;
+    const double p = 1.0 + 2.0 * (px / (qx - px));
+    const int32_t n1 = n >> 1;
+    const double y = Select(x < lo, 0.0, p * Pow2(n1) * Pow2(n - n1));
+    return Select(x != x, x, Select(x > hi, AsDouble(0x7ff0000000000000ll) /*inf*/, y));
+}
+
+// ---------------------------------------------------------------------------
+// Log
+// log(x) = e ln 2 + log(m) with m in [sqrt(1/2), sqrt(2)); denormal inputs are scaled up first.
+// ---------------------------------------------------------------------------
+
+template <bool fast>
+static inline float Log(float x)
+{
+    const bool denormal = x < 1.17549435e-38f; // (also true for 0 and negative numbers, which are fixed up below)
+    const float xs = x * Select(denormal, 8388608.0f /*2^23*/, 1.0f);
+    const int32_t bits = AsInt(xs);
+    int32_t e = ((bits >> 23) & 0xff) - 126 - 23 * (int32_t) denormal;
+    float m = AsFloat((bits & 0x807fffff) | 0x3f000000); // in [0.5, 1)
+    const bool small = m < 0.707106781186547524f;
+    e -= (int32_t) small;
+    m = m + Select(small, m, 0.0f) - 1.0f;
+    const float z = m * m;
+    float y = ((((((((7.0376836292E-2f * m - 1.1514610310E-1f) * m + 1.1676998740E-1f) * m - 1.2420140846E-1f) * m + 1.4249322787E-1f) * m - 1.6668057665E-1f) * m + 2.0000714765E-1f) * m - 2.4999993993E-1f) * m + 3.3333331174E-1f) * m * z;
+    y += e * -2.12194440e-4f;
+    y += -0.5f * z;
+    const float r = m + y + e * 0.693359375f;
+    // special cases: log(0) = -inf, log(inf) = inf, log(x < 0) = nan, log(nan) = nan
+    const float special = Select(x == 0, AsFloat(0xff800000), Select((x > 0) | (x != x), x, AsFloat(0x7fc00000)));
+    return Select((x > 0) & (x < AsFloat(0x7f800000)), r, special);
+}
+
+template <bool fast>
+static inline double Log(double x)
+{
+    const bool denormal = x < 2.2250738585072014e-308;
+    const double xs = x * Select(denormal, 4503599627370496.0 /*2^52*/, 1.0);
+    const int64_t bits = AsInt(xs);
+    int32_t e = (int32_t)(((uint64_t) bits >> 52) & 0x7ff) - 1022 - 52 * (int32_t) denormal;
+    double m = AsDouble((bits & 0x800fffffffffffffll) | 0x3fe0000000000000ll); // in [0.5, 1)
+    const bool small = m < 0.70710678118654752440;
+    e -= (int32_t) small;
+    m = m + Select(small, m, 0.0) - 1.0;
+    const double z = m * m;
+    const double p = ((((1.01875663804580931796E-4 * m + 4.97494994976747001425E-1) * m + 4.70579119878881725854E0) * m + 1.44989225341610930846E1) * m + 1.79368678507819816313E1) * m + 7.70838733755885391666E0;
+    const double q = ((((m + 1.12873587189167450590E1) * m + 4.52279145837532221105E1) * m + 8.29875266912776603211E1) * m + 7.11544750618563894466E1) * m + 2.31251620126765340583E1;
+    double y = m * (z * p / q);
+    y += e * -2.121944400546905827679e-4;
+    y += -0.5 * z;
+    const double r = m + y + e * 0.693359375;
+    const double special = Select(x == 0, AsDouble((int64_t) 0xfff0000000000000ull), Select((x > 0) | (x != x), x, AsDouble(0x7ff8000000000000ll)));
+    return Select((x > 0) & (x < AsDouble(0x7ff0000000000000ll)), r, special);
+}
+
+// ---------------------------------------------------------------------------
+// Tanh, Sigmoid, Log1p
+// ---------------------------------------------------------------------------
+
+template <bool fast>
+static inline float Tanh(float x)
+{
+    const float ax = Select(x < 0, -x, x);
+    // small |x|: odd polynomial; otherwise 1 - 2 / (exp(2|x|) + 1)
+    const float z = x * x;
+    const float small = ((((-5.70498872745E-3f * z + 2.06390887954E-2f) * z - 5.37397155531E-2f) * z + 1.33314422036E-1f) * z - 3.33332819422E-1f) * z * x + x;
+    const float large = 1.0f - 2.0f / (Exp<fast>(ax + ax) + 1.0f);
+    return Select((ax < 0.625f) | (x != x), small, Select(x < 0, -large, large));
+}
+
+template <bool fast>
+static inline double Tanh(double x)
+{
+    const double ax = Select(x < 0, -x, x);
+    const double z = x * x;
+    const double p = (-9.64399179425052238628E-1 * z - 9.92877231001918586564E1) * z - 1.61468768441708447952E3;
+    const double q = ((z + 1.12811678491632931402E2) * z + 2.23548839060100448583E3) * z + 4.84406305325125486048E3;
+    const double small = x + x * z * (p / q);
+    const double large = 1.0 - 2.0 / (Exp<fast>(ax + ax) + 1.0);
+    return Select((ax < 0.625) | (x != x), small, Select(x < 0, -large, large));
+}
+
+// same formula as Sigmoid() in TensorOps.h
+template <bool fast, class ElemType>
+static inline ElemType Sigmoid(ElemType x)
+{
+    return 1 / (1 + Exp<fast>(-x));
+}
+
+// log(1 + x), accurate also for small x
+template <bool fast, class ElemType>
+static inline ElemType Log1p(ElemType x)
+{
+    const ElemType u = 1 + x;
+    // log(u) * x / (u - 1) cancels the rounding error of 1 + x (Goldberg)
+    const ElemType d = u - 1;
+    const ElemType logu = Log<fast>(u);
+    const ElemType r = logu * (x / Select(d == 0, (ElemType) 1, d));
+    return Select(d == 0, x, Select(u == x, logu /*large or inf*/, r));
+}
+
+// log(exp(x) + exp(y)), for log-domain accumulation
+template <bool fast, class ElemType>
+static inline ElemType LogAdd(ElemType x, ElemType y)
+{
+    const ElemType hi = Select(x < y, y, x);
+    const ElemType lo = Select(x < y, x, y);
+    return hi + Log1p<fast>(Exp<fast>(lo - hi));
+}
+
+// ---------------------------------------------------------------------------
+// array versions, c[i] = f(a[i]) for i in [0, n) (VectorMath.cpp)
+// 'a' and 'c' may be identical but must not otherwise overlap. Single-threaded.
+// ---------------------------------------------------------------------------
+
+MATH_API void Exp(const float* a, float* c, size_t n, bool fast);
+MATH_API void Exp(const double* a, double* c, size_t n, bool fast);
+MATH_API void Log(const float* a, float* c, size_t n, bool fast);
+MATH_API void Log(const double* a, double* c, size_t n, bool fast);
+MATH_API void Tanh(const float* a, float* c, size_t n, bool fast);
+MATH_API void Tanh(const double* a, double* c, size_t n, bool fast);
+MATH_API void Sigmoid(const float* a, float* c, size_t n, bool fast);
+MATH_API void Sigmoid(const double* a, double* c, size_t n, bool fast);
+MATH_API void Log1p(const float* a, float* c, size_t n, bool fast);
+MATH_API void Log1p(const double* a, double* c, size_t n, bool fast);
+// sum of exp(a[i] - shift), as needed for softmax
+MATH_API float SumOfExp(const float* a, float shift, size_t n, bool fast);
+MATH_API double SumOfExp(const double* a, double shift, size_t n, bool fast);
+} } } }
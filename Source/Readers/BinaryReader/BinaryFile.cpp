@@ -10,9 +10,18 @@
 #include "BinaryReader.h"
 #include <limits.h>
 #include <stdint.h>
+#include <float.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+#ifdef _WIN32
 // HIGH and LOW DWORD functions
 DWORD HIDWORD(size_t size)
 {
@@ -22,6 +31,7 @@ DWORD LODWORD(size_t size)
 {
     return size & 0xFFFFFFFF;
 }
+#endif
 
 // BinaryFile Constructor
 // fileName - file to read or create (if it doesn't exist)
@@ -29,22 +39,20 @@ DWORD LODWORD(size_t size)
 // size - size of the file to map, will expand/contract existing files to given size. zero means keep current size
 BinaryFile::BinaryFile(std::wstring fileName, FileOptions options, size_t size)
 {
-
+    m_writeFile = options == fileOptionsReadWrite;
+    m_name = fileName;
+    m_maxViewSize = 0x10000000; // 256MB initial max size
+#ifdef _WIN32
     SYSTEM_INFO sysInfo;
     GetSystemInfo(&sysInfo);
-    m_viewAlignment = sysInfo.dwAllocationGranularity;
+    m_viewAlignment = max((size_t) sysInfo.dwAllocationGranularity, viewAlignmentMin);
     /* If file created, continue to map file. */
 
-    m_writeFile = options == fileOptionsReadWrite;
-    m_name = fileName;
-    m_maxViewSize = 0x10000000; // 256MB initial max size
     m_hndFile = CreateFile(fileName.c_str(), m_writeFile ? (GENERIC_WRITE | GENERIC_READ) : GENERIC_READ,
                            FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     if (m_hndFile == INVALID_HANDLE_VALUE)
     {
-        char message[256];
-        sprintf_s(message, "Unable to Open/Create file %ls, error %x", fileName.c_str(), GetLastError());
-        RuntimeError(message);
+        RuntimeError("Unable to Open/Create file %ls, error %x", fileName.c_str(), GetLastError());
     }
 
     // code to detect type of file (network/local)
@@ -70,10 +78,41 @@ BinaryFile::BinaryFile(std::wstring fileName, FileOptions options, size_t size)
                           NULL);
     if (m_hndMapped == NULL)
     {
-        char message[256];
-        sprintf_s(message, "Unable to map file %ls, error 0x%x", fileName.c_str(), GetLastError());
-        RuntimeError(message);
+        RuntimeError("Unable to map file %ls, error 0x%x", fileName.c_str(), GetLastError());
+    }
+#else
+    m_viewAlignment = max((size_t) sysconf(_SC_PAGESIZE), viewAlignmentMin);
+
+    m_fd = open(msra::strfun::utf8(fileName).c_str(), m_writeFile ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if (m_fd < 0)
+    {
+        RuntimeError("Unable to Open/Create file %ls, error %d", fileName.c_str(), errno);
+    }
+
+    // get the actual size of the file
+    struct stat fileStat;
+    if (fstat(m_fd, &fileStat) != 0)
+    {
+        RuntimeError("Unable to get size of file %ls, error %d", fileName.c_str(), errno);
+    }
+    if (size == 0)
+    {
+        size = (size_t) fileStat.st_size;
     }
+    else if (size > (size_t) fileStat.st_size)
+    {
+        // unlike CreateFileMapping(), mmap() does not grow the file, nor does it fail for a read-only file that is too short
+        if (!m_writeFile)
+        {
+            RuntimeError("Unable to map file %ls, size %llu exceeds the file size %llu", fileName.c_str(), (unsigned long long) size, (unsigned long long) fileStat.st_size);
+        }
+        if (ftruncate(m_fd, (off_t) size) != 0)
+        {
+            RuntimeError("Unable to extend file %ls to %llu bytes, error %d", fileName.c_str(), (unsigned long long) size, errno);
+        }
+    }
+    m_filePositionMax = size;
+#endif
     m_mappedSize = size;
 
     // if writing the file, the inital size of the file is zero
@@ -91,6 +130,7 @@ BinaryFile::~BinaryFile()
         // the view
         iter = ReleaseView(iter, true);
     }
+#ifdef _WIN32
     CloseHandle(m_hndMapped);
 
     // if we are writing the file, truncate to actual size
@@ -100,6 +140,12 @@ BinaryFile::~BinaryFile()
         SetEndOfFile(m_hndFile);
     }
     CloseHandle(m_hndFile);
+#else
+    // if we are writing the file, truncate to actual size
+    if (m_writeFile && ftruncate(m_fd, (off_t) m_filePositionMax) != 0)
+        fprintf(stderr, "BinaryFile: Unable to truncate file %ls, error %d\n", m_name.c_str(), errno);
+    close(m_fd);
+#endif
 }
 
 void BinaryFile::SetFilePositionMax(size_t filePositionMax)
@@ -107,9 +153,7 @@ void BinaryFile::SetFilePositionMax(size_t filePositionMax)
     m_filePositionMax = filePositionMax;
     if (m_filePositionMax > m_mappedSize)
     {
-        char message[128];
-        sprintf_s(message, "Setting max position larger than mapped file size: %ld > %ld", m_filePositionMax, m_mappedSize);
-        RuntimeError(message);
+        RuntimeError("Setting max position larger than mapped file size: %llu > %llu", (unsigned long long) m_filePositionMax, (unsigned long long) m_mappedSize);
     }
 }
 
@@ -144,7 +188,7 @@ vector<ViewPosition>::iterator BinaryFile::FindDataView(void* data)
     auto iter = m_views.begin();
     for (; iter != m_views.end(); ++iter)
     {
-        byte* viewBegin = (byte*) iter->view;
+        char* viewBegin = (char*) iter->view;
         if (viewBegin <= data && viewBegin + iter->size > data)
             break;
     }
@@ -191,10 +235,15 @@ vector<ViewPosition>::iterator BinaryFile::ReleaseView(vector<ViewPosition>::ite
     }
     else
     {
+#ifdef _WIN32
         if (m_writeFile)
             FlushViewOfFile(iter->view, iter->size);
         bool ret = UnmapViewOfFile(iter->view) != FALSE;
         ret;
+#else
+        // (no msync() needed: the pages are shared with the page cache, which writes them back)
+        munmap(iter->view, iter->size);
+#endif
         iter = m_views.erase(iter);
     }
     return iter;
@@ -206,6 +255,7 @@ vector<ViewPosition>::iterator BinaryFile::ReleaseView(vector<ViewPosition>::ite
 // returns - pointer to the view
 void* BinaryFile::GetView(size_t filePosition, size_t size)
 {
+#ifdef _WIN32
     void* pBuf = MapViewOfFile(m_hndMapped,                                  // handle to map object
                                m_writeFile ? FILE_MAP_WRITE : FILE_MAP_READ, // get correct permissions
                                HIDWORD(filePosition),
@@ -213,10 +263,28 @@ void* BinaryFile::GetView(size_t filePosition, size_t size)
                                size);
     if (pBuf == NULL)
     {
-        char message[128];
-        sprintf_s(message, "Unable to map file %ls @ %lld, error %x", m_name.c_str(), filePosition, GetLastError());
-        RuntimeError(message);
+        RuntimeError("Unable to map file %ls @ %llu, error %x", m_name.c_str(), (unsigned long long) filePosition, GetLastError());
     }
+#else
+    // MapViewOfFile() fails for views beyond the mapping, while mmap() would return pages that fault (SIGBUS) on access;
+    // so check against the file's actual size, which may also have changed since it was opened
+    struct stat fileStat;
+    if (fstat(m_fd, &fileStat) != 0)
+    {
+        RuntimeError("Unable to get size of file %ls, error %d", m_name.c_str(), errno);
+    }
+    const size_t fileSize = min(m_mappedSize, (size_t) fileStat.st_size);
+    if (filePosition > fileSize || size > fileSize - filePosition)
+    {
+        RuntimeError("Unable to map file %ls @ %llu, view of %llu bytes exceeds the file size %llu",
+                     m_name.c_str(), (unsigned long long) filePosition, (unsigned long long) size, (unsigned long long) fileSize);
+    }
+    void* pBuf = mmap(NULL, size, m_writeFile ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m_fd, (off_t) filePosition);
+    if (pBuf == MAP_FAILED)
+    {
+        RuntimeError("Unable to map file %ls @ %llu, error %d", m_name.c_str(), (unsigned long long) filePosition, errno);
+    }
+#endif
     m_views.push_back(ViewPosition(pBuf, filePosition, size));
 
     // update file position max if neccesary
@@ -303,7 +371,7 @@ void* BinaryFile::EnsureMapped(void* data, size_t size)
     auto viewPos = FindDataView(data);
     if (viewPos != m_views.end())
     {
-        int64_t offset = (byte*) data - (byte*) viewPos->view;
+        int64_t offset = (char*) data - (char*) viewPos->view;
         int64_t dataEnd = offset + size;
 
         // if our end of data is beyond the size of the view, need to reallocate
@@ -312,7 +380,7 @@ void* BinaryFile::EnsureMapped(void* data, size_t size)
             // TODO: this view change only accomidates this request
             size_t filePosition = viewPos->filePosition;
             ReleaseView(viewPos);
-            byte* view = (byte*) GetView(filePosition, dataEnd);
+            char* view = (char*) GetView(filePosition, dataEnd);
             data = view + offset;
         }
     }
@@ -340,7 +408,7 @@ size_t BinaryFile::RoundUp(size_t filePosition)
 SectionFile::SectionFile(std::wstring fileName, FileOptions options, size_t size)
     : BinaryFile(fileName, options, size)
 {
-    m_fileSection = new Section(this, 0, NULL, mappingFile, sectionHeaderMin);
+    m_fileSection = new Section(this, NULL, 0, mappingFile, sectionHeaderMin);
     if (m_writeFile)
     {
         m_fileSection->InitHeader(sectionTypeFile, string("Binary Data File"), sectionDataNone, 0);
@@ -349,9 +417,7 @@ SectionFile::SectionFile(std::wstring fileName, FileOptions options, size_t size
     // check for a file header
     if (!m_fileSection->ValidateHeader(m_writeFile))
     {
-        char message[128];
-        sprintf_s(message, "Invalid File format for binary file %ls", fileName.c_str());
-        RuntimeError(message);
+        RuntimeError("Invalid File format for binary file %ls", fileName.c_str());
     }
 }
 
@@ -389,7 +455,7 @@ void Section::InitHeader(SectionType type, std::string description, SectionData
     m_sectionHeader->flags = flagNone;                                                  // bit flags, dependent on sectionType
     m_sectionHeader->elementsCount = 0;                                                 // number of total elements stored
     memset(m_sectionHeader->nameDescription, 0, descriptionSize);                       // clear out the string buffer to all zeros first
-    strcpy_s(m_sectionHeader->nameDescription, description.c_str());                    // name and description of section contents in this format (name: description) (string, with extra bytes zeroed out, at least one null terminator required)
+    strcpy_s(m_sectionHeader->nameDescription, descriptionSize, description.c_str()); // name and description of section contents in this format (name: description) (string, with extra bytes zeroed out, at least one null terminator required)
     m_sectionHeader->size = sectionHeaderMin;                                           // size of this section (including header)
     m_sectionHeader->sizeAll = sectionHeaderMin;                                        // size of this section (including header and all sub-sections)
     m_sectionHeader->sectionFilePosition[0] = 0;                                        // sub-section file offsets (if needed), assumed to be in File Position order
@@ -497,9 +563,7 @@ Section* Section::ReadSection(size_t index, MappingType mapping, size_t sizeElem
     // make sure the header is valid
     if (!section->ValidateHeader())
     {
-        char message[256];
-        sprintf_s(message, "Invalid header in file %ls, in header %s\n", m_file->GetName(), section->GetName());
-        RuntimeError(message);
+        RuntimeError("Invalid header in file %ls, in header %ls", m_file->GetName().c_str(), section->GetName().c_str());
     }
 
     // setup the element mapping and pointers as needed
@@ -536,9 +600,7 @@ char* Section::EnsureElements(size_t element, size_t bytesRequested)
     size_t elementsRequested = bytesRequested / GetElementSize();
     if (element + elementsRequested > GetElementCount())
     {
-        char message[256];
-        sprintf_s(message, "Element out of range, error accesing element %lld, size=%lld\n", element, bytesRequested);
-        RuntimeError(message);
+        RuntimeError("Element out of range, error accesing element %llu, size=%llu", (unsigned long long) element, (unsigned long long) bytesRequested);
     }
 
     // make sure we have the buffer in the range to handle the request
@@ -559,9 +621,7 @@ char* Section::GetElementBuffer(size_t element, size_t windowSize)
     // check element range
     if (!m_file->Writing() && element >= GetElementCount())
     {
-        char message[256];
-        sprintf_s(message, "Element out of range, error accesing element %lld, max element=%lld\n", element, GetElementCount());
-        RuntimeError(message);
+        RuntimeError("Element out of range, error accesing element %llu, max element=%llu", (unsigned long long) element, (unsigned long long) GetElementCount());
     }
 
     // section is mapped as a whole, so no separate mapping for element buffer
@@ -700,7 +760,7 @@ void* Section::EnsureMapped(void* dataStart, size_t size)
         // Element Window is mapped separately so won't no need to remap
         if (m_mappingType != mappingElementWindow)
         {
-            int64_t offset = (byte*) view - (byte*) dataStart;
+            int64_t offset = (char*) view - (char*) dataStart;
             m_sectionHeader = (SectionHeader*) ((char*) m_sectionHeader + offset);
             m_elementBuffer = (char*) m_sectionHeader + m_sectionHeader->sizeHeader;
             RemapHeader(m_sectionHeader, m_filePosition);
@@ -1069,9 +1129,7 @@ void SectionString::SetLabelMapping(const std::map<SectionString::LabelIdType, S
         auto iter = labelMapping.find(i);
         if (iter == labelMapping.end())
         {
-            char message[256];
-            sprintf_s(message, "Mapping table doesn't contain an entry for label Id#%d\n", i);
-            RuntimeError(message);
+            RuntimeError("Mapping table doesn't contain an entry for label Id#%d", i);
         }
 
         // add to reverse mapping table
@@ -1081,9 +1139,7 @@ void SectionString::SetLabelMapping(const std::map<SectionString::LabelIdType, S
         errno_t err = strcpy_s(curStr, size, str.c_str());
         if (err)
         {
-            char message[256];
-            sprintf_s(message, "Not enough room in mapping buffer, %lld bytes insufficient for string %d - %s\n", originalSize, i, str.c_str());
-            RuntimeError(message);
+            RuntimeError("Not enough room in mapping buffer, %llu bytes insufficient for string %d - %s", (unsigned long long) originalSize, i, str.c_str());
         }
         size_t len = str.length() + 1; // don't forget the null
         size -= len;
@@ -1103,9 +1159,7 @@ void* SectionString::GetElement(size_t index) const
     char* str = (char*) m_elementBuffer;
     if (index >= GetElementCount())
     {
-        char message[256];
-        sprintf_s(message, "GetElement: invalid index, %lld requested when there are only %lld elements\n", index, GetElementCount());
-        RuntimeError(message);
+        RuntimeError("GetElement: invalid index, %llu requested when there are only %llu elements", (unsigned long long) index, (unsigned long long) GetElementCount());
     }
 
     // now skip all the strings before the one that we want
@@ -1129,9 +1183,7 @@ char* SectionString::EnsureElements(size_t element, size_t bytesRequested)
     assert(GetMappingType() != mappingElementWindow); // not supported for string tables currently
     if (element >= GetElementCount())
     {
-        char message[256];
-        sprintf_s(message, "Element out of range, error accesing element %lld, size=%lld\n", element, bytesRequested);
-        RuntimeError(message);
+        RuntimeError("Element out of range, error accesing element %llu, size=%llu", (unsigned long long) element, (unsigned long long) bytesRequested);
     }
 
     // make sure we have the buffer in the range to handle the request
@@ -1220,7 +1272,7 @@ void SectionStats::InitCompute(const ConfigArray& compute)
     {
         std::string name = compute[i];
         auto stat = GetElement<NumericStatistics>(i);
-        strcpy_s(stat->statistic, name.c_str());
+        strcpy_s(stat->statistic, _countof(stat->statistic), name.c_str());
         stat->value = 0.0;
     }
 
@@ -52,6 +52,8 @@ void BinaryReader<ElemType>::LoadSections(Section* sectionRoot, MappingType mapp
 //  # reader to use
 //  readerType=BinaryReader
 //  miniBatchMode=Partial
+//  # reshuffle the records for every sweep over the data: None (file order, the default), Auto (all of them), or a window size
+//  randomize=None
 //  file={,
 //    c:\speech\mnist\mnist_features.bin
 //      c:\speech\mnist\mnist_labels.bin
@@ -128,6 +130,24 @@ void BinaryReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig
     std::string minibatchMode(readerConfig(L"minibatchMode", "Partial"));
     m_partialMinibatch = !_stricmp(minibatchMode.c_str(), "Partial");
 
+    // determine the randomization (the windows are limited to the dataset)
+    std::string randomizeString(readerConfig(L"randomize", "None"));
+    if (!_stricmp(randomizeString.c_str(), "none"))
+        m_randomizeRange = 0;
+    else if (!_stricmp(randomizeString.c_str(), "auto"))
+        m_randomizeRange = m_totalSamples;
+    else
+    {
+        size_t randomizeRange = readerConfig(L"randomize");
+        m_randomizeRange = min(randomizeRange, m_totalSamples);
+    }
+    if (m_randomizeRange > 0)
+    {
+        if (mOneLinePerFile)
+            InvalidArgument("BinaryReader: 'randomize' is not supported with 'onelineperfile'.");
+        m_randomordering.Resize(m_totalSamples, m_randomizeRange);
+    }
+
     // Initial load is complete
     DisplayProperties();
 }
@@ -185,14 +205,20 @@ BinaryReader<ElemType>::~BinaryReader()
     }
 }
 
-//StartMinibatchLoop - Startup a minibatch loop
+//StartDistributedMinibatchLoop - Startup a minibatch loop
 // mbSize - [in] size of the minibatch (number of Samples, etc.)
 // epoch - [in] epoch number for this loop, if > 0 the requestedEpochSamples must be specified (unless epoch zero was completed this run)
+// subsetNum - [in] the subset number of the current node in a group of parallel training nodes
+// numSubsets - [in] total number of nodes participating in the parallel training
 // requestedEpochSamples - [in] number of samples to randomize, defaults to requestDataSize which uses the number of samples there are in the dataset
 //   this value must be a multiple of mbSize, if it is not, it will be rounded up to one.
 template <class ElemType>
-void BinaryReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples)
+void BinaryReader<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples)
 {
+    if (subsetNum >= numSubsets)
+        InvalidArgument("BinaryReader: subset %d out of range (%d subsets)", (int) subsetNum, (int) numSubsets);
+    m_subsetNum = subsetNum;
+    m_numSubsets = numSubsets;
     m_mbSize = mbSize;
     if (requestedEpochSamples == requestDataSize)
     {
@@ -209,9 +235,10 @@ void BinaryReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, siz
 
 // CheckEndDataset - Check to see if we have arrived at the end of the dataset
 // actualmbsize - [in] the actual size of the dataset we are requesting,
+//                [out] reduced to what is left of the epoch and the dataset
 // returns - true if there we hit dataset end, false otherwise
 template <class ElemType>
-bool BinaryReader<ElemType>::CheckEndDataset(size_t actualmbsize)
+bool BinaryReader<ElemType>::CheckEndDataset(size_t& actualmbsize)
 {
     size_t epochEnd = m_epochSize;
     size_t epochSample = m_mbStartSample % m_epochSize;
@@ -264,6 +291,14 @@ bool BinaryReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType
     if (endOfDataset)
         return false;
 
+    // There may be multiple parallel trainers reading at the same time, in which case we
+    // only touch the records of the current trainer's share; the other pages of the file are never mapped
+    size_t currSubsetStartCol = (actualmbsize * m_subsetNum) / m_numSubsets;
+    size_t currSubsetEndCol = (actualmbsize * (m_subsetNum + 1)) / m_numSubsets;
+    size_t currSubsetSize = currSubsetEndCol - currSubsetStartCol;
+    // Every sample is returned as a sequence of 1 frame.
+    m_pMBLayout->InitAsFrameMode(currSubsetSize);
+
     for (auto value : matrices)
     {
         wstring matrixName = value.first;
@@ -313,18 +348,41 @@ bool BinaryReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType
                 RuntimeError("Category Labels not saved in file, either save, or support creation in BinaryReader");
             }
         }
-        size_t size = rows * dataSize * actualmbsize;
-        size_t index = epochStartSample * section->GetElementsPerRecord();
-        ElemType* data = (ElemType*) section->EnsureElements(index, size);
-        // ElemType* data = section->GetElement<ElemType>(epochStartSample*section->GetElementsPerRecord());
-        // data = (ElemType*)section->EnsureMapped(data, size);
-
         // make sure that the data is as expected
         if (!!(section->GetFlags() & flagAuxilarySection) || section->GetElementSize() != sizeof(ElemType))
         {
             RuntimeError("GetMinibatch: Section %ls Auxilary section specified, and/or element size %lld mismatch", section->GetName().c_str(), section->GetElementSize());
         }
-        gpuData->SetValue(rows, actualmbsize, gpuData->GetDeviceId(), data);
+
+        // a trainer may get no records of a small last minibatch; that is still a valid (empty) minibatch
+        if (currSubsetSize == 0)
+        {
+            gpuData->Resize(rows, 0);
+            continue;
+        }
+
+        if (m_randomizeRange > 0)
+        {
+            // gather the records in the order of this sweep (seeded by the sweep, so that every sweep is shuffled differently)
+            m_randomizedRecords.resize(rows * currSubsetSize);
+            for (size_t j = 0; j < currSubsetSize; j++)
+            {
+                const size_t sample = m_mbStartSample + currSubsetStartCol + j;
+                const size_t record = m_randomordering(sample / m_totalSamples)[sample % m_totalSamples];
+                const ElemType* recordData = (const ElemType*) section->EnsureElements(record * section->GetElementsPerRecord(), rows * dataSize);
+                memcpy(&m_randomizedRecords[j * rows], recordData, rows * dataSize);
+            }
+            gpuData->SetValue(rows, currSubsetSize, gpuData->GetDeviceId(), m_randomizedRecords.data());
+            continue;
+        }
+
+        size_t size = rows * dataSize * currSubsetSize;
+        size_t index = (epochStartSample + currSubsetStartCol) * section->GetElementsPerRecord();
+        ElemType* data = (ElemType*) section->EnsureElements(index, size);
+        // ElemType* data = section->GetElement<ElemType>(epochStartSample*section->GetElementsPerRecord());
+        // data = (ElemType*)section->EnsureMapped(data, size);
+
+        gpuData->SetValue(rows, currSubsetSize, gpuData->GetDeviceId(), data);
     }
 
     // advance to the next minibatch
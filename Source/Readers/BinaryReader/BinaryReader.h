@@ -8,6 +8,7 @@
 #include "DataReader.h"
 #include "DataWriter.h"
 #include "Config.h"
+#include "RandomOrdering.h"
 #include <string>
 #include <map>
 #include <vector>
@@ -99,6 +100,10 @@ struct SectionHeader
 
 const int sectionHeaderMin = ((sizeof(SectionHeader) + 64 - 1) / 64) * 64;
 
+// Views are aligned to at least 64K, the allocation granularity on Windows, since section positions in the file are
+// rounded up to it. That way, files can be exchanged between platforms.
+const size_t viewAlignmentMin = 0x10000;
+
 enum LabelKind
 {
     labelNone = 0,       // no labels to worry about
@@ -130,8 +135,12 @@ struct ViewPosition
 class BinaryFile
 {
 protected:
+#ifdef _WIN32
     HANDLE m_hndFile;         // handle to the file
     HANDLE m_hndMapped;       // handle to the mapped file object
+#else
+    int m_fd;                 // the file, mapped with mmap()
+#endif
     size_t m_mappedSize;      // size of mapped file (zero for size of file being read)
     size_t m_maxViewSize;     // maximum size we want a single view to contain
     size_t m_viewAlignment;   // address alignment required by views
@@ -556,6 +565,15 @@ private:
     bool m_partialMinibatch;   // a partial minibatch is allowed
     MBLayoutPtr m_pMBLayout;
 
+    // distributed reading: this worker only maps and copies its own share of the records of each minibatch
+    size_t m_subsetNum;
+    size_t m_numSubsets;
+
+    // randomization: the records are reshuffled for every sweep over the dataset, within windows of this many (0: file order)
+    size_t m_randomizeRange;
+    RandomOrdering m_randomordering;
+    std::vector<ElemType> m_randomizedRecords; // the records of one input gathered for a minibatch
+
     int m_traceLevel;
     vector<SectionFile*> m_secFiles;
     std::map<std::wstring, Section*, nocase_compare> m_sections;
@@ -570,7 +588,7 @@ private:
     void SetupEpoch();
     void LoadSections(Section* parentSection, MappingType mapping, size_t windowSize);
     void DisplayProperties();
-    bool CheckEndDataset(size_t actualmbsize);
+    bool CheckEndDataset(size_t& actualmbsize);
 
 public:
     template <class ConfigRecordType>
@@ -585,22 +603,29 @@ public:
     }
     virtual void Destroy();
     BinaryReader()
-        : m_pMBLayout(make_shared<MBLayout>())
+        : m_pMBLayout(make_shared<MBLayout>()), m_subsetNum(0), m_numSubsets(1), m_randomizeRange(0)
     {
     }
     virtual ~BinaryReader();
-    virtual void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize);
+    virtual void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize)
+    {
+        return StartDistributedMinibatchLoop(mbSize, epoch, 0, 1, requestedEpochSamples);
+    }
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return true;
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override;
     virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices);
 
     size_t GetNumParallelSequences()
     {
-        return 1;
+        return m_pMBLayout->GetNumParallelSequences();
     }
     void SetNumParallelSequences(const size_t){};
     void CopyMBLayoutTo(MBLayoutPtr pMBLayout)
     {
         pMBLayout->CopyFrom(m_pMBLayout);
-        NOT_IMPLEMENTED;
     }
     virtual const std::map<LabelIdType, LabelType>& GetLabelMapping(const std::wstring& sectionName);
     virtual void SetLabelMapping(const std::wstring& sectionName, const std::map<typename BinaryReader<ElemType>::LabelIdType, typename BinaryReader<ElemType>::LabelType>& labelMapping);
@@ -613,6 +638,141 @@ public:
     };
 };
 
+// CachingReader - write-through cache of the minibatches of any reader in a section file
+// Configured by a 'cache' block of a reader (see DataReader), which wraps the reader in a CachingReader:
+//  cache=[
+//    file=c:\speech\mnist\mnist_train.cache.bin
+//    # upper bound of the number of records of the dataset; the file is laid out for this many (where the
+//    # file system supports sparse files, e.g. on Linux, the space of records that were not read is not allocated)
+//    maxRecords=60000
+//    # reshuffle the cached records for every sweep over them, as the wrapped reader would: Auto (all of them, the
+//    # default), a window size (to keep paging local), or None (replay them in the order of the pass that wrote them)
+//    randomize=Auto
+//  ]
+// A pass over the whole dataset (requestDataSize) that is not distributed is read from the wrapped reader and
+// written to the cache file as it goes; once the pass is complete, the record count is patched in, and all later
+// passes are served from the mapped file by a BinaryReader, without touching the wrapped reader. If the file exists
+// already, it is used from the start.
+// Only frame-mode data in dense matrices can be cached; for anything else the wrapped reader is used throughout.
+template <class ElemType>
+class CachingReader : public IDataReader<ElemType>
+{
+    typedef typename IDataReader<ElemType>::LabelType LabelType;
+    typedef typename IDataReader<ElemType>::LabelIdType LabelIdType;
+
+private:
+    IDataReader<ElemType>* m_source;       // the wrapped reader (owned)
+    std::wstring m_fileName;               // cache file
+    size_t m_maxRecords;                   // capacity of the cache file being written
+    std::string m_randomize;               // passed on to m_cacheReader
+    int m_traceLevel;
+    BinaryReader<ElemType>* m_cacheReader; // reads the complete cache file
+    bool m_reading;                        // the current pass is served by m_cacheReader
+    bool m_cachable;                       // false once the data turned out not to be cachable
+
+    // the cache file being written during a pass over the wrapped reader
+    bool m_writing;
+    std::wstring m_tempFileName;
+    SectionFile* m_writeFile;
+    std::map<std::wstring, Section*, nocase_compare> m_writeSections;
+    size_t m_recordsWritten;
+    MBLayoutPtr m_pMBLayout;
+
+    template <class ConfigRecordType>
+    void InitFromConfig(const ConfigRecordType&);
+    bool StartPass(size_t numSubsets, size_t requestedEpochSamples);
+    void OpenCache();
+    void WriteMinibatch(const std::map<std::wstring, Matrix<ElemType>*>& matrices);
+    void FinishWriting();
+    void AbortWriting();
+    void DisableCaching(const char* reason);
+
+public:
+    CachingReader(IDataReader<ElemType>* source)
+        : m_source(source), m_maxRecords(0), m_traceLevel(0), m_cacheReader(nullptr), m_reading(false), m_cachable(true),
+          m_writing(false), m_writeFile(nullptr), m_recordsWritten(0), m_pMBLayout(make_shared<MBLayout>())
+    {
+    }
+    virtual ~CachingReader();
+    // the configuration is the 'cache' block; the wrapped reader is initialized already
+    virtual void Init(const ConfigParameters& config) override
+    {
+        InitFromConfig(config);
+    }
+    virtual void Init(const ScriptableObjects::IConfigRecord& config) override
+    {
+        InitFromConfig(config);
+    }
+    virtual void Destroy() override; // (also destroys the wrapped reader)
+
+    virtual void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize) override;
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return m_cacheReader != nullptr ? m_cacheReader->SupportsDistributedMBRead() : m_source->SupportsDistributedMBRead();
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override;
+    virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices) override;
+
+    virtual size_t GetNumParallelSequences() override
+    {
+        return m_reading ? m_cacheReader->GetNumParallelSequences() : m_source->GetNumParallelSequences();
+    }
+    virtual void SetNumParallelSequences(const size_t sz) override
+    {
+        m_source->SetNumParallelSequences(sz);
+    }
+    virtual void CopyMBLayoutTo(MBLayoutPtr pMBLayout) override
+    {
+        if (m_reading)
+            m_cacheReader->CopyMBLayoutTo(pMBLayout);
+        else
+            m_source->CopyMBLayoutTo(pMBLayout);
+    }
+    virtual bool DataEnd(EndDataType endDataType) override
+    {
+        return m_reading ? m_cacheReader->DataEnd(endDataType) : m_source->DataEnd(endDataType);
+    }
+    virtual bool RequireSentenceSeg() const override
+    {
+        return m_source->RequireSentenceSeg();
+    }
+    virtual int GetSentenceEndIdFromOutputLabel() override
+    {
+        return m_source->GetSentenceEndIdFromOutputLabel();
+    }
+    virtual void SetRandomSeed(unsigned seed = 0) override
+    {
+        m_source->SetRandomSeed(seed);
+    }
+    // label mappings and other data besides the minibatches are not cached
+    virtual const std::map<LabelIdType, LabelType>& GetLabelMapping(const std::wstring& sectionName) override
+    {
+        return m_source->GetLabelMapping(sectionName);
+    }
+    virtual void SetLabelMapping(const std::wstring& sectionName, const std::map<LabelIdType, LabelType>& labelMapping) override
+    {
+        m_source->SetLabelMapping(sectionName, labelMapping);
+    }
+    virtual bool GetData(const std::wstring& sectionName, size_t numRecords, void* data, size_t& dataBufferSize, size_t recordStart = 0) override
+    {
+        return m_source->GetData(sectionName, numRecords, data, dataBufferSize, recordStart);
+    }
+
+    // data that depends on more than the input matrices cannot be cached; a pass that uses it is not written
+    virtual bool GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, vector<size_t>& extrauttmap) override;
+    virtual bool GetMinibatchCopy(std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo, std::map<std::wstring, Matrix<ElemType>*>& matrices, MBLayoutPtr pMBLayout) override;
+    virtual bool SetNetOutput(const std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo, const Matrix<ElemType>& outputs, const MBLayoutPtr pMBLayout) override
+    {
+        return m_reading ? false : m_source->SetNetOutput(uttInfo, outputs, pMBLayout);
+    }
+
+    // true if passes are served from the cache file
+    bool IsCached() const
+    {
+        return m_cacheReader != nullptr;
+    }
+};
+
 template <class ElemType>
 class BinaryWriter : public IDataWriter<ElemType>
 {
@@ -683,7 +843,9 @@ public:
 
 // utility function to round an integer up to a multiple of size
 size_t RoundUp(size_t value, size_t size);
+#ifdef _WIN32
 // HIGH and LOW DWORD functions
 DWORD HIDWORD(size_t size);
 DWORD LODWORD(size_t size);
+#endif
 } } }
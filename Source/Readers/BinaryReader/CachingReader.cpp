@@ -0,0 +1,279 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CachingReader.cpp : write-through cache of any reader in a section file (see BinaryReader.h)
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#define DATAREADER_EXPORTS
+#include "DataReader.h"
+#include "BinaryReader.h"
+#include "fileutil.h"
+#include <random>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// PublishFile - move the completed file 'from' to 'to' in one step, replacing 'to' if it exists already
+// Other processes see either no file, or a complete one; if several write the same cache, the last one wins. On Windows, a
+// cache file that another process has open cannot be replaced; that one is complete as well, and is used instead.
+static void PublishFile(const std::wstring& from, const std::wstring& to)
+{
+#ifdef _WIN32
+    if (!MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        const DWORD error = GetLastError();
+        if (error != ERROR_ACCESS_DENIED && error != ERROR_SHARING_VIOLATION)
+            RuntimeError("CachingReader: error moving '%ls' to '%ls': %d", from.c_str(), to.c_str(), (int) error);
+        unlinkOrDie(from);
+    }
+#else
+    renameOrDie(from, to); // (rename() replaces atomically)
+#endif
+}
+
+// InitFromConfig - initialize from the 'cache' block of a reader configuration
+// If the cache file exists, it is used right away.
+template <class ElemType>
+template <class ConfigRecordType>
+void CachingReader<ElemType>::InitFromConfig(const ConfigRecordType& config)
+{
+    wstring fileName = config(L"file");
+    m_fileName = fileName;
+    m_maxRecords = config(L"maxRecords", (size_t) 0);
+    m_traceLevel = config(L"traceLevel", 0);
+    std::string randomize(config(L"randomize", "Auto"));
+    m_randomize = randomize;
+    if (m_maxRecords == 0 && !fexists(m_fileName))
+        InvalidArgument("CachingReader: 'maxRecords' is required to write the cache file '%ls'.", m_fileName.c_str());
+    if (fexists(m_fileName))
+        OpenCache();
+}
+
+template <class ElemType>
+CachingReader<ElemType>::~CachingReader()
+{
+    AbortWriting();
+    if (m_cacheReader)
+        m_cacheReader->Destroy();
+}
+
+// Destroy - cleanup and remove this class and the wrapped reader
+// NOTE: this destroys the object, and it can't be used past this point
+template <class ElemType>
+void CachingReader<ElemType>::Destroy()
+{
+    m_source->Destroy();
+    delete this;
+}
+
+// OpenCache - open the complete cache file for reading
+template <class ElemType>
+void CachingReader<ElemType>::OpenCache()
+{
+    ConfigParameters config;
+    config.Insert(L"file", msra::strfun::utf8(m_fileName));
+    config.Insert(L"traceLevel", msra::strfun::strprintf("%d", m_traceLevel));
+    config.Insert(L"randomize", m_randomize);
+    auto cacheReader = new BinaryReader<ElemType>();
+    try
+    {
+        cacheReader->Init(config);
+    }
+    catch (...)
+    {
+        cacheReader->Destroy();
+        throw;
+    }
+    m_cacheReader = cacheReader;
+    fprintf(stderr, "CachingReader: reading from cache file '%ls'.\n", m_fileName.c_str());
+}
+
+// DisableCaching - give up on caching for the data of the wrapped reader, e.g. if it is not in frame mode
+template <class ElemType>
+void CachingReader<ElemType>::DisableCaching(const char* reason)
+{
+    fprintf(stderr, "CachingReader: not caching to '%ls', since %s.\n", m_fileName.c_str(), reason);
+    AbortWriting();
+    m_cachable = false;
+}
+
+// StartPass - start a pass; returns true if it is served from the cache file, otherwise the caller starts the wrapped reader
+// A pass over the whole dataset that is not distributed, and not served from the cache, is written to it.
+template <class ElemType>
+bool CachingReader<ElemType>::StartPass(size_t numSubsets, size_t requestedEpochSamples)
+{
+    AbortWriting(); // (the previous pass was not read to its end)
+    m_reading = m_cacheReader != nullptr;
+    m_writing = !m_reading && m_cachable && numSubsets == 1 && requestedEpochSamples == requestDataSize;
+    m_recordsWritten = 0;
+    return m_reading;
+}
+
+template <class ElemType>
+void CachingReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples)
+{
+    if (StartPass(1, requestedEpochSamples))
+        m_cacheReader->StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+    else
+        m_source->StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+}
+
+template <class ElemType>
+void CachingReader<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples)
+{
+    if (StartPass(numSubsets, requestedEpochSamples))
+        m_cacheReader->StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples);
+    else
+        m_source->StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples);
+}
+
+// GetMinibatch - Get the next minibatch, from the cache file or from the wrapped reader (and then write it to the cache file)
+// matrices - [in] a map with named matrix types (i.e. 'features', 'labels') mapped to the corresponding matrix,
+//             [out] each matrix resized if necessary containing data.
+// returns - true if there are more minibatches, false if no more minibatchs remain
+template <class ElemType>
+bool CachingReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices)
+{
+    if (m_reading)
+        return m_cacheReader->GetMinibatch(matrices);
+
+    bool wasDataRead = m_source->GetMinibatch(matrices);
+    if (m_writing)
+    {
+        if (wasDataRead)
+            WriteMinibatch(matrices);
+        else
+            FinishWriting();
+    }
+    return wasDataRead;
+}
+
+// WriteMinibatch - append the records of a minibatch to the cache file
+// The file and its sections (one per input) are created for the first minibatch, laid out for 'maxRecords' records.
+template <class ElemType>
+void CachingReader<ElemType>::WriteMinibatch(const std::map<std::wstring, Matrix<ElemType>*>& matrices)
+{
+    // each record is a sample, which is also what BinaryReader assumes when reading
+    m_source->CopyMBLayoutTo(m_pMBLayout);
+    const size_t numRecords = m_pMBLayout->GetNumParallelSequences();
+    bool frameMode = m_pMBLayout->GetNumTimeSteps() == 1 && m_pMBLayout->GetAllSequences().size() == numRecords;
+    for (const auto& seq : m_pMBLayout->GetAllSequences())
+        frameMode &= seq.tBegin == 0 && seq.tEnd == 1;
+    if (!frameMode)
+        return DisableCaching("the data is not in frame mode");
+    for (const auto& iter : matrices)
+    {
+        if (iter.second->GetMatrixType() != MatrixType::DENSE)
+            return DisableCaching("a sparse input cannot be cached");
+        if (iter.second->GetNumCols() != numRecords)
+            return DisableCaching("the number of columns of an input differs from the number of samples");
+        if (iter.second->GetNumRows() > USHRT_MAX)
+            return DisableCaching("an input has more rows than a section can hold"); // (elementsPerRecord is a WORD)
+    }
+    if (m_recordsWritten + numRecords > m_maxRecords)
+        return DisableCaching("the dataset has more records than 'maxRecords'");
+
+    if (!m_writeFile)
+    {
+        // the sections start at multiples of the view alignment
+        size_t fileSize = 2 * viewAlignmentMin;
+        for (const auto& iter : matrices)
+            fileSize += (iter.second->GetNumRows() * m_maxRecords * sizeof(ElemType) + sectionHeaderMin + viewAlignmentMin - 1) / viewAlignmentMin * viewAlignmentMin;
+        m_tempFileName = msra::strfun::wstrprintf(L"%ls.%d.%08x.tmp", m_fileName.c_str(), (int) GetCurrentProcessId(), (unsigned int) std::random_device()());
+        m_writeFile = new SectionFile(m_tempFileName, fileOptionsReadWrite, fileSize);
+        Section* parent = m_writeFile->FileSection();
+        for (const auto& iter : matrices)
+        {
+            const size_t dim = iter.second->GetNumRows();
+            const size_t dataSize = dim * m_maxRecords * sizeof(ElemType) + sectionHeaderMin;
+            Section* section = new Section(m_writeFile, parent, m_writeFile->RoundUp(m_writeFile->GetFilePositionMax()), mappingElementWindow, dataSize);
+            section->InitHeader(sectionTypeData, msra::strfun::utf8(iter.first) + ":Data Section", sectionDataFloat, sizeof(ElemType));
+            section->SetElementsPerRecord(dim);
+            section->SetElementCount(dim * m_maxRecords);
+            section->SetSize(dataSize);
+            section->SetSizeAll(dataSize);
+            m_writeFile->SetFilePositionMax(section->GetFilePosition() + dataSize);
+            parent->AddSection(section);
+            m_writeSections[iter.first] = section;
+        }
+    }
+    if (matrices.size() != m_writeSections.size())
+        return DisableCaching("the set of inputs changed during the pass");
+
+    for (const auto& iter : matrices)
+    {
+        auto found = m_writeSections.find(iter.first);
+        if (found == m_writeSections.end() || found->second->GetElementsPerRecord() != iter.second->GetNumRows())
+            return DisableCaching("the set of inputs changed during the pass");
+        Section* section = found->second;
+        const size_t dim = iter.second->GetNumRows();
+        if (numRecords == 0)
+            continue;
+        // copied right into the mapped view (with a buffer of the exact size, CopyToArray() does not reallocate)
+        ElemType* data = (ElemType*) section->EnsureElements(m_recordsWritten * dim, numRecords * dim * sizeof(ElemType));
+        size_t dataSize = numRecords * dim;
+        iter.second->CopyToArray(data, dataSize);
+    }
+    m_recordsWritten += numRecords;
+}
+
+// FinishWriting - the pass is complete: patch in the number of records, move the file in place, and read all further passes from it
+template <class ElemType>
+void CachingReader<ElemType>::FinishWriting()
+{
+    m_writing = false;
+    if (!m_writeFile || m_recordsWritten == 0)
+        return AbortWriting();
+
+    m_writeFile->FileSection()->SetElementCount(m_recordsWritten);
+    for (const auto& iter : m_writeSections)
+        iter.second->SetElementCount(m_recordsWritten * iter.second->GetElementsPerRecord());
+    m_writeSections.clear();
+    delete m_writeFile; // (marks the file complete, and writes it out)
+    m_writeFile = nullptr;
+
+    PublishFile(m_tempFileName, m_fileName);
+    fprintf(stderr, "CachingReader: wrote %d records to cache file '%ls'.\n", (int) m_recordsWritten, m_fileName.c_str());
+    OpenCache();
+}
+
+// AbortWriting - discard a partially written cache file
+template <class ElemType>
+void CachingReader<ElemType>::AbortWriting()
+{
+    m_writing = false;
+    if (!m_writeFile)
+        return;
+    m_writeSections.clear();
+    delete m_writeFile;
+    m_writeFile = nullptr;
+    unlinkOrDie(m_tempFileName);
+}
+
+template <class ElemType>
+bool CachingReader<ElemType>::GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, vector<size_t>& extrauttmap)
+{
+    if (m_reading)
+        LogicError("CachingReader: sequence-training data is not cached");
+    if (m_writing)
+        DisableCaching("sequence-training data cannot be cached");
+    return m_source->GetMinibatch4SE(latticeinput, uids, boundaries, extrauttmap);
+}
+
+template <class ElemType>
+bool CachingReader<ElemType>::GetMinibatchCopy(std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo, std::map<std::wstring, Matrix<ElemType>*>& matrices, MBLayoutPtr pMBLayout)
+{
+    if (m_reading)
+        return false;
+    bool wasDataRead = m_source->GetMinibatchCopy(uttInfo, matrices, pMBLayout);
+    if (wasDataRead && m_writing)
+        DisableCaching("sequence-training data cannot be cached");
+    return wasDataRead;
+}
+
+// instantiate all the combinations we expect to be used
+template class CachingReader<double>;
+template class CachingReader<float>;
+} } }
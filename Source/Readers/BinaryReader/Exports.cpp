@@ -29,6 +29,22 @@ extern "C" DATAREADER_API void GetReaderD(IDataReader<double>** preader)
     GetReader(preader);
 }
 
+// wrap an initialized reader in a write-through cache (see CachingReader)
+template <class ElemType>
+void DATAREADER_API GetCachingReader(IDataReader<ElemType>* source, IDataReader<ElemType>** preader)
+{
+    *preader = new CachingReader<ElemType>(source);
+}
+
+extern "C" DATAREADER_API void GetCachingReaderF(IDataReader<float>* source, IDataReader<float>** preader)
+{
+    GetCachingReader(source, preader);
+}
+extern "C" DATAREADER_API void GetCachingReaderD(IDataReader<double>* source, IDataReader<double>** preader)
+{
+    GetCachingReader(source, preader);
+}
+
 template <class ElemType>
 void DATAWRITER_API GetWriter(IDataWriter<ElemType>** pwriter)
 {
@@ -102,6 +102,7 @@ template <class ConfigRecordType>
 void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType& readerConfig)
 {
     vector<wstring> scriptpaths;
+    vector<wstring> packedArchivePaths;
     vector<wstring> RootPathInScripts;
     wstring RootPathInLatticeTocs;
     vector<wstring> mlfpaths;
@@ -169,6 +170,7 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
 
         m_featureNameToIdMap[featureNames[i]] = iFeat;
         scriptpaths.push_back(thisFeature(L"scpFile"));
+        packedArchivePaths.push_back(thisFeature(L"packedArchive", L""));
         RootPathInScripts.push_back(thisFeature(L"prefixPathInSCP", L""));
         m_featureNameToDimMap[featureNames[i]] = m_featDims[i];
 
@@ -455,8 +457,21 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
         m_lattices->setverbosity(m_verbosity);
 
         // now get the frame source. This has better randomization and doesn't create temp files
-        m_frameSource.reset(new msra::dbn::minibatchutterancesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, *m_lattices, m_latticeMap, m_frameMode));
+        auto utteranceSource = new msra::dbn::minibatchutterancesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, *m_lattices, m_latticeMap, m_frameMode);
+        m_frameSource.reset(utteranceSource);
         m_frameSource->setverbosity(m_verbosity);
+
+        // optionally page in upcoming chunks on background threads, so that chunk boundaries do not stall training
+        size_t readAheadChunks = readerConfig(L"readAheadChunks", (size_t) 0);
+        if (readAheadChunks > 0)
+            utteranceSource->setreadahead(readAheadChunks, readerConfig(L"maxReadAheadInFlight", (size_t) 2));
+
+        // optionally read features from packed chunk archives (created from the SCP on first use)
+        if (std::any_of(packedArchivePaths.begin(), packedArchivePaths.end(), [](const wstring& path)
+                        {
+                            return !path.empty();
+                        }))
+            utteranceSource->usepackedarchives(packedArchivePaths, readerConfig(L"packedArchiveCompression", false));
     }
     else if (!_wcsicmp(readMethod.c_str(), L"rollingWindow"))
     {
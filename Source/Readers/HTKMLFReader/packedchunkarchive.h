@@ -0,0 +1,328 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// packedchunkarchive.h -- packed archive of HTK features, one contiguous block per randomization chunk
+//
+// Paging a chunk from an SCP means one open/seek/read per utterance, plus per-frame decompression of
+// compressed HTK files. A packed chunk archive instead stores each chunk as a single aligned block that
+// is read with one large read and then converted in a tight loop.
+//
+// File layout (native byte order):
+//  - header: magic "PCHKARC1", version, flags, feature kind/dim/period, #chunks, offset of the index
+//  - chunk blocks, each starting at a multiple of 'blockalignment':
+//     - uncompressed: float[numframes][featdim]
+//     - compressed:   float scale[featdim], float offset[featdim], int16 data[numframes][featdim]
+//                     where value = data * scale + offset (per-chunk, per-dimension linear quantization)
+//  - index: per chunk its block offset and #frames, followed by key and #frames of each utterance
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "basetypes.h"
+#include "fileutil.h"
+#include <string>
+#include <vector>
+#include <limits>
+#include <random>
+#include <stdint.h>
+
+namespace msra { namespace asr {
+
+class packedchunkarchivebase
+{
+protected:
+    static const char *magic()
+    {
+        return "PCHKARC1";
+    }
+    static const uint32_t version = 1;
+    static const uint32_t flagcompressed = 1;
+    static const uint64_t blockalignment = 4096; // chunk blocks start at multiples of this (page size), so they can be read or mapped directly
+    static const size_t featkindsize = 32;       // fixed-size field for the feature-kind string
+
+    struct chunkentry
+    {
+        uint64_t offset;                 // byte offset of the chunk block in the file
+        uint64_t numframes;              // total #frames of the chunk
+        std::vector<std::wstring> keys;  // logical paths of the utterances, for validation against the SCP
+        std::vector<size_t> uttframes;   // #frames of each utterance
+    };
+
+    string featkind;
+    size_t featdim;
+    unsigned int sampperiod;
+    bool compressed;
+    std::vector<chunkentry> chunks;
+
+    size_t blockbytes(size_t numframes) const
+    {
+        if (compressed)
+            return 2 * featdim * sizeof(float) + numframes * featdim * sizeof(int16_t);
+        else
+            return numframes * featdim * sizeof(float);
+    }
+
+    packedchunkarchivebase()
+        : featdim(0), sampperiod(0), compressed(false)
+    {
+    }
+};
+
+// ---------------------------------------------------------------------------
+// packedchunkarchivewriter -- create a packed chunk archive, chunk by chunk
+// The archive is written to a temp file which is renamed upon close(), so an interrupted conversion never leaves a valid-looking archive.
+// The temp file name is unique to the writer, so that several processes (e.g. MPI ranks sharing a file system) can convert
+// concurrently; the first one to finish publishes its archive, the others discard theirs.
+// ---------------------------------------------------------------------------
+
+class packedchunkarchivewriter : protected packedchunkarchivebase
+{
+    auto_file_ptr f;
+    std::wstring path;
+    std::wstring tmppath;
+    std::vector<int16_t> quantized; // (buffer)
+
+    void writeheader(uint64_t indexoffset)
+    {
+        fsetpos(f, (uint64_t) 0);
+        fwriteOrDie(magic(), 1, 8, f);
+        fput(f, version);
+        fput(f, (uint32_t)(compressed ? flagcompressed : 0));
+        char kind[featkindsize] = {0};
+        strncpy(kind, featkind.c_str(), featkindsize - 1);
+        fwriteOrDie(kind, 1, featkindsize, f);
+        fput(f, (uint64_t) featdim);
+        fput(f, (uint32_t) sampperiod);
+        fput(f, (uint64_t) chunks.size());
+        fput(f, indexoffset);
+    }
+    void padtoalignment()
+    {
+        const uint64_t pos = fgetpos(f);
+        const uint64_t padding = (blockalignment - pos % blockalignment) % blockalignment;
+        static const char zeros[blockalignment] = {0};
+        if (padding > 0)
+            fwriteOrDie(zeros, 1, (size_t) padding, f);
+    }
+
+public:
+    packedchunkarchivewriter(const std::wstring &path, const string &featkind, size_t featdim, unsigned int sampperiod, bool compressed)
+        : path(path), tmppath(msra::strfun::wstrprintf(L"%ls.%d.%08x.tmp", path.c_str(), (int) GetCurrentProcessId(), (unsigned int) std::random_device()()))
+    {
+        this->featkind = featkind;
+        this->featdim = featdim;
+        this->sampperiod = sampperiod;
+        this->compressed = compressed;
+        if (featkind.size() >= featkindsize)
+            InvalidArgument("packedchunkarchivewriter: feature kind '%s' too long", featkind.c_str());
+        f = fopenOrDie(tmppath, L"wb");
+        writeheader(0); // placeholder; rewritten by close()
+    }
+
+    // append one chunk
+    // 'frames' holds all frames of the chunk's utterances consecutively, one frame per column, in the order of 'keys'.
+    template <class MATRIX>
+    void writechunk(const std::vector<std::wstring> &keys, const std::vector<size_t> &uttframes, const MATRIX &frames)
+    {
+        if (keys.size() != uttframes.size())
+            LogicError("writechunk: keys and frame counts inconsistent");
+        if (frames.rows() != featdim)
+            LogicError("writechunk: feature dimension mismatch (%d vs. %d)", (int) frames.rows(), (int) featdim);
+        padtoalignment();
+        chunkentry entry;
+        entry.offset = fgetpos(f);
+        entry.numframes = frames.cols();
+        entry.keys = keys;
+        entry.uttframes = uttframes;
+
+        if (!compressed)
+        {
+            for (size_t t = 0; t < frames.cols(); t++)
+                fwriteOrDie(&frames(0, t), sizeof(float), featdim, f);
+        }
+        else
+        {
+            // per-dimension linear quantization over the whole chunk
+            std::vector<float> scale(featdim), offset(featdim);
+            for (size_t k = 0; k < featdim; k++)
+            {
+                float minval = std::numeric_limits<float>::max();
+                float maxval = -std::numeric_limits<float>::max();
+                for (size_t t = 0; t < frames.cols(); t++)
+                {
+                    minval = min(minval, frames(k, t));
+                    maxval = max(maxval, frames(k, t));
+                }
+                offset[k] = (minval + maxval) / 2;
+                scale[k] = maxval > minval ? (maxval - minval) / 65534.0f : 1.0f; // maps the range onto [-32767, 32767]
+            }
+            fwriteOrDie(scale, f);
+            fwriteOrDie(offset, f);
+            quantized.resize(featdim);
+            for (size_t t = 0; t < frames.cols(); t++)
+            {
+                for (size_t k = 0; k < featdim; k++)
+                {
+                    float q = (frames(k, t) - offset[k]) / scale[k];
+                    quantized[k] = (int16_t) floor(max(-32767.0f, min(32767.0f, q)) + 0.5f);
+                }
+                fwriteOrDie(quantized, f);
+            }
+        }
+        chunks.push_back(std::move(entry));
+    }
+
+    // write the index and make the archive visible under its final name, unless another writer has done so meanwhile
+    void close()
+    {
+        padtoalignment();
+        const uint64_t indexoffset = fgetpos(f);
+        for (const auto &chunk : chunks)
+        {
+            fput(f, chunk.offset);
+            fput(f, chunk.numframes);
+            fput(f, (uint64_t) chunk.keys.size());
+            for (size_t i = 0; i < chunk.keys.size(); i++)
+            {
+                fput(f, (uint64_t) chunk.uttframes[i]);
+                fputstring(f, chunk.keys[i]);
+            }
+        }
+        writeheader(indexoffset);
+        if (fclose(f) != 0)
+            RuntimeError("packedchunkarchivewriter: error closing file '%ls'", tmppath.c_str());
+        if (fexists(path)) // (another process converted the same data; its archive may already be open, so keep it)
+            unlinkOrDie(tmppath);
+        else
+            renameOrDie(tmppath, path);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// packedchunkarchive -- read access to a packed chunk archive
+// Not thread-safe; callers serialize readchunk() calls.
+// ---------------------------------------------------------------------------
+
+class packedchunkarchive : protected packedchunkarchivebase
+{
+    auto_file_ptr f;
+    std::wstring path;
+    std::vector<char> buffer; // (chunk block is read into here in one go)
+
+public:
+    packedchunkarchive(const std::wstring &path)
+        : path(path)
+    {
+        f = fopenOrDie(path, L"rb");
+        char filemagic[8];
+        freadOrDie(filemagic, 1, 8, f);
+        if (memcmp(filemagic, magic(), 8) != 0)
+            RuntimeError("packedchunkarchive: '%ls' is not a packed chunk archive", path.c_str());
+        uint32_t fileversion, flags, period;
+        fget(f, fileversion);
+        if (fileversion != version)
+            RuntimeError("packedchunkarchive: '%ls' has unsupported version %d", path.c_str(), (int) fileversion);
+        fget(f, flags);
+        compressed = (flags & flagcompressed) != 0;
+        char kind[featkindsize];
+        freadOrDie(kind, 1, featkindsize, f);
+        kind[featkindsize - 1] = 0;
+        featkind = kind;
+        uint64_t dim, numchunks, indexoffset;
+        fget(f, dim);
+        fget(f, period);
+        fget(f, numchunks);
+        fget(f, indexoffset);
+        featdim = (size_t) dim;
+        sampperiod = period;
+        if (indexoffset == 0)
+            RuntimeError("packedchunkarchive: '%ls' is incomplete", path.c_str());
+
+        // read the index
+        fsetpos(f, indexoffset);
+        chunks.resize((size_t) numchunks);
+        for (auto &chunk : chunks)
+        {
+            uint64_t numutts;
+            fget(f, chunk.offset);
+            fget(f, chunk.numframes);
+            fget(f, numutts);
+            chunk.keys.resize((size_t) numutts);
+            chunk.uttframes.resize((size_t) numutts);
+            for (size_t i = 0; i < numutts; i++)
+            {
+                uint64_t n;
+                fget(f, n);
+                chunk.uttframes[i] = (size_t) n;
+                chunk.keys[i] = fgetwstring(f);
+            }
+        }
+    }
+
+    size_t numchunks() const
+    {
+        return chunks.size();
+    }
+    const string &getfeatkind() const
+    {
+        return featkind;
+    }
+    size_t getfeatdim() const
+    {
+        return featdim;
+    }
+    unsigned int getsampperiod() const
+    {
+        return sampperiod;
+    }
+    bool iscompressed() const
+    {
+        return compressed;
+    }
+    const std::vector<std::wstring> &chunkkeys(size_t c) const
+    {
+        return chunks[c].keys;
+    }
+    const std::vector<size_t> &chunkuttframes(size_t c) const
+    {
+        return chunks[c].uttframes;
+    }
+
+    // read chunk 'c' into 'frames', which must already be sized [featdim x #frames of the chunk]
+    // The whole block is fetched with a single read; decompression is a straight multiply-add over contiguous arrays.
+    template <class MATRIX>
+    void readchunk(size_t c, MATRIX &frames)
+    {
+        const auto &chunk = chunks[c];
+        if (frames.rows() != featdim || frames.cols() != chunk.numframes)
+            LogicError("readchunk: target matrix has wrong dimensions");
+        const size_t numframes = (size_t) chunk.numframes;
+        buffer.resize(blockbytes(numframes));
+        fsetpos(f, chunk.offset);
+        freadOrDie(buffer.data(), 1, buffer.size(), f);
+
+        if (!compressed)
+        {
+            const float *data = (const float *) buffer.data();
+            for (size_t t = 0; t < numframes; t++)
+                memcpy(&frames(0, t), data + t * featdim, featdim * sizeof(float));
+        }
+        else
+        {
+            const float *scale = (const float *) buffer.data();
+            const float *offset = scale + featdim;
+            const int16_t *data = (const int16_t *) (offset + featdim);
+            for (size_t t = 0; t < numframes; t++)
+            {
+                float *out = &frames(0, t);
+                const int16_t *in = data + t * featdim;
+                for (size_t k = 0; k < featdim; k++) // (simple enough for the compiler to vectorize)
+                    out[k] = in[k] * scale[k] + offset[k];
+            }
+        }
+    }
+};
+};
+};
@@ -9,10 +9,14 @@
 
 #include "Basics.h"         // for attempt()
 #include "htkfeatio.h"      // for htkmlfreader
+#include "packedchunkarchive.h"
 #include "latticearchive.h" // for reading HTK phoneme lattices (MMI training)
 #include "minibatchsourcehelpers.h"
 #include "minibatchiterator.h"
 #include "unordered_set"
+#include <future>
+#include <mutex>
+#include <map>
 
 namespace msra { namespace dbn {
 
@@ -87,10 +91,12 @@ class minibatchutterancesourcemulti : public minibatchsource
         mutable msra::dbn::matrix frames;                                           // stores all frames consecutively (mutable since this is a cache)
         size_t totalframes;                                                         // total #frames for all utterances in this chunk
         mutable std::vector<shared_ptr<const latticesource::latticepair>> lattices; // (may be empty if none)
+        msra::asr::packedchunkarchive *archive;                                     // if not null then features are read from this chunk of a packed chunk archive
+        size_t archivechunk;
 
         // construction
         utterancechunkdata()
-            : totalframes(0)
+            : totalframes(0), archive(nullptr), archivechunk(0)
         {
         }
         void push_back(utterancedesc && /*destructive*/ utt)
@@ -142,6 +148,29 @@ class minibatchutterancesourcemulti : public minibatchsource
                 LogicError("requiredata: called when data is already in memory");
             try // this function supports retrying since we read from the unrealible network, i.e. do not return in a broken state
             {
+                if (archive) // packed chunk archive: one read for the entire chunk
+                {
+                    if (featdim == 0)
+                    {
+                        featkind = archive->getfeatkind();
+                        featdim = archive->getfeatdim();
+                        sampperiod = archive->getsampperiod();
+                        fprintf(stderr, "requiredata: determined feature kind as %d-dimensional '%s' with frame shift %.1f ms from packed chunk archive\n", (int) featdim, featkind.c_str(), sampperiod / 1e4);
+                    }
+                    else if (featdim != archive->getfeatdim() || featkind != archive->getfeatkind() || sampperiod != archive->getsampperiod())
+                        LogicError("requiredata: packed chunk archive has different feature kind than expected");
+                    frames.resize(featdim, totalframes);
+                    archive->readchunk(archivechunk, frames);
+                    if (!latticesource.empty())
+                    {
+                        lattices.resize(utteranceset.size());
+                        foreach_index (i, utteranceset)
+                            latticesource.getlattices(utteranceset[i].key(), lattices[i], numframes(i));
+                    }
+                    if (verbosity)
+                        fprintf(stderr, "requiredata: %d utterances read from packed chunk archive\n", (int) utteranceset.size());
+                    return;
+                }
                 msra::asr::htkfeatreader reader; // feature reader (we reinstantiate it for each block, i.e. we reopen the file actually)
                 // if this is the first feature read ever, we explicitly open the first file to get the information such as feature dimension
                 if (featdim == 0)
@@ -185,8 +214,20 @@ class minibatchutterancesourcemulti : public minibatchsource
             // release lattice data
             lattices.clear();
         }
+        // page out data for this chunk, but hand the frame memory over to the caller instead of freeing it here
+        // (used to free expired chunks on a background thread)
+        void releasedata(msra::dbn::matrix &releasedframes) const
+        {
+            if (numutterances() == 0)
+                LogicError("releasedata: cannot page out virgin block");
+            if (!isinram())
+                LogicError("releasedata: called when data is not memory");
+            releasedframes.swap(frames);
+            lattices.clear();
+        }
     };
     std::vector<std::vector<utterancechunkdata>> allchunks;           // set of utterances organized in chunks, referred to by an iterator (not an index)
+    std::vector<unique_ptr<msra::asr::packedchunkarchive>> packedarchives; // [feature stream] packed chunk archive if used, else null
     std::vector<unique_ptr<biggrowablevector<CLASSIDTYPE>>> classids; // [classidsbegin+t] concatenation of all state sequences
     std::vector<unique_ptr<biggrowablevector<HMMIDTYPE>>> phoneboundaries;
     bool issupervised() const
@@ -240,6 +281,22 @@ class minibatchutterancesourcemulti : public minibatchsource
     };
     std::vector<std::vector<chunk>> randomizedchunks; // utterance chunks after being brought into random order (we randomize within a rolling window over them)
     size_t chunksinram;                               // (for diagnostics messages)
+
+    // read-ahead paging
+    // If enabled, the chunks that the randomization window is about to reach are paged in on background threads
+    // before getbatch() needs them, and the memory of expired chunks is freed in the background.
+    // All page-ins are serialized through 'pagingmutex' since the feature and lattice readers are not thread-safe;
+    // the point is to move the I/O off the training thread, not to parallelize it.
+    size_t readaheadchunks;                                                      // number of chunks beyond the current window to page in ahead of use (0: off)
+    size_t maxinflightchunks;                                                    // bound on read-aheads outstanding at any time
+    std::map<const utterancechunkdata *, std::future<void>> inflightchunks;      // [chunk data of first stream] pending read-ahead
+    std::vector<std::future<void>> pendingreleases;                              // pending background frees of expired chunks
+    std::mutex pagingmutex;                                                      // serializes requiredata() between training and read-ahead threads
+    size_t numchunksreadahead;                                                   // chunks paged in by read-ahead
+    size_t maxreadaheaddepth;                                                    // most chunks read ahead and not yet used at any time
+    size_t numchunkmisses;                                                       // chunks getbatch() had to page in itself
+    size_t numchunkstalls;                                                       // chunks getbatch() had to wait for since their read-ahead was not done yet
+    double chunkstalltime;                                                       // seconds spent by getbatch() in misses and stalls
     struct utteranceref                               // describes the underlying random utterance associated with an utterance position
     {
         size_t chunkindex;     // lives in this chunk (index into randomizedchunks[])
@@ -389,7 +446,7 @@ public:
     minibatchutterancesourcemulti(const std::vector<std::vector<wstring>> &infiles, const std::vector<map<wstring, std::vector<msra::asr::htkmlfentry>>> &labels,
                                   std::vector<size_t> vdim, std::vector<size_t> udim, std::vector<size_t> leftcontext, std::vector<size_t> rightcontext, size_t randomizationrange,
                                   const latticesource &lattices, const map<wstring, msra::lattices::lattice::htkmlfwordsequence> &allwordtranscripts, const bool framemode)
-        : vdim(vdim), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), randomizationrange(randomizationrange), currentsweep(SIZE_MAX), lattices(lattices), allwordtranscripts(allwordtranscripts), framemode(framemode), chunksinram(0), timegetbatch(0), verbosity(2)
+        : vdim(vdim), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), randomizationrange(randomizationrange), currentsweep(SIZE_MAX), lattices(lattices), allwordtranscripts(allwordtranscripts), framemode(framemode), chunksinram(0), readaheadchunks(0), maxinflightchunks(0), numchunksreadahead(0), maxreadaheaddepth(0), numchunkmisses(0), numchunkstalls(0), chunkstalltime(0), timegetbatch(0), verbosity(2)
     // [v-hansu] change framemode (lattices.empty()) into framemode (false) to run utterance mode without lattice
     // you also need to change another line, search : [v-hansu] comment out to run utterance mode without lattice
     {
@@ -1057,9 +1114,31 @@ private:
         return sweep;
     }
 
+    // helper to wait for a pending read-ahead of randomized chunk k, if any
+    // Must be called before inspecting or changing the chunk's paging state on the training thread.
+    void waitforreadahead(size_t k, bool countasstall)
+    {
+        auto iter = inflightchunks.find(&randomizedchunks[0][k].getchunkdata());
+        if (iter == inflightchunks.end())
+            return;
+        if (countasstall && iter->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            auto_timer stalltimer;
+            iter->second.wait();
+            chunkstalltime += stalltimer;
+            numchunkstalls++;
+            if (verbosity)
+                fprintf(stderr, "waitforreadahead: stalled on read-ahead of randomized chunk %d\n", (int) k);
+        }
+        auto readahead = std::move(iter->second);
+        inflightchunks.erase(iter);
+        readahead.get(); // (rethrows if the read-ahead failed)
+    }
+
     // helper to page out a chunk with log message
     void releaserandomizedchunk(size_t k)
     {
+        waitforreadahead(k, false);
         size_t numreleased = 0;
         foreach_index (m, randomizedchunks)
         {
@@ -1069,7 +1148,17 @@ private:
                 if (verbosity)
                     fprintf(stderr, "releaserandomizedchunk: paging out randomized chunk %d (frame range [%d..%d]), %d resident in RAM\n",
                             (int) k, (int) randomizedchunks[m][k].globalts, (int) (randomizedchunks[m][k].globalte() - 1), (int) (chunksinram - 1));
-                chunkdata.releasedata();
+                if (readaheadchunks > 0) // free the memory in the background
+                {
+                    auto releasedframes = make_shared<msra::dbn::matrix>();
+                    chunkdata.releasedata(*releasedframes);
+                    pendingreleases.push_back(std::async(std::launch::async, [releasedframes]()
+                                                         {
+                                                             releasedframes->resize(0, 0);
+                                                         }));
+                }
+                else
+                    chunkdata.releasedata();
                 numreleased++;
             }
         }
@@ -1094,6 +1183,8 @@ private:
         if (chunkindex < windowbegin || chunkindex >= windowend)
             LogicError("requirerandomizedchunk: requested utterance outside in-memory chunk range");
 
+        waitforreadahead(chunkindex, true);
+
         foreach_index (m, randomizedchunks)
         {
             auto &chunk = randomizedchunks[m][chunkindex];
@@ -1105,6 +1196,8 @@ private:
             return false;
         else if (numinram == 0)
         {
+            auto_timer misstimer;
+            std::lock_guard<std::mutex> lock(pagingmutex);
             foreach_index (m, randomizedchunks)
             {
                 auto &chunk = randomizedchunks[m][chunkindex];
@@ -1117,6 +1210,11 @@ private:
                                     });
             }
             chunksinram++;
+            if (readaheadchunks > 0)
+            {
+                numchunkmisses++;
+                chunkstalltime += misstimer;
+            }
             return true;
         }
         else
@@ -1125,6 +1223,74 @@ private:
         }
     }
 
+    // helper to start background page-ins of the chunks that getbatch() will need next
+    // These are the chunks of the current window that are not in RAM yet, followed by the 'readaheadchunks'
+    // chunks after it, in randomized order. At most 'maxinflightchunks' page-ins are outstanding at any time.
+    // Completed read-aheads stay in 'inflightchunks' until getbatch() uses or releases them; they do not count as outstanding.
+    void readaheadrandomizedchunks(const size_t windowbegin, const size_t windowend, const size_t subsetnum, const size_t numsubsets)
+    {
+        if (readaheadchunks == 0)
+            return;
+        foreach_index (m, featdim)
+            if (featdim[m] == 0) // the first page-in determines the feature kind; leave that to the training thread
+                return;
+
+        // reap completed background frees
+        pendingreleases.erase(std::remove_if(pendingreleases.begin(), pendingreleases.end(), [](std::future<void> &f)
+                                             {
+                                                 return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                                             }),
+                              pendingreleases.end());
+
+        size_t numpending = std::count_if(inflightchunks.begin(), inflightchunks.end(), [](const std::pair<const utterancechunkdata *const, std::future<void>> &readahead)
+                                          {
+                                              return readahead.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+                                          });
+        const size_t readaheadend = min(windowend + readaheadchunks, randomizedchunks[0].size());
+        for (size_t k = windowbegin; k < readaheadend && numpending < maxinflightchunks; k++)
+        {
+            if ((k % numsubsets) != subsetnum) // in MPI mode, we only read our own chunks
+                continue;
+            const auto *key = &randomizedchunks[0][k].getchunkdata();
+            if (inflightchunks.find(key) != inflightchunks.end() || key->isinram())
+                continue;
+
+            std::vector<const utterancechunkdata *> chunkdata;
+            foreach_index (m, randomizedchunks)
+                chunkdata.push_back(&randomizedchunks[m][k].getchunkdata());
+            if (verbosity)
+                fprintf(stderr, "readaheadrandomizedchunks: reading ahead randomized chunk %d (frame range [%d..%d]), %d resident in RAM\n",
+                        (int) k, (int) randomizedchunks[0][k].globalts, (int) (randomizedchunks[0][k].globalte() - 1), (int) (chunksinram + 1));
+            inflightchunks[key] = std::async(std::launch::async, [this, chunkdata]()
+                                             {
+                                                 std::lock_guard<std::mutex> lock(pagingmutex);
+                                                 foreach_index (m, chunkdata)
+                                                 {
+                                                     msra::util::attempt(5, [&]() // (reading from network)
+                                                                         {
+                                                                             chunkdata[m]->requiredata(featkind[m], featdim[m], sampperiod[m], this->lattices, 0);
+                                                                         });
+                                                 }
+                                             });
+            chunksinram++; // (counted as resident from now on; a chunk is never released before its read-ahead completed)
+            numchunksreadahead++;
+            numpending++;
+            maxreadaheaddepth = max(maxreadaheaddepth, inflightchunks.size());
+        }
+    }
+
+    // helper to wait for all background paging activity (before destruction)
+    void waitforallpaging()
+    {
+        for (auto &readahead : inflightchunks)
+            if (readahead.second.valid())
+                readahead.second.wait();
+        inflightchunks.clear();
+        for (auto &release : pendingreleases)
+            release.wait();
+        pendingreleases.clear();
+    }
+
     class matrixasvectorofvectors // wrapper around a matrix that views it as a vector of column vectors
     {
         void operator=(const matrixasvectorofvectors &); // non-assignable
@@ -1164,6 +1330,105 @@ public:
         verbosity = newverbosity;
     }
 
+    // enable read-ahead paging of the next 'numchunks' chunks beyond the randomization window, with at most 'maxinflight' page-ins outstanding
+    void setreadahead(size_t numchunks, size_t maxinflight)
+    {
+        readaheadchunks = numchunks;
+        maxinflightchunks = max(maxinflight, (size_t) 1);
+    }
+
+    // read the features of stream m from the packed chunk archive 'archivepaths[m]' (empty: keep reading from the SCP)
+    // An archive that does not exist yet is first created from the SCP, by reading every chunk once; this is the conversion step.
+    // An existing archive must match the chunking of the current SCP, MLF and lattice configuration, and 'compress'.
+    // Several processes (MPI ranks) may convert at the same time; each writes its own temp file (see packedchunkarchivewriter).
+    // Must be called before the first getbatch().
+    void usepackedarchives(const std::vector<wstring> &archivepaths, bool compress)
+    {
+        if (chunksinram > 0)
+            LogicError("usepackedarchives: must be called before any data is paged in");
+        packedarchives.resize(allchunks.size());
+        foreach_index (m, archivepaths)
+        {
+            if (archivepaths[m].empty())
+                continue;
+            auto &thisallchunks = allchunks[m];
+            if (!fexists(archivepaths[m]))
+            {
+                fprintf(stderr, "usepackedarchives: converting feature set %d (%d chunks) into packed chunk archive '%ls'%s\n",
+                        m, (int) thisallchunks.size(), archivepaths[m].c_str(), compress ? " (16-bit compressed)" : "");
+                unique_ptr<msra::asr::packedchunkarchivewriter> writer;
+                msra::asr::htkfeatreader reader;
+                foreach_index (c, thisallchunks)
+                {
+                    const auto &chunkdata = thisallchunks[c];
+                    if (featdim[m] == 0)
+                        reader.getinfo(chunkdata.utteranceset[0].parsedpath, featkind[m], featdim[m], sampperiod[m]);
+                    if (!writer)
+                        writer.reset(new msra::asr::packedchunkarchivewriter(archivepaths[m], featkind[m], featdim[m], sampperiod[m], compress));
+                    msra::dbn::matrix frames(featdim[m], chunkdata.totalframes);
+                    std::vector<wstring> keys;
+                    std::vector<size_t> uttframes;
+                    foreach_index (i, chunkdata.utteranceset)
+                    {
+                        msra::dbn::matrixstripe stripe(frames, chunkdata.firstframes[i], chunkdata.numframes(i));
+                        msra::util::attempt(5, [&]() // (reading from network)
+                                            {
+                                                reader.read(chunkdata.utteranceset[i].parsedpath, (const string &) featkind[m], sampperiod[m], stripe);
+                                            });
+                        keys.push_back(chunkdata.utteranceset[i].logicalpath());
+                        uttframes.push_back(chunkdata.numframes(i));
+                    }
+                    writer->writechunk(keys, uttframes, frames);
+                }
+                if (writer)
+                    writer->close();
+            }
+
+            // open and validate against our chunking
+            packedarchives[m].reset(new msra::asr::packedchunkarchive(archivepaths[m]));
+            auto &archive = *packedarchives[m];
+            if (archive.iscompressed() != compress)
+                RuntimeError("usepackedarchives: packed chunk archive '%ls' is %scompressed, but compression is %s; delete it to have it recreated", archivepaths[m].c_str(), archive.iscompressed() ? "" : "not ", compress ? "on" : "off");
+            if (archive.numchunks() != thisallchunks.size())
+                RuntimeError("usepackedarchives: packed chunk archive '%ls' has %d chunks but the data has %d; delete it to have it recreated", archivepaths[m].c_str(), (int) archive.numchunks(), (int) thisallchunks.size());
+            foreach_index (c, thisallchunks)
+            {
+                auto &chunkdata = thisallchunks[c];
+                const auto &keys = archive.chunkkeys(c);
+                const auto &uttframes = archive.chunkuttframes(c);
+                bool matches = keys.size() == chunkdata.numutterances();
+                for (size_t i = 0; matches && i < keys.size(); i++)
+                    matches = keys[i] == chunkdata.utteranceset[i].logicalpath() && uttframes[i] == chunkdata.numframes(i);
+                if (!matches)
+                    RuntimeError("usepackedarchives: chunk %d of packed chunk archive '%ls' does not match the data; delete it to have it recreated", c, archivepaths[m].c_str());
+                chunkdata.archive = &archive;
+                chunkdata.archivechunk = c;
+            }
+            fprintf(stderr, "usepackedarchives: feature set %d reads from packed chunk archive '%ls'\n", m, archivepaths[m].c_str());
+        }
+    }
+
+    // report read-ahead effectiveness: chunks paged in ahead of use vs. chunks getbatch() had to wait for
+    void printpagingstats() const
+    {
+        if (readaheadchunks == 0)
+            return;
+        fprintf(stderr, "minibatchutterancesourcemulti: %d chunks read ahead (up to %d at a time), %d chunk misses, %d read-ahead stalls, %.3f seconds stalled\n",
+                (int) numchunksreadahead, (int) maxreadaheaddepth, (int) numchunkmisses, (int) numchunkstalls, chunkstalltime);
+    }
+
+    // the most chunks that were read ahead and not yet used by getbatch() at any one time
+    size_t getmaxreadaheaddepth() const
+    {
+        return maxreadaheaddepth;
+    }
+
+    ~minibatchutterancesourcemulti()
+    {
+        waitforallpaging();
+        printpagingstats();
+    }
+
     // get the next minibatch
     // A minibatch is made up of one or more utterances.
     // We will return less than 'framesrequested' unless the first utterance is too long.
@@ -1214,13 +1479,15 @@ public:
             // We are a little more blunt for now: Free all outside the range, and page in only what is touched. We could save some loop iterations.
             const size_t windowbegin = positionchunkwindows[spos].windowbegin();
             const size_t windowend = positionchunkwindows[epos - 1].windowend();
+            // Chunks in the read-ahead range after the window are kept.
             for (size_t k = 0; k < windowbegin; k++)
                 releaserandomizedchunk(k);
-            for (size_t k = windowend; k < randomizedchunks[0].size(); k++)
+            for (size_t k = windowend + readaheadchunks; k < randomizedchunks[0].size(); k++)
                 releaserandomizedchunk(k);
             for (size_t pos = spos; pos < epos; pos++)
                 if ((randomizedutterancerefs[pos].chunkindex % numsubsets) == subsetnum)
                     readfromdisk |= requirerandomizedchunk(randomizedutterancerefs[pos].chunkindex, windowbegin, windowend); // (window range passed in for checking only)
+            readaheadrandomizedchunks(windowbegin, windowend, subsetnum, numsubsets);
 
             // Note that the above loop loops over all chunks incl. those that we already should have.
             // This has an effect, e.g., if 'numsubsets' has changed (we will fill gaps).
@@ -1371,8 +1638,9 @@ public:
             for (size_t k = windowbegin; k < windowend; k++)
                 if ((k % numsubsets) == subsetnum)                                     // in MPI mode, we skip chunks this way
                     readfromdisk |= requirerandomizedchunk(k, windowbegin, windowend); // (window range passed in for checking only, redundant here)
-            for (size_t k = windowend; k < randomizedchunks[0].size(); k++)
+            for (size_t k = windowend + readaheadchunks; k < randomizedchunks[0].size(); k++)
                 releaserandomizedchunk(k);
+            readaheadrandomizedchunks(windowbegin, windowend, subsetnum, numsubsets);
 
             // determine the true #frames we return--it is less than mbframes in the case of MPI/data-parallel sub-set mode
             // First determine it for all nodes, then pick the min over all nodes, as to give all the same #frames for better load balancing.
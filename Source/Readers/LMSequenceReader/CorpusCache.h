@@ -0,0 +1,330 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CorpusCache.h - binary, memory-mapped cache of a pre-tokenized language-model corpus
+//
+// Tokenizing the text corpus and mapping every word through the vocabulary map dominates the
+// LMSequenceReader on large corpora. The cache is built once from the text and the vocabulary and is
+// afterwards streamed directly from a read-only memory mapping.
+//
+// File layout (native byte order):
+//  - header: magic "LMCCACH1", version, key, #words, #sentences, #vocabulary entries, section offsets
+//  - words:     uint32 word id of every token, sentences stored back to back
+//  - sentences: uint64 offset into the word array of each sentence, plus one end offset
+//  - vocabulary (class info): per word its id, class, count and spelling
+//
+// The key is a hash of everything the content depends on (corpus and vocabulary file identity and the
+// reader settings used for the mapping); a cache with a different key is rebuilt.
+//
+#pragma once
+
+#include "Basics.h"
+#include "fileutil.h"
+#include <random>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#ifdef _WIN32
+#include "Windows.h"
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class CorpusCache
+{
+public:
+    struct VocabEntry
+    {
+        int id;
+        int classId;
+        size_t count;
+        std::string word;
+    };
+
+private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t key;
+        uint64_t numWords;
+        uint64_t numSentences;
+        uint64_t numVocab;
+        uint64_t wordsOffset;
+        uint64_t sentencesOffset;
+        uint64_t vocabOffset;
+    };
+    static const char* Magic()
+    {
+        return "LMCCACH1";
+    }
+    static const uint32_t Version = 1;
+
+    std::wstring m_path;
+    const char* m_data; // the mapped file
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+    const Header* m_header;
+    const uint32_t* m_words;
+    const uint64_t* m_sentences;
+
+    void Map()
+    {
+#ifdef _WIN32
+        m_file = CreateFileW(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            RuntimeError("CorpusCache: cannot open '%ls'", m_path.c_str());
+        LARGE_INTEGER size;
+        GetFileSizeEx(m_file, &size);
+        m_size = (size_t) size.QuadPart;
+        m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping == NULL)
+            RuntimeError("CorpusCache: cannot map '%ls'", m_path.c_str());
+        m_data = (const char*) MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = open(wtocharpath(m_path.c_str()).c_str(), O_RDONLY);
+        if (fd < 0)
+            RuntimeError("CorpusCache: cannot open '%ls'", m_path.c_str());
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            RuntimeError("CorpusCache: cannot stat '%ls'", m_path.c_str());
+        }
+        m_size = (size_t) st.st_size;
+        void* p = m_size > 0 ? mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd); // the mapping stays valid
+        m_data = p == MAP_FAILED ? nullptr : (const char*) p;
+        if (m_data)
+            madvise(p, m_size, MADV_SEQUENTIAL);
+#endif
+        if (m_data == nullptr)
+            RuntimeError("CorpusCache: cannot map '%ls'", m_path.c_str());
+    }
+    void Unmap()
+    {
+        if (m_data == nullptr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+#else
+        munmap((void*) m_data, m_size);
+#endif
+        m_data = nullptr;
+    }
+
+    // disallow copying (we own the mapping)
+    CorpusCache(const CorpusCache&);
+    CorpusCache& operator=(const CorpusCache&);
+
+public:
+    // open an existing cache; fails if it is not a complete cache file
+    CorpusCache(const std::wstring& path)
+        : m_path(path), m_data(nullptr), m_size(0)
+    {
+        Map();
+        m_header = (const Header*) m_data;
+        if (m_size < sizeof(Header) || memcmp(m_header->magic, Magic(), sizeof(m_header->magic)) != 0 || m_header->version != Version)
+        {
+            Unmap();
+            RuntimeError("CorpusCache: '%ls' is not a valid corpus cache", path.c_str());
+        }
+        if (m_header->vocabOffset > m_size ||
+            m_header->wordsOffset + m_header->numWords * sizeof(uint32_t) > m_size ||
+            m_header->sentencesOffset + (m_header->numSentences + 1) * sizeof(uint64_t) > m_size)
+        {
+            Unmap();
+            RuntimeError("CorpusCache: '%ls' is truncated", path.c_str());
+        }
+        m_words = (const uint32_t*) (m_data + m_header->wordsOffset);
+        m_sentences = (const uint64_t*) (m_data + m_header->sentencesOffset);
+    }
+    ~CorpusCache()
+    {
+        Unmap();
+    }
+
+    uint64_t Key() const
+    {
+        return m_header->key;
+    }
+    size_t NumSentences() const
+    {
+        return (size_t) m_header->numSentences;
+    }
+    size_t NumWords() const
+    {
+        return (size_t) m_header->numWords;
+    }
+    size_t NumVocab() const
+    {
+        return (size_t) m_header->numVocab;
+    }
+    size_t SentenceBegin(size_t s) const
+    {
+        return (size_t) m_sentences[s];
+    }
+    size_t SentenceLength(size_t s) const
+    {
+        return (size_t)(m_sentences[s + 1] - m_sentences[s]);
+    }
+    // word ids of the whole corpus; index with SentenceBegin()
+    const uint32_t* Words() const
+    {
+        return m_words;
+    }
+
+    // read back the vocabulary/class information stored with the cache
+    std::vector<VocabEntry> ReadVocabulary() const
+    {
+        std::vector<VocabEntry> vocab((size_t) m_header->numVocab);
+        const char* p = m_data + m_header->vocabOffset;
+        const char* end = m_data + m_size;
+        for (auto& entry : vocab)
+        {
+            if (p + 2 * sizeof(int32_t) + sizeof(uint64_t) + sizeof(uint32_t) > end)
+                RuntimeError("CorpusCache: vocabulary section of '%ls' is truncated", m_path.c_str());
+            entry.id = *(const int32_t*) p;
+            p += sizeof(int32_t);
+            entry.classId = *(const int32_t*) p;
+            p += sizeof(int32_t);
+            entry.count = (size_t) * (const uint64_t*) p;
+            p += sizeof(uint64_t);
+            uint32_t len = *(const uint32_t*) p;
+            p += sizeof(uint32_t);
+            if (p + len > end)
+                RuntimeError("CorpusCache: vocabulary section of '%ls' is truncated", m_path.c_str());
+            entry.word.assign(p, len);
+            p += len;
+        }
+        return vocab;
+    }
+
+    // hash for the cache key (FNV-1a); feed it everything the cache content depends on
+    static void HashBytes(uint64_t& hash, const void* data, size_t bytes)
+    {
+        const unsigned char* p = (const unsigned char*) data;
+        for (size_t i = 0; i < bytes; i++)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    static uint64_t HashInit()
+    {
+        return 14695981039346656037ull;
+    }
+    // identity of a file: its size and modification time, so that the key can be computed without reading the corpus
+    static void HashFile(uint64_t& hash, const std::wstring& path)
+    {
+        int64_t size = fexists(path) ? filesize64(path.c_str()) : -1;
+        HashBytes(hash, &size, sizeof(size));
+#ifdef _WIN32
+        FILETIME time;
+        memset(&time, 0, sizeof(time));
+        getfiletime(path, time);
+#else
+        struct stat st;
+        int64_t time = stat(wtocharpath(path.c_str()).c_str(), &st) == 0 ? (int64_t) st.st_mtime : 0;
+#endif
+        HashBytes(hash, &time, sizeof(time));
+    }
+
+    // -----------------------------------------------------------------------
+    // Writer -- build a cache sentence by sentence
+    // Written to a temp file that is renamed by Close(), so that an interrupted build is never picked up.
+    // The temp file name is unique to the writer, so that several processes (e.g. MPI ranks sharing a file system) can
+    // build the same cache concurrently; whoever finishes after a current cache has appeared discards its own.
+    // -----------------------------------------------------------------------
+
+    class Writer
+    {
+        std::wstring m_path;
+        std::wstring m_tmpPath;
+        FILE* m_f;
+        Header m_header;
+        std::vector<uint64_t> m_sentences;
+
+    public:
+        Writer(const std::wstring& path, uint64_t key)
+            : m_path(path), m_tmpPath(msra::strfun::wstrprintf(L"%ls.%d.%08x.tmp", path.c_str(), (int) GetCurrentProcessId(), (unsigned int) std::random_device()()))
+        {
+            memset(&m_header, 0, sizeof(m_header));
+            memcpy(m_header.magic, Magic(), sizeof(m_header.magic));
+            m_header.version = Version;
+            m_header.key = key;
+            m_header.wordsOffset = sizeof(Header);
+            m_f = fopenOrDie(m_tmpPath, L"wb");
+            fwriteOrDie(&m_header, sizeof(m_header), 1, m_f); // placeholder; rewritten by Close()
+            m_sentences.push_back(0);
+        }
+        ~Writer()
+        {
+            if (m_f)
+                fclose(m_f);
+        }
+
+        void AddSentence(const std::vector<uint32_t>& words)
+        {
+            if (!words.empty())
+                fwriteOrDie(words.data(), sizeof(uint32_t), words.size(), m_f);
+            m_header.numWords += words.size();
+            m_sentences.push_back(m_header.numWords);
+        }
+
+        void Close(const std::vector<VocabEntry>& vocab)
+        {
+            // pad so that the offset array is naturally aligned
+            if (m_header.numWords % 2)
+                fput(m_f, (uint32_t) 0);
+            m_header.numSentences = m_sentences.size() - 1;
+            m_header.sentencesOffset = fgetpos(m_f);
+            fwriteOrDie(m_sentences.data(), sizeof(uint64_t), m_sentences.size(), m_f);
+            m_header.vocabOffset = fgetpos(m_f);
+            m_header.numVocab = vocab.size();
+            for (const auto& entry : vocab)
+            {
+                fput(m_f, (int32_t) entry.id);
+                fput(m_f, (int32_t) entry.classId);
+                fput(m_f, (uint64_t) entry.count);
+                fput(m_f, (uint32_t) entry.word.size());
+                fwriteOrDie(entry.word.data(), 1, entry.word.size(), m_f);
+            }
+            fsetpos(m_f, (uint64_t) 0);
+            fwriteOrDie(&m_header, sizeof(m_header), 1, m_f);
+            int rc = fclose(m_f);
+            m_f = nullptr;
+            if (rc != 0)
+                RuntimeError("CorpusCache: error closing file '%ls'", m_tmpPath.c_str());
+            // another process may have built the same cache meanwhile and have it mapped already; keep that one
+            bool current = false;
+            if (fexists(m_path))
+            {
+                try
+                {
+                    current = CorpusCache(m_path).Key() == m_header.key;
+                }
+                catch (const std::exception&)
+                {
+                }
+            }
+            if (current)
+                unlinkOrDie(m_tmpPath);
+            else
+                renameOrDie(m_tmpPath, m_path);
+        }
+    };
+};
+} } }
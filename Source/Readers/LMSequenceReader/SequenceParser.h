@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <fstream>
 #include <map>
+#include <algorithm>
 #include <stdint.h>
 #include "Basics.h"
 #include "fileutil.h"
@@ -489,6 +490,11 @@ protected:
     FILE *mFile;
     std::wstring mFileName;
 
+    // distributed reading: only every m_numSubsets-th sentence, starting at m_subsetNum, is returned
+    size_t m_subsetNum;
+    size_t m_numSubsets;
+    size_t m_sentenceIndex; // index of the next sentence in the file
+
 public:
     using SequenceParser<NumType, LabelType>::m_dimFeatures;
     using SequenceParser<NumType, LabelType>::m_dimLabelsIn;
@@ -513,6 +519,9 @@ public:
     LMSequenceParser()
     {
         mFile = nullptr;
+        m_subsetNum = 0;
+        m_numSubsets = 1;
+        m_sentenceIndex = 0;
     };
     ~LMSequenceParser()
     {
@@ -554,6 +563,15 @@ public:
     {
         if (mFile)
             fseek(mFile, 0, SEEK_SET);
+        m_sentenceIndex = 0;
+    }
+
+    // SetSubset - read only the share of the sentences of worker 'subsetNum' out of 'numSubsets' (round robin)
+    // This is the same sharding as that of the corpus cache, so both give each worker the same sentences.
+    void SetSubset(size_t subsetNum, size_t numSubsets)
+    {
+        m_subsetNum = subsetNum;
+        m_numSubsets = numSubsets;
     }
 
     // Parse - Parse the data
@@ -585,10 +603,21 @@ public:
         {
 
             string ch = ch2;
+
+            // another worker's sentence: only check whether it is one (same test as below), without tokenizing it
+            if (m_numSubsets > 1 && m_sentenceIndex % m_numSubsets != m_subsetNum)
+            {
+                trim(ch);
+                if (std::count(ch.begin(), ch.end(), ' ') >= 2)
+                    m_sentenceIndex++;
+                continue;
+            }
+
             std::vector<string> vstr;
             vstr = sep_string(ch, " ");
             if (vstr.size() < 3)
                 continue;
+            m_sentenceIndex++;
 
             for (size_t i = 0; i < vstr.size(); i++)
             {
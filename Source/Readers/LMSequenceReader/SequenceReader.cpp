@@ -1011,6 +1011,9 @@ void SequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring, Matrix<Elem
     else if (readerMode == ReaderMode::Softmax)
         labels->Resize(1, actualmbsize);
 
+    if (readerMode == ReaderMode::NCE && noise_shared)
+        m_noiseSampler.sample(this->noise_sample_size, m_noiseWords);
+
     for (size_t jSample = m_mbStartSample; j < actualmbsize; ++j, ++jSample)
     {
         // pick the right sample with randomization if desired
@@ -1023,7 +1026,7 @@ void SequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring, Matrix<Elem
             labels->SetValue(1, j, (ElemType) m_noiseSampler.logprob(wrd));
             for (size_t noiseid = 0; noiseid < this->noise_sample_size; noiseid++)
             {
-                int wid = m_noiseSampler.sample();
+                int wid = noise_shared ? m_noiseWords[noiseid] : m_noiseSampler.sample();
                 labels->SetValue(2 * (noiseid + 1), j, (ElemType) wid);
                 labels->SetValue(2 * (noiseid + 1) + 1, j, -(ElemType) m_noiseSampler.logprob(wid));
             }
@@ -1406,6 +1409,8 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
         readerMode = ReaderMode::NCE;
 
         this->noise_sample_size = featureConfig(L"noise_number", 0);
+        // share the noise words across all frames of a minibatch, which lets the NCE criterion score them with a single GEMM
+        this->noise_shared = featureConfig(L"noise_shared", false);
     }
     else if (mode == L"softmax")
         readerMode = ReaderMode::Softmax;
@@ -1417,6 +1422,15 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
     // read unk sybol
     this->mUnk = msra::strfun::utf8(readerConfig(L"unk", L"<unk>"));
 
+    // pre-tokenized corpus cache; if it is up to date, the vocabulary is read from it as well
+    std::wstring corpusCachePath = readerConfig(L"corpusCache", L"");
+    uint64_t corpusCacheKey = 0;
+    if (!corpusCachePath.empty())
+    {
+        corpusCacheKey = CorpusCacheKey(readerConfig);
+        OpenCorpusCache(corpusCachePath, corpusCacheKey);
+    }
+
     class_size = 0;
     m_featureDim = featureConfig(L"dim");
     for (int index = labelInfoMin; index < labelInfoMax; ++index)
@@ -1450,7 +1464,11 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
         {
             std::wstring wClassFile = readerConfig(L"wordclass", L"");
             nwords = labelConfig(L"labelDim");
-            if (wClassFile != L"")
+            if (wClassFile != L"" && m_corpusCache && m_corpusCache->NumVocab() > 0)
+            {
+                ReadClassInfoFromCache();
+            }
+            else if (wClassFile != L"")
             {
                 ReadClassInfo(wClassFile, class_size,
                               word4idx,
@@ -1480,14 +1498,17 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
             {
                 if (wClassFile != L"")
                 {
-                    ReadClassInfo(wClassFile, class_size,
-                                  word4idx,
-                                  idx4word,
-                                  idx4class,
-                                  idx4cnt,
-                                  nwords,
-                                  mUnk, m_noiseSampler,
-                                  false);
+                    if (m_corpusCache && m_corpusCache->NumVocab() > 0)
+                        ReadClassInfoFromCache();
+                    else
+                        ReadClassInfo(wClassFile, class_size,
+                                      word4idx,
+                                      idx4word,
+                                      idx4class,
+                                      idx4cnt,
+                                      nwords,
+                                      mUnk, m_noiseSampler,
+                                      false);
                     if (word4idx.size() != nwords)
                     {
                         LogicError("BatchSequenceReader::Init : vocabulary size %d from setup file and %d from that in word class file %ls is not consistent", (int) nwords, (int) word4idx.size(), wClassFile.c_str());
@@ -1562,9 +1583,180 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
     const LabelInfo& labelOut = m_labelInfo[labelInfoOut];
     m_parser.ParseInit(m_file.c_str(), m_featureDim, labelIn.dim, labelOut.dim, labelIn.beginSequence, labelIn.endSequence, labelOut.beginSequence, labelOut.endSequence);
 
+    // build the corpus cache if it does not exist or is stale
+    if (!corpusCachePath.empty() && !m_corpusCache)
+    {
+        if (labelOut.type != labelNextWord)
+            InvalidArgument("BatchSequenceReader: corpusCache requires labelType=NextWord for the output labels");
+        BuildCorpusCache(corpusCachePath, corpusCacheKey);
+        OpenCorpusCache(corpusCachePath, corpusCacheKey);
+        if (!m_corpusCache)
+            RuntimeError("BatchSequenceReader: failed to create corpus cache %ls", corpusCachePath.c_str());
+    }
+
     mRequestedNumParallelSequences = readerConfig(L"nbruttsineachrecurrentiter", (size_t) 1);
 }
 
+// CorpusCacheKey - hash of everything the content of the corpus cache depends on
+// The corpus is identified by size and modification time, so computing the key does not require reading it.
+template <class ElemType>
+template <class ConfigRecordType>
+uint64_t BatchSequenceReader<ElemType>::CorpusCacheKey(const ConfigRecordType& readerConfig)
+{
+    uint64_t key = CorpusCache::HashInit();
+    CorpusCache::HashFile(key, readerConfig(L"file", L""));
+    CorpusCache::HashFile(key, readerConfig(L"wordclass", L""));
+    CorpusCache::HashBytes(key, mUnk.data(), mUnk.size());
+    for (int index = labelInfoMin; index < labelInfoMax; ++index)
+    {
+        const ConfigRecordType& labelConfig = readerConfig(m_labelsName[index].c_str(), ConfigRecordType::Record());
+        std::wstring labelPath = labelConfig(L"labelMappingFile", L"");
+        CorpusCache::HashFile(key, labelPath);
+        std::string beginSequence = msra::strfun::utf8(labelConfig(L"beginSequence", L""));
+        std::string endSequence = msra::strfun::utf8(labelConfig(L"endSequence", L""));
+        std::string labelType(labelConfig(L"labelType", "Category"));
+        size_t labelDim = labelConfig(L"labelDim", (size_t) 0);
+        CorpusCache::HashBytes(key, beginSequence.c_str(), beginSequence.size() + 1);
+        CorpusCache::HashBytes(key, endSequence.c_str(), endSequence.size() + 1);
+        CorpusCache::HashBytes(key, labelType.c_str(), labelType.size() + 1);
+        CorpusCache::HashBytes(key, &labelDim, sizeof(labelDim));
+    }
+    return key;
+}
+
+// OpenCorpusCache - open the corpus cache if it exists and matches the key, otherwise leave m_corpusCache empty
+template <class ElemType>
+void BatchSequenceReader<ElemType>::OpenCorpusCache(const std::wstring& cachePath, uint64_t key)
+{
+    m_corpusCache.reset();
+    if (!fexists(cachePath))
+        return;
+    try
+    {
+        m_corpusCache.reset(new CorpusCache(cachePath));
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "BatchSequenceReader: ignoring corpus cache %ls: %s\n", cachePath.c_str(), e.what());
+        return;
+    }
+    if (m_corpusCache->Key() != key)
+    {
+        fprintf(stderr, "BatchSequenceReader: corpus cache %ls is out of date, rebuilding\n", cachePath.c_str());
+        m_corpusCache.reset();
+        return;
+    }
+    if (m_traceLevel > 0)
+        fprintf(stderr, "BatchSequenceReader: using corpus cache %ls (%d sentences, %d words)\n", cachePath.c_str(), (int) m_corpusCache->NumSentences(), (int) m_corpusCache->NumWords());
+}
+
+// BuildCorpusCache - tokenize the text corpus once and write the word ids into the corpus cache
+// Uses the same parser and vocabulary lookup as the text path, so both produce identical minibatches.
+template <class ElemType>
+void BatchSequenceReader<ElemType>::BuildCorpusCache(const std::wstring& cachePath, uint64_t key)
+{
+    fprintf(stderr, "BatchSequenceReader: building corpus cache %ls\n", cachePath.c_str());
+    LabelInfo& labelIn = m_labelInfo[labelInfoIn];
+    CorpusCache::Writer writer(cachePath, key);
+
+    std::vector<LabelType> labels;
+    std::vector<ElemType> numbers;
+    std::vector<SequencePosition> seqPos;
+    std::vector<uint32_t> words;
+    m_parser.SetSubset(0, 1); // the cache holds all sentences
+    m_parser.ParseReset();
+    for (;;)
+    {
+        labels.clear();
+        numbers.clear();
+        seqPos.clear();
+        m_parser.mSentenceIndex2SentenceInfo.clear();
+        if (m_parser.Parse(CACHE_BLOG_SIZE, &labels, &numbers, &seqPos) == 0)
+            break;
+        for (const auto& sentence : m_parser.mSentenceIndex2SentenceInfo)
+        {
+            words.clear();
+            for (size_t i = sentence.sBegin; i < sentence.sEnd; i++)
+                words.push_back((uint32_t) GetIdFromLabel(labels[i], labelIn));
+            writer.AddSentence(words);
+        }
+    }
+    m_parser.mSentenceIndex2SentenceInfo.clear();
+    m_parser.ParseReset();
+
+    // class info goes along, so that later runs need not parse the vocabulary file either
+    std::vector<CorpusCache::VocabEntry> vocab;
+    vocab.reserve(idx4word.size());
+    for (const auto& p : idx4word)
+    {
+        CorpusCache::VocabEntry entry;
+        entry.id = p.first;
+        entry.word = p.second;
+        entry.classId = idx4class[p.first];
+        entry.count = idx4cnt[p.first];
+        vocab.push_back(entry);
+    }
+    writer.Close(vocab);
+}
+
+// ReadClassInfoFromCache - same as ReadClassInfo() but from the vocabulary stored in the corpus cache
+template <class ElemType>
+void BatchSequenceReader<ElemType>::ReadClassInfoFromCache()
+{
+    word4idx.clear();
+    idx4word.clear();
+    idx4class.clear();
+    idx4cnt.clear();
+    class_size = 0;
+    for (const auto& entry : m_corpusCache->ReadVocabulary())
+    {
+        idx4cnt[entry.id] = entry.count;
+        word4idx[entry.word] = entry.id;
+        idx4word[entry.id] = entry.word;
+        idx4class[entry.id] = entry.classId;
+        class_size = max(class_size, entry.classId);
+    }
+    class_size++;
+
+    if (idx4class.size() < nwords)
+        LogicError("BatchSequenceReader::ReadClassInfoFromCache the actual number of words %d is smaller than the specified vocabulary size %d. Check if labelDim is too large. ", (int) idx4class.size(), (int) nwords);
+    std::vector<double> counts(idx4cnt.size());
+    for (const auto& p : idx4cnt)
+        counts[p.first] = (double) p.second;
+    m_noiseSampler = noiseSampler<long>(counts);
+
+    // check if unk is the same used in vocabulary file
+    if (word4idx.find(mUnk.c_str()) == word4idx.end())
+        LogicError("BatchSequenceReader::ReadClassInfoFromCache unk symbol %s is not in the vocabulary of the corpus cache", mUnk.c_str());
+}
+
+// ReadCachedSentences - the corpus-cache counterpart of m_parser.Parse()
+// Fills m_parser.mSentenceIndex2SentenceInfo with the next block of this worker's sentences; sBegin/sEnd index the
+// cache's word array directly. Returns the number of sentences read, 0 at the end of the corpus.
+template <class ElemType>
+size_t BatchSequenceReader<ElemType>::ReadCachedSentences(size_t wordsRequested)
+{
+    size_t numRead = 0;
+    size_t numWords = 0;
+    const size_t numSentences = m_corpusCache->NumSentences();
+    while (numWords < wordsRequested && m_cacheNextSentence < numSentences)
+    {
+        const size_t s = m_cacheNextSentence;
+        m_cacheNextSentence += m_numSubsets;
+        const size_t len = m_corpusCache->SentenceLength(s);
+        if (len < 3) // (same as the text parser, which skips lines with fewer than 3 tokens)
+            continue;
+        stSentenceInfo stinfo;
+        stinfo.sLen = len;
+        stinfo.sBegin = m_corpusCache->SentenceBegin(s);
+        stinfo.sEnd = stinfo.sBegin + len;
+        m_parser.mSentenceIndex2SentenceInfo.push_back(stinfo);
+        numWords += len;
+        numRead++;
+    }
+    return numRead;
+}
+
 template <class ElemType>
 void BatchSequenceReader<ElemType>::Reset()
 {
@@ -1585,6 +1777,17 @@ void BatchSequenceReader<ElemType>::Reset()
 template <class ElemType>
 void BatchSequenceReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples)
 {
+    return StartDistributedMinibatchLoop(mbSize, epoch, 0, 1, requestedEpochSamples);
+}
+
+template <class ElemType>
+void BatchSequenceReader<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples)
+{
+    if (subsetNum >= numSubsets)
+        InvalidArgument("BatchSequenceReader: subset %d out of range (%d subsets)", (int) subsetNum, (int) numSubsets);
+    m_subsetNum = subsetNum;
+    m_numSubsets = numSubsets;
+
     // if we aren't currently caching, see if we can use a cache
     if (!m_cachingReader && !m_cachingWriter)
     {
@@ -1593,10 +1796,17 @@ void BatchSequenceReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epo
             ReleaseMemory(); // free the memory used by the SequenceReader
     }
 
+    // the reader cache (writerType, wfile) holds the minibatches of all the data; it cannot be written from a share of it, and can
+    // only be read by share if the reader of the cached files supports that
+    if (numSubsets > 1 && m_cachingWriter)
+        InvalidArgument("BatchSequenceReader: writing the reader cache (wfile) is not supported with distributed reading; use corpusCache instead.");
+    if (numSubsets > 1 && m_cachingReader && !m_cachingReader->SupportsDistributedMBRead())
+        InvalidArgument("BatchSequenceReader: the reader of the cached files (writerType) does not support distributed reading; use corpusCache instead.");
+
     // if we are reading from the cache, do so now and return
     if (m_cachingReader)
     {
-        m_cachingReader->StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+        m_cachingReader->StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples);
         return;
     }
 
@@ -1668,7 +1878,9 @@ void BatchSequenceReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epo
     m_clsinfoRead = false;
     m_idx2clsRead = false;
 
+    m_parser.SetSubset(m_subsetNum, m_numSubsets);
     m_parser.ParseReset();
+    m_cacheNextSentence = m_subsetNum;
 
     Reset();
 }
@@ -1761,7 +1973,10 @@ bool BatchSequenceReader<ElemType>::EnsureDataAvailable(size_t /*mbStartSample*/
     {
         Reset();
 
-        mNumRead = m_parser.Parse(CACHE_BLOG_SIZE, &m_labelTemp, &m_featureTemp, &seqPos);
+        if (m_corpusCache)
+            mNumRead = ReadCachedSentences(CACHE_BLOG_SIZE);
+        else
+            mNumRead = m_parser.Parse(CACHE_BLOG_SIZE, &m_labelTemp, &m_featureTemp, &seqPos);
         firstPosInSentence = mLastPosInSentence;
         if (mNumRead == 0)
             return false;
@@ -1784,6 +1999,16 @@ bool BatchSequenceReader<ElemType>::EnsureDataAvailable(size_t /*mbStartSample*/
             size_t seq = mToProcess[k];
             size_t label = m_parser.mSentenceIndex2SentenceInfo[seq].sBegin + i;
 
+            if (m_corpusCache)
+            {
+                // already mapped to ids; the output label is the next word
+                const uint32_t* words = m_corpusCache->Words();
+                m_featureData.push_back((float) words[label]);
+                m_labelIdData.push_back((LabelIdType) words[label + 1]);
+                m_totalSamples++;
+                continue;
+            }
+
             // labelIn should be a category label
             LabelType labelValue = m_labelTemp[label++];
 
@@ -2078,6 +2303,9 @@ void BatchSequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring,
     labels->TransferFromDeviceToDevice(curDevId, CPUDEVICE, true, false, false);
     ElemType epsilon = (ElemType) 1e-6; // avoid all zero, although this is almost impossible.
 
+    if (readerMode == ReaderMode::NCE && noise_shared)
+        m_noiseSampler.sample(this->noise_sample_size, m_noiseWords);
+
     if (labels->GetCurrentMatrixLocation() == CPU)
         for (size_t jSample = m_mbStartSample; j < actualmbsize; ++j, ++jSample)
         {
@@ -2092,7 +2320,7 @@ void BatchSequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring,
                 labels->SetValue(1, j, (ElemType) m_noiseSampler.logprob(wrd));
                 for (size_t noiseid = 0; noiseid < this->noise_sample_size; noiseid++)
                 {
-                    int wid = m_noiseSampler.sample();
+                    int wid = noise_shared ? m_noiseWords[noiseid] : m_noiseSampler.sample();
                     labels->SetValue(2 * (noiseid + 1), j, (ElemType) wid);
                     labels->SetValue(2 * (noiseid + 1) + 1, j, -(ElemType) m_noiseSampler.logprob(wid));
                 }
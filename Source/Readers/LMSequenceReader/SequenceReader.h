@@ -11,6 +11,7 @@
 #include "DataWriter.h"
 #include "Config.h"
 #include "SequenceParser.h"
+#include "CorpusCache.h"
 #include "RandomOrdering.h"
 #include <string>
 #include <map>
@@ -44,19 +45,63 @@ enum ReaderMode
     None = 4, // some other type of label
 };
 
+// noiseSampler -- draws noise words for NCE from a unigram distribution
+// Sampling uses Walker's alias method (table built with Vose's algorithm), so each draw costs
+// one uniform random number and one table lookup, independent of the vocabulary size.
+// The tables are read-only after construction; callers that sample from multiple threads
+// pass their own engine to sample(Engine&) so that each thread has its own random stream.
 template <typename Count>
 class noiseSampler
 {
     std::vector<double> m_prob, m_log_prob;
-    std::uniform_int_distribution<Count> unif_int;
+    std::vector<double> m_accept; // alias table: probability of keeping bucket i
+    std::vector<int> m_alias;     // alias table: word to return if bucket i is rejected
     bool uniform_sampling;
     double uniform_prob;
     double uniform_log_prob;
-    std::piecewise_constant_distribution<double> d;
     std::mt19937 rng;
 
+    // build the alias table from the normalized probabilities (Vose's algorithm)
+    void BuildAliasTable()
+    {
+        const size_t k = m_prob.size();
+        m_accept.assign(k, 1.0);
+        m_alias.resize(k);
+        std::vector<double> scaled(k);
+        std::vector<int> small, large;
+        for (size_t i = 0; i < k; i++)
+        {
+            m_alias[i] = (int) i;
+            scaled[i] = m_prob[i] * k;
+            if (scaled[i] < 1.0)
+                small.push_back((int) i);
+            else
+                large.push_back((int) i);
+        }
+        while (!small.empty() && !large.empty())
+        {
+            int s = small.back();
+            small.pop_back();
+            int l = large.back();
+            m_accept[s] = scaled[s];
+            m_alias[s] = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // leftovers are 1 up to rounding error
+        for (int i : small)
+            m_accept[i] = 1.0;
+        for (int i : large)
+            m_accept[i] = 1.0;
+    }
+
 public:
     noiseSampler()
+        : uniform_sampling(false), uniform_prob(0), uniform_log_prob(0)
     {
     }
     noiseSampler(const std::vector<double>& counts, bool xuniform_sampling = false)
@@ -65,15 +110,19 @@ public:
         size_t k = counts.size();
         uniform_prob = 1.0 / k;
         uniform_log_prob = std::log(uniform_prob);
-        std::vector<double> vn(counts.size() + 1);
-        for (int i = 0; i < vn.size(); i++)
-            vn[i] = i;
-        d = std::piecewise_constant_distribution<double>(vn.begin(), vn.end(), counts.begin());
-        unif_int = std::uniform_int_distribution<Count>(0, (long) counts.size() - 1);
-        m_prob = d.densities();
-        m_log_prob.resize(m_prob.size());
-        for (int i = 0; i < k; i++)
+        double total = 0;
+        for (const auto& c : counts)
+            total += c;
+        if (k == 0 || total <= 0)
+            InvalidArgument("noiseSampler: word counts must be non-empty and have a positive sum.");
+        m_prob.resize(k);
+        m_log_prob.resize(k);
+        for (size_t i = 0; i < k; i++)
+        {
+            m_prob[i] = counts[i] / total;
             m_log_prob[i] = std::log(m_prob[i]);
+        }
+        BuildAliasTable();
     }
     int size() const
     {
@@ -94,19 +143,32 @@ public:
             return m_log_prob[i];
     }
 
+    // draw one word using the caller's random engine; thread-safe as long as each thread uses its own engine
     template <typename Engine>
-    int sample(Engine& eng)
+    int sample(Engine& eng) const
     {
-        int m = unif_int(eng);
-        if (uniform_sampling)
-            return m;
-        return (int) d(eng);
+        const size_t k = m_prob.size();
+        double u = std::uniform_real_distribution<double>(0.0, (double) k)(eng);
+        size_t bucket = (size_t) u;
+        if (bucket >= k) // guard against rounding at the upper end
+            bucket = k - 1;
+        if (uniform_sampling || u - bucket < m_accept[bucket])
+            return (int) bucket;
+        return m_alias[bucket];
     }
 
     int sample()
     {
         return sample(this->rng);
     }
+
+    // draw 'n' words into 'samples' using the sampler's own engine
+    void sample(size_t n, std::vector<int>& samples)
+    {
+        samples.resize(n);
+        for (size_t i = 0; i < n; i++)
+            samples[i] = sample(this->rng);
+    }
 };
 
 template <class ElemType>
@@ -136,6 +198,8 @@ public:
     map<int, vector<int>> class_words;
 
     int noise_sample_size;
+    bool noise_shared;             // draw one set of noise words per minibatch and share it across all frames
+    std::vector<int> m_noiseWords; // noise words of the current minibatch if noise_shared
     noiseSampler<long> m_noiseSampler;
 
     ReaderMode readerMode;
@@ -275,6 +339,8 @@ public:
         m_cachingWriter = NULL;
         m_labelsIdBuffer = NULL;
         readerMode = ReaderMode::Class;
+        noise_sample_size = 0;
+        noise_shared = false;
         /*
         delete m_featuresBufferRow;
         delete m_featuresBufferRowIdx;
@@ -366,6 +432,8 @@ public:
     using SequenceReader<ElemType>::idx4class;
     using SequenceReader<ElemType>::m_indexer;
     using SequenceReader<ElemType>::m_noiseSampler;
+    using SequenceReader<ElemType>::m_noiseWords;
+    using SequenceReader<ElemType>::noise_shared;
     using SequenceReader<ElemType>::readerMode;
     using SequenceReader<ElemType>::GetIdFromLabel;
     using SequenceReader<ElemType>::GetInputToClass;
@@ -388,6 +456,19 @@ private:
 
     MBLayoutPtr m_pMBLayout;
 
+    // pre-tokenized binary corpus (optional, see CorpusCache.h); when present, sentences are streamed from it instead of parsing the text
+    std::unique_ptr<CorpusCache> m_corpusCache;
+    size_t m_cacheNextSentence; // next sentence of the cache to read
+    size_t m_subsetNum;         // distributed reading: this worker reads every m_numSubsets-th sentence, starting at m_subsetNum
+    size_t m_numSubsets;
+
+    template <class ConfigRecordType>
+    uint64_t CorpusCacheKey(const ConfigRecordType& readerConfig);
+    void OpenCorpusCache(const std::wstring& cachePath, uint64_t key);
+    void BuildCorpusCache(const std::wstring& cachePath, uint64_t key);
+    void ReadClassInfoFromCache();
+    size_t ReadCachedSentences(size_t wordsRequested);
+
 public:
     vector<bool> mProcessed;
     LMBatchSequenceParser<ElemType, LabelType> m_parser;
@@ -399,6 +480,9 @@ public:
         mLastPosInSentence = 0;
         mNumRead = 0;
         mSentenceEnd = false;
+        m_cacheNextSentence = 0;
+        m_subsetNum = 0;
+        m_numSubsets = 1;
     }
 
     template <class ConfigRecordType>
@@ -438,6 +522,12 @@ public:
                         size_t m_mbStartSample, size_t actualmbsize);
 
     void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize);
+    // distributed reading shards the corpus by sentence, both when streaming from the corpus cache and when parsing text
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return true;
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override;
     bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices);
     bool EnsureDataAvailable(size_t mbStartSample, size_t& firstPosInSentence);
     size_t GetNumParallelSequences();
@@ -69,6 +69,90 @@ size_t UCIFastReader<ElemType>::RecordsToRead(size_t mbStartSample, bool tail)
     return numberToRead;
 }
 
+// ReadSubsetOnly - Determine whether only the records of this trainer's subset need to be parsed
+// Each minibatch is split among the trainers by columns. Which trainer a record goes to is only known before it is read
+// once the dataset was read to its end (then the record count, epoch size, randomization range and label mapping are final),
+// and as long as all but the last minibatch of an epoch have the full size (with partial minibatches, one is cut short
+// where an epoch crosses the end of the dataset).
+template <class ElemType>
+bool UCIFastReader<ElemType>::ReadSubsetOnly()
+{
+    if (m_numSubsets <= 1 || !m_endReached || !m_labelFileToWrite.empty() || (m_cachingWriter && m_subsetNum == 0))
+        return false;
+    if (m_totalSamples < m_mbSize || (m_partialMinibatch && m_totalSamples % m_epochSize != 0))
+        return false;
+    return !Randomize() || m_epochSize % m_randomizeRange == 0;
+}
+
+// IsSubsetRecord - Determine whether a record goes to this trainer's subset of its minibatch
+// sample - the sample number of the record, as it is read
+template <class ElemType>
+bool UCIFastReader<ElemType>::IsSubsetRecord(size_t sample)
+{
+    // the column of the epoch where the record is used
+    size_t epochSample = sample % m_epochSize;
+    if (Randomize())
+    {
+        size_t randomizeSweep = RandomizeSweep(sample);
+        if (randomizeSweep != m_subsetColumnsSweep || m_subsetColumns.size() != m_randomizeRange)
+        {
+            // invert the randomization of this range, on a copy so that the records to read are still determined by m_randomordering
+            RandomOrdering randomOrdering = m_randomordering;
+            const auto& tmap = randomOrdering(randomizeSweep);
+            m_subsetColumns.resize(tmap.size());
+            for (size_t i = 0; i < tmap.size(); i++)
+                m_subsetColumns[tmap[i]] = i;
+            m_subsetColumnsSweep = randomizeSweep;
+        }
+        epochSample = epochSample - epochSample % m_randomizeRange + m_subsetColumns[epochSample % m_randomizeRange];
+    }
+
+    // the same split of the minibatch as in GetMinibatchImpl()
+    size_t mbStartSample = epochSample - epochSample % m_mbSize;
+    size_t mbSize = min(m_mbSize, m_epochSize - mbStartSample);
+    size_t column = epochSample - mbStartSample;
+    return column >= (mbSize * m_subsetNum) / m_numSubsets && column < (mbSize * (m_subsetNum + 1)) / m_numSubsets;
+}
+
+// ParseRecords - Parse the next records of the file, appending them to the data arrays
+// sample - the sample number of the first record
+// subsetOnly - only parse the records of this trainer's subset, the lines of the others are skipped and stored as zeros
+// returns - number of records read, if the end of file is reached the return value will be < requested records
+template <class ElemType>
+long UCIFastReader<ElemType>::ParseRecords(size_t sample, size_t numRecords, bool subsetOnly)
+{
+    if (!subsetOnly)
+        return m_parser.Parse(numRecords, &m_featureData, &m_labelData);
+
+    m_subsetDataOnly = true;
+    size_t recordsRead = 0;
+    while (recordsRead < numRecords)
+    {
+        // parse or skip a run of records that all go to the same side
+        bool inSubset = IsSubsetRecord(sample + recordsRead);
+        size_t runLength = 1;
+        while (recordsRead + runLength < numRecords && IsSubsetRecord(sample + recordsRead + runLength) == inSubset)
+            runLength++;
+
+        size_t numRead;
+        if (inSubset)
+            numRead = m_parser.Parse(runLength, &m_featureData, &m_labelData);
+        else
+        {
+            m_parser.SetParseMode(ParseLineCount);
+            numRead = m_parser.Parse(runLength, NULL, NULL);
+            m_parser.SetParseMode(ParseNormal);
+            m_featureData.resize(m_featureData.size() + numRead * m_featureCount);
+            if (m_labelType != labelNone)
+                m_labelData.resize(m_labelData.size() + numRead);
+        }
+        recordsRead += numRead;
+        if (numRead < runLength)
+            break;
+    }
+    return (long) recordsRead;
+}
+
 // EnsureDataAvailable - Read enough lines so we can request a minibatch starting as requested
 // mbStartSample - the starting sample we are ensureing are good
 // endOfDataCheck - check if we are at the end of the dataset (no wraparound)
@@ -101,10 +185,12 @@ bool UCIFastReader<ElemType>::EnsureDataAvailable(size_t mbStartSample, bool end
         m_labelData.resize(epochSample);
     }
 
+    // with distributed reading, the other trainers' records may not need to be parsed
+    bool subsetOnly = ReadSubsetOnly();
     int recordsRead = 0;
     do
     {
-        int numRead = m_parser.Parse(numberToRead - recordsRead, &m_featureData, &m_labelData);
+        int numRead = ParseRecords(mbStartSample + recordsRead, numberToRead - recordsRead, subsetOnly);
 
         recordsRead += numRead;
         if (!m_endReached)
@@ -139,6 +225,12 @@ bool UCIFastReader<ElemType>::EnsureDataAvailable(size_t mbStartSample, bool end
         // loop through all the newly read records
         for (int numberRead = 0; numberRead < recordsRead; numberRead++)
         {
+            // (records of other trainers were not parsed)
+            if (subsetOnly && !IsSubsetRecord(mbStartSample + numberRead))
+            {
+                m_labelIdData.push_back(0);
+                continue;
+            }
             LabelType& label = m_labelData[epochSample + numberRead];
             // check to see if we have seen this label before
             auto value = m_mapLabelToId.find(label);
@@ -314,6 +406,10 @@ void UCIFastReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfi
     m_mbStartSample = m_epoch = m_totalSamples = m_epochStartSample = 0;
     m_labelIdMax = m_labelDim = 0;
     m_partialMinibatch = m_endReached = false;
+    m_subsetNum = 0;
+    m_numSubsets = 1;
+    m_subsetDataOnly = false;
+    m_subsetColumnsSweep = SIZE_MAX;
     m_labelType = labelCategory;
     m_featureCount = vdim;
     m_readNextSample = 0;
@@ -601,7 +697,8 @@ void UCIFastReader<ElemType>::SetupEpoch()
                 }
             }
             // move the read pointer to the end since we have everything already in memory.
-            if (endReached && m_epochStartSample % m_totalSamples == fileRecord && m_featureData.size() >= m_epochSize * m_featureCount)
+            // (unless only the records of this trainer's subset were parsed, since this epoch may need others)
+            if (endReached && m_epochStartSample % m_totalSamples == fileRecord && m_featureData.size() >= m_epochSize * m_featureCount && !m_subsetDataOnly)
             {
                 m_readNextSample = mbStartSample + m_epochSize;
                 // write the label file here to make sure we do it somewhere. We know the entire dataset has been read at this point
@@ -670,7 +767,7 @@ void UCIFastReader<ElemType>::StartDistributedMinibatchLoop(size_t mbSize, size_
     // if we are reading from the cache, do so now and return
     if (m_cachingReader)
     {
-        m_cachingReader->StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+        m_cachingReader->StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples);
         return;
     }
 
@@ -891,17 +988,31 @@ bool UCIFastReader<ElemType>::GetMinibatchImpl(std::map<std::wstring, Matrix<Ele
         memset(m_labelsBuffer.get(), 0, sizeof(ElemType) * 1 * actualmbsize);
     }
 
-    if (actualmbsize > 0)
+    // There may be multiple parallel trainers reading at the same time in which case
+    // we will slice the data to only return the share of the current trainer's subset
+    size_t currSubsetStartCol = (actualmbsize * m_subsetNum) / m_numSubsets;
+    size_t currSubsetEndCol = (actualmbsize * (m_subsetNum + 1)) / m_numSubsets;
+    size_t currSubsetSize = currSubsetEndCol - currSubsetStartCol;
+    // create the respective MBLayout
+    // Every sample is returned as a sequence of 1 frame.
+    m_pMBLayout->InitAsFrameMode(currSubsetSize);
+
+    // only the trainer's own samples are copied to the buffers, unless the whole minibatch goes to the cache file
+    bool writingCache = m_cachingWriter && (m_subsetNum == 0);
+    size_t bufferStartCol = writingCache ? 0 : currSubsetStartCol;
+    size_t bufferEndCol = writingCache ? actualmbsize : currSubsetEndCol;
+
+    if (bufferEndCol > bufferStartCol)
     {
         // loop through and copy data to matrix
-        int j = 0; // vector of vectors of feature data
+        size_t j = 0; // vector of vectors of feature data
         // determine randomization base index
         size_t randBase = 0; // (keep compiler happy)
         if (randomize)
             randBase = epochSample - epochSample % m_randomizeRange;
 
-        // loop through all the samples
-        for (size_t jSample = m_mbStartSample; j < actualmbsize; ++j, ++jSample)
+        // loop through the samples; the randomization is the same on all trainers, since it only depends on the sample index
+        for (size_t jSample = m_mbStartSample + bufferStartCol; j < bufferEndCol - bufferStartCol; ++j, ++jSample)
         {
             // pick the right sample with randomization if desired
             size_t jRand = randomize ? (randBase + tmap[jSample % m_randomizeRange]) : jSample;
@@ -929,17 +1040,8 @@ bool UCIFastReader<ElemType>::GetMinibatchImpl(std::map<std::wstring, Matrix<Ele
         }
     }
 
-    // There may be multiple parallel trainers reading at the same time in which case
-    // we will slice the data to only return the share of the current trainer's subset
-    size_t currSubsetStartCol = (actualmbsize * m_subsetNum) / m_numSubsets;
-    size_t currSubsetEndCol = (actualmbsize * (m_subsetNum + 1)) / m_numSubsets;
-    size_t currSubsetSize = currSubsetEndCol - currSubsetStartCol;
-    // create the respective MBLayout
-    // Every sample is returned as a sequence of 1 frame.
-    m_pMBLayout->InitAsFrameMode(currSubsetSize);
-
     // if we are writing out to the caching writer, do it now
-    if (m_cachingWriter && (m_subsetNum == 0))
+    if (writingCache)
     {
         map<std::wstring, void*, nocase_compare> writeBuffer;
         writeBuffer[m_featuresName] = m_featuresBuffer.get();
@@ -978,13 +1080,24 @@ bool UCIFastReader<ElemType>::GetMinibatchImpl(std::map<std::wstring, Matrix<Ele
     m_mbStartSample += actualmbsize;
 
     // if they don't want partial minibatches, skip data transfer and return
-    if (actualmbsize < m_mbSize && !m_partialMinibatch || actualmbsize == 0 || currSubsetSize == 0) // no records found (end of minibatch)
+    if (actualmbsize < m_mbSize && !m_partialMinibatch || actualmbsize == 0) // no records found (end of minibatch)
     {
         return false;
     }
 
+    // a trainer may get no samples of a small last minibatch; like with decimation, that is still a valid (empty) minibatch
+    if (currSubsetSize == 0)
+    {
+        features.Resize(m_featureCount, 0);
+        auto labelEntry = matrices.find(m_labelsName);
+        if (m_labelType != labelNone && labelEntry != matrices.end() && labelEntry->second != nullptr)
+            labelEntry->second->Resize(m_labelType == labelCategory ? m_labelDim : 1, 0);
+        return true;
+    }
+
     // now transfer to the GPU as needed
-    features.SetValue(m_featureCount, currSubsetSize, features.GetDeviceId(), m_featuresBuffer.get() + (m_featureCount * currSubsetStartCol), matrixFlagNormal);
+    size_t bufferOffset = currSubsetStartCol - bufferStartCol;
+    features.SetValue(m_featureCount, currSubsetSize, features.GetDeviceId(), m_featuresBuffer.get() + (m_featureCount * bufferOffset), matrixFlagNormal);
     if (m_labelType == labelCategory)
     {
         auto labelEntry = matrices.find(m_labelsName);
@@ -992,7 +1105,7 @@ bool UCIFastReader<ElemType>::GetMinibatchImpl(std::map<std::wstring, Matrix<Ele
         {
             Matrix<ElemType>* labels = labelEntry->second;
             if (labels != nullptr)
-                labels->SetValue(m_labelDim, currSubsetSize, labels->GetDeviceId(), m_labelsBuffer.get() + (m_labelDim * currSubsetStartCol), matrixFlagNormal);
+                labels->SetValue(m_labelDim, currSubsetSize, labels->GetDeviceId(), m_labelsBuffer.get() + (m_labelDim * bufferOffset), matrixFlagNormal);
         }
     }
     else if (m_labelType != labelNone)
@@ -1002,7 +1115,7 @@ bool UCIFastReader<ElemType>::GetMinibatchImpl(std::map<std::wstring, Matrix<Ele
         {
             Matrix<ElemType>* labels = labelEntry->second;
             if (labels != nullptr)
-                labels->SetValue(1, currSubsetSize, labels->GetDeviceId(), m_labelsBuffer.get() + (1 * currSubsetStartCol), matrixFlagNormal);
+                labels->SetValue(1, currSubsetSize, labels->GetDeviceId(), m_labelsBuffer.get() + (1 * bufferOffset), matrixFlagNormal);
         }
     }
     // we read some records, so process them
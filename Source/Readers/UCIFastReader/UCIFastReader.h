@@ -79,6 +79,9 @@ private:
     // Distributed reading related fields
     size_t m_subsetNum;
     size_t m_numSubsets;
+    bool m_subsetDataOnly;               // the data arrays hold only the records of this trainer's subset (the others are zero)
+    std::vector<size_t> m_subsetColumns; // [record in the randomization range] -> column in the range where it is used
+    size_t m_subsetColumnsSweep;         // randomization sweep of m_subsetColumns
 
     bool m_endReached;
     int m_traceLevel;
@@ -120,6 +123,9 @@ private:
     void ReleaseMemory();
     void WriteLabelFile();
 
+    bool ReadSubsetOnly();
+    bool IsSubsetRecord(size_t sample);
+    long ParseRecords(size_t sample, size_t numRecords, bool subsetOnly);
     virtual bool EnsureDataAvailable(size_t mbStartSample, bool endOfDataCheck = false);
     virtual bool ReadRecord(size_t readSample);
 
@@ -163,10 +169,14 @@ public:
 
     size_t GetNumParallelSequences()
     {
+        if (m_cachingReader)
+            return m_cachingReader->GetNumParallelSequences();
         return m_pMBLayout->GetNumParallelSequences();
     }
     void CopyMBLayoutTo(MBLayoutPtr pMBLayout)
     {
+        if (m_cachingReader)
+            return m_cachingReader->CopyMBLayoutTo(pMBLayout);
         pMBLayout->CopyFrom(m_pMBLayout);
     };
     virtual const std::map<LabelIdType, LabelType>& GetLabelMapping(const std::wstring& sectionName);
@@ -0,0 +1,198 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// LocalParallelTrain.h -- helpers for data-parallel training with several worker threads in one process (SGD's localParallelTrain)
+//
+// Each worker owns a replica of the network (its own activations and gradients) and trains on its share of the
+// minibatches of the one training reader, which the LocalMinibatchDealer hands out. The parameters are either the
+// same Matrix objects in all replicas, updated by all workers without locking ('hogwild'), or each replica has its
+// own copy, and the copies are averaged every few minibatches, at a LocalWorkerBarrier ('modelAveraging').
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "ComputationNetwork.h"
+#include "DataReader.h"
+#include "DataReaderHelpers.h"
+#include "Matrix.h"
+#include "TaskGraphExecutor.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// state of one worker: its network replica, and its statistics of the current epoch
+template <class ElemType>
+struct LocalWorker
+{
+    ComputationNetworkPtr net;
+    std::vector<ComputationNodeBasePtr> featureNodes;
+    std::vector<ComputationNodeBasePtr> labelNodes;
+    std::vector<ComputationNodeBasePtr> criterionNodes;
+    std::vector<ComputationNodeBasePtr> evaluationNodes;
+    std::list<ComputationNodeBasePtr> learnableNodes; // in the same order as those of the main network
+    std::map<std::wstring, Matrix<ElemType>*> inputMatrices;
+    std::list<Matrix<ElemType>> smoothedGradients;
+    double fsAdaSmoothedFrames; // the rest of the learner state (see SGD::UpdateLearnableParameters())
+    double prevDropoutRate;
+    unsigned long dropOutSeed;
+
+    size_t numMBs;
+    size_t numSamples; // with label
+    double criterion;  // sums over the minibatches
+    std::vector<double> evalErrors;
+    double seconds;        // from the start of the epoch until the worker ran out of data
+    double secondsWaiting; // of which waiting for a minibatch or for the other workers
+
+    LocalWorker()
+        : fsAdaSmoothedFrames(0), prevDropoutRate(0), dropOutSeed(1)
+    {
+        ResetStatistics();
+    }
+    void ResetStatistics()
+    {
+        numMBs = numSamples = 0;
+        criterion = seconds = secondsWaiting = 0;
+        evalErrors.assign(evaluationNodes.size(), 0);
+    }
+};
+
+// hands out the minibatches of one reader to the workers, one at a time
+// If 'ordered', worker w receives minibatches w, w + K, w + 2K, ... of the epoch, independent of the timing of the
+// threads, which makes training reproducible; otherwise, whoever asks first gets the next one.
+template <class ElemType>
+class LocalMinibatchDealer
+{
+public:
+    LocalMinibatchDealer(IDataReader<ElemType>& reader, size_t numWorkers, bool ordered)
+        : m_reader(reader), m_numWorkers(numWorkers), m_ordered(ordered), m_next(0), m_dataEnd(false)
+    {
+    }
+
+    // read the next minibatch of 'worker' into its network; returns false at the end of the epoch
+    bool GetMinibatch(size_t worker, LocalWorker<ElemType>& state, size_t& actualMBSize)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_ordered)
+            m_turn.wait(lock, [&]() { return m_dataEnd || m_next % m_numWorkers == worker; });
+        if (m_dataEnd)
+            return false;
+        bool wasDataRead;
+        try
+        {
+            wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork(m_reader, state.net, state.criterionNodes[0],
+                                                                     false, false, state.inputMatrices, actualMBSize);
+            if (wasDataRead)
+                m_reader.DataEnd(EndDataType::endDataSentence);
+        }
+        catch (...)
+        {
+            m_dataEnd = true; // (nobody gets further data)
+            m_turn.notify_all();
+            throw;
+        }
+        if (!wasDataRead)
+            m_dataEnd = true;
+        m_next++;
+        m_turn.notify_all();
+        return wasDataRead;
+    }
+
+    // no more minibatches for anybody, e.g. because a worker failed
+    void Abort()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_dataEnd = true;
+        m_turn.notify_all();
+    }
+
+private:
+    IDataReader<ElemType>& m_reader;
+    size_t m_numWorkers;
+    bool m_ordered;
+    size_t m_next; // number of minibatches handed out so far
+    bool m_dataEnd;
+    std::mutex m_mutex;
+    std::condition_variable m_turn;
+};
+
+// lets the workers meet, e.g. to average their models
+// A worker that has run out of data Leave()s; the others then no longer wait for it.
+class LocalWorkerBarrier
+{
+public:
+    // 'action' is run by the last worker to arrive at a meeting, with the indices of the workers that arrived, in ascending order
+    LocalWorkerBarrier(size_t numWorkers, const std::function<void(const std::vector<size_t>&)>& action)
+        : m_numActive(numWorkers), m_action(action), m_generation(0), m_aborted(false)
+    {
+    }
+
+    // wait until all active workers have arrived; returns false if the barrier was aborted
+    bool Arrive(size_t worker)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_aborted)
+            return false;
+        m_arrived.push_back(worker);
+        if (m_arrived.size() == m_numActive)
+            return Complete();
+        size_t generation = m_generation;
+        m_met.wait(lock, [&]() { return m_aborted || m_generation != generation; });
+        return !m_aborted;
+    }
+
+    // a worker is done for good; a meeting that only waited for it takes place now
+    void Leave()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_numActive--;
+        if (!m_aborted && !m_arrived.empty() && m_arrived.size() == m_numActive)
+            Complete();
+    }
+
+    // release all waiting workers, e.g. because a worker failed
+    void Abort()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_aborted = true;
+        m_met.notify_all();
+    }
+
+private:
+    // (called with m_mutex held; the others are waiting anyway)
+    bool Complete()
+    {
+        std::sort(m_arrived.begin(), m_arrived.end());
+        try
+        {
+            m_action(m_arrived);
+        }
+        catch (...)
+        {
+            m_aborted = true;
+            m_met.notify_all();
+            throw;
+        }
+        m_arrived.clear();
+        m_generation++;
+        m_met.notify_all();
+        return true;
+    }
+
+    size_t m_numActive;
+    std::function<void(const std::vector<size_t>&)> m_action;
+    std::vector<size_t> m_arrived;
+    size_t m_generation;
+    bool m_aborted;
+    std::mutex m_mutex;
+    std::condition_variable m_met;
+};
+} } }
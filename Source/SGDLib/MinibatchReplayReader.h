@@ -0,0 +1,218 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MinibatchReplayReader.h -- keeps the minibatches of one pass over a reader in memory, to replay them for further passes
+//
+// Used for the trial mini-epochs of the learning-rate and minibatch-size search, which all read the same leading
+// part of an epoch. The first pass reads from the wrapped reader and records each minibatch (the input matrices and
+// the MBLayout). A later pass that is started with the same minibatch size, epoch, subset and number of samples is
+// served from the recording, without touching the wrapped reader; any other pass reads from it and is recorded anew.
+// The recording is kept on the device of the input matrices.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "DataReader.h"
+#include "Matrix.h"
+#include "Sequences.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class MinibatchReplayReader : public IDataReader<ElemType>
+{
+public:
+    MinibatchReplayReader(IDataReader<ElemType>* reader)
+        : m_reader(reader), m_replaying(false), m_complete(false), m_replayable(false), m_nextMinibatch(0), m_numParallelSequences(0), m_numReplays(0)
+    {
+    }
+
+    virtual void Init(const ConfigParameters&) override
+    {
+        LogicError("MinibatchReplayReader: wraps an initialized reader");
+    }
+    virtual void Init(const ScriptableObjects::IConfigRecord&) override
+    {
+        LogicError("MinibatchReplayReader: wraps an initialized reader");
+    }
+    virtual void Destroy() override
+    {
+        // (owned by its creator; the wrapped reader is not ours to destroy)
+    }
+
+    virtual void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize) override
+    {
+        if (!Start(PassKey(mbSize, epoch, 0, 1, requestedEpochSamples)))
+        {
+            m_reader->StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+            m_numParallelSequences = m_reader->GetNumParallelSequences();
+        }
+    }
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return m_reader->SupportsDistributedMBRead();
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override
+    {
+        if (!Start(PassKey(mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples)))
+        {
+            m_reader->StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples);
+            m_numParallelSequences = m_reader->GetNumParallelSequences();
+        }
+    }
+
+    virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices) override
+    {
+        if (m_replaying)
+        {
+            if (m_nextMinibatch >= m_minibatches.size())
+                return false;
+            const auto& minibatch = *m_minibatches[m_nextMinibatch];
+            m_currentLayout = minibatch.layout;
+            m_nextMinibatch++;
+            for (auto& iter : matrices)
+            {
+                auto recorded = minibatch.matrices.find(iter.first);
+                if (recorded == minibatch.matrices.end())
+                    LogicError("MinibatchReplayReader: input '%ls' was not recorded", iter.first.c_str());
+                iter.second->SetValue(*recorded->second, recorded->second->GetFormat());
+            }
+            return true;
+        }
+
+        bool wasDataRead = m_reader->GetMinibatch(matrices);
+        if (!wasDataRead)
+        {
+            m_complete = true; // (the end of the pass has been reached; it can now be replayed)
+            return false;
+        }
+        if (m_replayable)
+        {
+            auto minibatch = make_shared<RecordedMinibatch>();
+            for (const auto& iter : matrices)
+            {
+                auto copy = make_shared<Matrix<ElemType>>(iter.second->GetDeviceId());
+                copy->SetValue(*iter.second, iter.second->GetFormat());
+                minibatch->matrices[iter.first] = copy;
+            }
+            minibatch->layout = make_shared<MBLayout>();
+            m_reader->CopyMBLayoutTo(minibatch->layout);
+            m_minibatches.push_back(minibatch);
+        }
+        return true;
+    }
+
+    virtual void CopyMBLayoutTo(MBLayoutPtr pMBLayout) override
+    {
+        if (m_replaying)
+            pMBLayout->CopyFrom(m_currentLayout);
+        else
+            m_reader->CopyMBLayoutTo(pMBLayout);
+    }
+    virtual size_t GetNumParallelSequences() override
+    {
+        return m_replaying ? m_numParallelSequences : m_reader->GetNumParallelSequences();
+    }
+    virtual bool DataEnd(EndDataType endDataType) override
+    {
+        return m_replaying ? true : m_reader->DataEnd(endDataType);
+    }
+    virtual bool RequireSentenceSeg() const override
+    {
+        return m_reader->RequireSentenceSeg();
+    }
+    virtual int GetSentenceEndIdFromOutputLabel() override
+    {
+        return m_reader->GetSentenceEndIdFromOutputLabel();
+    }
+
+    // data that depends on more than the input matrices cannot be replayed; passes that use it are not recorded
+    virtual bool GetMinibatch4SE(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, vector<size_t>& extrauttmap) override
+    {
+        if (m_replaying)
+            LogicError("MinibatchReplayReader: sequence-training data cannot be replayed");
+        DisableRecording();
+        return m_reader->GetMinibatch4SE(latticeinput, uids, boundaries, extrauttmap);
+    }
+    virtual bool GetMinibatchCopy(std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo, std::map<std::wstring, Matrix<ElemType>*>& matrices, MBLayoutPtr pMBLayout) override
+    {
+        if (m_replaying)
+            return false;
+        bool wasDataRead = m_reader->GetMinibatchCopy(uttInfo, matrices, pMBLayout);
+        if (wasDataRead)
+            DisableRecording();
+        return wasDataRead;
+    }
+    virtual bool SetNetOutput(const std::vector<std::vector<std::pair<wstring, size_t>>>& uttInfo, const Matrix<ElemType>& outputs, const MBLayoutPtr pMBLayout) override
+    {
+        return m_replaying ? false : m_reader->SetNetOutput(uttInfo, outputs, pMBLayout);
+    }
+
+    // number of passes served from memory so far
+    size_t NumReplays() const
+    {
+        return m_numReplays;
+    }
+
+private:
+    struct PassKey
+    {
+        size_t mbSize, epoch, subsetNum, numSubsets, requestedEpochSamples;
+        PassKey(size_t mbSize = 0, size_t epoch = 0, size_t subsetNum = 0, size_t numSubsets = 0, size_t requestedEpochSamples = 0)
+            : mbSize(mbSize), epoch(epoch), subsetNum(subsetNum), numSubsets(numSubsets), requestedEpochSamples(requestedEpochSamples)
+        {
+        }
+        bool operator==(const PassKey& other) const
+        {
+            return mbSize == other.mbSize && epoch == other.epoch && subsetNum == other.subsetNum && numSubsets == other.numSubsets && requestedEpochSamples == other.requestedEpochSamples;
+        }
+    };
+    struct RecordedMinibatch
+    {
+        std::map<std::wstring, shared_ptr<Matrix<ElemType>>> matrices;
+        MBLayoutPtr layout;
+    };
+
+    // start a pass; returns true if it is replayed, otherwise the caller starts the wrapped reader, and the pass is recorded
+    bool Start(const PassKey& key)
+    {
+        if (m_complete && m_replayable && key == m_key)
+        {
+            m_replaying = true;
+            m_nextMinibatch = 0;
+            m_numReplays++;
+            return true;
+        }
+        m_replaying = false;
+        m_complete = false;
+        m_replayable = true;
+        m_key = key;
+        m_minibatches.clear();
+        m_numReplays = 0;
+        return false;
+    }
+
+    void DisableRecording()
+    {
+        m_replayable = false;
+        m_minibatches.clear();
+    }
+
+    IDataReader<ElemType>* m_reader; // (not owned)
+    PassKey m_key;                   // parameters of the recorded pass
+    bool m_replaying;                // serving the current pass from m_minibatches
+    bool m_complete;                 // the recorded pass was read to its end
+    bool m_replayable;               // the recorded pass only consists of input matrices and MBLayouts
+    std::vector<shared_ptr<RecordedMinibatch>> m_minibatches;
+    size_t m_nextMinibatch;
+    MBLayoutPtr m_currentLayout;
+    size_t m_numParallelSequences;
+    size_t m_numReplays;
+};
+} } }
@@ -0,0 +1,234 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// OutputValueWriter.h -- buffered writing of output node values on a background thread, for the "write" action
+//
+// Write() copies a minibatch of values into one of two host buffers and returns as soon as the previous minibatch
+// has been written, so formatting and file I/O of one minibatch overlap with ForwardProp() of the next.
+//
+// Formats:
+//  - text:   one line per column, each value followed by a blank. Values have 6 significant digits (as with the
+//            former ofstream output), or, with 'roundTrip', 9 (float) or 17 (double), which read back to the identical value.
+//  - binary: raw float32, column after column, plus an index file '<path>.idx' (text) whose first line is the
+//            number of rows, followed by one line 'firstColumn numColumns' per minibatch.
+//  - htk:    a single HTK feature file (parameter kind USER, float32, big-endian) with one frame per column.
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "Matrix.h"
+#include "fileutil.h"
+#include <string>
+#include <vector>
+#include <future>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+enum class OutputValueFormat
+{
+    text,
+    binary,
+    htk
+};
+
+static inline OutputValueFormat ParseOutputValueFormat(const std::wstring& s)
+{
+    if (s == L"text")
+        return OutputValueFormat::text;
+    else if (s == L"binary")
+        return OutputValueFormat::binary;
+    else if (s == L"htk")
+        return OutputValueFormat::htk;
+    InvalidArgument("Invalid outputFormat '%ls'; must be 'text', 'binary' or 'htk'.", s.c_str());
+}
+
+template <class ElemType>
+class OutputValueWriter
+{
+public:
+    OutputValueWriter(const std::wstring& path, OutputValueFormat format, bool roundTrip = false)
+        : m_path(path), m_format(format), m_roundTrip(roundTrip), m_indexFile(nullptr), m_current(0), m_numRows(0), m_numColumns(0)
+    {
+        m_file = fopenOrDie(path, format == OutputValueFormat::text ? L"w" : L"wb");
+        if (m_format == OutputValueFormat::binary)
+            m_indexFile = fopenOrDie(path + L".idx", L"w");
+        else if (m_format == OutputValueFormat::htk)
+            WriteHTKHeader(); // (rewritten by Close() once the number of frames is known)
+        m_buffers[0] = m_buffers[1] = nullptr;
+        m_bufferSizes[0] = m_bufferSizes[1] = 0;
+    }
+    ~OutputValueWriter()
+    {
+        if (m_pending.valid())
+            m_pending.wait();
+        if (m_file)
+            fclose(m_file);
+        if (m_indexFile)
+            fclose(m_indexFile);
+        delete[] m_buffers[0];
+        delete[] m_buffers[1];
+    }
+
+    // hand over the next minibatch of values; they are copied, so the matrix may be overwritten right after
+    void Write(const Matrix<ElemType>& values)
+    {
+        const size_t numRows = values.GetNumRows();
+        const size_t numCols = values.GetNumCols();
+        if (numRows * numCols == 0)
+            return;
+        // fill the buffer that is not being written while the previous minibatch may still be in flight
+        values.CopyToArray(m_buffers[m_current], m_bufferSizes[m_current]);
+        Wait();
+        const ElemType* data = m_buffers[m_current];
+        m_pending = std::async(std::launch::async, [this, data, numRows, numCols]()
+                               {
+                                   WriteBlock(data, numRows, numCols);
+                               });
+        m_current = 1 - m_current;
+    }
+
+    // finish writing; errors of the background thread are reported here at the latest
+    void Close()
+    {
+        Wait();
+        if (m_format == OutputValueFormat::htk)
+        {
+            fseekOrDie(m_file, 0, SEEK_SET);
+            WriteHTKHeader();
+        }
+        CloseFile(m_file, m_path);
+        if (m_indexFile)
+            CloseFile(m_indexFile, m_path + L".idx");
+    }
+
+private:
+    void Wait()
+    {
+        if (m_pending.valid())
+            m_pending.get(); // (rethrows an exception of the background thread)
+    }
+
+    static void CloseFile(FILE*& f, const std::wstring& path)
+    {
+        int rc = fclose(f);
+        f = nullptr;
+        if (rc != 0)
+            RuntimeError("OutputValueWriter: error writing '%ls'", path.c_str());
+    }
+
+    // runs on the background thread
+    void WriteBlock(const ElemType* data, size_t numRows, size_t numCols)
+    {
+        if (m_format != OutputValueFormat::text)
+        {
+            if (m_numRows == 0)
+            {
+                if (m_format == OutputValueFormat::htk && numRows * sizeof(float) > SHRT_MAX)
+                    RuntimeError("OutputValueWriter: %d rows are too many for the HTK format; use outputFormat=binary", (int) numRows);
+                m_numRows = numRows;
+                if (m_indexFile)
+                    fprintfOrDie(m_indexFile, "%d\n", (int) numRows);
+            }
+            else if (numRows != m_numRows)
+                LogicError("OutputValueWriter: the number of rows changed from %d to %d", (int) m_numRows, (int) numRows);
+        }
+
+        switch (m_format)
+        {
+        case OutputValueFormat::text:
+            WriteText(data, numRows, numCols);
+            break;
+        case OutputValueFormat::binary:
+        case OutputValueFormat::htk:
+            m_floatBuffer.resize(numRows * numCols);
+            for (size_t i = 0; i < m_floatBuffer.size(); i++)
+                m_floatBuffer[i] = (float) data[i];
+            if (m_format == OutputValueFormat::htk)
+                for (auto& value : m_floatBuffer)
+                    SwapBytes(&value, sizeof(value));
+            fwriteOrDie(m_floatBuffer.data(), sizeof(float), m_floatBuffer.size(), m_file);
+            if (m_indexFile)
+                fprintfOrDie(m_indexFile, "%llu %llu\n", (unsigned long long) m_numColumns, (unsigned long long) numCols);
+            break;
+        }
+        m_numColumns += numCols;
+    }
+
+    void WriteText(const ElemType* data, size_t numRows, size_t numCols)
+    {
+        // formatted into one buffer per minibatch, which is written with a single call
+        const size_t maxValueLength = 32;
+        m_textBuffer.resize(numCols * (numRows * maxValueLength + 1));
+        char* p = m_textBuffer.data();
+        for (size_t j = 0; j < numCols; j++)
+        {
+            for (size_t i = 0; i < numRows; i++)
+            {
+                p += FormatValue(p, maxValueLength, *data++);
+                *p++ = ' ';
+            }
+            *p++ = '\n';
+        }
+        fwriteOrDie(m_textBuffer.data(), 1, p - m_textBuffer.data(), m_file);
+    }
+
+    // format one value into 'p', returns the number of characters
+    // (9 resp. 17 significant digits are enough for any float resp. double to read back to the identical value)
+    int FormatValue(char* p, size_t size, ElemType value) const
+    {
+        if (!m_roundTrip)
+            return snprintf(p, size, "%.6g", (double) value);
+        return snprintf(p, size, sizeof(ElemType) == sizeof(float) ? "%.9g" : "%.17g", (double) value);
+    }
+
+    static void SwapBytes(void* p, size_t n)
+    {
+        char* c = (char*) p;
+        for (size_t i = 0; i < n / 2; i++)
+            std::swap(c[i], c[n - 1 - i]);
+    }
+
+    void WriteHTKHeader()
+    {
+        // nSamples, sampPeriod [100ns], sampSize [bytes], parmKind (9 = USER), big-endian
+        int32_t numSamples = (int32_t) m_numColumns;
+        int32_t samplePeriod = 100000;
+        int16_t sampleSize = (int16_t)(m_numRows * sizeof(float));
+        int16_t parameterKind = 9;
+        SwapBytes(&numSamples, sizeof(numSamples));
+        SwapBytes(&samplePeriod, sizeof(samplePeriod));
+        SwapBytes(&sampleSize, sizeof(sampleSize));
+        SwapBytes(&parameterKind, sizeof(parameterKind));
+        fwriteOrDie(&numSamples, sizeof(numSamples), 1, m_file);
+        fwriteOrDie(&samplePeriod, sizeof(samplePeriod), 1, m_file);
+        fwriteOrDie(&sampleSize, sizeof(sampleSize), 1, m_file);
+        fwriteOrDie(&parameterKind, sizeof(parameterKind), 1, m_file);
+    }
+
+    std::wstring m_path;
+    OutputValueFormat m_format;
+    bool m_roundTrip;
+    FILE* m_file;
+    FILE* m_indexFile;
+
+    // double buffering: Write() fills m_buffers[m_current] while the other one may still be written
+    ElemType* m_buffers[2];
+    size_t m_bufferSizes[2];
+    int m_current;
+    std::future<void> m_pending;
+
+    // used by the background thread only
+    size_t m_numRows;    // rows of the first minibatch (binary and htk)
+    size_t m_numColumns; // columns written so far
+    std::vector<char> m_textBuffer;
+    std::vector<float> m_floatBuffer;
+
+    void operator=(const OutputValueWriter&); // (not assignable)
+};
+} } }
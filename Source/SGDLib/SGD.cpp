@@ -14,6 +14,8 @@
 #endif
 #include "SimpleDistGradAggregator.h"
 #include "ProgressTracing.h"
+#include "PerformanceProfiler.h"
+#include "NumaPlacement.h"
 
 #include <map>
 #include <set>
@@ -315,6 +317,14 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                                                   m_seqGammarCalcAMF, m_seqGammarCalcLMF, m_seqGammarCalcWP, m_seqGammarCalcbMMIFactor, m_seqGammarCalcUsesMBR);
     }
 
+    // replicas of the network for data-parallel training on several threads of this process
+    if (m_localParallelizationMethod != LocalParallelizationMethod::None)
+    {
+        if ((m_needAdaptRegularization && m_adaptationRegType == AdaptationRegType::KL && refNode) || isSequenceTrainingCriterion)
+            InvalidArgument("LocalParallelTrain cannot be combined with KL-regularized adaptation or sequence training.");
+        CreateLocalWorkers(net, criterionNodes, evaluationNodes, learnableNodes);
+    }
+
     // --- MAIN EPOCH LOOP
     for (int i = startEpoch; i < (int) m_maxEpochs; i++) // TODO: why is this an int, and not a size_t?
     {
@@ -403,6 +413,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             chosenMinibatchSize = m_mbSize[i];
         }
 
+        // the searches of this epoch are done
+        ClearTrialState();
+
         actualMinibatchSize = FixUpEffectiveMBSize(chosenMinibatchSize /*BUGBUG workaround:*/, trainSetDataReader->GetNumParallelSequences());
 
         double momentumPerSample = GetMomentumPerSample(i /*BUGBUG workaround:*/, trainSetDataReader->GetNumParallelSequences());
@@ -413,21 +426,31 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         fprintf(stderr, "Starting Epoch %d: learning rate per sample = %f  effective momentum = %f  momentum as time constant = %.1f samples\n",
                 i + 1, learnRatePerSample, MomentumPerMB(momentumPerSample, actualMinibatchSize), momentumAsTimeConstant);
 
-        TrainOneEpoch(net,
-                      refNet,
-                      refNode,
-                      i,
-                      m_epochSize,
-                      trainSetDataReader,
-                      learnRatePerSample,
-                      chosenMinibatchSize,
-                      featureNodes,
-                      labelNodes,
-                      criterionNodes,
-                      evaluationNodes,
-                      inputMatrices,
-                      learnableNodes, smoothedGradients,
-                      epochCriterion, epochEvalErrors, totalSamplesSeen);
+        if (!m_localWorkers.empty())
+            TrainOneEpochWithLocalWorkers(net,
+                                          i,
+                                          m_epochSize,
+                                          trainSetDataReader,
+                                          learnRatePerSample,
+                                          chosenMinibatchSize,
+                                          learnableNodes, smoothedGradients,
+                                          epochCriterion, epochEvalErrors, totalSamplesSeen);
+        else
+            TrainOneEpoch(net,
+                          refNet,
+                          refNode,
+                          i,
+                          m_epochSize,
+                          trainSetDataReader,
+                          learnRatePerSample,
+                          chosenMinibatchSize,
+                          featureNodes,
+                          labelNodes,
+                          criterionNodes,
+                          evaluationNodes,
+                          inputMatrices,
+                          learnableNodes, smoothedGradients,
+                          epochCriterion, epochEvalErrors, totalSamplesSeen);
 
         timer.Stop();
         double epochTime = timer.ElapsedSeconds();
@@ -478,6 +501,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                         i + 1, (int) m_maxEpochs, evalNodeNames[j].c_str(), epochEvalErrors[j]);
             }
         }
+        if (net->RecomputesActivations())
+            fprintf(stderr, "Finished Epoch[%2d of %d]: Node values and gradients take %.1f MB with activation recomputation\n",
+                    i + 1, (int) m_maxEpochs, net->GetNumMatrixPoolBytes() / (1024.0 * 1024.0));
 
         if ((g_mpi == nullptr) || g_mpi->IsMainNode())
         {
@@ -708,6 +734,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 {
     double totalTimeInMBs = 0; // use double since timer has sub-microsecond time resolution
     double epochCriterionLastMBs = 0;
+    MinibatchPhaseTimes phaseTimesLastMBs; // breakdown of totalTimeInMBs
+    MinibatchPhaseTimes epochPhaseTimes;
+    double epochTimeInMBs = 0;
 
     int numSamplesLastMBs = 0;
     std::vector<double> epochEvalErrorsLastMBs(epochEvalErrors.size(), 0);
@@ -835,8 +864,12 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         // get minibatch
         // TODO: is it guaranteed that the GPU is already completed at this point, is it safe to overwrite the buffers?
         size_t actualMBSize = 0;
-        bool wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, criterionNodes[0],
-                                                                      useDistributedMBReading, useParallelTrain, *inputMatrices, actualMBSize);
+        bool wasDataRead;
+        {
+            ProfilePhase profile("ReadMinibatch", &phaseTimesLastMBs.seconds[MinibatchPhaseTimes::ReadMinibatch]);
+            wasDataRead = DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, criterionNodes[0],
+                                                                     useDistributedMBReading, useParallelTrain, *inputMatrices, actualMBSize);
+        }
         if (!wasDataRead && (!useDistributedMBReading || noMoreSamplesToProcess)) // in case of distributed reading, we do a few more loops until all ranks have completed
             break;                                                                // end of epoch
 
@@ -880,6 +913,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             }
 
             // do forward and back propagation
+            ProfilePhase profile("ForwardBackward", &phaseTimesLastMBs.seconds[MinibatchPhaseTimes::ForwardBackward]);
 
             // We optionally break the minibatch into sub-minibatches.
             // This, when enabled, is used when a full minibatch does not fit into GPU RAM.
@@ -979,6 +1013,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             for (size_t i = 0; i < evaluationNodes.size(); i++)
                 m_gradHeader->evalErrors[i] = actualMBSize > 0 ? evaluationNodes[i]->Get00Element() : 0.0;
 
+            ProfilePhase profile("AggregateGradients", &phaseTimesLastMBs.seconds[MinibatchPhaseTimes::AggregateGradients]);
             bool samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader, epochNumber);
             noMoreSamplesToProcess = !samplesProcessed;
 
@@ -992,27 +1027,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         // update model parameters
         if ((aggregateNumSamples > 0) && (learnRatePerSample > m_minLearnRate * 0.01))
         {
-            auto smoothedGradientIter = smoothedGradients.begin();
-            for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
-            {
-                ComputationNodeBasePtr node = *nodeIter;
-                if (node->IsParameterUpdateRequired())
-                {
-                    Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
-#ifdef _DEBUG
-                    if (smoothedGradient.HasNan("TrainOneEpoch/UpdateWeights(): "))
-                        LogicError("%ls %ls operation has NaNs in smoothedGradient.", node->NodeName().c_str(), node->OperationName().c_str());
-#endif
-                    UpdateWeights(node, smoothedGradient, learnRatePerSample,
-                                  GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtr()->GetNumParallelSequences()), aggregateNumSamples,
-                                  m_L2RegWeight, m_L1RegWeight,
-                                  m_needAveMultiplier, m_useNesterovMomentum);
-#ifdef _DEBUG
-                    if (dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().HasNan("TrainOneEpoch/UpdateWeights(): "))
-                        LogicError("%ls %ls operation has NaNs in functionValues after parameter update.", node->NodeName().c_str(), node->OperationName().c_str());
-#endif
-                }
-            }
+            ProfilePhase profile("UpdateWeights", &phaseTimesLastMBs.seconds[MinibatchPhaseTimes::UpdateWeights]);
+            double momentumPerSample = GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, net->GetMBLayoutPtr()->GetNumParallelSequences());
+            UpdateLearnableParameters(learnableNodes, smoothedGradients, m_fsAdaSmoothedFrames, learnRatePerSample, momentumPerSample, aggregateNumSamples);
         }
 
         // aggregation by model averaging
@@ -1031,6 +1048,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
             if (g_mpi->NumNodesInUse() > 1)
             {
+                ProfilePhase profile("ModelAveraging", &phaseTimesLastMBs.seconds[MinibatchPhaseTimes::ModelAveraging]);
                 size_t processedSamples = 0;
                 float secondsSinceLastSyncFinished = 0;
                 float secondsSpentOnSync = 0;
@@ -1127,6 +1145,10 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             string formatString = "TotalTime = " + GeneratePaddedFloatOrExpFormat(0, 4, totalTimeInMBs) + "s; SamplesPerSecond = %.1f\n";
             SGDTrace(stderr, formatString.c_str(), totalTimeInMBs, numSamplesLastMBs / totalTimeInMBs);
 
+            // where the time went; ranks run in lockstep only with gradient aggregation, so only then can we compare them here
+            TraceTimeBreakdown(msra::strfun::strprintf("Epoch[%2d of %d]-Minibatch[%4d-%4d]", epochNumber + 1, (int) m_maxEpochs, numMBsRun - m_numMBsToShowResult + 1, numMBsRun),
+                               phaseTimesLastMBs, totalTimeInMBs, useGradientAggregation);
+
             // progress tracing for compute cluster management
             if (wasProgressPrinted)
             {
@@ -1139,6 +1161,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             }
 
             // reset statistics
+            epochPhaseTimes += phaseTimesLastMBs;
+            epochTimeInMBs += totalTimeInMBs;
+            phaseTimesLastMBs.Reset();
             totalTimeInMBs = 0;
             numSamplesLastMBs = 0;
 
@@ -1175,6 +1200,11 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
     // --- END MAIN MINIBATCH LOOP
 
+    // time breakdown of the whole epoch (all ranks get here)
+    epochPhaseTimes += phaseTimesLastMBs;
+    epochTimeInMBs += totalTimeInMBs;
+    TraceTimeBreakdown(msra::strfun::strprintf("Epoch[%2d of %d]", epochNumber + 1, (int) m_maxEpochs), epochPhaseTimes, epochTimeInMBs, useParallelTrain);
+
     if (useModelAveraging && (g_mpi->NumNodesInUse() > 1))
     {
         // may not be synced after epoch finished, so do the sync here
@@ -1220,6 +1250,362 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     return totalEpochSamples;
 }
 
+// -----------------------------------------------------------------------
+// data-parallel training on several threads of this process (localParallelTrain)
+// -----------------------------------------------------------------------
+
+// the values of those 'learnableNodes' that are updated
+template <class ElemType>
+static std::vector<Matrix<ElemType>*> UpdatedParameterValues(const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    std::vector<Matrix<ElemType>*> values;
+    for (const auto& node : learnableNodes)
+    {
+        if (node->IsParameterUpdateRequired())
+            values.push_back(&dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value());
+    }
+    return values;
+}
+
+// the smoothed gradients that belong to those 'learnableNodes' that are updated
+template <class ElemType>
+static std::vector<Matrix<ElemType>*> UpdatedSmoothedGradients(const std::list<ComputationNodeBasePtr>& learnableNodes, std::list<Matrix<ElemType>>& smoothedGradients)
+{
+    std::vector<Matrix<ElemType>*> matrices;
+    auto smoothedGradientIter = smoothedGradients.begin();
+    for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+    {
+        if ((*nodeIter)->IsParameterUpdateRequired())
+            matrices.push_back(&*smoothedGradientIter);
+    }
+    return matrices;
+}
+
+// replace copies[k][j] for all k by their average, and copy that to targets[j] as well (if given)
+// The copies are summed in the given order, so that the result does not depend on the timing of the threads.
+template <class ElemType>
+static void AverageMatrices(const std::vector<std::vector<Matrix<ElemType>*>>& copies, const std::vector<Matrix<ElemType>*>& targets)
+{
+    for (size_t j = 0; j < copies[0].size(); j++)
+    {
+        Matrix<ElemType>& average = *copies[0][j];
+        for (size_t k = 1; k < copies.size(); k++)
+            average += *copies[k][j];
+        average *= (ElemType)(1.0 / copies.size());
+        for (size_t k = 1; k < copies.size(); k++)
+            copies[k][j]->SetValue(average);
+        if (!targets.empty())
+            targets[j]->SetValue(average);
+    }
+}
+
+// create the network replicas of the worker threads
+// They are loaded from a copy of the model as it is after PreCompute. Their LearnableParameters are set from the main
+// network at the start of each epoch, and the main network receives the result at its end.
+template <class ElemType>
+void SGD<ElemType>::CreateLocalWorkers(ComputationNetworkPtr net,
+                                       const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                                       const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                                       const std::list<ComputationNodeBasePtr>& learnableNodes)
+{
+    if (net->GetDeviceId() != CPUDEVICE)
+        InvalidArgument("LocalParallelTrain is only supported on the CPU (deviceId=-1).");
+    if (m_maxSamplesInRAM < SIZE_MAX || m_numSubminiBatches > 1)
+        InvalidArgument("LocalParallelTrain cannot be combined with sub-minibatches (maxSamplesInRAM, numSubminibatches).");
+    if (m_doGradientCheck)
+        InvalidArgument("LocalParallelTrain cannot be combined with gradientcheck.");
+    if (ComputationNetwork::IsParallelNodeExecutionEnabled())
+        InvalidArgument("LocalParallelTrain cannot be combined with parallelNodeExecution, which also divides the CPU threads.");
+
+    const wstring replicaPath = m_modelPath + L".localWorker";
+    net->Save(replicaPath);
+    m_localWorkers.clear();
+    for (size_t w = 0; w < m_numLocalWorkers; w++)
+    {
+        // with pinThreads, each worker runs on one NUMA node, and its replica is allocated there
+        NumaPlacement::ScopedNodeBinding binding(NumaPlacement::NodeOfWorker(w, m_numLocalWorkers));
+        unique_ptr<LocalWorker<ElemType>> worker(new LocalWorker<ElemType>());
+        worker->net = ComputationNetwork::CreateFromFile<ElemType>(net->GetDeviceId(), replicaPath);
+        for (const auto& node : criterionNodes)
+            worker->criterionNodes.push_back(worker->net->GetNodeFromName(node->NodeName()));
+        for (const auto& node : evaluationNodes)
+            worker->evaluationNodes.push_back(worker->net->GetNodeFromName(node->NodeName()));
+        worker->featureNodes = worker->net->FeatureNodes();
+        worker->labelNodes = worker->net->LabelNodes();
+
+        worker->net->AllocateAllMatrices(worker->evaluationNodes, {}, worker->criterionNodes[0]);
+        ComputationNetwork::SetMaxTempMemSizeForCNN(worker->net, worker->criterionNodes[0], m_maxTempMemSizeInSamplesForCNN);
+        for (const auto& node : worker->featureNodes)
+            worker->inputMatrices[node->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        for (const auto& node : worker->labelNodes)
+            worker->inputMatrices[node->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+
+        worker->learnableNodes = worker->net->LearnableParameterNodes(worker->criterionNodes[0]);
+        if (worker->learnableNodes.size() != learnableNodes.size() ||
+            !std::equal(learnableNodes.begin(), learnableNodes.end(), worker->learnableNodes.begin(), [](const ComputationNodeBasePtr& a, const ComputationNodeBasePtr& b)
+                        {
+                            return a->NodeName() == b->NodeName();
+                        }))
+            LogicError("CreateLocalWorkers: the replica's learnable parameters differ from those of the network.");
+        for (const auto& node : worker->learnableNodes)
+        {
+            const auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+            worker->smoothedGradients.push_back(Matrix<ElemType>(value.GetNumRows(), value.GetNumCols(), net->GetDeviceId()));
+        }
+
+        worker->dropOutSeed = 1 + (unsigned long) (w + 1) * 1000; // (different dropout masks in each worker, but the same in each run)
+        worker->ResetStatistics();
+        m_localWorkers.push_back(std::move(worker));
+    }
+    _wunlink(replicaPath.c_str());
+
+    // the workers divide the CPU threads among them
+    int numCPUThreads = CPUMatrix<float /*any will do*/>::SetNumThreadsForCurrentThread(0); // (0 = just query)
+    m_numThreadsPerLocalWorker = max(1, numCPUThreads / (int) m_numLocalWorkers);
+    const int numThreadsPerWorker = m_numThreadsPerLocalWorker;
+    const size_t numWorkers = m_numLocalWorkers;
+    m_localWorkerThreads.reset(new TaskGraphExecutor(m_numLocalWorkers, [numThreadsPerWorker, numWorkers](size_t w)
+                                                     {
+                                                         NumaPlacement::ScopedNodeBinding::Bind(NumaPlacement::NodeOfWorker(w, numWorkers));
+                                                         CPUMatrix<float>::SetNumThreadsForCurrentThread(numThreadsPerWorker);
+                                                         NumaPlacement::PinOpenMPThreads();
+                                                     }));
+    fprintf(stderr, "\nLocalParallelTrain: %d worker threads with %d CPU threads each, %s.\n", (int) m_numLocalWorkers, m_numThreadsPerLocalWorker,
+            m_localParallelizationMethod == LocalParallelizationMethod::Hogwild ? "updating shared parameters (Hogwild)"
+                                                                                : msra::strfun::strprintf("averaging the models every %d minibatches", (int) m_localSyncPeriod).c_str());
+    if (NumaPlacement::NodeOfWorker(0, m_numLocalWorkers) >= 0)
+        fprintf(stderr, "LocalParallelTrain: workers partitioned over %d NUMA nodes.\n", (int) NumaPlacement::NumNodes());
+}
+
+template <class ElemType>
+size_t SGD<ElemType>::TrainOneEpochWithLocalWorkers(ComputationNetworkPtr net,
+                                                    const int epochNumber,
+                                                    const size_t epochSize,
+                                                    IDataReader<ElemType>* trainSetDataReader,
+                                                    const double learnRatePerSample,
+                                                    size_t tunedMBSize,
+                                                    const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                                    std::list<Matrix<ElemType>>& smoothedGradients,
+                                                    /*out*/ double& epochCriterion,
+                                                    /*out*/ std::vector<double>& epochEvalErrors,
+                                                    /*out*/ size_t& totalSamplesSeen)
+{
+    const bool hogwild = m_localParallelizationMethod == LocalParallelizationMethod::Hogwild;
+    const size_t numWorkers = m_localWorkers.size();
+
+    // all workers start from the model and learner state of the main network
+    for (auto& worker : m_localWorkers)
+    {
+        ComputationNetwork::SetDropoutRate<ElemType>(worker->net, worker->criterionNodes[0], m_dropoutRates[epochNumber], worker->prevDropoutRate, worker->dropOutSeed);
+        auto nodeIter = learnableNodes.begin();
+        auto smoothedGradientIter = smoothedGradients.begin();
+        auto workerSmoothedGradientIter = worker->smoothedGradients.begin();
+        for (const auto& workerNode : worker->learnableNodes)
+        {
+            auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter++);
+            if (hogwild)
+                dynamic_pointer_cast<ComputationNode<ElemType>>(workerNode)->ShareValueOf(*node);
+            else
+                dynamic_pointer_cast<ComputationNode<ElemType>>(workerNode)->Value().SetValue(node->Value());
+            workerNode->BumpEvalTimeStamp();
+            (workerSmoothedGradientIter++)->SetValue(*smoothedGradientIter++);
+        }
+        worker->fsAdaSmoothedFrames = m_fsAdaSmoothedFrames;
+        worker->ResetStatistics();
+        worker->net->StartEvaluateMinibatchLoop(worker->evaluationNodes);
+        worker->net->StartEvaluateMinibatchLoop(worker->criterionNodes);
+    }
+
+    trainSetDataReader->StartMinibatchLoop(tunedMBSize, epochNumber, epochSize);
+
+    // Hogwild: minibatches are handed out in the order they are asked for
+    // model averaging: worker w trains on minibatches w, w + K, ..., and the workers that are still running average their models every m_localSyncPeriod minibatches
+    LocalMinibatchDealer<ElemType> dealer(*trainSetDataReader, numWorkers, !hogwild);
+    unique_ptr<LocalWorkerBarrier> barrier;
+    size_t numSyncs = 0;
+    if (!hogwild)
+    {
+        barrier.reset(new LocalWorkerBarrier(numWorkers, [&](const std::vector<size_t>& workers)
+                                             {
+                                                 std::vector<std::vector<Matrix<ElemType>*>> copies;
+                                                 for (size_t w : workers)
+                                                     copies.push_back(UpdatedParameterValues<ElemType>(m_localWorkers[w]->learnableNodes));
+                                                 AverageMatrices(copies, {});
+                                                 for (size_t w : workers)
+                                                 {
+                                                     for (const auto& node : m_localWorkers[w]->learnableNodes)
+                                                         node->BumpEvalTimeStamp();
+                                                 }
+                                                 numSyncs++;
+                                             }));
+    }
+
+    fprintf(stderr, "\nStarting minibatch loop, LocalParallelTrain with %d worker threads.\n", (int) numWorkers);
+
+    Timer timer;
+    timer.Start();
+
+    // the calling thread is one of the workers
+    TaskGraph independentWorkers(numWorkers);
+    int prevNumThreads = CPUMatrix<float>::SetNumThreadsForCurrentThread(m_numThreadsPerLocalWorker);
+    try
+    {
+        NumaPlacement::ScopedNodeBinding binding(NumaPlacement::NodeOfWorker(0, numWorkers)); // (for the duration of the epoch)
+        NumaPlacement::PinOpenMPThreads();
+        m_localWorkerThreads->Run(independentWorkers, [&](size_t w)
+                                  {
+                                      RunLocalWorker(*m_localWorkers[w], w, epochNumber, learnRatePerSample, dealer, barrier.get());
+                                  });
+    }
+    catch (...)
+    {
+        CPUMatrix<float>::SetNumThreadsForCurrentThread(prevNumThreads);
+        NumaPlacement::PinOpenMPThreads();
+        throw;
+    }
+    CPUMatrix<float>::SetNumThreadsForCurrentThread(prevNumThreads);
+    NumaPlacement::PinOpenMPThreads();
+
+    timer.Stop();
+    double epochSeconds = timer.ElapsedSeconds();
+
+    // the model of the epoch is the average of the models of the workers that got data, the learner state likewise
+    std::vector<std::vector<Matrix<ElemType>*>> parameterCopies, smoothedGradientCopies;
+    double fsAdaSmoothedFramesSum = 0;
+    for (auto& worker : m_localWorkers)
+    {
+        if (worker->numMBs == 0)
+            continue;
+        parameterCopies.push_back(UpdatedParameterValues<ElemType>(worker->learnableNodes));
+        smoothedGradientCopies.push_back(UpdatedSmoothedGradients(worker->learnableNodes, worker->smoothedGradients));
+        fsAdaSmoothedFramesSum += worker->fsAdaSmoothedFrames;
+    }
+    if (!parameterCopies.empty())
+    {
+        if (!hogwild) // (otherwise, they all are the main network's parameters)
+            AverageMatrices(parameterCopies, UpdatedParameterValues<ElemType>(learnableNodes));
+        AverageMatrices(smoothedGradientCopies, UpdatedSmoothedGradients(learnableNodes, smoothedGradients));
+        m_fsAdaSmoothedFrames = fsAdaSmoothedFramesSum / parameterCopies.size();
+    }
+    for (const auto& node : learnableNodes)
+        node->BumpEvalTimeStamp();
+
+    // the criteria are summed in worker order, so that they are reproducible as well
+    size_t totalEpochSamples = 0;
+    epochCriterion = 0;
+    epochEvalErrors.assign(epochEvalErrors.size(), 0);
+    for (size_t w = 0; w < numWorkers; w++)
+    {
+        const auto& worker = *m_localWorkers[w];
+        totalEpochSamples += worker.numSamples;
+        epochCriterion += worker.criterion;
+        for (size_t i = 0; i < epochEvalErrors.size(); i++)
+            epochEvalErrors[i] += worker.evalErrors[i];
+
+        fprintf(stderr, "Epoch[%2d of %d]-LocalWorker[%d]: Minibatches = %d; SamplesSeen = %d; TrainLossPerSample = %.8g; TotalTime = %.4fs; SamplesPerSecond = %.1f; WaitTime = %.4fs (%.1f%%)\n",
+                epochNumber + 1, (int) m_maxEpochs, (int) w, (int) worker.numMBs, (int) worker.numSamples,
+                worker.numSamples > 0 ? worker.criterion / worker.numSamples : 0.0,
+                worker.seconds, worker.seconds > 0 ? worker.numSamples / worker.seconds : 0.0,
+                worker.secondsWaiting, worker.seconds > 0 ? 100.0 * worker.secondsWaiting / worker.seconds : 0.0);
+    }
+    fprintf(stderr, "Epoch[%2d of %d]-LocalWorkers: SamplesSeen = %d; TotalTime = %.4fs; SamplesPerSecond = %.1f", epochNumber + 1, (int) m_maxEpochs,
+            (int) totalEpochSamples, epochSeconds, epochSeconds > 0 ? totalEpochSamples / epochSeconds : 0.0);
+    if (!hogwild)
+        fprintf(stderr, "; ModelAveragings = %d", (int) numSyncs);
+    fprintf(stderr, "\n");
+
+    epochCriterion /= float(totalEpochSamples);
+    for (size_t i = 0; i < epochEvalErrors.size(); i++)
+        epochEvalErrors[i] /= totalEpochSamples;
+    totalSamplesSeen += totalEpochSamples;
+    return totalEpochSamples;
+}
+
+// the minibatch loop of one worker thread
+template <class ElemType>
+void SGD<ElemType>::RunLocalWorker(LocalWorker<ElemType>& worker, size_t workerIndex, const int epochNumber, const double learnRatePerSample,
+                                   LocalMinibatchDealer<ElemType>& dealer, LocalWorkerBarrier* barrier)
+{
+    Timer timer, waitTimer;
+    timer.Start();
+    size_t numMBsSinceSync = 0;
+    size_t numSamplesLastMBs = 0;
+    double criterionLastMBs = 0;
+    double secondsLastMBs = 0;
+    try
+    {
+        for (;;)
+        {
+            size_t actualMBSize = 0;
+            waitTimer.Restart();
+            bool wasDataRead = dealer.GetMinibatch(workerIndex, worker, actualMBSize);
+            waitTimer.Stop();
+            worker.secondsWaiting += waitTimer.ElapsedSeconds();
+            if (!wasDataRead)
+                break;
+
+            ComputationNetwork::BumpEvalTimeStamp(worker.featureNodes);
+            ComputationNetwork::BumpEvalTimeStamp(worker.labelNodes);
+
+            if (actualMBSize > 0)
+            {
+                worker.net->ForwardProp(worker.evaluationNodes);
+                worker.net->ForwardProp(worker.criterionNodes[0]);
+                if (learnRatePerSample > 0.01 * m_minLearnRate) // (as in TrainOneEpoch())
+                {
+                    worker.net->Backprop(worker.criterionNodes[0]);
+                    double momentumPerSample = GetMomentumPerSample(epochNumber /*BUGBUG workaround:*/, worker.net->GetMBLayoutPtr()->GetNumParallelSequences());
+                    UpdateLearnableParameters(worker.learnableNodes, worker.smoothedGradients, worker.fsAdaSmoothedFrames, learnRatePerSample, momentumPerSample, actualMBSize);
+                }
+                worker.criterion += worker.criterionNodes[0]->Get00Element();
+                for (size_t i = 0; i < worker.evaluationNodes.size(); i++)
+                    worker.evalErrors[i] += worker.evaluationNodes[i]->Get00Element();
+                worker.numSamples += worker.net->GetNumSamplesWithLabel(actualMBSize);
+            }
+            worker.numMBs++;
+
+            if (barrier && ++numMBsSinceSync == m_localSyncPeriod)
+            {
+                waitTimer.Restart();
+                bool met = barrier->Arrive(workerIndex);
+                waitTimer.Stop();
+                worker.secondsWaiting += waitTimer.ElapsedSeconds();
+                if (!met) // (another worker failed)
+                    break;
+                numMBsSinceSync = 0;
+            }
+
+            if (worker.numMBs % m_numMBsToShowResult == 0)
+            {
+                timer.Stop();
+                double seconds = timer.ElapsedSeconds() - secondsLastMBs;
+                size_t numSamples = worker.numSamples - numSamplesLastMBs;
+                double trainLossPerSample = numSamples > 0 ? (worker.criterion - criterionLastMBs) / numSamples : 0.0;
+                SGDTrace(stderr, "Epoch[%2d of %d]-Minibatch[%4d-%4d]-LocalWorker[%d]: SamplesSeen = %d; TrainLossPerSample = %.8g; SamplesPerSecond = %.1f\n",
+                         epochNumber + 1, (int) m_maxEpochs, (int) (worker.numMBs - m_numMBsToShowResult + 1), (int) worker.numMBs, (int) workerIndex,
+                         (int) numSamples, trainLossPerSample, seconds > 0 ? numSamples / seconds : 0.0);
+                if (std::isnan(worker.criterion))
+                    RuntimeError("The training criterion is not a number (NAN). Stop\n");
+                secondsLastMBs += seconds;
+                numSamplesLastMBs = worker.numSamples;
+                criterionLastMBs = worker.criterion;
+            }
+        }
+        if (barrier)
+            barrier->Leave();
+    }
+    catch (...)
+    {
+        // release the others, who might be waiting for this one
+        dealer.Abort();
+        if (barrier)
+            barrier->Abort();
+        throw;
+    }
+    timer.Stop();
+    worker.seconds = timer.ElapsedSeconds();
+}
+
 // -----------------------------------------------------------------------
 // subroutines and helpers follow below
 // -----------------------------------------------------------------------
@@ -1288,10 +1674,38 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     // trainSetDataReader->StartMinibatchLoop(m_mbSize[0],  0 , m_epochSize); // only based on one epoch
     // [1/12/2015 erw] to support large dataset, we usually partition whole dataset into several epoch's,
     // so we need to use all the data to do precomputing
-    if (m_useAllDataForPreComputedNode) // using all the data
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0);
-    else // using only one epoch
-        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, m_epochSize);
+    size_t requestedSamples = m_useAllDataForPreComputedNode ? requestDataSize // using all the data
+                                                             : m_epochSize;    // using only one epoch
+    if (m_numSamplesForPreCompute > 0)
+        requestedSamples = min(requestedSamples, m_numSamplesForPreCompute);
+
+    // with distributedPreCompute, each worker only reads its share of the data, and the statistics are summed up at the end
+    bool useDistributedPreCompute = m_distributedPreCompute && g_mpi != nullptr && g_mpi->NumNodesInUse() > 1;
+
+    // the statistics may have been cached by an earlier run over the same data
+    // With distributedPreCompute, the workers must agree on whether to accumulate, since all of them join the summation.
+    // The cache file may appear while they get here, so the main node decides.
+    wstring cacheFileName = GetPreComputeCacheFileName(nodes, requestedSamples);
+    char useCache = (char) 0; // use char for bool
+    if (!useDistributedPreCompute || g_mpi->IsMainNode())
+        useCache = (char) (!cacheFileName.empty() && fexists(cacheFileName) && LoadPreComputeCache(cacheFileName, nodes));
+    if (useDistributedPreCompute)
+    {
+        g_mpi->Bcast(&useCache, 1, g_mpi->MainNodeRank());
+        if (useCache && !g_mpi->IsMainNode() && !LoadPreComputeCache(cacheFileName, nodes))
+            RuntimeError("PreCompute: The cache %ls loaded by the main node does not match the PreCompute nodes.", cacheFileName.c_str());
+    }
+    if (useCache)
+    {
+        fprintf(stderr, "\nPrecomputing --> Completed, statistics loaded from cache %ls.\n\n", cacheFileName.c_str());
+        return true;
+    }
+
+    bool useDistributedMBReading = useDistributedPreCompute && m_enableDistributedMBReading && trainSetDataReader->SupportsDistributedMBRead();
+    if (useDistributedMBReading)
+        trainSetDataReader->StartDistributedMinibatchLoop(m_mbSize[0], 0, g_mpi->CurrentNodeRank(), g_mpi->NumNodesInUse(), requestedSamples);
+    else
+        trainSetDataReader->StartMinibatchLoop(m_mbSize[0], 0, requestedSamples);
     net->StartEvaluateMinibatchLoop(nodes);
 
     // initialize
@@ -1303,9 +1717,12 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
 
     const size_t numIterationsBeforePrintingProgress = 100;
     size_t numItersSinceLastPrintOfProgress = 0;
-    size_t actualMBSizeDummy;
-    while (DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, nullptr, false, false, *inputMatrices, actualMBSizeDummy))
+    size_t actualMBSize;
+    while (DataReaderHelpers::GetMinibatchIntoNetwork(*trainSetDataReader, net, nullptr, useDistributedMBReading, useDistributedPreCompute, *inputMatrices, actualMBSize))
     {
+        if (actualMBSize == 0)
+            continue; // (this worker's share of the minibatch is empty)
+
         // TODO: move these into GetMinibatchIntoNetwork()  --but those are passed around; necessary? Can't we get them from 'net'?
         ComputationNetwork::BumpEvalTimeStamp(featureNodes);
         ComputationNetwork::BumpEvalTimeStamp(labelNodes);
@@ -1324,6 +1741,33 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
         }
     }
 
+    // combine the statistics of all workers, and cache them
+    if (useDistributedPreCompute || !cacheFileName.empty())
+    {
+        std::vector<std::vector<double>> stats;
+        std::vector<double> allStats;
+        for (auto nodeIter = nodes.begin(); nodeIter != nodes.end(); nodeIter++)
+        {
+            stats.push_back(std::vector<double>());
+            static_pointer_cast<PreComputedNodeBase<ElemType>>(*nodeIter)->GetAccumulatedStatistics(stats.back());
+            allStats.insert(allStats.end(), stats.back().begin(), stats.back().end());
+        }
+        if (useDistributedPreCompute)
+        {
+            g_mpi->AllReduce(allStats.data(), allStats.size());
+            auto source = allStats.begin();
+            auto statsIter = stats.begin();
+            for (auto nodeIter = nodes.begin(); nodeIter != nodes.end(); nodeIter++, statsIter++)
+            {
+                std::copy(source, source + statsIter->size(), statsIter->begin());
+                source += statsIter->size();
+                static_pointer_cast<PreComputedNodeBase<ElemType>>(*nodeIter)->SetAccumulatedStatistics(*statsIter);
+            }
+        }
+        if (!cacheFileName.empty() && (g_mpi == nullptr || g_mpi->IsMainNode()))
+            SavePreComputeCache(cacheFileName, nodes, stats);
+    }
+
     // finalize
     for (auto nodeIter = nodes.begin(); nodeIter != nodes.end(); nodeIter++)
     {
@@ -1335,6 +1779,88 @@ bool SGD<ElemType>::PreCompute(ComputationNetworkPtr net,
     return true;
 }
 
+// PreCompute statistics cache
+// The accumulated statistics (see PreComputedNodeBase::GetAccumulatedStatistics()) are stored in a file whose name is
+// a hash of the cache key set by the caller (the reader configuration), the amount of data, and the PreCompute nodes.
+template <class ElemType>
+wstring SGD<ElemType>::GetPreComputeCacheFileName(const std::list<ComputationNodeBasePtr>& nodes, const size_t requestedSamples) const
+{
+    if (m_preComputeCacheDir.empty())
+        return L"";
+    if (m_preComputeCacheKey.empty())
+    {
+        fprintf(stderr, "PreCompute: no cache key is known for this reader; preComputeCacheDir is ignored.\n");
+        return L"";
+    }
+
+    wstring key = m_preComputeCacheKey + msra::strfun::wstrprintf(L"|%d|%llu", (int) sizeof(ElemType), (unsigned long long) requestedSamples);
+    for (const auto& node : nodes)
+        key += msra::strfun::wstrprintf(L"|%ls:%ls(%ls)[%d]", node->NodeName().c_str(), node->OperationName().c_str(),
+                                        node->Input(0)->NodeName().c_str(), (int) node->GetSampleLayout().GetNumElements());
+
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (wchar_t c : key)
+    {
+        hash ^= (uint64_t) c;
+        hash *= 1099511628211ull;
+    }
+    return msra::strfun::wstrprintf(L"%ls/precompute.%016llx.bin", m_preComputeCacheDir.c_str(), (unsigned long long) hash);
+}
+
+// returns false if the cache does not match the nodes
+template <class ElemType>
+bool SGD<ElemType>::LoadPreComputeCache(const wstring& fileName, const std::list<ComputationNodeBasePtr>& nodes)
+{
+    std::vector<std::vector<double>> stats;
+    {
+        File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsRead);
+        fstream.GetMarker(FileMarker::fileMarkerBeginSection, L"BPreComputeCache");
+        size_t numNodes;
+        fstream >> numNodes;
+        if (numNodes != nodes.size())
+            return false;
+        for (const auto& node : nodes)
+        {
+            wstring nodeName;
+            fstream >> nodeName;
+            if (nodeName != node->NodeName())
+                return false;
+            stats.push_back(std::vector<double>());
+            fstream >> stats.back();
+        }
+        fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EPreComputeCache");
+    }
+
+    auto statsIter = stats.begin();
+    for (const auto& nodeBase : nodes)
+    {
+        auto node = static_pointer_cast<PreComputedNodeBase<ElemType>>(nodeBase);
+        node->MarkComputed(false);
+        node->SetAccumulatedStatistics(*statsIter++);
+        node->MarkComputed(true);
+    }
+    return true;
+}
+
+template <class ElemType>
+void SGD<ElemType>::SavePreComputeCache(const wstring& fileName, const std::list<ComputationNodeBasePtr>& nodes, const std::vector<std::vector<double>>& stats)
+{
+    msra::files::make_intermediate_dirs(fileName);
+    wstring tmpFileName = fileName + L".tmp"; // (written under a temporary name, so that readers never see a partial file)
+    {
+        File fstream(tmpFileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BPreComputeCache");
+        fstream << nodes.size();
+        auto statsIter = stats.begin();
+        for (const auto& node : nodes)
+            fstream << node->NodeName() << *statsIter++;
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EPreComputeCache");
+    }
+    renameOrDie(tmpFileName, fileName);
+    fprintf(stderr, "PreCompute: statistics cached in %ls\n", fileName.c_str());
+}
+
 // return a reasonable initial learning rate based on the initial mbsize
 template <class ElemType>
 double SGD<ElemType>::SearchForBestLearnRate(ComputationNetworkPtr net,
@@ -1725,8 +2251,17 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
                                                     /*out*/ size_t& totalSamplesSeen,
                                                     std::string prefixMsg)
 {
+    // with replay, the trials of an epoch read through the same recording reader
+    IDataReader<ElemType>* trialDataReader = trainSetDataReader;
+    if (m_replayTrialMinibatches)
+    {
+        if (!m_trialMinibatches)
+            m_trialMinibatches.reset(new MinibatchReplayReader<ElemType>(trainSetDataReader));
+        trialDataReader = m_trialMinibatches.get();
+    }
+
     TrainOneEpoch(net, refNet, refNode, epochNumber, epochSize,
-                  trainSetDataReader, learnRatePerSample, minibatchSize, featureNodes,
+                  trialDataReader, learnRatePerSample, minibatchSize, featureNodes,
                   labelNodes, criterionNodes, evaluationNodes,
                   inputMatrices, learnableNodes, smoothedGradients,
                   /*out*/ epochCriterion, /*out*/ epochEvalErrors, /*out*/ totalSamplesSeen,
@@ -1746,18 +2281,61 @@ void SGD<ElemType>::TrainOneMiniEpochAndReloadModel(ComputationNetworkPtr net,
         fprintf(stderr, "AvgLearningRatePerSample = %.8g\n", learnRatePerSample);
     }
 
+    // restore the state before the trial; from the files only once per epoch if it is kept in memory
+    if (m_keepTrialStateInMemory && m_trialStateEpoch == epochNumber)
+    {
+        RestoreTrialState(net, smoothedGradients, /*out*/ totalSamplesSeen);
+        return;
+    }
+
     int baseModelEpoch = epochNumber - 1;
     net->RereadPersistableParameters<ElemType>(GetModelNameForEpoch(baseModelEpoch));
 
     double dummyLearnRate;
     double dummtPrevCriterion;
     size_t dummyMinibatchSize = 0;
-    LoadCheckPointInfo(baseModelEpoch,
-                       /*out*/ totalSamplesSeen,
-                       /*out*/ dummyLearnRate,
-                       smoothedGradients,
-                       /*out*/ dummtPrevCriterion,
-                       /*out*/ dummyMinibatchSize);
+    bool checkPointLoaded = LoadCheckPointInfo(baseModelEpoch,
+                                               /*out*/ totalSamplesSeen,
+                                               /*out*/ dummyLearnRate,
+                                               smoothedGradients,
+                                               /*out*/ dummtPrevCriterion,
+                                               /*out*/ dummyMinibatchSize);
+
+    if (m_keepTrialStateInMemory && checkPointLoaded)
+        SaveTrialState(net, epochNumber, smoothedGradients, totalSamplesSeen);
+}
+
+// keep the state that TrainOneMiniEpochAndReloadModel() restores after each trial in memory
+// This is all the state of the model file that was reloaded (see ComputationNetwork::SavePersistableState()), and that of the learner.
+template <class ElemType>
+void SGD<ElemType>::SaveTrialState(ComputationNetworkPtr net, const int epochNumber, const std::list<Matrix<ElemType>>& smoothedGradients, const size_t totalSamplesSeen)
+{
+    net->SavePersistableState<ElemType>(m_trialNetworkState);
+    m_trialSmoothedGradients = smoothedGradients;
+    m_trialFSAdaSmoothedFrames = m_fsAdaSmoothedFrames;
+    m_trialTotalSamplesSeen = totalSamplesSeen;
+    m_trialStateEpoch = epochNumber;
+}
+
+template <class ElemType>
+void SGD<ElemType>::RestoreTrialState(ComputationNetworkPtr net, std::list<Matrix<ElemType>>& smoothedGradients, /*out*/ size_t& totalSamplesSeen)
+{
+    net->RestorePersistableState<ElemType>(m_trialNetworkState);
+    auto savedGradient = m_trialSmoothedGradients.begin();
+    for (auto& smoothedGradient : smoothedGradients)
+        smoothedGradient.SetValue(*savedGradient++);
+    m_fsAdaSmoothedFrames = m_trialFSAdaSmoothedFrames;
+    totalSamplesSeen = m_trialTotalSamplesSeen;
+}
+
+// release the trial state and recorded minibatches once the search of an epoch is done
+template <class ElemType>
+void SGD<ElemType>::ClearTrialState()
+{
+    m_trialStateEpoch = -1;
+    m_trialNetworkState = ComputationNetwork::PersistableState();
+    m_trialSmoothedGradients.clear();
+    m_trialMinibatches.reset();
 }
 
 // Attemps to compute the error signal for the whole utterance, which will
@@ -1826,6 +2404,49 @@ int SGD<ElemType>::SGDTrace(FILE* __restrict __stream, const char* __restrict __
     return result;
 }
 
+// print the time spent in each phase of the minibatch loop, in readable form and as a single machine-readable line
+// With 'acrossRanks', all MPI ranks must call this together, and the minimum and maximum over the ranks are included to expose stragglers.
+template <class ElemType>
+void SGD<ElemType>::TraceTimeBreakdown(const string& label, const MinibatchPhaseTimes& times, double totalSeconds, bool acrossRanks)
+{
+    const size_t numPhases = MinibatchPhaseTimes::NumPhases;
+    double minSeconds[numPhases + 1], maxSeconds[numPhases + 1]; // [numPhases] is the total
+    for (size_t i = 0; i < numPhases; i++)
+        minSeconds[i] = maxSeconds[i] = times.seconds[i];
+    minSeconds[numPhases] = maxSeconds[numPhases] = totalSeconds;
+    acrossRanks = acrossRanks && g_mpi != nullptr && g_mpi->NumNodesInUse() > 1;
+    if (acrossRanks)
+    {
+        g_mpi->AllReduce(minSeconds, numPhases + 1, MPI_MIN);
+        g_mpi->AllReduce(maxSeconds, numPhases + 1, MPI_MAX);
+    }
+
+    double otherSeconds = totalSeconds;
+    SGDTrace(stderr, "%s TimeBreakdown: ", label.c_str());
+    for (size_t i = 0; i < numPhases; i++)
+    {
+        otherSeconds -= times.seconds[i];
+        if (times.seconds[i] > 0 || maxSeconds[i] > 0)
+            SGDTrace(stderr, "%s = %.4fs (%.1f%%); ", MinibatchPhaseTimes::Name(i), times.seconds[i], totalSeconds > 0 ? 100.0 * times.seconds[i] / totalSeconds : 0.0);
+    }
+    SGDTrace(stderr, "other = %.4fs", max(0.0, otherSeconds));
+    if (acrossRanks)
+        SGDTrace(stderr, "; slowest rank total = %.4fs, fastest = %.4fs", maxSeconds[numPhases], minSeconds[numPhases]);
+    SGDTrace(stderr, "\n");
+
+    // machine-readable: key=value pairs, times in seconds
+    SGDTrace(stderr, "PerfStats: label=%s rank=%d total=%.6f", label.c_str(), g_mpi ? (int) g_mpi->CurrentNodeRank() : 0, totalSeconds);
+    for (size_t i = 0; i < numPhases; i++)
+    {
+        SGDTrace(stderr, " %s=%.6f", MinibatchPhaseTimes::Name(i), times.seconds[i]);
+        if (acrossRanks)
+            SGDTrace(stderr, " %sMin=%.6f %sMax=%.6f", MinibatchPhaseTimes::Name(i), minSeconds[i], MinibatchPhaseTimes::Name(i), maxSeconds[i]);
+    }
+    if (acrossRanks)
+        SGDTrace(stderr, " totalMin=%.6f totalMax=%.6f", minSeconds[numPhases], maxSeconds[numPhases]);
+    SGDTrace(stderr, "\n");
+}
+
 template <class ElemType>
 void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int traceLevel)
 {
@@ -1968,7 +2589,8 @@ template <class ElemType>
                                               const double L2RegWeight,
                                               const double L1RegWeight,
                                               const bool needAveMultiplier,
-                                              const bool useNesterovMomentum)
+                                              const bool useNesterovMomentum,
+                                              double& fsAdaSmoothedFrames)
 {
     // we use simple linear (instead of log linear) scaling here
     const double momentum = MomentumPerMB(momentumPerSample, actualMBSize);
@@ -2022,7 +2644,7 @@ template <class ElemType>
     }
     else if (adpType == GradientsUpdateType::FSAdaGrad)
     {
-        smoothedGradient.FSAdagrad(actualMBSize, gradientValues, functionValues, (ElemType) learnRatePerSample, (ElemType) momentum);
+        smoothedGradient.FSAdagrad(actualMBSize, gradientValues, functionValues, (ElemType) learnRatePerSample, (ElemType) momentum, fsAdaSmoothedFrames);
     }
     else if (adpType == GradientsUpdateType::RmsProp)
     {
@@ -2060,7 +2682,8 @@ void SGD<ElemType>::UpdateWeights(const ComputationNodeBasePtr& node,
                                   const size_t actualMBSize,
                                   const double L2RegWeight, const double L1RegWeight,
                                   const bool needAveMultiplier,
-                                  const bool useNesterovMomentum) const
+                                  const bool useNesterovMomentum,
+                                  double& fsAdaSmoothedFrames) const
 {
 #if DUMPOUTPUT
     fprintf(stderr, "Update_%ls\n", node->NodeName().c_str());
@@ -2071,10 +2694,117 @@ void SGD<ElemType>::UpdateWeights(const ComputationNodeBasePtr& node,
     UpdateWeightsS(this, dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value(), dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient(),
                    smoothedGradient, learnRatePerSample, momentumPerSample,
                    actualMBSize, L2RegWeight, L1RegWeight,
-                   needAveMultiplier, m_useNesterovMomentum);
+                   needAveMultiplier, m_useNesterovMomentum, fsAdaSmoothedFrames);
     node->BumpEvalTimeStamp();
 }
 
+template <class ElemType>
+void SGD<ElemType>::UpdateLearnableParameters(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                              std::list<Matrix<ElemType>>& smoothedGradients,
+                                              double& fsAdaSmoothedFrames,
+                                              const double learnRatePerSample,
+                                              const double momentumPerSample,
+                                              const size_t actualMBSize)
+{
+    // update all parameters in one fused pass where possible, otherwise one by one
+    bool updated = UpdateWeightsFused(learnableNodes, smoothedGradients, fsAdaSmoothedFrames, learnRatePerSample, momentumPerSample, actualMBSize);
+    if (updated)
+        return;
+    if (m_clippingByGlobalNorm)
+        ClipGradientsByGlobalNorm(learnableNodes, actualMBSize);
+    auto smoothedGradientIter = smoothedGradients.begin();
+    for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+    {
+        ComputationNodeBasePtr node = *nodeIter;
+        if (node->IsParameterUpdateRequired())
+        {
+            Matrix<ElemType>& smoothedGradient = *smoothedGradientIter;
+#ifdef _DEBUG
+            if (smoothedGradient.HasNan("TrainOneEpoch/UpdateWeights(): "))
+                LogicError("%ls %ls operation has NaNs in smoothedGradient.", node->NodeName().c_str(), node->OperationName().c_str());
+#endif
+            UpdateWeights(node, smoothedGradient, learnRatePerSample, momentumPerSample, actualMBSize,
+                          m_L2RegWeight, m_L1RegWeight,
+                          m_needAveMultiplier, m_useNesterovMomentum, fsAdaSmoothedFrames);
+#ifdef _DEBUG
+            if (dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().HasNan("TrainOneEpoch/UpdateWeights(): "))
+                LogicError("%ls %ls operation has NaNs in functionValues after parameter update.", node->NodeName().c_str(), node->OperationName().c_str());
+#endif
+        }
+    }
+}
+
+// UpdateWeightsFused - update all learnable parameters with a single multi-tensor learner update (see Matrix::MultiTensorLearnerUpdate())
+// Returns false if that is not possible, e.g. on the GPU, for sparse gradients, with noise injection, or in the first update of
+// learners that initialize their state from it. The caller then updates the parameters one by one.
+template <class ElemType>
+bool SGD<ElemType>::UpdateWeightsFused(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                       std::list<Matrix<ElemType>>& smoothedGradients,
+                                       double& fsAdaSmoothedFrames,
+                                       const double learnRatePerSample,
+                                       const double momentumPerSample,
+                                       const size_t actualMBSize)
+{
+    if (!m_useFusedParameterUpdate || GradientUpdateNoiseStd() > 0)
+        return false;
+
+    LearnerUpdateParams params;
+    switch (GradUpdateType())
+    {
+    case GradientsUpdateType::None:
+        params.type = LearnerUpdateType::Momentum;
+        break;
+    case GradientsUpdateType::AdaGrad:
+        params.type = LearnerUpdateType::AdaGrad;
+        break;
+    case GradientsUpdateType::FSAdaGrad:
+        params.type = LearnerUpdateType::FSAdaGrad;
+        break;
+    case GradientsUpdateType::RmsProp:
+        params.type = LearnerUpdateType::RmsProp;
+        break;
+    default:
+        return false;
+    }
+    params.learnRatePerSample = learnRatePerSample;
+    params.momentum = MomentumPerMB(momentumPerSample, actualMBSize);
+    params.useNesterovMomentum = m_useNesterovMomentum;
+    params.mbSize = actualMBSize;
+    params.clippingThreshold = m_clippingThresholdPerSample * actualMBSize;
+    params.clipWithTruncation = m_gradientClippingWithTruncation;
+    params.clipByGlobalNorm = m_clippingByGlobalNorm;
+    params.L2RegWeight = m_L2RegWeight;
+    params.L1RegWeight = m_L1RegWeight;
+    params.needAveMultiplier = m_needAveMultiplier;
+    params.rmsGamma = m_rpi.gamma;
+    params.rmsWgtInc = m_rpi.inc;
+    params.rmsWgtMax = m_rpi.max;
+    params.rmsWgtDec = m_rpi.dec;
+    params.rmsWgtMin = m_rpi.min;
+    params.fsAdaSmoothedFrames = &fsAdaSmoothedFrames;
+
+    vector<Matrix<ElemType>*> values, gradients, smoothed;
+    auto smoothedGradientIter = smoothedGradients.begin();
+    for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++, smoothedGradientIter++)
+    {
+        auto node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
+        if (!node->IsParameterUpdateRequired())
+            continue;
+        values.push_back(&node->Value());
+        gradients.push_back(&node->Gradient());
+        smoothed.push_back(&*smoothedGradientIter);
+    }
+    if (!Matrix<ElemType>::MultiTensorLearnerUpdate(values, gradients, smoothed, params))
+        return false;
+
+    for (auto& node : learnableNodes)
+    {
+        if (node->IsParameterUpdateRequired())
+            node->BumpEvalTimeStamp();
+    }
+    return true;
+}
+
 template <class ElemType>
 void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const
 {
@@ -2083,7 +2813,7 @@ void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actual
         double maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
         if (m_gradientClippingWithTruncation)
             gradient.InplaceTruncate((ElemType)(maxGradientPerMB));
-        else
+        else if (!m_clippingByGlobalNorm) // (otherwise done for all gradients together by ClipGradientsByGlobalNorm())
         {
             // norm2 normalized
             double gradientNorm = gradient.FrobeniusNorm();
@@ -2096,6 +2826,34 @@ void SGD<ElemType>::ClipGradient(Matrix<ElemType>& gradient, const size_t actual
     }
 }
 
+// scale all gradients down together such that their combined norm does not exceed the clipping threshold
+template <class ElemType>
+void SGD<ElemType>::ClipGradientsByGlobalNorm(const std::list<ComputationNodeBasePtr>& learnableNodes, const size_t actualMBSize) const
+{
+    if (m_clippingThresholdPerSample == std::numeric_limits<double>::infinity() || m_gradientClippingWithTruncation)
+        return;
+    double sqrNorm = 0;
+    for (auto& node : learnableNodes)
+    {
+        if (node->IsParameterUpdateRequired())
+        {
+            double norm = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient().FrobeniusNorm();
+            sqrNorm += norm * norm;
+        }
+    }
+    double maxGradientPerMB = m_clippingThresholdPerSample * actualMBSize;
+    double gradientNorm = sqrt(sqrNorm);
+    if (gradientNorm > maxGradientPerMB)
+    {
+        ElemType normFactor = (ElemType)(maxGradientPerMB / gradientNorm);
+        for (auto& node : learnableNodes)
+        {
+            if (node->IsParameterUpdateRequired())
+                dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient() *= normFactor;
+        }
+    }
+}
+
 template <class ElemType>
 void SGD<ElemType>::SaveCheckPointInfo(const size_t epoch, const size_t totalSamplesSeen,
                                        const double learnRatePerSample,
@@ -2385,6 +3143,18 @@ static ParallelizationMethod ParseParallelizationMethod(const wstring& s)
         InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | dataParallelSGD | modelAveragingSGD)");
 }
 
+static LocalParallelizationMethod ParseLocalParallelizationMethod(const wstring& s)
+{
+    if (!_wcsicmp(s.c_str(), L"") || !_wcsicmp(s.c_str(), L"none"))
+        return LocalParallelizationMethod::None;
+    else if (!_wcsicmp(s.c_str(), L"hogwild"))
+        return LocalParallelizationMethod::Hogwild;
+    else if (!_wcsicmp(s.c_str(), L"modelAveraging"))
+        return LocalParallelizationMethod::ModelAveraging;
+    else
+        InvalidArgument("ParseLocalParallelizationMethod: Invalid local parallelization method. Valid values are (none | hogwild | modelAveraging)");
+}
+
 static LearningRateSearchAlgorithm ParseLearningRateSearchType(const wstring& s)
 {
     // TODO: why allow so many variants?
@@ -2423,6 +3193,8 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_minibatchSizeTuningFrequency = configAALR(L"minibatchSizeTuningFrequency", (size_t) 1);
     m_minibatchSizeTuningMax = configAALR(L"minibatchSizeTuningMax", (size_t) 1048576);
     m_minibatchSearchCriterionErrorMargin = configAALR(L"minibatchSearchCriterionErrorMargin", (size_t) 1);
+    m_keepTrialStateInMemory = configAALR(L"keepTrialStateInMemory", false);
+    m_replayTrialMinibatches = configAALR(L"replayTrialMinibatches", false);
 
     // the number of minibatches used to search
     // the learning rate. Its typically set to 10-20% of
@@ -2471,6 +3243,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
 
     m_gradientClippingWithTruncation = configSGD(L"gradientClippingWithTruncation", true);
     m_clippingThresholdPerSample = configSGD(L"clippingThresholdPerSample", numeric_limits<double>::infinity());
+    m_clippingByGlobalNorm = configSGD(L"clippingByGlobalNorm", false);
 
     // sequence-training parameters
     m_hSmoothingWeight = configSGD(L"hSmoothingWeight", 0.95);
@@ -2499,6 +3272,7 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_needAveMultiplier = configSGD(L"normWithAveMultiplier", true);
     m_L2RegWeight = configSGD(L"L2RegWeight", 0.0);
     m_L1RegWeight = configSGD(L"L1RegWeight", 0.0);
+    m_useFusedParameterUpdate = configSGD(L"fusedParameterUpdate", true);
 
     // for backward support. future setup should use gradUpdateType=AdaGrad, instead of
     // useAdagrad=true
@@ -2522,6 +3296,9 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     }
 
     m_useAllDataForPreComputedNode = configSGD(L"UseAllDataForPreComputedNode", true);
+    m_distributedPreCompute = configSGD(L"distributedPreCompute", false);
+    m_numSamplesForPreCompute = configSGD(L"numSamplesForPreCompute", (size_t) 0);
+    m_preComputeCacheDir = (const wstring&) configSGD(L"preComputeCacheDir", L"");
 
     // consistency checks
     for (size_t i = 0; i < m_mbSize.size(); i++)
@@ -2655,6 +3432,25 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
             m_nFramesBetweenMASync = configMASGD(L"syncFrequencyInFrames", (size_t) 40000);
         }
     }
+
+    // data-parallel training on several threads of this process, e.g.
+    // LocalParallelTrain = [ numWorkers = 4 ; method = modelAveraging (or hogwild) ; syncFrequencyInMinibatches = 4 ]
+    m_numLocalWorkers = 0;
+    m_localParallelizationMethod = LocalParallelizationMethod::None;
+    m_localSyncPeriod = 4;
+    if (configSGD.Exists(L"LocalParallelTrain"))
+    {
+        const ConfigRecordType& configLocalParallelTrain(configSGD(L"LocalParallelTrain", ConfigRecordType::Record()));
+        m_numLocalWorkers = configLocalParallelTrain(L"numWorkers", (size_t) 0);
+        m_localParallelizationMethod = ParseLocalParallelizationMethod(configLocalParallelTrain(L"method", L"modelAveraging"));
+        m_localSyncPeriod = configLocalParallelTrain(L"syncFrequencyInMinibatches", (size_t) 4);
+        if (m_localSyncPeriod == 0)
+            InvalidArgument("LocalParallelTrain: syncFrequencyInMinibatches must be at least 1.");
+        if (m_numLocalWorkers <= 1)
+            m_localParallelizationMethod = LocalParallelizationMethod::None;
+        if (m_localParallelizationMethod != LocalParallelizationMethod::None && m_parallelizationMethod != ParallelizationMethod::None)
+            InvalidArgument("LocalParallelTrain cannot be combined with ParallelTrain.");
+    }
 }
 
 static size_t GetSizeOfPrecision(const ScriptableObjects::IConfigRecordPtr configp)
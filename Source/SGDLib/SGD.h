@@ -17,6 +17,9 @@
 #include <chrono>
 #include <random>
 #include "Profiler.h"
+#include "MinibatchReplayReader.h"
+#include "LocalParallelTrain.h"
+#include <memory>
 
 using namespace std; // ugh! TODO: get rid of this from .h files!!!
 
@@ -54,6 +57,14 @@ enum class ParallelizationMethod : int
     ModelParallelSGD = (1 << 2), // Currently unsupported
 };
 
+// data parallelism across worker threads of one process (see LocalParallelTrain.h)
+enum class LocalParallelizationMethod : int
+{
+    None,
+    Hogwild,       // all workers update the same parameters, without locking
+    ModelAveraging // each worker updates its own copy of the parameters; the copies are averaged periodically
+};
+
 // configuration parameters associated with RMSProp learning algorithm
 struct RMSPropInfo
 {
@@ -73,6 +84,42 @@ struct RMSPropInfo
     }
 };
 
+// time spent in the phases of the minibatch loop, reported with the training progress
+struct MinibatchPhaseTimes
+{
+    enum Phase
+    {
+        ReadMinibatch,      // GetMinibatchIntoNetwork()
+        ForwardBackward,    // ForwardProp()/Backprop()
+        AggregateGradients, // data-parallel gradient exchange
+        UpdateWeights,      // UpdateWeights()
+        ModelAveraging,     // ModelAveragingProcessing()
+        NumPhases
+    };
+    double seconds[NumPhases];
+
+    MinibatchPhaseTimes()
+    {
+        Reset();
+    }
+    void Reset()
+    {
+        for (size_t i = 0; i < NumPhases; i++)
+            seconds[i] = 0;
+    }
+    MinibatchPhaseTimes& operator+=(const MinibatchPhaseTimes& other)
+    {
+        for (size_t i = 0; i < NumPhases; i++)
+            seconds[i] += other.seconds[i];
+        return *this;
+    }
+    static const char* Name(size_t phase)
+    {
+        static const char* names[NumPhases] = {"read", "compute", "aggregate", "update", "modelAveraging"};
+        return names[phase];
+    }
+};
+
 struct GradientUpdateInfo
 {
     GradientsUpdateType mType;
@@ -169,6 +216,7 @@ protected:
 
     bool m_gradientClippingWithTruncation;
     double m_clippingThresholdPerSample;
+    bool m_clippingByGlobalNorm; // norm clipping uses the norm of all gradients together
 
     intargvector m_numMiniBatch4LRSearch;
     size_t m_numBestSearchEpoch;
@@ -197,6 +245,10 @@ protected:
     size_t m_minibatchSizeTuningFrequency;
     size_t m_minibatchSizeTuningMax;
 
+    // for the trial mini-epochs of the learning-rate and minibatch-size search:
+    bool m_keepTrialStateInMemory; // restore the model and learner state between trials from memory instead of the checkpoint files
+    bool m_replayTrialMinibatches; // read the trial minibatches once, and replay them from memory for further trials
+
     floatargvector m_dropoutRates;
     size_t m_maxTempMemSizeInSamplesForCNN;
 
@@ -218,6 +270,9 @@ protected:
     bool m_doUnitTest;
 
     bool m_useAllDataForPreComputedNode;
+    bool m_distributedPreCompute;     // under MPI, each worker accumulates the PreCompute statistics over its share of the data
+    size_t m_numSamplesForPreCompute; // if not 0, the PreCompute statistics are accumulated over this many samples only
+    wstring m_preComputeCacheDir;     // if not empty, the PreCompute statistics are cached in this directory
 
     // Parallel training
     ParallelizationMethod m_parallelizationMethod;
@@ -238,9 +293,15 @@ protected:
     // Parallel training related with MA
     size_t m_nFramesBetweenMASync;
 
+    // data-parallel training with several worker threads in this process (CPU only)
+    size_t m_numLocalWorkers; // 0 or 1: not used
+    LocalParallelizationMethod m_localParallelizationMethod;
+    size_t m_localSyncPeriod; // model averaging: minibatches of each worker between two averagings
+
     bool m_needAveMultiplier;
     double m_L2RegWeight;
     double m_L1RegWeight;
+    bool m_useFusedParameterUpdate; // update all parameters in one multi-tensor pass where possible
 
     // sequence training
     double m_hSmoothingWeight;
@@ -282,8 +343,13 @@ public:
           m_evalCriterionNodeName((const wstring&) configSGD(L"evalCriterionNodeName", L"")),
           m_prevChosenMinibatchSize(0),
           m_lastFinishedEpochTrainLoss(0.0),
+          m_fsAdaSmoothedFrames(0),
           m_distGradAgg(nullptr),
-          m_gradHeader(nullptr)
+          m_gradHeader(nullptr),
+          m_trialStateEpoch(-1),
+          m_trialFSAdaSmoothedFrames(0),
+          m_trialTotalSamplesSeen(0),
+          m_numThreadsPerLocalWorker(0)
     {
         msra::files::make_intermediate_dirs(m_modelPath);
     }
@@ -295,6 +361,13 @@ public:
     {
     }
 
+    // identifies the training data for the PreCompute statistics cache, e.g. the text of the reader configuration
+    // If not set, the statistics are not cached.
+    void SetPreComputeCacheKey(const wstring& key)
+    {
+        m_preComputeCacheKey = key;
+    }
+
     void Train(function<ComputationNetworkPtr(DEVICEID_TYPE)> createNetworkFn, DEVICEID_TYPE deviceId,
                IDataReader<ElemType>* trainSetDataReader,
                IDataReader<ElemType>* validationSetDataReader,
@@ -324,6 +397,10 @@ protected:
                     std::vector<ComputationNodeBasePtr>& labelNodes,
                     std::map<std::wstring, Matrix<ElemType>*>* inputMatrices);
 
+    wstring GetPreComputeCacheFileName(const std::list<ComputationNodeBasePtr>& nodes, const size_t requestedSamples) const;
+    bool LoadPreComputeCache(const wstring& fileName, const std::list<ComputationNodeBasePtr>& nodes);
+    void SavePreComputeCache(const wstring& fileName, const std::list<ComputationNodeBasePtr>& nodes, const std::vector<std::vector<double>>& stats);
+
     // return a reasonable initial learning rate based on the initial mbsize
     double SearchForBestLearnRate(ComputationNetworkPtr net,
                                   ComputationNetworkPtr refNet,
@@ -430,6 +507,31 @@ protected:
 
     size_t ModelAveragingSync(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes);
 
+    void CreateLocalWorkers(ComputationNetworkPtr net,
+                            const std::vector<ComputationNodeBasePtr>& criterionNodes,
+                            const std::vector<ComputationNodeBasePtr>& evaluationNodes,
+                            const std::list<ComputationNodeBasePtr>& learnableNodes);
+
+    // TrainOneEpoch() with m_numLocalWorkers threads, each with its own network replica
+    size_t TrainOneEpochWithLocalWorkers(ComputationNetworkPtr net,
+                                         const int epochNumber,
+                                         const size_t epochSize,
+                                         IDataReader<ElemType>* trainSetDataReader,
+                                         const double learnRatePerSample,
+                                         size_t tunedMBSize,
+                                         const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                         std::list<Matrix<ElemType>>& smoothedGradients,
+                                         /*out*/ double& epochCriterion,
+                                         /*out*/ std::vector<double>& epochEvalErrors,
+                                         /*out*/ size_t& totalSamplesSeen);
+
+    void RunLocalWorker(LocalWorker<ElemType>& worker, size_t workerIndex, const int epochNumber, const double learnRatePerSample,
+                        LocalMinibatchDealer<ElemType>& dealer, LocalWorkerBarrier* barrier);
+
+    void SaveTrialState(ComputationNetworkPtr net, const int epochNumber, const std::list<Matrix<ElemType>>& smoothedGradients, const size_t totalSamplesSeen);
+    void RestoreTrialState(ComputationNetworkPtr net, std::list<Matrix<ElemType>>& smoothedGradients, /*out*/ size_t& totalSamplesSeen);
+    void ClearTrialState();
+
 public:
     // UpdateWeightsS - static version of UpdateWeights()
     static void UpdateWeightsS(const SGD* sgd, Matrix<ElemType>& functionValues,
@@ -441,7 +543,8 @@ public:
                                const double L2RegWeight,
                                const double L1RegWeight,
                                const bool needAveMultiplier,
-                               const bool useNesterovMomentum);
+                               const bool useNesterovMomentum,
+                               double& fsAdaSmoothedFrames);
 
 protected:
     // UpdateWeights - update the weights in
@@ -452,9 +555,27 @@ protected:
                        const size_t actualMBSize,
                        const double L2RegWeight, const double L1RegWeight,
                        const bool needAveMultiplier,
-                       const bool useNesterovMomentum) const;
+                       const bool useNesterovMomentum,
+                       double& fsAdaSmoothedFrames) const;
+
+    // update all learnable parameters after a minibatch of 'actualMBSize' samples
+    // The learner state is 'smoothedGradients' and 'fsAdaSmoothedFrames', which belong to the caller (the SGD object or a local worker).
+    void UpdateLearnableParameters(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                                   std::list<Matrix<ElemType>>& smoothedGradients,
+                                   double& fsAdaSmoothedFrames,
+                                   const double learnRatePerSample,
+                                   const double momentumPerSample,
+                                   const size_t actualMBSize);
+
+    bool UpdateWeightsFused(const std::list<ComputationNodeBasePtr>& learnableNodes,
+                            std::list<Matrix<ElemType>>& smoothedGradients,
+                            double& fsAdaSmoothedFrames,
+                            const double learnRatePerSample,
+                            const double momentumPerSample,
+                            const size_t actualMBSize);
 
     void ClipGradient(Matrix<ElemType>& gradient, const size_t actualMBSize) const;
+    void ClipGradientsByGlobalNorm(const std::list<ComputationNodeBasePtr>& learnableNodes, const size_t actualMBSize) const;
 
     void SaveCheckPointInfo(const size_t epoch, const size_t totalSamplesSeen,
                             const double learnRatePerSample,
@@ -502,11 +623,28 @@ protected:
 
     size_t m_prevChosenMinibatchSize;
     double m_lastFinishedEpochTrainLoss;
+    double m_fsAdaSmoothedFrames; // FSAdaGrad's smoothed #frames, shared by all parameters (cf. Matrix::FSAdagrad())
+
+    wstring m_preComputeCacheKey;
 
     IDistGradAggregator<ElemType>* m_distGradAgg;
     struct DistGradHeader* m_gradHeader;
 
+    // state shared by the trial mini-epochs of one epoch's learning-rate and minibatch-size search
+    int m_trialStateEpoch; // epoch the saved state belongs to, or -1 if none
+    ComputationNetwork::PersistableState m_trialNetworkState;
+    std::list<Matrix<ElemType>> m_trialSmoothedGradients;
+    double m_trialFSAdaSmoothedFrames;
+    size_t m_trialTotalSamplesSeen;
+    std::unique_ptr<MinibatchReplayReader<ElemType>> m_trialMinibatches;
+
+    // replicas of the network for localParallelTrain, created once before the first epoch, and the threads that run them
+    std::vector<std::unique_ptr<LocalWorker<ElemType>>> m_localWorkers;
+    std::unique_ptr<TaskGraphExecutor> m_localWorkerThreads;
+    int m_numThreadsPerLocalWorker; // CPU (OpenMP) threads of each worker
+
 private:
     int SGDTrace(FILE* __restrict __stream, const char* __restrict __format, ...);
+    void TraceTimeBreakdown(const string& label, const MinibatchPhaseTimes& times, double totalSeconds, bool acrossRanks);
 };
 } } }
@@ -9,11 +9,15 @@
 #include "ComputationNode.h"
 #include "ComputationNetwork.h"
 #include "DataReaderHelpers.h"
+#include "CPUMatrix.h" // for SetNumThreadsForCurrentThread()
+#include "NumaPlacement.h"
 #include "TrainingNodes.h" // TODO: we should move the functions that depend on these to the .cpp
 
 #include <vector>
 #include <string>
 #include <set>
+#include <map>
+#include <memory>
 
 using namespace std;
 
@@ -33,35 +37,7 @@ public:
     vector<double> Evaluate(IDataReader<ElemType>* dataReader, const vector<wstring>& evalNodeNames, const size_t mbSize, const size_t testSize = requestDataSize)
     {
         // determine nodes to evaluate
-        std::vector<ComputationNodeBasePtr> evalNodes;
-
-        set<ComputationNodeBasePtr> criteriaLogged; // (keeps track ot duplicates to avoid we don't double-log critera)
-        if (evalNodeNames.size() == 0)
-        {
-            fprintf(stderr, "evalNodeNames are not specified, using all the default evalnodes and training criterion nodes.\n");
-            if (m_net->EvaluationNodes().empty() && m_net->FinalCriterionNodes().empty())
-                InvalidArgument("There is no default evaluation node or training criterion specified in the network.");
-
-            for (const auto& node : m_net->EvaluationNodes())
-                if (criteriaLogged.insert(node).second)
-                    evalNodes.push_back(node);
-
-            for (const auto& node : m_net->FinalCriterionNodes())
-                if (criteriaLogged.insert(node).second)
-                    evalNodes.push_back(node);
-        }
-        else
-        {
-            for (int i = 0; i < evalNodeNames.size(); i++)
-            {
-                const auto& node = m_net->GetNodeFromName(evalNodeNames[i]);
-                if (!criteriaLogged.insert(node).second)
-                    continue;
-                if (node->GetSampleLayout().GetNumElements() != 1)
-                    InvalidArgument("Criterion nodes to evaluate must have dimension 1x1.");
-                evalNodes.push_back(node);
-            }
-        }
+        std::vector<ComputationNodeBasePtr> evalNodes = DetermineEvalNodes(m_net, evalNodeNames);
 
         // initialize eval results
         std::vector<double> evalResults;
@@ -75,11 +51,7 @@ public:
         auto& featureNodes = m_net->FeatureNodes();
         auto& labelNodes = m_net->LabelNodes();
 
-        std::map<std::wstring, Matrix<ElemType>*> inputMatrices;
-        for (size_t i = 0; i < featureNodes.size(); i++)
-            inputMatrices[featureNodes[i]->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(featureNodes[i])->Value();
-        for (size_t i = 0; i < labelNodes.size(); i++)
-            inputMatrices[labelNodes[i]->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(labelNodes[i])->Value();
+        std::map<std::wstring, Matrix<ElemType>*> inputMatrices = GetInputMatrices(m_net);
 
         // evaluate through minibatches
         size_t totalEpochSamples = 0;
@@ -158,10 +130,219 @@ public:
         return evalResults;
     }
 
+    // evaluates several networks (e.g. the models of successive epochs) in a single pass over the data
+    // Each minibatch is read once, into the inputs of the first network, and copied into the inputs of the others, which
+    // must have inputs of the same names. The networks are then evaluated concurrently on up to 'numThreads' threads, among
+    // which the CPU threads are divided. GPU networks, and CPU networks while parallel node execution is enabled, are
+    // evaluated one after the other. Returns the per-sample criteria of each network, like Evaluate().
+    static vector<vector<double>> EvaluateModels(const vector<ComputationNetworkPtr>& nets, const vector<wstring>& modelNames,
+                                                 IDataReader<ElemType>* dataReader, const vector<wstring>& evalNodeNames, const size_t mbSize, const size_t testSize,
+                                                 const size_t numMBsToShowResult, const int traceLevel, size_t numThreads)
+    {
+        const size_t numModels = nets.size();
+        if (numModels == 0 || modelNames.size() != numModels)
+            LogicError("EvaluateModels: expected one name per network, and at least one network.");
+
+        // determine nodes to evaluate, and allocate memory for forward computation
+        vector<vector<ComputationNodeBasePtr>> evalNodes(numModels);
+        vector<std::map<std::wstring, Matrix<ElemType>*>> inputMatrices(numModels);
+        vector<vector<double>> evalResults(numModels);
+        vector<vector<double>> evalResultsLastMBs(numModels);
+        bool onCPU = true;
+        for (size_t k = 0; k < numModels; k++)
+        {
+            evalNodes[k] = DetermineEvalNodes(nets[k], evalNodeNames, /*logDefaultNodes=*/k == 0);
+            evalResults[k].assign(evalNodes[k].size(), 0);
+            evalResultsLastMBs[k].assign(evalNodes[k].size(), 0);
+            nets[k]->AllocateAllMatrices(evalNodes[k], {}, nullptr);
+            inputMatrices[k] = GetInputMatrices(nets[k]);
+            for (const auto& input : inputMatrices[0])
+                if (inputMatrices[k].find(input.first) == inputMatrices[k].end())
+                    InvalidArgument("EvaluateModels: model %ls has no input named '%ls'.", modelNames[k].c_str(), input.first.c_str());
+            onCPU &= nets[k]->GetDeviceId() < 0;
+        }
+
+        // the models are independent tasks, executed by a pool of threads that divide the CPU threads among them
+        numThreads = min(numThreads, numModels);
+        unique_ptr<TaskGraphExecutor> executor;
+        int numThreadsPerModel = 0;
+        if (numThreads > 1 && onCPU && !ComputationNetwork::IsParallelNodeExecutionEnabled())
+        {
+            int numCPUThreads = CPUMatrix<float /*any will do*/>::SetNumThreadsForCurrentThread(0); // (0 = just query)
+            numThreadsPerModel = max(1, numCPUThreads / (int) numThreads);
+            // with pinThreads, the threads are partitioned over the NUMA nodes, so that a model's OpenMP threads share one node
+            executor.reset(new TaskGraphExecutor(numThreads, [numThreadsPerModel, numThreads](size_t w)
+                                                 {
+                                                     NumaPlacement::ScopedNodeBinding::Bind(NumaPlacement::NodeOfWorker(w, numThreads));
+                                                     CPUMatrix<float>::SetNumThreadsForCurrentThread(numThreadsPerModel);
+                                                     NumaPlacement::PinOpenMPThreads();
+                                                 }));
+            fprintf(stderr, "Evaluating %d models concurrently on %d threads, with %d CPU threads each.\n", (int) numModels, (int) numThreads, numThreadsPerModel);
+        }
+        TaskGraph independentModels(numModels);
+        auto evaluateModel = [&](size_t k)
+        {
+            ComputationNetwork::BumpEvalTimeStamp(nets[k]->FeatureNodes());
+            ComputationNetwork::BumpEvalTimeStamp(nets[k]->LabelNodes());
+            for (size_t i = 0; i < evalNodes[k].size(); i++)
+            {
+                nets[k]->ForwardProp(evalNodes[k][i]);
+                evalResults[k][i] += (double) evalNodes[k][i]->Get00Element(); // criterionNode should be a scalar
+            }
+        };
+
+        // evaluate through minibatches
+        size_t totalEpochSamples = 0;
+        size_t numMBsRun = 0;
+        size_t actualMBSize = 0;
+        size_t numSamplesLastMBs = 0;
+        size_t lastMBsRun = 0; // MBs run before this display
+
+        dataReader->StartMinibatchLoop(mbSize, 0, testSize);
+        for (size_t k = 0; k < numModels; k++)
+            nets[k]->StartEvaluateMinibatchLoop(evalNodes[k]);
+
+        while (DataReaderHelpers::GetMinibatchIntoNetwork(*dataReader, nets[0], nullptr, false, false, inputMatrices[0], actualMBSize))
+        {
+            for (size_t k = 1; k < numModels; k++)
+                CopyMinibatch(nets[0], inputMatrices[0], nets[k], inputMatrices[k]);
+
+            if (executor)
+            {
+                // the calling thread is one of the workers
+                int prevNumThreads = CPUMatrix<float>::SetNumThreadsForCurrentThread(numThreadsPerModel);
+                {
+                    NumaPlacement::ScopedNodeBinding binding(NumaPlacement::NodeOfWorker(0, numThreads));
+                    NumaPlacement::PinOpenMPThreads();
+                    executor->Run(independentModels, evaluateModel);
+                }
+                CPUMatrix<float>::SetNumThreadsForCurrentThread(prevNumThreads);
+                NumaPlacement::PinOpenMPThreads();
+            }
+            else
+            {
+                for (size_t k = 0; k < numModels; k++)
+                    evaluateModel(k);
+            }
+
+            // all networks share the same minibatch layout
+            size_t numSamplesWithLabel = nets[0]->GetNumSamplesWithLabel(actualMBSize);
+            totalEpochSamples += numSamplesWithLabel;
+            numMBsRun++;
+
+            if (traceLevel > 0)
+            {
+                numSamplesLastMBs += numSamplesWithLabel;
+
+                if (numMBsRun % numMBsToShowResult == 0)
+                {
+                    for (size_t k = 0; k < numModels; k++)
+                    {
+                        fprintf(stderr, "model %ls: ", modelNames[k].c_str());
+                        DisplayEvalStatistics(lastMBsRun + 1, numMBsRun, numSamplesLastMBs, evalNodes[k], evalResults[k], evalResultsLastMBs[k]);
+                        evalResultsLastMBs[k] = evalResults[k];
+                    }
+                    numSamplesLastMBs = 0;
+                    lastMBsRun = numMBsRun;
+                }
+            }
+
+            // call DataEnd to check if end of sentence is reached
+            // datareader will do its necessary/specific process for sentence ending
+            dataReader->DataEnd(endDataSentence);
+        }
+
+        // show last batch of results
+        if (traceLevel > 0 && numSamplesLastMBs > 0)
+        {
+            for (size_t k = 0; k < numModels; k++)
+            {
+                fprintf(stderr, "model %ls: ", modelNames[k].c_str());
+                DisplayEvalStatistics(lastMBsRun + 1, numMBsRun, numSamplesLastMBs, evalNodes[k], evalResults[k], evalResultsLastMBs[k]);
+            }
+        }
+
+        // final statistics
+        for (size_t k = 0; k < numModels; k++)
+        {
+            evalResultsLastMBs[k].assign(evalResults[k].size(), 0);
+            fprintf(stderr, "model %ls --> \n", modelNames[k].c_str());
+            fprintf(stderr, "Final Results: ");
+            DisplayEvalStatistics(1, numMBsRun, totalEpochSamples, evalNodes[k], evalResults[k], evalResultsLastMBs[k], true);
+
+            for (size_t i = 0; i < evalResults[k].size(); i++)
+                evalResults[k][i] /= totalEpochSamples;
+        }
+
+        return evalResults;
+    }
+
 protected:
-    void DisplayEvalStatistics(const size_t startMBNum, const size_t endMBNum, const size_t numSamplesLastMBs,
-                               const vector<ComputationNodeBasePtr>& evalNodes,
-                               const double evalResults, const double evalResultsLastMBs, bool displayConvertedValue = false)
+    // determine the nodes to evaluate: those named, or else all evaluation and training criterion nodes
+    // (logDefaultNodes = false: the latter is not logged again for each of several models)
+    static vector<ComputationNodeBasePtr> DetermineEvalNodes(const ComputationNetworkPtr& net, const vector<wstring>& evalNodeNames, bool logDefaultNodes = true)
+    {
+        std::vector<ComputationNodeBasePtr> evalNodes;
+
+        set<ComputationNodeBasePtr> criteriaLogged; // (keeps track ot duplicates to avoid we don't double-log critera)
+        if (evalNodeNames.size() == 0)
+        {
+            if (logDefaultNodes)
+                fprintf(stderr, "evalNodeNames are not specified, using all the default evalnodes and training criterion nodes.\n");
+            if (net->EvaluationNodes().empty() && net->FinalCriterionNodes().empty())
+                InvalidArgument("There is no default evaluation node or training criterion specified in the network.");
+
+            for (const auto& node : net->EvaluationNodes())
+                if (criteriaLogged.insert(node).second)
+                    evalNodes.push_back(node);
+
+            for (const auto& node : net->FinalCriterionNodes())
+                if (criteriaLogged.insert(node).second)
+                    evalNodes.push_back(node);
+        }
+        else
+        {
+            for (int i = 0; i < evalNodeNames.size(); i++)
+            {
+                const auto& node = net->GetNodeFromName(evalNodeNames[i]);
+                if (!criteriaLogged.insert(node).second)
+                    continue;
+                if (node->GetSampleLayout().GetNumElements() != 1)
+                    InvalidArgument("Criterion nodes to evaluate must have dimension 1x1.");
+                evalNodes.push_back(node);
+            }
+        }
+        return evalNodes;
+    }
+
+    // the Value() matrices of the feature and label nodes, by node name, for the reader to fill in
+    static std::map<std::wstring, Matrix<ElemType>*> GetInputMatrices(const ComputationNetworkPtr& net)
+    {
+        std::map<std::wstring, Matrix<ElemType>*> inputMatrices;
+        for (const auto& node : net->FeatureNodes())
+            inputMatrices[node->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        for (const auto& node : net->LabelNodes())
+            inputMatrices[node->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+        return inputMatrices;
+    }
+
+    // copy a minibatch that was read into one network into the inputs of another, as GetMinibatchIntoNetwork() would have
+    static void CopyMinibatch(const ComputationNetworkPtr& fromNet, const std::map<std::wstring, Matrix<ElemType>*>& from,
+                              const ComputationNetworkPtr& toNet, const std::map<std::wstring, Matrix<ElemType>*>& to)
+    {
+        for (const auto& input : from)
+            to.at(input.first)->SetValue(*input.second, input.second->GetFormat());
+        toNet->GetMBLayoutPtr()->CopyFrom(fromNet->GetMBLayoutPtr());
+        for (auto& node : toNet->FeatureNodes())
+            node->NotifyFunctionValuesMBSizeModified();
+        for (auto& node : toNet->LabelNodes())
+            node->NotifyFunctionValuesMBSizeModified();
+        toNet->DetermineActualMBSizeFromFeatures();
+    }
+
+    static void DisplayEvalStatistics(const size_t startMBNum, const size_t endMBNum, const size_t numSamplesLastMBs,
+                                      const vector<ComputationNodeBasePtr>& evalNodes,
+                                      const double evalResults, const double evalResultsLastMBs, bool displayConvertedValue = false)
     {
         vector<double> evaR;
         evaR.push_back(evalResults);
@@ -171,8 +352,8 @@ protected:
         DisplayEvalStatistics(startMBNum, endMBNum, numSamplesLastMBs, evalNodes, evaR, evaLast, displayConvertedValue);
     }
 
-    void DisplayEvalStatistics(const size_t startMBNum, const size_t endMBNum, const size_t numSamplesLastMBs, const vector<ComputationNodeBasePtr>& evalNodes,
-                               const vector<double>& evalResults, const vector<double>& evalResultsLastMBs, bool displayConvertedValue = false)
+    static void DisplayEvalStatistics(const size_t startMBNum, const size_t endMBNum, const size_t numSamplesLastMBs, const vector<ComputationNodeBasePtr>& evalNodes,
+                                      const vector<double>& evalResults, const vector<double>& evalResultsLastMBs, bool displayConvertedValue = false)
     {
         fprintf(stderr, "Minibatch[%lu-%lu]: Samples Seen = %lu    ", startMBNum, endMBNum, numSamplesLastMBs);
 
@@ -10,6 +10,7 @@
 #include "DataReaderHelpers.h"
 #include "Helpers.h"
 #include "fileutil.h"
+#include "OutputValueWriter.h"
 #include <vector>
 #include <string>
 #include <stdexcept>
@@ -108,7 +109,9 @@ public:
         // clean up
     }
 
-    void WriteOutput(IDataReader<ElemType>& dataReader, size_t mbSize, std::wstring outputPath, const std::vector<std::wstring>& outputNodeNames, size_t numOutputSamples = requestDataSize)
+    // writes the values of each output node to '<outputPath>.<nodeName>'; see OutputValueWriter.h for the formats
+    void WriteOutput(IDataReader<ElemType>& dataReader, size_t mbSize, std::wstring outputPath, const std::vector<std::wstring>& outputNodeNames, size_t numOutputSamples = requestDataSize,
+                     OutputValueFormat outputFormat = OutputValueFormat::text, bool roundTrip = false)
     {
         msra::files::make_intermediate_dirs(outputPath);
 
@@ -128,13 +131,9 @@ public:
                 outputNodes.push_back(m_net->GetNodeFromName(outputNodeNames[i]));
         }
 
-        std::vector<ofstream*> outputStreams;
-        for (int i = 0; i < outputNodes.size(); i++)
-#ifdef _MSC_VER
-            outputStreams.push_back(new ofstream((outputPath + L"." + outputNodes[i]->NodeName()).c_str()));
-#else
-            outputStreams.push_back(new ofstream(wtocharpath(outputPath + L"." + outputNodes[i]->NodeName()).c_str()));
-#endif
+        std::vector<std::unique_ptr<OutputValueWriter<ElemType>>> outputWriters;
+        for (size_t i = 0; i < outputNodes.size(); i++)
+            outputWriters.push_back(std::unique_ptr<OutputValueWriter<ElemType>>(new OutputValueWriter<ElemType>(outputPath + L"." + outputNodes[i]->NodeName(), outputFormat, roundTrip)));
 
         // allocate memory for forward computation
         m_net->AllocateAllMatrices({}, outputNodes, nullptr);
@@ -152,8 +151,6 @@ public:
 
         size_t totalEpochSamples = 0;
         size_t numMBsRun = 0;
-        size_t tempArraySize = 0;
-        ElemType* tempArray = nullptr;
 
         size_t actualMBSize;
         while (DataReaderHelpers::GetMinibatchIntoNetwork(dataReader, m_net, nullptr, false, false, inputMatrices, actualMBSize))
@@ -164,18 +161,8 @@ public:
             {
                 m_net->ForwardProp(outputNodes[i]);
 
-                Matrix<ElemType>& outputValues = dynamic_pointer_cast<ComputationNode<ElemType>>(outputNodes[i])->Value();
-                ofstream& outputStream = *outputStreams[i];
-                outputValues.CopyToArray(tempArray, tempArraySize);
-                ElemType* pCurValue = tempArray;
-                foreach_column (j, outputValues)
-                {
-                    foreach_row (k, outputValues)
-                    {
-                        outputStream << *pCurValue++ << " ";
-                    }
-                    outputStream << endl;
-                }
+                // formatting and writing happen on a background thread, overlapped with the next minibatch
+                outputWriters[i]->Write(dynamic_pointer_cast<ComputationNode<ElemType>>(outputNodes[i])->Value());
             }
 
             totalEpochSamples += actualMBSize;
@@ -186,13 +173,8 @@ public:
         fprintf(stderr, "Total Samples Evaluated = %lu\n", totalEpochSamples);
 
         // clean up
-        for (int i = 0; i < outputStreams.size(); i++)
-        {
-            outputStreams[i]->close();
-            delete outputStreams[i];
-        }
-
-        delete[] tempArray;
+        for (size_t i = 0; i < outputWriters.size(); i++)
+            outputWriters[i]->Close();
     }
 
 private:
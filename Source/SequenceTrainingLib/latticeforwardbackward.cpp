@@ -12,6 +12,7 @@
 #include "simplesenonehmm.h" // the model
 #include "ssematrix.h"       // the matrices
 #include "latticestorage.h"
+#include "VectorMath.h"
 #include <unordered_map>
 #include <list>
 #include <stdexcept>
@@ -91,13 +92,21 @@ static void logaddratio(float &loga, float diff)
 {
     if (diff < -17.0f)
         return; // log (2^-24), 23-bit mantissa -> cut of after 24th bit
-    loga += logf(1.0f + expf(diff));
+    using namespace Microsoft::MSR::CNTK;
+    if (VectorMath::GetMode() != VectorMath::Mode::None) // inlined polynomials instead of two library calls
+        loga += VectorMath::Log1p<false>(VectorMath::Exp<false>(diff));
+    else
+        loga += logf(1.0f + expf(diff));
 }
 static void logaddratio(double &loga, double diff)
 {
     if (diff < -37.0f)
         return; // log (2^-53), 52-bit mantissa -> cut of after 53th bit
-    loga += log(1.0 + exp(diff));
+    using namespace Microsoft::MSR::CNTK;
+    if (VectorMath::GetMode() != VectorMath::Mode::None)
+        loga += VectorMath::Log1p<false>(VectorMath::Exp<false>(diff));
+    else
+        loga += log(1.0 + exp(diff));
 }
 // loga <- log (exp (loga) + exp (logb)) = log (exp (loga) * (1.0 + exp (logb - loga)) = loga + log (1.0 + exp (logb - loga))
 template <typename FLOAT>
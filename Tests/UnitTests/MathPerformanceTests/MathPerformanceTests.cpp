@@ -8,10 +8,15 @@
 #define NOMINMAX
 #include "Windows.h"
 #include <chrono>
+#include <functional>
 #include <iostream>
 #include <vector>
 #include "Matrix.h"
 #include "CPUMatrix.h"
+#include "CPUSparseMatrix.h"
+#include "VectorMath.h"
+#include "NumaPlacement.h"
+#include "CPUMatrixAllocator.h"
 #include "Sequences.h"
 using namespace Microsoft::MSR::CNTK;
 using namespace std;
@@ -435,8 +440,197 @@ void MandSTest(int count, int devId)
     delete[] data3;
 }
 
+// random CSC matrix with the given fraction of non-zero elements
+template <class ElemType>
+void randomInitializeCPUSparseMatrix(CPUSparseMatrix<ElemType>& M, size_t rows, size_t cols, double density)
+{
+    vector<CPUSPARSE_INDEX_TYPE> colStart(cols + 1), rowIndex;
+    vector<ElemType> values;
+    for (size_t j = 0; j < cols; j++)
+    {
+        colStart[j] = (CPUSPARSE_INDEX_TYPE) rowIndex.size();
+        for (size_t i = 0; i < rows; i++)
+        {
+            if (1.0 * rand() / RAND_MAX < density)
+            {
+                rowIndex.push_back((CPUSPARSE_INDEX_TYPE) i);
+                values.push_back((ElemType)(1.0 * rand() / RAND_MAX));
+            }
+        }
+    }
+    colStart[cols] = (CPUSPARSE_INDEX_TYPE) rowIndex.size();
+    M.SetMatrixFromCSCFormat(colStart.data(), rowIndex.data(), values.data(), values.size(), rows, cols);
+}
+
+// sparse x dense products on the CPU, for all transpositions, over a range of sparsity levels
+// The shapes resemble a sparse-input layer: [hidden x vocab] weights times a [vocab x minibatch] sparse input.
+template <class ElemType>
+void SparseDenseMultiplyTest(size_t hidden, size_t vocab, size_t mbSize, int count)
+{
+    const double densities[] = {0.0001, 0.001, 0.01, 0.1};
+    for (double density : densities)
+    {
+        CPUSparseMatrix<ElemType> S(matrixFormatSparseCSC);
+        randomInitializeCPUSparseMatrix(S, vocab, mbSize, density);
+        CPUMatrix<ElemType> W(hidden, vocab);
+        randomInitializeCPUMatrix<ElemType>(W);
+        CPUMatrix<ElemType> WT(vocab, hidden);
+        randomInitializeCPUMatrix<ElemType>(WT);
+        CPUMatrix<ElemType> G(hidden, mbSize);
+        randomInitializeCPUMatrix<ElemType>(G);
+        CPUMatrix<ElemType> C;
+
+        auto timeIt = [&](const char* what, std::function<void()> f)
+        {
+            f(); // warm up
+            auto t_start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < count; i++)
+                f();
+            auto t_end = std::chrono::high_resolution_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(t_end - t_start).count() / count;
+            cout << "density " << density << " (" << S.NzCount() << " nz): " << what << " " << ms << " ms" << endl;
+        };
+
+        timeIt("dense x sparse       W * S    ", [&]() { CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, W, false, S, false, 0, C); });
+        timeIt("dense' x sparse      WT' * S  ", [&]() { CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, WT, true, S, false, 0, C); });
+        timeIt("dense x sparse'      G * S'   ", [&]() { CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, G, false, S, true, 0, C); });
+        timeIt("sparse' x dense      S' * WT  ", [&]() { CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, S, true, WT, false, 0, C); });
+        timeIt("sparse' x dense'     S' * W'  ", [&]() { CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, S, true, W, true, 0, C); });
+        CPUSparseMatrix<ElemType> blockGrad(matrixFormatSparseBlockCol);
+        timeIt("dense x sparse' (blk) G * S'  ", [&]() { CPUSparseMatrix<ElemType>::MultiplyAndAdd(1, G, false, S, true, blockGrad); });
+    }
+}
+
+// elementwise transcendental functions on the CPU with the C library and with the vectorized kernels
+template <class ElemType>
+void VectorMathTest(size_t rows, size_t cols, int count)
+{
+    CPUMatrix<ElemType> A(rows, cols);
+    randomInitializeCPUMatrix<ElemType>(A);
+    CPUMatrix<ElemType> C(rows, cols);
+
+    const VectorMath::Mode modes[] = {VectorMath::Mode::None, VectorMath::Mode::Accurate, VectorMath::Mode::Fast};
+    const char* modeNames[] = {"none    ", "accurate", "fast    "};
+    for (size_t m = 0; m < 3; m++)
+    {
+        VectorMath::SetMode(modes[m]);
+        auto timeIt = [&](const char* what, std::function<void()> f)
+        {
+            f(); // warm up
+            auto t_start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < count; i++)
+                f();
+            auto t_end = std::chrono::high_resolution_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(t_end - t_start).count() / count;
+            cout << "vectorMath " << modeNames[m] << ": " << what << " " << ms << " ms (" << rows * cols / ms * 1e-6 << " G elements/s)" << endl;
+        };
+
+        timeIt("exp       ", [&]() { C.AssignExpOf(A); });
+        timeIt("tanh      ", [&]() { C.AssignTanhOf(A); });
+        timeIt("sigmoid   ", [&]() { C.AssignSigmoidOf(A); });
+        timeIt("logSoftmax", [&]() { C.AssignLogSoftmaxOf(A, true); });
+    }
+    VectorMath::SetMode(VectorMath::Mode::None);
+}
+
+// memory bandwidth and GEMM speed depending on where the CPUMatrix buffers are, relative to the threads that use them
+// 1. buffers on node m, threads (pinned) on node r, for all m, r: local (m == r) versus remote bandwidth
+// 2. threads on all nodes, buffers placed by each NumaPlacement policy
+template <class ElemType>
+void NumaBandwidthTest(size_t rows, size_t cols, int count)
+{
+    const size_t numNodes = NumaPlacement::NumNodes();
+    const bool pinThreads = NumaPlacement::GetPinThreads();
+    NumaPlacement::SetPinThreads(true);
+    auto timeIt = [&](std::function<void()> f)
+    {
+        f(); // warm up
+        auto t_start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < count; i++)
+            f();
+        auto t_end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(t_end - t_start).count() / count;
+    };
+    const double bytes = 2.0 * rows * cols * sizeof(ElemType); // (C = A + 1 reads A and writes C)
+
+    cout << "NUMA: " << numNodes << " nodes" << endl;
+    for (size_t m = 0; m < numNodes; m++)
+    {
+        NumaPlacement::ScopedNodeBinding memoryNode((int) m);
+        CPUMatrix<ElemType> A(rows, cols);
+        randomInitializeCPUMatrix<ElemType>(A);
+        CPUMatrix<ElemType> C(rows, cols);
+        C.SetValue(0); // (faults the pages in on node m)
+        for (size_t r = 0; r < numNodes; r++)
+        {
+            NumaPlacement::ScopedNodeBinding threadNode((int) r);
+            NumaPlacement::PinOpenMPThreads();
+            double ms = timeIt([&]() { C.AssignSumOf(1, A); });
+            cout << "NUMA: memory on node " << m << " (A on node " << NumaPlacement::NodeOfAddress(A.BufferPointer()) << "), threads on node " << r
+                 << (m == r ? " (local):  " : " (remote): ") << ms << " ms (" << bytes / ms * 1e-6 << " GB/s)" << endl;
+        }
+    }
+    NumaPlacement::PinOpenMPThreads();
+
+    const NumaPlacement::Policy policies[] = {NumaPlacement::Policy::None, NumaPlacement::Policy::FirstTouch, NumaPlacement::Policy::Interleave};
+    const char* policyNames[] = {"none      ", "firstTouch", "interleave"};
+    for (size_t p = 0; p < 3; p++)
+    {
+        NumaPlacement::SetPolicy(policies[p]);
+        CPUMatrix<ElemType> A(rows, cols), B(cols, cols);
+        randomInitializeCPUMatrix<ElemType>(A);
+        randomInitializeCPUMatrix<ElemType>(B);
+        CPUMatrix<ElemType> C(rows, cols);
+        double ms = timeIt([&]() { C.AssignSumOf(1, A); });
+        cout << "NUMA: numaPolicy " << policyNames[p] << ": elementwise " << ms << " ms (" << bytes / ms * 1e-6 << " GB/s)";
+        ms = timeIt([&]() { CPUMatrix<ElemType>::MultiplyAndWeightedAdd(1, A, false, B, false, 0, C); });
+        cout << ", GEMM " << ms << " ms (" << 2.0 * rows * cols * cols / ms * 1e-6 << " GFlop/s)" << endl;
+    }
+    NumaPlacement::SetPolicy(NumaPlacement::Policy::None);
+    NumaPlacement::SetPinThreads(pinThreads);
+}
+
+// a matrix resized to varying minibatch sizes, as with variable-length sequences, with each CPUMatrixAllocator
+template <class ElemType>
+void CPUMatrixAllocatorTest(size_t rows, size_t maxCols, int count)
+{
+    const char* names[] = {"default", "caching"};
+    for (const char* name : names)
+    {
+        for (bool hugePages : {false, true})
+        {
+            auto allocator = CPUMatrixAllocator::Create(name, hugePages, 0);
+            CPUMatrixAllocator::SetCurrent(allocator);
+            auto t_start = std::chrono::high_resolution_clock::now();
+            {
+                CPUMatrix<ElemType> A(rows, maxCols);
+                for (int i = 0; i < count; i++)
+                {
+                    const size_t cols = maxCols / 4 + (i * 7919) % (maxCols - maxCols / 4);
+                    A.Resize(rows, cols, false);
+                    A.SetValue(1);
+                }
+            }
+            auto t_end = std::chrono::high_resolution_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(t_end - t_start).count() / count;
+            cout << "cpuMatrixAllocator " << name << (hugePages ? ", hugePages: " : ":            ") << ms << " ms per resize and fill; "
+                 << allocator->GetStatistics().ToString() << endl;
+        }
+    }
+    CPUMatrixAllocator::SetCurrent(nullptr);
+}
+
 int wmain()
 {
+    SparseDenseMultiplyTest<float>(512, 50000, 256, 10);
+
+    VectorMathTest<float>(2048, 256, 100);
+    VectorMathTest<double>(2048, 256, 100);
+
+    NumaBandwidthTest<float>(8192, 2048, 10);
+
+    CPUMatrixAllocatorTest<float>(4096, 8192, 200);
+
     ColumnSliceMultAndAddTest<float>(2048, 2048, 256, 0);
 
     TestRnnForwardPropSRP<float>();
@@ -4,6 +4,10 @@
 //
 #include "stdafx.h"
 #include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/VectorMath.h"
+#include "../../../Source/Math/NumaPlacement.h"
+#include "../../../Source/Math/CPUMatrixAllocator.h"
+#include <thread>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -874,6 +878,53 @@ BOOST_FIXTURE_TEST_CASE(CPUColumnElementOperations, RandomSeedFixture)
     BOOST_CHECK(m0.IsEqualTo(m2, c_epsilonFloatE4));
 }
 
+// When all columns carry the same noise words, NCE and its gradients take the GEMM path; it must agree with
+// scoring each column on its own (a single column never takes it).
+BOOST_FIXTURE_TEST_CASE(CPUMatrixNCESharedNoise, RandomSeedFixture)
+{
+    const size_t vocab = 50, hidden = 8, batch = 6, numNoise = 5, sampleSize = numNoise + 1;
+    SMatrix a = SMatrix::RandomUniform(hidden, batch, -1, 1, IncrementCounter());
+    SMatrix b = SMatrix::RandomUniform(hidden, vocab, -1, 1, IncrementCounter());
+    SMatrix bias = SMatrix::RandomUniform(1, vocab, -1, 1, IncrementCounter());
+
+    // [word id; log prob] pairs, target first, then the shared noise words (their log probs negated, as the reader writes them)
+    SMatrix samples(2 * sampleSize, batch);
+    const int noiseWords[numNoise] = {3, 17, 3, 42, 8}; // (3 drawn twice)
+    for (size_t j = 0; j < batch; j++)
+    {
+        samples(0, j) = (float) (j * 7 % vocab);
+        samples(1, j) = -3.0f - 0.1f * j;
+        for (size_t k = 0; k < numNoise; k++)
+        {
+            samples(2 * (k + 1), j) = (float) noiseWords[k];
+            samples(2 * (k + 1) + 1, j) = 2.5f + 0.2f * k;
+        }
+    }
+
+    SMatrix tmp(sampleSize, batch), c(1, 1);
+    samples.AssignNoiseContrastiveEstimation(a, b, bias, tmp, c);
+    SMatrix gradA = SMatrix::Zeros(hidden, batch), gradB = SMatrix::Zeros(hidden, vocab);
+    samples.AssignNCEDerivative(tmp, a, b, 1, gradA);
+    samples.AssignNCEDerivative(tmp, a, b, 2, gradB);
+
+    SMatrix expectedTmp(sampleSize, batch), columnC(1, 1);
+    SMatrix expectedGradA = SMatrix::Zeros(hidden, batch), expectedGradB = SMatrix::Zeros(hidden, vocab);
+    float expectedC = 0;
+    for (size_t j = 0; j < batch; j++)
+    {
+        SMatrix columnSamples = samples.ColumnSlice(j, 1), columnA = a.ColumnSlice(j, 1), columnTmp = expectedTmp.ColumnSlice(j, 1);
+        columnSamples.AssignNoiseContrastiveEstimation(columnA, b, bias, columnTmp, columnC);
+        expectedC += columnC(0, 0);
+        SMatrix columnGradA = expectedGradA.ColumnSlice(j, 1);
+        columnSamples.AssignNCEDerivative(columnTmp, columnA, b, 1, columnGradA);
+        columnSamples.AssignNCEDerivative(columnTmp, columnA, b, 2, expectedGradB);
+    }
+    BOOST_CHECK_CLOSE(c(0, 0), expectedC, 1e-3);
+    BOOST_CHECK(tmp.IsEqualTo(expectedTmp, c_epsilonFloatE4));
+    BOOST_CHECK(gradA.IsEqualTo(expectedGradA, c_epsilonFloatE4));
+    BOOST_CHECK(gradB.IsEqualTo(expectedGradB, c_epsilonFloatE4));
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingFloat, RandomSeedFixture)
 {
     const float low = 0;
@@ -898,6 +949,424 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+// With counter-based random numbers, a fill must not depend on the number of threads, and a dropout mask
+// applied to a column slice at the matching offset must equal the mask of the whole matrix.
+BOOST_FIXTURE_TEST_CASE(CPUMatrixCounterBasedRNG, RandomSeedFixture)
+{
+    const unsigned long seed = 4711;
+    SMatrix::SetCounterBasedRNG(true);
+
+    SMatrix::SetNumThreads(1);
+    auto m1 = SMatrix::RandomUniform(300, 100, -1, 1, seed);
+    auto g1 = SMatrix::RandomGaussian(300, 100, 0, 1, seed);
+    SMatrix::SetNumThreads((int) std::thread::hardware_concurrency());
+    auto m2 = SMatrix::RandomUniform(300, 100, -1, 1, seed);
+    auto g2 = SMatrix::RandomGaussian(300, 100, 0, 1, seed);
+    BOOST_CHECK(m1.IsEqualTo(m2, 0));
+    BOOST_CHECK(g1.IsEqualTo(g2, 0));
+    BOOST_CHECK_LE(fabs(m1.SumOfElements() / m1.GetNumElements()), 0.05);
+
+    const float rate = 0.3f;
+    const float scale = 1 / (1 - rate);
+    SMatrix input = SMatrix::RandomUniform(7, 10, 1, 2, seed); // (no zeroes, so that a zero output means dropped)
+    SMatrix mask(7, 10);
+    mask.SetUniformRandomMask(rate, scale, seed);
+    SMatrix expected(7, 10);
+    expected.AssignElementProductOf(mask, input);
+
+    SMatrix whole(7, 10);
+    whole.AssignDropoutOf(input, rate, scale, seed, 0);
+    BOOST_CHECK(whole.IsEqualTo(expected, 1e-6f));
+
+    SMatrix gradient(7, 10);
+    gradient.SetValue(0);
+    for (size_t j = 0; j < 10; j += 3)
+    {
+        const size_t numCols = std::min((size_t) 3, 10 - j);
+        SMatrix sliceOut = whole.ColumnSlice(j, numCols);
+        sliceOut.AssignDropoutOf(input.ColumnSlice(j, numCols), rate, scale, seed, j * 7);
+        SMatrix sliceGrad = gradient.ColumnSlice(j, numCols);
+        sliceGrad.AddDropoutOf(input.ColumnSlice(j, numCols), rate, scale, seed, j * 7);
+    }
+    BOOST_CHECK(whole.IsEqualTo(expected, 1e-6f));
+    BOOST_CHECK(gradient.IsEqualTo(expected, 1e-6f));
+
+    SMatrix::SetCounterBasedRNG(false);
+}
+
+// the vectorized functions against the C library, over [-range, range], relative to max(|f(x)|, floor)
+template <class ElemType, class F1, class F2>
+static double MaxVectorMathError(F1 vectorized, F2 reference, ElemType lo, ElemType hi, double floor)
+{
+    const size_t n = 100001;
+    std::vector<ElemType> a(n), c(n);
+    for (size_t i = 0; i < n; i++)
+        a[i] = lo + (hi - lo) * (ElemType) i / (ElemType)(n - 1);
+    vectorized(a.data(), c.data(), n);
+    double maxError = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const double expected = reference((double) a[i]);
+        maxError = std::max(maxError, fabs(c[i] - expected) / std::max(fabs(expected), floor));
+    }
+    return maxError;
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixVectorMath, RandomSeedFixture)
+{
+    auto sigmoid = [](double x) { return 1 / (1 + exp(-x)); };
+    auto exp_ = [](double x) { return exp(x); };
+    auto log_ = [](double x) { return log(x); };
+    auto tanh_ = [](double x) { return tanh(x); };
+    for (bool fast : {false, true})
+    {
+        const double tolerance = fast ? 5e-6 : 1e-6;
+        BOOST_CHECK_LE(MaxVectorMathError<float>([=](const float* a, float* c, size_t n) { VectorMath::Exp(a, c, n, fast); }, exp_, -80, 80, 0), tolerance);
+        BOOST_CHECK_LE(MaxVectorMathError<float>([=](const float* a, float* c, size_t n) { VectorMath::Log(a, c, n, fast); }, log_, 1e-30f, 1e30f, 1e-3), tolerance);
+        BOOST_CHECK_LE(MaxVectorMathError<float>([=](const float* a, float* c, size_t n) { VectorMath::Tanh(a, c, n, fast); }, tanh_, -20, 20, 1), tolerance);
+        BOOST_CHECK_LE(MaxVectorMathError<float>([=](const float* a, float* c, size_t n) { VectorMath::Sigmoid(a, c, n, fast); }, sigmoid, -80, 80, 0), tolerance);
+    }
+    BOOST_CHECK_LE(MaxVectorMathError<double>([](const double* a, double* c, size_t n) { VectorMath::Exp(a, c, n, false); }, exp_, -700, 700, 0), 1e-14);
+    BOOST_CHECK_LE(MaxVectorMathError<double>([](const double* a, double* c, size_t n) { VectorMath::Log(a, c, n, false); }, log_, 1e-300, 1e300, 1e-3), 1e-14);
+    BOOST_CHECK_LE(MaxVectorMathError<double>([](const double* a, double* c, size_t n) { VectorMath::Tanh(a, c, n, false); }, tanh_, -40, 40, 1), 1e-14);
+
+    // the matrix functions give the same results as with the C library, within the accuracy of the mode
+    SMatrix input = SMatrix::RandomUniform(300, 100, -10, 10, IncrementCounter());
+    SMatrix expected(300, 100), actual(300, 100);
+    for (auto mode : {VectorMath::Mode::Accurate, VectorMath::Mode::Fast})
+    {
+        VectorMath::SetMode(VectorMath::Mode::None);
+        expected.AssignExpOf(input);
+        VectorMath::SetMode(mode);
+        actual.AssignExpOf(input);
+        actual.ElementDivideBy(expected); // (relative error)
+        BOOST_CHECK(actual.IsEqualTo(SMatrix::Ones(300, 100), 1e-5f));
+
+        VectorMath::SetMode(VectorMath::Mode::None);
+        expected.AssignLogSoftmaxOf(input, true);
+        VectorMath::SetMode(mode);
+        actual.AssignLogSoftmaxOf(input, true);
+        BOOST_CHECK(actual.IsEqualTo(expected, 1e-4f));
+
+        VectorMath::SetMode(VectorMath::Mode::None);
+        expected.AssignSigmoidOf(input);
+        VectorMath::SetMode(mode);
+        actual.AssignSigmoidOf(input);
+        BOOST_CHECK(actual.IsEqualTo(expected, 1e-5f));
+    }
+    VectorMath::SetMode(VectorMath::Mode::None);
+}
+
+// The learners sum their average multiplier in parallel. These tests check them against plain serial loops,
+// and check that the result does not depend on the number of threads.
+
+// 30000 elements span several of the blocks that are summed in parallel; 7 are fewer than one block
+static const std::array<std::pair<size_t, size_t>, 2> c_learnerTestShapes = {{{300, 100}, {7, 1}}};
+
+// run 'update' once on a single thread and once on all threads, and check that both give identical results
+template <class UPDATE>
+static void CheckLearnerDeterminism(const DMatrix& gradients, const DMatrix& smoothed, const DMatrix& values, UPDATE update)
+{
+    DMatrix g1(gradients), s1(smoothed), v1(values);
+    DMatrix g2(gradients), s2(smoothed), v2(values);
+    DMatrix::SetNumThreads(1);
+    double m1 = update(g1, s1, v1);
+    DMatrix::SetNumThreads((int) std::thread::hardware_concurrency());
+    double m2 = update(g2, s2, v2);
+    BOOST_CHECK_EQUAL(m1, m2);
+    BOOST_CHECK(g1.IsEqualTo(g2, 0));
+    BOOST_CHECK(s1.IsEqualTo(s2, 0));
+    BOOST_CHECK(v1.IsEqualTo(v2, 0));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixAdagrad, RandomSeedFixture)
+{
+    for (const auto& shape : c_learnerTestShapes)
+    {
+        const size_t n = shape.first * shape.second;
+        DMatrix gradients = DMatrix::RandomUniform(shape.first, shape.second, -1, 1, 1);
+        DMatrix smoothed = DMatrix::RandomUniform(shape.first, shape.second, 0, 1, 2);
+
+        // serial reference
+        DMatrix refGradients(gradients), refSmoothed(smoothed);
+        double refMultiplier = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            refSmoothed.BufferPointer()[i] += refGradients.BufferPointer()[i] * refGradients.BufferPointer()[i];
+            double denom = sqrt(refSmoothed.BufferPointer()[i] + 1e-16);
+            refGradients.BufferPointer()[i] /= denom;
+            refMultiplier += 1 / denom;
+        }
+        refMultiplier /= n;
+
+        DMatrix g(gradients), s(smoothed);
+        double aveMultiplier = s.Adagrad(g, true);
+        BOOST_CHECK_CLOSE(aveMultiplier, refMultiplier, 1e-9);
+        BOOST_CHECK(g.IsEqualTo(refGradients, c_epsilonDoubleE11));
+        BOOST_CHECK(s.IsEqualTo(refSmoothed, c_epsilonDoubleE11));
+
+        DMatrix g2(gradients), s2(smoothed);
+        BOOST_CHECK_EQUAL(s2.Adagrad(g2, false), 1);
+        BOOST_CHECK(g2.IsEqualTo(refGradients, c_epsilonDoubleE11));
+
+        CheckLearnerDeterminism(gradients, smoothed, DMatrix(), [](DMatrix& g, DMatrix& s, DMatrix&)
+                                {
+                                    return s.Adagrad(g, true);
+                                });
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixRmsProp, RandomSeedFixture)
+{
+    const double gamma = 0.99, inc = 1.2, max = 10, dec = 0.75, min = 0.1;
+    for (const auto& shape : c_learnerTestShapes)
+    {
+        const size_t n = shape.first * shape.second;
+        DMatrix gradients = DMatrix::RandomUniform(shape.first, shape.second, -1, 1, 1);
+
+        // the first call initializes the state from the gradient
+        DMatrix s, g(gradients);
+        s.RmsProp(g, gamma, inc, max, dec, min, true);
+        BOOST_CHECK_EQUAL(s.GetNumCols(), 3 * shape.second);
+        for (size_t i = 0; i < n; i++)
+            BOOST_CHECK_CLOSE(s.BufferPointer()[i], gradients.BufferPointer()[i] * gradients.BufferPointer()[i], 1e-9);
+
+        // serial reference for the second call
+        DMatrix smoothed(s);
+        gradients = DMatrix::RandomUniform(shape.first, shape.second, -1, 1, 3);
+        DMatrix refGradients(gradients), refSmoothed(smoothed);
+        double* avars = refSmoothed.BufferPointer();
+        double* signs = avars + n;
+        double* steps = avars + 2 * n;
+        double* grad = refGradients.BufferPointer();
+        double refMultiplier = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            avars[i] = gamma * avars[i] + (1 - gamma) * grad[i] * grad[i];
+            int gradSign = (0 < grad[i]) - (grad[i] < 0);
+            if (signs[i] * gradSign > 0)
+                steps[i] = std::min(steps[i] * inc, max);
+            else
+                steps[i] = std::max(steps[i] * dec, min);
+            double a = steps[i] / sqrt(avars[i] + (double) 1e-6f); // (the floor is a float constant in RmsProp())
+            grad[i] *= a;
+            signs[i] = gradSign;
+            refMultiplier += a;
+        }
+        refMultiplier /= n;
+
+        DMatrix g2(gradients), s2(smoothed);
+        double aveMultiplier = s2.RmsProp(g2, gamma, inc, max, dec, min, true);
+        BOOST_CHECK_CLOSE(aveMultiplier, refMultiplier, 1e-9);
+        BOOST_CHECK(g2.IsEqualTo(refGradients, c_epsilonDoubleE11));
+        BOOST_CHECK(s2.IsEqualTo(refSmoothed, c_epsilonDoubleE11));
+
+        CheckLearnerDeterminism(gradients, smoothed, DMatrix(), [&](DMatrix& g, DMatrix& s, DMatrix&)
+                                {
+                                    return s.RmsProp(g, gamma, inc, max, dec, min, true);
+                                });
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixFSAdagrad, RandomSeedFixture)
+{
+    const double learnRate = 0.01, momentum = 0.9, adaWeight = 0.99, adaMul = 0.05;
+    for (const auto& shape : c_learnerTestShapes)
+    {
+        const size_t n = shape.first * shape.second;
+        DMatrix gradients = DMatrix::RandomUniform(shape.first, shape.second, -1, 1, 1);
+        DMatrix values = DMatrix::RandomUniform(shape.first, shape.second, -1, 1, 2);
+        DMatrix smoothed = DMatrix::RandomUniform(shape.first, 2 * shape.second, 0, 1, 3);
+        smoothed.BufferPointer()[0] = 0; // (no adaptive scaling for a zero variance)
+        gradients.BufferPointer()[0] = 0;
+
+        // serial reference
+        DMatrix refValues(values), refSmoothed(smoothed);
+        double* smoothAda = refSmoothed.BufferPointer();
+        double* smoothMom = smoothAda + n;
+        for (size_t i = 0; i < n; i++)
+        {
+            double g = gradients.BufferPointer()[i];
+            smoothAda[i] = adaWeight * smoothAda[i] + (1 - adaWeight) * g * g;
+            if (smoothAda[i] != 0)
+                g *= std::min(adaMul / sqrt(smoothAda[i]), 10.0);
+            g = momentum * smoothMom[i] + (1 - momentum) * g;
+            smoothMom[i] = g;
+            refValues.BufferPointer()[i] -= learnRate * g;
+        }
+
+        DMatrix g(gradients), s(smoothed), v(values);
+        s.FSAdagrad(g, v, learnRate, momentum, adaWeight, adaMul);
+        BOOST_CHECK(v.IsEqualTo(refValues, c_epsilonDoubleE11));
+        BOOST_CHECK(s.IsEqualTo(refSmoothed, c_epsilonDoubleE11));
+
+        CheckLearnerDeterminism(gradients, smoothed, values, [&](DMatrix& g, DMatrix& s, DMatrix& v)
+                                {
+                                    s.FSAdagrad(g, v, learnRate, momentum, adaWeight, adaMul);
+                                    return 0.0;
+                                });
+    }
+}
+
+// MultiTensorLearnerUpdate() with FSAdaGrad equals FSAdagrad() on each parameter with that parameter's multiplier
+// (at this level the smoothing weight and the multipliers are given, so they need not come from the shared #frames)
+BOOST_FIXTURE_TEST_CASE(CPUMatrixMultiTensorFSAdagrad, RandomSeedFixture)
+{
+    const double adaWeight = 0.99;
+    for (double momentum : {0.0, 0.9})
+    {
+        LearnerUpdateParams params;
+        params.type = LearnerUpdateType::FSAdaGrad;
+        params.learnRatePerSample = 0.01;
+        params.momentum = momentum;
+        params.mbSize = 16;
+
+        std::vector<DMatrix> values, gradients, smoothed, refValues, refSmoothed;
+        std::vector<double> adaMuls;
+        for (size_t i = 0; i < c_learnerTestShapes.size(); i++)
+        {
+            const auto& shape = c_learnerTestShapes[i];
+            values.push_back(DMatrix::RandomUniform(shape.first, shape.second, -1, 1, 1 + i));
+            gradients.push_back(DMatrix::RandomUniform(shape.first, shape.second, -1, 1, 100 + i));
+            smoothed.push_back(DMatrix::RandomUniform(shape.first, 2 * shape.second, 0, 1, 200 + i));
+            refValues.push_back(values[i]);
+            refSmoothed.push_back(smoothed[i]);
+            adaMuls.push_back(0.05 * (i + 1));
+        }
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            DMatrix g(gradients[i]);
+            refSmoothed[i].FSAdagrad(g, refValues[i], params.learnRatePerSample, momentum, adaWeight, adaMuls[i]);
+        }
+
+        std::vector<DMatrix*> pValues, pGradients, pSmoothed;
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            pValues.push_back(&values[i]);
+            pGradients.push_back(&gradients[i]);
+            pSmoothed.push_back(&smoothed[i]);
+        }
+        DMatrix::MultiTensorLearnerUpdate(pValues, pGradients, pSmoothed, params, adaWeight, adaMuls);
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            BOOST_CHECK(values[i].IsEqualTo(refValues[i], c_epsilonDoubleE11));
+            BOOST_CHECK(smoothed[i].IsEqualTo(refSmoothed[i], c_epsilonDoubleE11));
+        }
+    }
+}
+
+// buffers placed by each policy, or on a node, are zero-initialized and behave as any other (large ones are mmap'ed)
+BOOST_FIXTURE_TEST_CASE(CPUMatrixNumaPlacement, RandomSeedFixture)
+{
+    const NumaPlacement::Policy policies[] = {NumaPlacement::Policy::None, NumaPlacement::Policy::FirstTouch, NumaPlacement::Policy::Interleave};
+    const SMatrix source = SMatrix::RandomUniform(1024, 600, -1, 1, IncrementCounter()); // (> 1 MB)
+    for (int node = -1; node < (int) NumaPlacement::NumNodes(); node++)
+    {
+        NumaPlacement::ScopedNodeBinding binding(node);
+        for (auto policy : policies)
+        {
+            NumaPlacement::SetPolicy(policy);
+            SMatrix m(1024, 600);
+            BOOST_CHECK(m.IsEqualTo(SMatrix::Zeros(1024, 600), 0));
+            m.SetValue(source);
+            BOOST_CHECK(m.IsEqualTo(source, 0));
+            if (node >= 0)
+                BOOST_CHECK(NumaPlacement::NodeOfAddress(m.BufferPointer()) == node || NumaPlacement::NodeOfAddress(m.BufferPointer()) == -1);
+
+            m.Resize(2048, 600); // (from one placed buffer to another)
+            BOOST_CHECK(m.IsEqualTo(SMatrix::Zeros(2048, 600), 0));
+            const float* placedBuffer = m.BufferPointer();
+            m.Resize(10, 10, /*growOnly=*/false); // (to the heap)
+            BOOST_CHECK(m.BufferPointer() != placedBuffer);
+            m.SetValue(1);
+            SMatrix moved(std::move(m));
+            BOOST_CHECK(moved.IsEqualTo(SMatrix::Ones(10, 10), 0));
+        }
+        NumaPlacement::SetPolicy(NumaPlacement::Policy::Interleave);
+        SMatrix placed(1024, 600);
+        NumaPlacement::SetPolicy(NumaPlacement::Policy::None); // (freed after the policy changed)
+    }
+    BOOST_CHECK_EQUAL(NumaPlacement::GetCurrentThreadNode(), -1);
+}
+
+BOOST_AUTO_TEST_CASE(CPUMatrixAllocatorSizeClasses)
+{
+    for (size_t bytes = 1; bytes < 100000000; bytes += bytes / 7 + 1)
+    {
+        size_t classBytes = CachingCPUMatrixAllocator::SizeClass(bytes);
+        BOOST_CHECK(classBytes >= bytes);
+        BOOST_CHECK(classBytes % 64 == 0);
+        BOOST_CHECK(bytes <= 1024 || classBytes <= bytes + bytes / 4);
+        BOOST_CHECK_EQUAL(CachingCPUMatrixAllocator::SizeClass(classBytes), classBytes);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CPUMatrixCachingAllocator)
+{
+    for (bool hugePages : {false, true})
+    {
+        CachingCPUMatrixAllocator allocator(0, hugePages);
+        const size_t bytes = 3000000;
+        char* p = (char*) allocator.Malloc(bytes);
+        BOOST_CHECK((size_t) p % 64 == 0);
+        memset(p, 1, bytes);
+        allocator.Free(p, bytes);
+
+        // a request of the same size class gets the block again, cleared
+        char* q = (char*) allocator.Malloc(bytes - 100000);
+        BOOST_CHECK(q == p);
+        BOOST_CHECK(std::all_of(q, q + bytes - 100000, [](char c) { return c == 0; }));
+        auto stats = allocator.GetStatistics();
+        BOOST_CHECK_EQUAL(stats.numAllocations, 2);
+        BOOST_CHECK_EQUAL(stats.numCacheHits, 1);
+        BOOST_CHECK_EQUAL(stats.numSystemAllocations, 1);
+        BOOST_CHECK_EQUAL(stats.bytesInUse, bytes - 100000);
+        BOOST_CHECK_EQUAL(stats.bytesAllocated, CachingCPUMatrixAllocator::SizeClass(bytes));
+        BOOST_CHECK(stats.Fragmentation() > 0 && stats.Fragmentation() < 0.25);
+
+        allocator.Free(q, bytes - 100000);
+        stats = allocator.GetStatistics();
+        BOOST_CHECK_EQUAL(stats.bytesInUse, 0);
+        BOOST_CHECK_EQUAL(stats.bytesCached, CachingCPUMatrixAllocator::SizeClass(bytes));
+        allocator.ReleaseCachedMemory();
+        stats = allocator.GetStatistics();
+        BOOST_CHECK_EQUAL(stats.bytesCached, 0);
+        BOOST_CHECK_EQUAL(stats.numSystemFrees, 1);
+    }
+
+    // blocks beyond the limit of the cache go back to the system
+    CachingCPUMatrixAllocator limited(1 << 20);
+    void* p = limited.Malloc(2 << 20);
+    limited.Free(p, 2 << 20);
+    BOOST_CHECK_EQUAL(limited.GetStatistics().bytesCached, 0);
+    BOOST_CHECK_EQUAL(limited.GetStatistics().numSystemFrees, 1);
+}
+
+// matrices allocated through one allocator can be freed through another
+BOOST_FIXTURE_TEST_CASE(CPUMatrixWithCachingAllocator, RandomSeedFixture)
+{
+    auto allocator = std::make_shared<CachingCPUMatrixAllocator>(0, true);
+    CPUMatrixAllocator::SetCurrent(allocator);
+    const SMatrix source = SMatrix::RandomUniform(512, 1000, -1, 1, IncrementCounter());
+    SMatrix m(512, 1000);
+    for (size_t cols : {1000, 700, 1000, 3, 1000})
+    {
+        m.Resize(512, cols, false); // (a new buffer each time)
+        BOOST_CHECK(m.IsEqualTo(SMatrix::Zeros(512, cols), 0));
+        m.SetValue(source.ColumnSlice(0, cols));
+        BOOST_CHECK(m.IsEqualTo(source.ColumnSlice(0, cols), 0));
+    }
+    BOOST_CHECK(allocator->GetStatistics().numCacheHits > 0);
+    BOOST_CHECK((size_t) m.BufferPointer() % 64 == 0);
+
+    CPUMatrixAllocator::SetCurrent(nullptr); // (back to the default)
+    allocator.reset();
+    m.Resize(512, 10, false); // (frees the caching allocator's block)
+    BOOST_CHECK(m.IsEqualTo(SMatrix::Zeros(512, 10), 0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
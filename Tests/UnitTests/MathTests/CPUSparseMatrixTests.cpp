@@ -59,6 +59,61 @@ BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixCopyColumnSliceToDense, RandomSeedFixture
     BOOST_CHECK(dm1.IsEqualTo(dm2, c_epsilonFloatE4));
 }
 
+// sparse from the non-zeroes of a dense matrix; SetValue() must be called column by column for CSC, and row by row for CSR
+// (SetValue() cannot skip more than one column (CSC) or row (CSR) at a time, so the dense matrix must not have empty runs of those)
+static void AssignSparse(const DenseMatrix& dense, SparseMatrix& sparse)
+{
+    const bool csr = sparse.GetFormat() == matrixFormatSparseCSR;
+    for (size_t i = 0; i < (csr ? dense.GetNumRows() : dense.GetNumCols()); i++)
+        for (size_t j = 0; j < (csr ? dense.GetNumCols() : dense.GetNumRows()); j++)
+        {
+            const size_t row = csr ? i : j;
+            const size_t col = csr ? j : i;
+            if (dense(row, col) != 0)
+                sparse.SetValue(row, col, dense(row, col));
+        }
+}
+
+// all transpositions of dense x sparse and sparse x dense, with CSC and CSR sparse operands, against the dense product
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixMultiplyAndWeightedAdd, RandomSeedFixture)
+{
+    const size_t m = 67, k = 45, n = 23;
+    for (auto format : {matrixFormatSparseCSC, matrixFormatSparseCSR})
+    {
+        for (int transposeA = 0; transposeA < 2; transposeA++)
+        {
+            for (int transposeB = 0; transposeB < 2; transposeB++)
+            {
+                // dense x sparse
+                DenseMatrix a = DenseMatrix::RandomGaussian(transposeA ? k : m, transposeA ? m : k, 1, 4, IncrementCounter());
+                DenseMatrix b = DenseMatrix::RandomUniform(transposeB ? n : k, transposeB ? k : n, -1, 1, IncrementCounter());
+                b.InplaceTruncateBottom(0); // (about half are zero)
+                b(b.GetNumRows() - 1, b.GetNumCols() - 1) = 1; // (a non-zero in the last row and column)
+                SparseMatrix bSparse(format, b.GetNumRows(), b.GetNumCols(), 0);
+                AssignSparse(b, bSparse);
+                DenseMatrix expected = DenseMatrix::RandomGaussian(m, n, 1, 2, IncrementCounter());
+                DenseMatrix actual(expected);
+                DenseMatrix::MultiplyAndWeightedAdd(0.3, a, transposeA != 0, b, transposeB != 0, 1.3, expected);
+                SparseMatrix::MultiplyAndWeightedAdd(0.3, a, transposeA != 0, bSparse, transposeB != 0, 1.3, actual);
+                BOOST_CHECK(actual.IsEqualTo(expected, c_epsilonFloatE4));
+
+                // sparse x dense
+                DenseMatrix c = DenseMatrix::RandomUniform(transposeA ? k : m, transposeA ? m : k, -1, 1, IncrementCounter());
+                c.InplaceTruncateBottom(0);
+                c(c.GetNumRows() - 1, c.GetNumCols() - 1) = 1;
+                SparseMatrix cSparse(format, c.GetNumRows(), c.GetNumCols(), 0);
+                AssignSparse(c, cSparse);
+                DenseMatrix d = DenseMatrix::RandomGaussian(transposeB ? n : k, transposeB ? k : n, 1, 4, IncrementCounter());
+                expected = DenseMatrix::RandomGaussian(m, n, 1, 2, IncrementCounter());
+                actual.SetValue(expected);
+                DenseMatrix::MultiplyAndWeightedAdd(0.3, c, transposeA != 0, d, transposeB != 0, 1.3, expected);
+                SparseMatrix::MultiplyAndWeightedAdd(0.3, cSparse, transposeA != 0, d, transposeB != 0, 1.3, actual);
+                BOOST_CHECK(actual.IsEqualTo(expected, c_epsilonFloatE4));
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
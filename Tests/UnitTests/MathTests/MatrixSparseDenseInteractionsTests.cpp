@@ -125,6 +125,54 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparse, RandomSeedFixture)
     BOOST_CHECK(mD.IsEqualTo(mC, c_epsilonFloatE4));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparseAllTransposes, RandomSeedFixture)
+{
+    const size_t m = 67, k = 45, n = 23;
+    for (int transposeA = 0; transposeA < 2; transposeA++)
+    {
+        for (int transposeB = 0; transposeB < 2; transposeB++)
+        {
+            Matrix<float> mBdense(CPUDEVICE);
+            mBdense.AssignTruncateBottomOf(Matrix<float>::RandomUniform(transposeB ? n : k, transposeB ? k : n, -3.0f, 0.1f, IncrementCounter(), CPUDEVICE), 0);
+            Matrix<float> mBsparse(mBdense);
+            mBsparse.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseCSC, true);
+
+            Matrix<float> mA = Matrix<float>::RandomGaussian(transposeA ? k : m, transposeA ? m : k, 1, 4, IncrementCounter(), CPUDEVICE);
+            Matrix<float> mC = Matrix<float>::RandomGaussian(m, n, 1, 2, IncrementCounter(), CPUDEVICE);
+            Matrix<float> mD(mC);
+
+            Matrix<float>::MultiplyAndWeightedAdd(0.3f, mA, transposeA != 0, mBdense, transposeB != 0, 1.3f, mC);
+            Matrix<float>::MultiplyAndWeightedAdd(0.3f, mA, transposeA != 0, mBsparse, transposeB != 0, 1.3f, mD);
+
+            BOOST_CHECK(mD.IsEqualTo(mC, c_epsilonFloatE4));
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixSparseTimesDenseAllTransposes, RandomSeedFixture)
+{
+    const size_t m = 67, k = 45, n = 23;
+    for (int transposeA = 0; transposeA < 2; transposeA++)
+    {
+        for (int transposeB = 0; transposeB < 2; transposeB++)
+        {
+            Matrix<float> mAdense(CPUDEVICE);
+            mAdense.AssignTruncateBottomOf(Matrix<float>::RandomUniform(transposeA ? k : m, transposeA ? m : k, -3.0f, 0.1f, IncrementCounter(), CPUDEVICE), 0);
+            Matrix<float> mAsparse(mAdense);
+            mAsparse.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseCSC, true);
+
+            Matrix<float> mB = Matrix<float>::RandomGaussian(transposeB ? n : k, transposeB ? k : n, 1, 4, IncrementCounter(), CPUDEVICE);
+            Matrix<float> mC = Matrix<float>::RandomGaussian(m, n, 1, 2, IncrementCounter(), CPUDEVICE);
+            Matrix<float> mD(mC);
+
+            Matrix<float>::MultiplyAndWeightedAdd(0.3f, mAdense, transposeA != 0, mB, transposeB != 0, 1.3f, mC);
+            Matrix<float>::MultiplyAndWeightedAdd(0.3f, mAsparse, transposeA != 0, mB, transposeB != 0, 1.3f, mD);
+
+            BOOST_CHECK(mD.IsEqualTo(mC, c_epsilonFloatE4));
+        }
+    }
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUMatrixDenseTimesSparseAsSparse, RandomSeedFixture)
 {
 #if 0
@@ -1101,6 +1101,115 @@ BOOST_FIXTURE_TEST_CASE(MatrixAssignNumOfDiff, RandomSeedFixture)
         BOOST_CHECK_EQUAL(expectedDiff, actual.Get00Element());
     }
 }
+// the reference for MultiTensorLearnerUpdate(): the per-matrix sequence, as SGD::UpdateWeightsS() does it
+static void LearnerUpdateReference(DoubleMatrix& value, DoubleMatrix& gradient, DoubleMatrix& smoothed, const LearnerUpdateParams& params, double clipFactor)
+{
+    if (params.clippingThreshold != std::numeric_limits<double>::infinity())
+    {
+        if (params.clipWithTruncation)
+            gradient.InplaceTruncate(params.clippingThreshold);
+        else
+            gradient *= clipFactor;
+    }
+    if (params.L2RegWeight > 0)
+        DoubleMatrix::ScaleAndAdd(params.L2RegWeight * params.mbSize, value, gradient);
+    if (params.type == LearnerUpdateType::Momentum)
+        smoothed.NormalGrad(gradient, value, params.learnRatePerSample, params.momentum, params.useNesterovMomentum);
+    else
+    {
+        double aveMultiplier = params.type == LearnerUpdateType::AdaGrad
+                                   ? smoothed.Adagrad(gradient, params.needAveMultiplier)
+                                   : smoothed.RmsProp(gradient, params.rmsGamma, params.rmsWgtInc, params.rmsWgtMax, params.rmsWgtDec, params.rmsWgtMin, params.needAveMultiplier);
+        DoubleMatrix::ScaleAndAdd(-params.learnRatePerSample / aveMultiplier, gradient, value);
+    }
+    if (params.L1RegWeight > 0)
+        value.InplaceSoftThreshold(params.learnRatePerSample * params.L1RegWeight * params.mbSize);
+}
+
+BOOST_FIXTURE_TEST_CASE(MatrixMultiTensorLearnerUpdate, RandomSeedFixture)
+{
+    // parameters of different sizes, the largest spanning several blocks
+    const std::vector<std::pair<size_t, size_t>> shapes = {{1, 1}, {7, 3}, {200, 150}, {33, 1}};
+    for (auto type : {LearnerUpdateType::Momentum, LearnerUpdateType::AdaGrad, LearnerUpdateType::RmsProp})
+    {
+        for (int variant = 0; variant < 3; variant++)
+        {
+            LearnerUpdateParams params;
+            params.type = type;
+            params.learnRatePerSample = 0.01;
+            params.momentum = 0.9;
+            params.mbSize = 16;
+            params.needAveMultiplier = variant != 1;
+            params.useNesterovMomentum = variant == 1;
+            params.L2RegWeight = variant == 2 ? 0.001 : 0;
+            params.L1RegWeight = variant == 2 ? 0.0001 : 0;
+            params.clippingThreshold = variant == 0 ? 0.5 : variant == 2 ? 4.0 : std::numeric_limits<double>::infinity();
+            params.clipWithTruncation = variant == 0;
+
+            std::vector<DoubleMatrix> values, gradients, smoothed;
+            std::vector<DoubleMatrix> refValues, refGradients, refSmoothed;
+            for (size_t i = 0; i < shapes.size(); i++)
+            {
+                values.push_back(DoubleMatrix::RandomUniform(shapes[i].first, shapes[i].second, -1, 1, 1 + i, CPUDEVICE));
+                gradients.push_back(DoubleMatrix::RandomUniform(shapes[i].first, shapes[i].second, -1, 1, 100 + i, CPUDEVICE));
+                smoothed.push_back(DoubleMatrix::Zeros(shapes[i].first, shapes[i].second * params.NumStateColumnsPerColumn(), CPUDEVICE));
+                refValues.push_back(DoubleMatrix(values[i], CPUDEVICE));
+                refGradients.push_back(DoubleMatrix(gradients[i], CPUDEVICE));
+                refSmoothed.push_back(DoubleMatrix(smoothed[i], CPUDEVICE));
+            }
+            // RmsProp initializes its state from the first gradient, so compare the second update
+            if (type == LearnerUpdateType::RmsProp)
+            {
+                for (size_t i = 0; i < shapes.size(); i++)
+                {
+                    smoothed[i].Resize(0, 0);
+                    smoothed[i].RmsProp(gradients[i], params.rmsGamma, params.rmsWgtInc, params.rmsWgtMax, params.rmsWgtDec, params.rmsWgtMin, false);
+                    refSmoothed[i].SetValue(smoothed[i]);
+                    gradients[i].SetValue(DoubleMatrix::RandomUniform(shapes[i].first, shapes[i].second, -1, 1, 200 + i, CPUDEVICE));
+                    refGradients[i].SetValue(gradients[i]);
+                }
+            }
+
+            std::vector<DoubleMatrix*> pValues, pGradients, pSmoothed;
+            for (size_t i = 0; i < shapes.size(); i++)
+            {
+                pValues.push_back(&values[i]);
+                pGradients.push_back(&gradients[i]);
+                pSmoothed.push_back(&smoothed[i]);
+            }
+            BOOST_CHECK(DoubleMatrix::MultiTensorLearnerUpdate(pValues, pGradients, pSmoothed, params));
+
+            for (size_t i = 0; i < shapes.size(); i++)
+            {
+                double norm = refGradients[i].FrobeniusNorm();
+                double clipFactor = norm > params.clippingThreshold ? params.clippingThreshold / norm : 1.0;
+                LearnerUpdateReference(refValues[i], refGradients[i], refSmoothed[i], params, clipFactor);
+                BOOST_CHECK(values[i].IsEqualTo(refValues[i], c_epsilonFloatE5));
+                BOOST_CHECK(smoothed[i].IsEqualTo(refSmoothed[i], c_epsilonFloatE5));
+            }
+        }
+    }
+
+    // global-norm clipping scales all gradients by the same factor
+    LearnerUpdateParams params;
+    params.learnRatePerSample = 1;
+    params.clippingThreshold = 1;
+    params.clipWithTruncation = false;
+    params.clipByGlobalNorm = true;
+    DoubleMatrix v1 = DoubleMatrix::Zeros(1, 1, CPUDEVICE), v2 = DoubleMatrix::Zeros(1, 1, CPUDEVICE);
+    DoubleMatrix g1(1, 1, CPUDEVICE), g2(1, 1, CPUDEVICE);
+    g1.SetValue(3);
+    g2.SetValue(4);
+    DoubleMatrix s1 = DoubleMatrix::Zeros(1, 1, CPUDEVICE), s2 = DoubleMatrix::Zeros(1, 1, CPUDEVICE);
+    BOOST_CHECK(DoubleMatrix::MultiTensorLearnerUpdate({&v1, &v2}, {&g1, &g2}, {&s1, &s2}, params));
+    BOOST_CHECK_CLOSE(v1.Get00Element(), -0.6, 1e-8);
+    BOOST_CHECK_CLOSE(v2.Get00Element(), -0.8, 1e-8);
+
+    // not applicable: state of the learner not initialized yet
+    params.type = LearnerUpdateType::RmsProp;
+    BOOST_CHECK(!DoubleMatrix::MultiTensorLearnerUpdate({&v1, &v2}, {&g1, &g2}, {&s1, &s2}, params));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
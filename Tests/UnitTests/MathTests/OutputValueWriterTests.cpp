@@ -0,0 +1,173 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "../../../Source/Math/Matrix.h"
+#include "../../../Source/SGDLib/OutputValueWriter.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+const size_t c_numRows = 7;
+const size_t c_numMinibatches = 4;
+
+// minibatches of c_numRows rows and 3, 4, 5, ... columns, with values of very different magnitudes
+template <class ElemType>
+static std::vector<std::vector<ElemType>> MakeMinibatches()
+{
+    std::vector<std::vector<ElemType>> minibatches;
+    for (size_t m = 0; m < c_numMinibatches; m++)
+    {
+        std::vector<ElemType> values(c_numRows * (3 + m));
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = (ElemType)((i % 2 ? -1.0 : 1.0) * (i + 1) / 3.0 * pow(10.0, (int) (i % 13) - 6));
+        minibatches.push_back(values);
+    }
+    return minibatches;
+}
+
+template <class ElemType>
+static void WriteMinibatches(const std::wstring& path, OutputValueFormat format, bool roundTrip, const std::vector<std::vector<ElemType>>& minibatches)
+{
+    OutputValueWriter<ElemType> writer(path, format, roundTrip);
+    for (auto values : minibatches)
+        writer.Write(Matrix<ElemType>(c_numRows, values.size() / c_numRows, values.data(), matrixFlagNormal, CPUDEVICE));
+    writer.Close();
+}
+
+static std::string ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+static float BigEndianFloat(const std::string& s, size_t pos)
+{
+    char bytes[sizeof(float)];
+    for (size_t i = 0; i < sizeof(float); i++)
+        bytes[i] = s[pos + sizeof(float) - 1 - i];
+    float value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static int BigEndianInt(const std::string& s, size_t pos, size_t size)
+{
+    int value = 0;
+    for (size_t i = 0; i < size; i++)
+        value = (value << 8) | (unsigned char) s[pos + i];
+    return value;
+}
+
+BOOST_AUTO_TEST_SUITE(OutputValueWriterSuite)
+
+// the default text output is the same as that of an ostream: 6 significant digits and a blank after each value
+BOOST_AUTO_TEST_CASE(OutputValueWriterText)
+{
+    auto minibatches = MakeMinibatches<float>();
+    WriteMinibatches(L"OutputValues.txt", OutputValueFormat::text, false, minibatches);
+
+    std::ostringstream expected;
+    for (const auto& values : minibatches)
+    {
+        for (size_t j = 0; j < values.size() / c_numRows; j++)
+        {
+            for (size_t i = 0; i < c_numRows; i++)
+                expected << values[j * c_numRows + i] << " ";
+            expected << "\n";
+        }
+    }
+    BOOST_CHECK(ReadFile("OutputValues.txt") == expected.str());
+}
+
+template <class ElemType>
+static void TestTextRoundTrip()
+{
+    auto minibatches = MakeMinibatches<ElemType>();
+    WriteMinibatches(L"OutputValues.roundTrip.txt", OutputValueFormat::text, true, minibatches);
+
+    std::istringstream text(ReadFile("OutputValues.roundTrip.txt"));
+    for (const auto& values : minibatches)
+    {
+        for (auto value : values)
+        {
+            std::string token;
+            BOOST_REQUIRE(text >> token);
+            BOOST_CHECK_EQUAL((ElemType) strtod(token.c_str(), nullptr), value);
+        }
+    }
+    std::string token;
+    BOOST_CHECK(!(text >> token));
+}
+
+// with 'roundTrip', every value reads back identically
+BOOST_AUTO_TEST_CASE(OutputValueWriterTextRoundTrip)
+{
+    TestTextRoundTrip<float>();
+    TestTextRoundTrip<double>();
+}
+
+// raw float32, column after column, and an index with the number of rows and 'firstColumn numColumns' per minibatch
+BOOST_AUTO_TEST_CASE(OutputValueWriterBinary)
+{
+    auto minibatches = MakeMinibatches<double>();
+    WriteMinibatches(L"OutputValues.bin", OutputValueFormat::binary, false, minibatches);
+
+    std::string data = ReadFile("OutputValues.bin");
+    std::ostringstream expectedIndex;
+    expectedIndex << c_numRows << "\n";
+    size_t pos = 0, numColumns = 0;
+    for (const auto& values : minibatches)
+    {
+        expectedIndex << numColumns << " " << values.size() / c_numRows << "\n";
+        numColumns += values.size() / c_numRows;
+        for (auto value : values)
+        {
+            BOOST_REQUIRE(pos + sizeof(float) <= data.size());
+            float read;
+            memcpy(&read, &data[pos], sizeof(read));
+            BOOST_CHECK_EQUAL(read, (float) value);
+            pos += sizeof(float);
+        }
+    }
+    BOOST_CHECK_EQUAL(pos, data.size());
+    BOOST_CHECK(ReadFile("OutputValues.bin.idx") == expectedIndex.str());
+}
+
+// a single HTK feature file: big-endian header (nSamples, sampPeriod, sampSize, parmKind USER) and frames
+BOOST_AUTO_TEST_CASE(OutputValueWriterHTK)
+{
+    auto minibatches = MakeMinibatches<float>();
+    WriteMinibatches(L"OutputValues.htk", OutputValueFormat::htk, false, minibatches);
+
+    std::string data = ReadFile("OutputValues.htk");
+    size_t numValues = 0;
+    for (const auto& values : minibatches)
+        numValues += values.size();
+    BOOST_REQUIRE_EQUAL(data.size(), 12 + numValues * sizeof(float));
+    BOOST_CHECK_EQUAL(BigEndianInt(data, 0, 4), (int) (numValues / c_numRows));
+    BOOST_CHECK_EQUAL(BigEndianInt(data, 4, 4), 100000);
+    BOOST_CHECK_EQUAL(BigEndianInt(data, 8, 2), (int) (c_numRows * sizeof(float)));
+    BOOST_CHECK_EQUAL(BigEndianInt(data, 10, 2), 9);
+
+    size_t pos = 12;
+    for (const auto& values : minibatches)
+    {
+        for (auto value : values)
+        {
+            BOOST_CHECK_EQUAL(BigEndianFloat(data, pos), value);
+            pos += sizeof(float);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,234 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "Basics.h"
+#include "DataReader.h"
+#include "ComputationNetwork.h"
+#include "ComputationNetworkBuilder.h"
+#include "PreComputeNodes.h"
+#include "DataReaderHelpers.h"
+#include <random>
+#include <vector>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+const size_t c_featDim = 20;
+const size_t c_hiddenDim = 32;
+const size_t c_labelDim = 5;
+
+// BuildTestNetwork - a small classifier: 'features' -> sigmoid hidden layers -> softmax over 'labels'
+// The training criterion is 'ce' (cross entropy), the evaluation node 'err' (error rate). 'seed' initializes the parameters.
+// With 'normalizeFeatures', the features are normalized by their precomputed mean and standard deviation.
+// Hidden layer i is 'H<i>' = Sigmoid('W<i-1>' * input + 'B<i-1>'); the output layer is 'W<n>' * 'H<n>' + 'B<n>'.
+template <class ElemType>
+ComputationNetworkPtr BuildTestNetwork(unsigned long seed, bool normalizeFeatures = false, size_t numHiddenLayers = 1)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<ElemType> builder(*net);
+
+    auto features = builder.CreateInputNode(L"features", c_featDim);
+    net->FeatureNodes().push_back(features);
+    auto labels = builder.CreateInputNode(L"labels", c_labelDim);
+    net->LabelNodes().push_back(labels);
+    auto input = features;
+    if (normalizeFeatures)
+        input = builder.PerDimMeanVarNormalization(features, builder.Mean(features, L"featureMean"), builder.InvStdDev(features, L"featureInvStdDev"), L"normalizedFeatures");
+
+    wstring inputName = L"features";
+    for (size_t i = 0; i < numHiddenLayers; i++)
+    {
+        auto w = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"W%d", (int) i), c_hiddenDim, i == 0 ? c_featDim : c_hiddenDim);
+        net->InitLearnableParameters(w, true, seed + 2 * i, (ElemType) 1);
+        auto b = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"B%d", (int) i), c_hiddenDim, 1);
+        net->InitLearnableParameters(b, true, seed + 2 * i + 1, (ElemType) 1);
+        auto product = builder.Times(w, input, w->NodeName() + L"*" + inputName);
+        input = builder.Sigmoid(builder.Plus(product, b, product->NodeName() + L"+" + b->NodeName()), msra::strfun::wstrprintf(L"H%d", (int) i + 1));
+        inputName = input->NodeName();
+    }
+
+    auto w = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"W%d", (int) numHiddenLayers), c_labelDim, c_hiddenDim);
+    net->InitLearnableParameters(w, true, seed + 2 * numHiddenLayers, (ElemType) 1);
+    auto b = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"B%d", (int) numHiddenLayers), c_labelDim, 1);
+    net->InitLearnableParameters(b, true, seed + 2 * numHiddenLayers + 1, (ElemType) 1);
+    auto z = builder.Plus(builder.Times(w, input, w->NodeName() + L"*" + inputName), b, L"z");
+
+    net->FinalCriterionNodes().push_back(builder.CrossEntropyWithSoftmax(labels, z, L"ce"));
+    net->EvaluationNodes().push_back(builder.ErrorPrediction(labels, z, L"err"));
+
+    net->CompileNetwork();
+    return net;
+}
+
+// GetInputMatrices - the Value() matrices of the feature and label nodes, by node name, for a reader to fill in
+template <class ElemType>
+std::map<std::wstring, Matrix<ElemType>*> GetInputMatrices(const ComputationNetworkPtr& net)
+{
+    std::map<std::wstring, Matrix<ElemType>*> inputMatrices;
+    for (const auto& node : net->FeatureNodes())
+        inputMatrices[node->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+    for (const auto& node : net->LabelNodes())
+        inputMatrices[node->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+    return inputMatrices;
+}
+
+// AccumulateStatistics - accumulate the PreCompute nodes over subset 'subsetNum' of 'numSubsets' of the data of 'reader',
+// as SGD::PreCompute() does; returns the nodes, which are left accumulating
+template <class ElemType>
+std::list<ComputationNodeBasePtr> AccumulateStatistics(const ComputationNetworkPtr& net, IDataReader<ElemType>& reader, size_t mbSize, size_t subsetNum = 0, size_t numSubsets = 1)
+{
+    std::list<ComputationNodeBasePtr> nodes = net->GetNodesRequiringPreComputation();
+    auto inputMatrices = GetInputMatrices<ElemType>(net);
+    reader.StartDistributedMinibatchLoop(mbSize, 0, subsetNum, numSubsets);
+    net->StartEvaluateMinibatchLoop(nodes);
+    for (const auto& node : nodes)
+        static_pointer_cast<PreComputedNodeBase<ElemType>>(node)->MarkComputed(false);
+    size_t actualMBSize;
+    while (DataReaderHelpers::GetMinibatchIntoNetwork(reader, net, nullptr, false, false, inputMatrices, actualMBSize))
+    {
+        ComputationNetwork::BumpEvalTimeStamp(net->FeatureNodes());
+        ComputationNetwork::BumpEvalTimeStamp(net->LabelNodes());
+        net->ForwardProp(nodes);
+    }
+    return nodes;
+}
+
+// PreComputeStatistics - compute the PreCompute nodes over all data of 'reader'
+template <class ElemType>
+void PreComputeStatistics(const ComputationNetworkPtr& net, IDataReader<ElemType>& reader, size_t mbSize)
+{
+    for (const auto& node : AccumulateStatistics(net, reader, mbSize))
+        static_pointer_cast<PreComputedNodeBase<ElemType>>(node)->MarkComputed(true);
+}
+
+// ComputeGradients - propagate the first minibatch of 'reader' forward to the training criterion and back, as SGD does;
+// returns the gradients of the LearnableParameters, by node name
+template <class ElemType>
+std::map<std::wstring, std::vector<ElemType>> ComputeGradients(const ComputationNetworkPtr& net, IDataReader<ElemType>& reader, size_t mbSize)
+{
+    const auto& criterion = net->FinalCriterionNodes()[0];
+    net->AllocateAllMatrices(net->EvaluationNodes(), {}, criterion);
+    net->StartEvaluateMinibatchLoop(criterion);
+    auto inputMatrices = GetInputMatrices<ElemType>(net);
+    reader.StartMinibatchLoop(mbSize, 0);
+    size_t actualMBSize;
+    if (!DataReaderHelpers::GetMinibatchIntoNetwork(reader, net, nullptr, false, false, inputMatrices, actualMBSize))
+        LogicError("ComputeGradients: The reader has no data.");
+    ComputationNetwork::BumpEvalTimeStamp(net->FeatureNodes());
+    ComputationNetwork::BumpEvalTimeStamp(net->LabelNodes());
+    net->ForwardProp(criterion);
+    net->Backprop(criterion);
+
+    std::map<std::wstring, std::vector<ElemType>> gradients;
+    for (const auto& node : net->LearnableParameterNodes(criterion))
+    {
+        const auto& gradient = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Gradient();
+        std::unique_ptr<ElemType[]> values(gradient.CopyToArray());
+        gradients[node->NodeName()].assign(values.get(), values.get() + gradient.GetNumElements());
+    }
+    return gradients;
+}
+
+// MemoryDataReader - serves random 'features' and one-hot 'labels' from memory, in frame mode
+// The data is determined by 'seed', so two readers with the same seed serve the same minibatches.
+// With distributed reading, each subset gets every numSubsets-th sample of a minibatch.
+template <class ElemType>
+class MemoryDataReader : public IDataReader<ElemType>
+{
+public:
+    MemoryDataReader(size_t numSamples, unsigned long seed)
+        : m_numSamples(numSamples), m_features(c_featDim * numSamples), m_labels(c_labelDim * numSamples, 0), m_pMBLayout(make_shared<MBLayout>())
+    {
+        std::mt19937 rng(seed);
+        std::normal_distribution<double> value(0, 1);
+        for (auto& feature : m_features)
+            feature = (ElemType) value(rng);
+        for (size_t t = 0; t < numSamples; t++)
+            m_labels[t * c_labelDim + rng() % c_labelDim] = 1;
+    }
+
+    virtual void Init(const ConfigParameters&) override
+    {
+    }
+    virtual void Init(const ScriptableObjects::IConfigRecord&) override
+    {
+    }
+    virtual void Destroy() override
+    {
+    }
+
+    virtual void StartMinibatchLoop(size_t mbSize, size_t /*epoch*/, size_t requestedEpochSamples = requestDataSize) override
+    {
+        m_mbSize = mbSize;
+        m_epochSize = min(requestedEpochSamples, m_numSamples);
+        m_nextSample = 0;
+        m_subsetNum = 0;
+        m_numSubsets = 1;
+    }
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return true;
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t epoch, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override
+    {
+        StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+        m_subsetNum = subsetNum;
+        m_numSubsets = numSubsets;
+    }
+
+    virtual bool GetMinibatch(std::map<std::wstring, Matrix<ElemType>*>& matrices) override
+    {
+        if (m_nextSample >= m_epochSize)
+            return false;
+        const size_t endSample = m_nextSample + min(m_mbSize, m_epochSize - m_nextSample);
+        std::vector<ElemType> featureValues, labelValues;
+        for (size_t t = m_nextSample; t < endSample; t++)
+        {
+            if (t % m_numSubsets != m_subsetNum)
+                continue;
+            featureValues.insert(featureValues.end(), m_features.begin() + t * c_featDim, m_features.begin() + (t + 1) * c_featDim);
+            labelValues.insert(labelValues.end(), m_labels.begin() + t * c_labelDim, m_labels.begin() + (t + 1) * c_labelDim);
+        }
+        const size_t numSamples = labelValues.size() / c_labelDim;
+        auto features = matrices.find(L"features");
+        if (features != matrices.end())
+            features->second->SetValue(c_featDim, numSamples, features->second->GetDeviceId(), featureValues.data());
+        auto labels = matrices.find(L"labels");
+        if (labels != matrices.end())
+            labels->second->SetValue(c_labelDim, numSamples, labels->second->GetDeviceId(), labelValues.data());
+        m_pMBLayout->InitAsFrameMode(numSamples);
+        m_nextSample = endSample;
+        return true;
+    }
+
+    virtual size_t GetNumParallelSequences() override
+    {
+        return m_pMBLayout->GetNumParallelSequences();
+    }
+    virtual void CopyMBLayoutTo(MBLayoutPtr pMBLayout) override
+    {
+        pMBLayout->CopyFrom(m_pMBLayout);
+    }
+    virtual bool DataEnd(EndDataType endDataType) override
+    {
+        if (endDataType == endDataSentence) // in frame mode, each minibatch is considered a "sentence"
+            return true;
+        return m_nextSample >= m_epochSize;
+    }
+
+private:
+    size_t m_numSamples;
+    std::vector<ElemType> m_features;
+    std::vector<ElemType> m_labels;
+    MBLayoutPtr m_pMBLayout;
+    size_t m_mbSize;
+    size_t m_epochSize;
+    size_t m_nextSample;
+    size_t m_subsetNum;
+    size_t m_numSubsets;
+};
+} } } }
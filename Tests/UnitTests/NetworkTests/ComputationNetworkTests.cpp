@@ -0,0 +1,326 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "SimpleEvaluator.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// change all persistable state, as a trial pass of training would: the parameters, and the precomputed statistics,
+// which are left in the middle of an accumulation
+template <class ElemType>
+static void ChangePersistableState(const ComputationNetworkPtr& net)
+{
+    for (const auto& node : net->GetAllNodes())
+    {
+        if (node->OperationName() == OperationNameOf(LearnableParameter))
+            dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().SetValue((ElemType) 0.5);
+        else if (node->RequiresPreCompute())
+        {
+            static_pointer_cast<PreComputedNodeBase<ElemType>>(node)->MarkComputed(false);
+            dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().SetValue((ElemType) 0.5);
+        }
+    }
+}
+
+// memory sharing, and optionally activation recomputation, for the networks allocated during the lifetime of this object
+struct MemorySharingScope
+{
+    MemorySharingScope(bool recomputeActivations)
+    {
+        g_shareNodeValueMatrices = true;
+        ComputationNetwork::SetActivationRecomputation(recomputeActivations, 0);
+    }
+    ~MemorySharingScope()
+    {
+        ComputationNetwork::SetActivationRecomputation(false, 0);
+        g_shareNodeValueMatrices = false;
+    }
+};
+
+// parallel node execution on 'numThreads' threads during the lifetime of this object
+struct ParallelNodeExecutionScope
+{
+    ParallelNodeExecutionScope(size_t numThreads)
+    {
+        ComputationNetwork::SetNumParallelNodeExecutionThreads(numThreads);
+    }
+    ~ParallelNodeExecutionScope()
+    {
+        ComputationNetwork::SetNumParallelNodeExecutionThreads(0);
+    }
+};
+
+// whether task 'to' of 'graph' cannot start before task 'from' has completed
+static bool IsReachable(const TaskGraph& graph, size_t from, size_t to)
+{
+    std::vector<bool> visited(graph.size(), false);
+    std::vector<size_t> stack(1, from);
+    while (!stack.empty())
+    {
+        size_t task = stack.back();
+        stack.pop_back();
+        for (size_t succ : graph.Successors(task))
+        {
+            if (succ == to)
+                return true;
+            if (!visited[succ])
+            {
+                visited[succ] = true;
+                stack.push_back(succ);
+            }
+        }
+    }
+    return false;
+}
+
+// a classifier with two output layers on hidden layer 'H1', trained on the sum 'ce' of their cross entropies 'ce1' and 'ce2'
+// (with memory sharing, 'ce' could run in place of 'ce1', were it not a root)
+template <class ElemType>
+static ComputationNetworkPtr BuildTwoCriteriaNetwork(unsigned long seed)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<ElemType> builder(*net);
+
+    auto features = builder.CreateInputNode(L"features", c_featDim);
+    net->FeatureNodes().push_back(features);
+    auto labels = builder.CreateInputNode(L"labels", c_labelDim);
+    net->LabelNodes().push_back(labels);
+
+    auto w0 = builder.CreateLearnableParameter(L"W0", c_hiddenDim, c_featDim);
+    net->InitLearnableParameters(w0, true, seed, (ElemType) 1);
+    auto b0 = builder.CreateLearnableParameter(L"B0", c_hiddenDim, 1);
+    net->InitLearnableParameters(b0, true, seed + 1, (ElemType) 1);
+    auto h1 = builder.Sigmoid(builder.Plus(builder.Times(w0, features, L"W0*features"), b0, L"W0*features+B0"), L"H1");
+
+    shared_ptr<ComputationNode<ElemType>> criteria[2];
+    for (int i = 0; i < 2; i++)
+    {
+        auto w = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"W%d", i + 1), c_labelDim, c_hiddenDim);
+        net->InitLearnableParameters(w, true, seed + 2 * i + 2, (ElemType) 1);
+        auto b = builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"B%d", i + 1), c_labelDim, 1);
+        net->InitLearnableParameters(b, true, seed + 2 * i + 3, (ElemType) 1);
+        auto z = builder.Plus(builder.Times(w, h1, w->NodeName() + L"*H1"), b, msra::strfun::wstrprintf(L"z%d", i + 1));
+        criteria[i] = builder.CrossEntropyWithSoftmax(labels, z, msra::strfun::wstrprintf(L"ce%d", i + 1));
+    }
+    net->FinalCriterionNodes().push_back(builder.Plus(criteria[0], criteria[1], L"ce"));
+
+    net->CompileNetwork();
+    return net;
+}
+
+BOOST_AUTO_TEST_SUITE(ComputationNetworkSuite)
+
+// restoring the state kept in memory has the same effect as rereading the model file saved at the same time
+BOOST_AUTO_TEST_CASE(RestorePersistableState)
+{
+    const size_t numSamples = 1000;
+    const size_t mbSize = 64;
+
+    auto savedNet = BuildTestNetwork<float>(1, /*normalizeFeatures=*/true);
+    MemoryDataReader<float> reader(numSamples, 1);
+    PreComputeStatistics(savedNet, reader, mbSize);
+    savedNet->Save(L"PersistableState.dnn");
+    std::vector<double> expected = SimpleEvaluator<float>(savedNet).Evaluate(&reader, {}, mbSize);
+
+    // go back by rereading the model file
+    auto rereadNet = BuildTestNetwork<float>(2, /*normalizeFeatures=*/true);
+    ChangePersistableState<float>(rereadNet);
+    rereadNet->RereadPersistableParameters<float>(L"PersistableState.dnn");
+    std::vector<double> reread = SimpleEvaluator<float>(rereadNet).Evaluate(&reader, {}, mbSize);
+
+    // go back to the state kept in memory
+    auto restoredNet = BuildTestNetwork<float>(1, /*normalizeFeatures=*/true);
+    PreComputeStatistics(restoredNet, reader, mbSize);
+    ComputationNetwork::PersistableState state;
+    restoredNet->SavePersistableState<float>(state);
+    ChangePersistableState<float>(restoredNet);
+    restoredNet->RestorePersistableState<float>(state);
+    std::vector<double> restored = SimpleEvaluator<float>(restoredNet).Evaluate(&reader, {}, mbSize);
+
+    BOOST_REQUIRE_EQUAL(reread.size(), expected.size());
+    BOOST_REQUIRE_EQUAL(restored.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(reread[i], expected[i]);
+        BOOST_CHECK_EQUAL(restored[i], expected[i]);
+    }
+    for (const auto& node : restoredNet->GetAllNodes())
+    {
+        if (node->RequiresPreCompute())
+            BOOST_CHECK(static_pointer_cast<PreComputedNodeBase<float>>(node)->HasComputed());
+    }
+
+    // (the change is undone, not a no-op)
+    auto changedNet = BuildTestNetwork<float>(1, /*normalizeFeatures=*/true);
+    PreComputeStatistics(changedNet, reader, mbSize);
+    ChangePersistableState<float>(changedNet);
+    BOOST_CHECK(SimpleEvaluator<float>(changedNet).Evaluate(&reader, {}, mbSize) != expected);
+}
+
+// recomputing the values during backprop that were released after ForwardProp() gives the same gradients as keeping them,
+// in less memory if the network is deep enough (the values being recomputed take memory, too)
+BOOST_AUTO_TEST_CASE(RecomputeActivations)
+{
+    const size_t numHiddenLayers = 36;
+    const size_t mbSize = 64;
+
+    auto net = BuildTestNetwork<float>(1, /*normalizeFeatures=*/false, numHiddenLayers);
+    MemoryDataReader<float> reader(mbSize, 1);
+    std::map<std::wstring, std::vector<float>> expected;
+    {
+        MemorySharingScope scope(/*recomputeActivations=*/false);
+        expected = ComputeGradients(net, reader, mbSize);
+    }
+    BOOST_CHECK(!net->RecomputesActivations());
+
+    auto recomputingNet = BuildTestNetwork<float>(1, /*normalizeFeatures=*/false, numHiddenLayers);
+    std::map<std::wstring, std::vector<float>> gradients;
+    {
+        MemorySharingScope scope(/*recomputeActivations=*/true);
+        gradients = ComputeGradients(recomputingNet, reader, mbSize);
+    }
+    BOOST_REQUIRE(recomputingNet->RecomputesActivations());
+
+    BOOST_REQUIRE_EQUAL(gradients.size(), 2 * (numHiddenLayers + 1));
+    BOOST_REQUIRE(gradients.size() == expected.size());
+    for (const auto& iter : expected)
+    {
+        BOOST_REQUIRE_EQUAL(gradients[iter.first].size(), iter.second.size());
+        for (size_t i = 0; i < iter.second.size(); i++)
+            BOOST_CHECK_EQUAL(gradients[iter.first][i], iter.second[i]);
+    }
+    BOOST_TEST_MESSAGE("Matrix pool: " << net->GetNumMatrixPoolBytes() << " bytes without recomputation, " << recomputingNet->GetNumMatrixPoolBytes() << " with it");
+    BOOST_CHECK_LT(recomputingNet->GetNumMatrixPoolBytes(), net->GetNumMatrixPoolBytes());
+}
+
+// nodes running in place of their inputs (with memory sharing) give the same values and gradients as without;
+// a root, here the sum of two criteria, does not run in place, lest its seeded gradient be zeroed as its input's
+BOOST_AUTO_TEST_CASE(RunInPlace)
+{
+    const size_t mbSize = 64;
+
+    auto net = BuildTwoCriteriaNetwork<float>(1);
+    MemoryDataReader<float> reader(mbSize, 1);
+    auto expected = ComputeGradients(net, reader, mbSize);
+    BOOST_CHECK(!net->GetNodeFromName(L"W0*features+B0")->RunsInPlace());
+
+    auto inPlaceNet = BuildTwoCriteriaNetwork<float>(1);
+    std::map<std::wstring, std::vector<float>> gradients;
+    {
+        MemorySharingScope scope(/*recomputeActivations=*/false);
+        gradients = ComputeGradients(inPlaceNet, reader, mbSize);
+    }
+    BOOST_CHECK(inPlaceNet->GetNodeFromName(L"W0*features+B0")->RunsInPlace());
+    BOOST_CHECK(!inPlaceNet->GetNodeFromName(L"ce")->RunsInPlace());
+
+    auto criterion = dynamic_pointer_cast<ComputationNode<float>>(net->GetNodeFromName(L"ce"));
+    auto inPlaceCriterion = dynamic_pointer_cast<ComputationNode<float>>(inPlaceNet->GetNodeFromName(L"ce"));
+    BOOST_CHECK_EQUAL(inPlaceCriterion->Value().Get00Element(), criterion->Value().Get00Element());
+    BOOST_CHECK_EQUAL(inPlaceCriterion->Gradient().Get00Element(), 1.0f);
+
+    BOOST_REQUIRE_EQUAL(gradients.size(), 6);
+    BOOST_REQUIRE(gradients.size() == expected.size());
+    for (const auto& iter : expected)
+    {
+        BOOST_REQUIRE_EQUAL(gradients[iter.first].size(), iter.second.size());
+        bool anyNonZero = false;
+        for (size_t i = 0; i < iter.second.size(); i++)
+        {
+            BOOST_CHECK_EQUAL(gradients[iter.first][i], iter.second[i]);
+            anyNonZero |= iter.second[i] != 0;
+        }
+        BOOST_CHECK(anyNonZero);
+    }
+}
+
+// running the nodes that do not depend on each other concurrently gives the same criterion and gradients as serial
+// execution, with and without memory sharing, also when repeated
+BOOST_AUTO_TEST_CASE(ParallelNodeExecution)
+{
+    const size_t mbSize = 64;
+
+    for (bool shareMemory : {false, true})
+    {
+        std::unique_ptr<MemorySharingScope> sharingScope(shareMemory ? new MemorySharingScope(/*recomputeActivations=*/false) : nullptr);
+        MemoryDataReader<float> reader(mbSize, 1);
+        auto net = BuildTwoCriteriaNetwork<float>(1);
+        auto expected = ComputeGradients(net, reader, mbSize);
+        const float expectedCriterion = dynamic_pointer_cast<ComputationNode<float>>(net->GetNodeFromName(L"ce"))->Value().Get00Element();
+
+        ParallelNodeExecutionScope parallelScope(4);
+        BOOST_REQUIRE(ComputationNetwork::IsParallelNodeExecutionEnabled());
+        auto parallelNet = BuildTwoCriteriaNetwork<float>(1);
+        for (size_t run = 0; run < 3; run++)
+        {
+            auto gradients = ComputeGradients(parallelNet, reader, mbSize);
+            const auto& criterion = parallelNet->FinalCriterionNodes()[0];
+            BOOST_REQUIRE_GT(parallelNet->GetParallelTaskGraph(criterion, /*backprop=*/false).size(), 0); // (really ran in parallel)
+            BOOST_REQUIRE_GT(parallelNet->GetParallelTaskGraph(criterion, /*backprop=*/true).size(), 0);
+            BOOST_CHECK_EQUAL(dynamic_pointer_cast<ComputationNode<float>>(criterion)->Value().Get00Element(), expectedCriterion);
+
+            BOOST_REQUIRE_EQUAL(gradients.size(), 6);
+            BOOST_REQUIRE(gradients.size() == expected.size());
+            for (const auto& iter : expected)
+            {
+                BOOST_REQUIRE_EQUAL(gradients[iter.first].size(), iter.second.size());
+                for (size_t i = 0; i < iter.second.size(); i++)
+                    BOOST_CHECK_EQUAL(gradients[iter.first][i], iter.second[i]);
+            }
+        }
+    }
+}
+
+// the task graphs keep inputs before their consumers (reversed for backprop), and the nodes that share a matrix through the
+// pool in their serial order (reversed for backprop), even where no data flows between them
+BOOST_AUTO_TEST_CASE(ParallelNodeExecutionTaskGraphs)
+{
+    const size_t mbSize = 64;
+
+    MemorySharingScope sharingScope(/*recomputeActivations=*/false);
+    ParallelNodeExecutionScope parallelScope(4);
+    MemoryDataReader<float> reader(mbSize, 1);
+    auto net = BuildTwoCriteriaNetwork<float>(1);
+    ComputeGradients(net, reader, mbSize);
+
+    const auto& criterion = net->FinalCriterionNodes()[0];
+    const auto& forward = net->GetParallelTaskGraph(criterion, /*backprop=*/false);
+    const auto& backprop = net->GetParallelTaskGraph(criterion, /*backprop=*/true);
+    const auto& nodes = dynamic_pointer_cast<FlowControlNode>(net->GetNestedNetwork(criterion))->m_nestedNodes;
+    BOOST_REQUIRE_EQUAL(forward.size(), nodes.size());
+    BOOST_REQUIRE_EQUAL(backprop.size(), nodes.size());
+    std::map<const ComputationNodeBase*, size_t> taskOf;
+    for (size_t t = 0; t < nodes.size(); t++)
+        taskOf[nodes[t].get()] = t;
+
+    TaskGraph dataFlow(nodes.size());
+    for (size_t t = 0; t < nodes.size(); t++)
+    {
+        for (const auto& input : nodes[t]->GetInputs())
+        {
+            dataFlow.AddEdge(taskOf.at(input.get()), t);
+            BOOST_CHECK(IsReachable(forward, taskOf.at(input.get()), t));
+            BOOST_CHECK(IsReachable(backprop, t, taskOf.at(input.get())));
+        }
+    }
+
+    // (the two output layers do not depend on each other, yet reuse each other's matrices)
+    size_t numConflictsWithoutDataFlow = 0;
+    for (const auto& conflict : net->GetMatrixSharingConflicts())
+    {
+        size_t first = taskOf.at(conflict.first), second = taskOf.at(conflict.second);
+        if (first > second)
+            std::swap(first, second);
+        BOOST_CHECK(IsReachable(forward, first, second));
+        BOOST_CHECK(IsReachable(backprop, second, first));
+        if (!IsReachable(dataFlow, first, second))
+            numConflictsWithoutDataFlow++;
+    }
+    BOOST_CHECK_GT(numConflictsWithoutDataFlow, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
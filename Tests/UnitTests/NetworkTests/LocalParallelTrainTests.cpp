@@ -0,0 +1,195 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "LocalParallelTrain.h"
+#include "SGD.h"
+#include <thread>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// a worker state with just what LocalMinibatchDealer needs: a network to read into
+static LocalWorker<float> CreateReadingWorker()
+{
+    LocalWorker<float> worker;
+    worker.net = BuildTestNetwork<float>(1);
+    worker.criterionNodes = worker.net->FinalCriterionNodes();
+    worker.inputMatrices = GetInputMatrices<float>(worker.net);
+    return worker;
+}
+
+// the first feature value of each minibatch of an epoch, which tells the minibatches of a MemoryDataReader apart
+static std::vector<float> FirstFeatureOfMinibatches(IDataReader<float>& reader, size_t mbSize)
+{
+    Matrix<float> features(CPUDEVICE), labels(CPUDEVICE);
+    std::map<std::wstring, Matrix<float>*> matrices = {{L"features", &features}, {L"labels", &labels}};
+    std::vector<float> firsts;
+    reader.StartMinibatchLoop(mbSize, 0);
+    while (reader.GetMinibatch(matrices))
+        firsts.push_back(features.Get00Element());
+    return firsts;
+}
+
+// deal one epoch to 'numWorkers' threads; returns the first feature value of the minibatches each worker got, in order
+static std::vector<std::vector<float>> DealMinibatches(IDataReader<float>& reader, size_t mbSize, size_t numWorkers, bool ordered)
+{
+    std::vector<LocalWorker<float>> workers;
+    for (size_t w = 0; w < numWorkers; w++)
+        workers.push_back(CreateReadingWorker());
+    std::vector<std::vector<float>> firsts(numWorkers);
+
+    reader.StartMinibatchLoop(mbSize, 0);
+    LocalMinibatchDealer<float> dealer(reader, numWorkers, ordered);
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < numWorkers; w++)
+    {
+        threads.push_back(std::thread([&, w]()
+                                      {
+                                          size_t actualMBSize;
+                                          while (dealer.GetMinibatch(w, workers[w], actualMBSize))
+                                          {
+                                              firsts[w].push_back(workers[w].inputMatrices[L"features"]->Get00Element());
+                                              std::this_thread::sleep_for(std::chrono::microseconds(100 * (numWorkers - w))); // (the first worker is the slowest)
+                                          }
+                                      }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    return firsts;
+}
+
+// train BuildTestNetwork() for two epochs with FSAdaGrad on 'numWorkers' worker threads; returns the parameters of the resulting model
+static std::map<std::wstring, std::vector<float>> TrainWithLocalWorkers(const std::string& method, size_t numWorkers)
+{
+    const std::string modelPath = "LocalParallelTrain.dnn";
+    ConfigParameters config;
+    config.Parse("modelPath=" + modelPath + ";maxEpochs=2;minibatchSize=16;learningRatesPerSample=0.01;momentumPerMB=0.9;gradUpdateType=fsAdagrad;"
+                 "LocalParallelTrain=[numWorkers=" + std::to_string(numWorkers) + ";method=" + method + ";syncFrequencyInMinibatches=2]");
+    SGD<float> sgd(config);
+    MemoryDataReader<float> reader(600, 1);
+    sgd.Train([](DEVICEID_TYPE)
+              {
+                  return BuildTestNetwork<float>(1);
+              },
+              CPUDEVICE, &reader, nullptr, /*makeMode=*/false);
+
+    auto net = ComputationNetwork::CreateFromFile<float>(CPUDEVICE, msra::strfun::utf16(modelPath));
+    std::map<std::wstring, std::vector<float>> parameters;
+    for (const auto& node : net->LearnableParameterNodes(net->FinalCriterionNodes()[0]))
+    {
+        const auto& value = dynamic_pointer_cast<ComputationNode<float>>(node)->Value();
+        std::unique_ptr<float[]> values(value.CopyToArray());
+        parameters[node->NodeName()].assign(values.get(), values.get() + value.GetNumElements());
+    }
+    return parameters;
+}
+
+BOOST_AUTO_TEST_SUITE(LocalParallelTrainSuite)
+
+// ordered, worker w gets minibatches w, w + K, ... of the epoch whatever the timing of the threads; unordered, each minibatch
+// goes to somebody, once
+BOOST_AUTO_TEST_CASE(LocalMinibatchDealerDeals)
+{
+    const size_t numSamples = 200;
+    const size_t mbSize = 16;
+    const size_t numWorkers = 3;
+
+    MemoryDataReader<float> reference(numSamples, 1);
+    auto expected = FirstFeatureOfMinibatches(reference, mbSize);
+    BOOST_REQUIRE_EQUAL(expected.size(), 13);
+
+    MemoryDataReader<float> reader(numSamples, 1);
+    auto ordered = DealMinibatches(reader, mbSize, numWorkers, /*ordered=*/true);
+    for (size_t w = 0; w < numWorkers; w++)
+    {
+        std::vector<float> expectedOfWorker;
+        for (size_t i = w; i < expected.size(); i += numWorkers)
+            expectedOfWorker.push_back(expected[i]);
+        BOOST_CHECK(ordered[w] == expectedOfWorker);
+    }
+
+    auto unordered = DealMinibatches(reader, mbSize, numWorkers, /*ordered=*/false);
+    std::vector<float> all;
+    for (const auto& firsts : unordered)
+        all.insert(all.end(), firsts.begin(), firsts.end());
+    std::sort(all.begin(), all.end());
+    std::sort(expected.begin(), expected.end());
+    BOOST_CHECK(all == expected);
+}
+
+// the workers meet as long as they arrive; one that has left is no longer waited for; the meeting's action sees the
+// workers that arrived, in ascending order
+BOOST_AUTO_TEST_CASE(LocalWorkerBarrierMeets)
+{
+    const size_t numWorkers = 4;
+
+    std::vector<std::vector<size_t>> meetings;
+    LocalWorkerBarrier barrier(numWorkers, [&](const std::vector<size_t>& workers)
+                               {
+                                   meetings.push_back(workers);
+                               });
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < numWorkers; w++)
+    {
+        threads.push_back(std::thread([&, w]()
+                                      {
+                                          // worker w arrives w + 1 times, the later ones after a delay
+                                          for (size_t i = 0; i <= w; i++)
+                                          {
+                                              std::this_thread::sleep_for(std::chrono::microseconds(100 * (numWorkers - w)));
+                                              BOOST_CHECK(barrier.Arrive(w));
+                                          }
+                                          barrier.Leave();
+                                      }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    std::vector<std::vector<size_t>> expected = {{0, 1, 2, 3}, {1, 2, 3}, {2, 3}, {3}};
+    BOOST_CHECK(meetings == expected);
+}
+
+// aborting releases the waiting workers without a meeting
+BOOST_AUTO_TEST_CASE(LocalWorkerBarrierAbort)
+{
+    size_t numMeetings = 0;
+    LocalWorkerBarrier barrier(2, [&](const std::vector<size_t>&)
+                               {
+                                   numMeetings++;
+                               });
+    bool met = true;
+    std::thread waiting([&]()
+                        {
+                            met = barrier.Arrive(0);
+                        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    barrier.Abort();
+    waiting.join();
+    BOOST_CHECK(!met);
+    BOOST_CHECK(!barrier.Arrive(1));
+    BOOST_CHECK_EQUAL(numMeetings, 0);
+}
+
+// with model averaging, training gives the same model every time, regardless of the timing of the worker threads
+BOOST_AUTO_TEST_CASE(LocalModelAveragingRepeatable)
+{
+    auto expected = TrainWithLocalWorkers("modelAveraging", 3);
+    BOOST_REQUIRE_EQUAL(expected.size(), 4);
+
+    for (size_t run = 0; run < 2; run++)
+    {
+        auto parameters = TrainWithLocalWorkers("modelAveraging", 3);
+        BOOST_CHECK(parameters == expected);
+    }
+
+    // (and the training changed the model)
+    auto initial = BuildTestNetwork<float>(1);
+    std::unique_ptr<float[]> initialW0(dynamic_pointer_cast<ComputationNode<float>>(initial->GetNodeFromName(L"W0"))->Value().CopyToArray());
+    BOOST_CHECK(!std::equal(expected[L"W0"].begin(), expected[L"W0"].end(), initialW0.get()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
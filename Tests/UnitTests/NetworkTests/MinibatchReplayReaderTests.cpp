@@ -0,0 +1,95 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "MinibatchReplayReader.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// a pass over a reader: the values of each minibatch, features followed by labels, and its number of samples
+struct ReadPass
+{
+    std::vector<std::vector<float>> minibatches;
+    std::vector<size_t> numSamples;
+};
+
+static ReadPass ReadMinibatches(IDataReader<float>& reader, size_t mbSize, size_t epoch, size_t requestedEpochSamples)
+{
+    Matrix<float> features(CPUDEVICE), labels(CPUDEVICE);
+    std::map<std::wstring, Matrix<float>*> matrices = {{L"features", &features}, {L"labels", &labels}};
+    auto pMBLayout = make_shared<MBLayout>();
+    ReadPass pass;
+    reader.StartMinibatchLoop(mbSize, epoch, requestedEpochSamples);
+    while (reader.GetMinibatch(matrices))
+    {
+        std::vector<float> values;
+        for (const auto& iter : matrices)
+        {
+            std::unique_ptr<float[]> data(iter.second->CopyToArray());
+            values.insert(values.end(), data.get(), data.get() + iter.second->GetNumElements());
+        }
+        pass.minibatches.push_back(values);
+        reader.CopyMBLayoutTo(pMBLayout);
+        pass.numSamples.push_back(pMBLayout->GetNumTimeSteps() * pMBLayout->GetNumParallelSequences());
+    }
+    return pass;
+}
+
+BOOST_AUTO_TEST_SUITE(MinibatchReplayReaderSuite)
+
+// a pass started like the recorded one is replayed from memory, with the same minibatches as the wrapped reader serves
+BOOST_AUTO_TEST_CASE(MinibatchReplayReaderReplay)
+{
+    const size_t numSamples = 500;
+    const size_t mbSize = 64;
+
+    MemoryDataReader<float> reference(numSamples, 1);
+    ReadPass expected = ReadMinibatches(reference, mbSize, 0, 300);
+    BOOST_REQUIRE_EQUAL(expected.minibatches.size(), 5);
+
+    MemoryDataReader<float> source(numSamples, 1);
+    MinibatchReplayReader<float> reader(&source);
+    for (size_t pass = 0; pass < 3; pass++)
+    {
+        ReadPass read = ReadMinibatches(reader, mbSize, 0, 300);
+        BOOST_CHECK(read.minibatches == expected.minibatches);
+        BOOST_CHECK(read.numSamples == expected.numSamples);
+        BOOST_CHECK_EQUAL(reader.NumReplays(), pass);
+    }
+}
+
+// a pass started differently reads from the wrapped reader, and is recorded in place of the earlier one
+BOOST_AUTO_TEST_CASE(MinibatchReplayReaderNewPass)
+{
+    const size_t numSamples = 500;
+
+    MemoryDataReader<float> source(numSamples, 1);
+    MinibatchReplayReader<float> reader(&source);
+    ReadMinibatches(reader, 64, 0, 300);
+    ReadMinibatches(reader, 64, 0, 300);
+    BOOST_CHECK_EQUAL(reader.NumReplays(), 1);
+
+    MemoryDataReader<float> reference(numSamples, 1);
+    ReadPass expected = ReadMinibatches(reference, 100, 0, 300);
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        ReadPass read = ReadMinibatches(reader, 100, 0, 300);
+        BOOST_CHECK(read.minibatches == expected.minibatches);
+        BOOST_CHECK(read.numSamples == expected.numSamples);
+        BOOST_CHECK_EQUAL(reader.NumReplays(), pass);
+    }
+
+    // (a pass that was not read to its end is not replayed)
+    Matrix<float> features(CPUDEVICE), labels(CPUDEVICE);
+    std::map<std::wstring, Matrix<float>*> matrices = {{L"features", &features}, {L"labels", &labels}};
+    reader.StartMinibatchLoop(50, 0, 300);
+    BOOST_REQUIRE(reader.GetMinibatch(matrices));
+    ReadMinibatches(reader, 50, 0, 300);
+    BOOST_CHECK_EQUAL(reader.NumReplays(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,88 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static std::vector<float> NodeValue(const ComputationNetworkPtr& net, const std::wstring& nodeName)
+{
+    const auto& value = dynamic_pointer_cast<ComputationNode<float>>(net->GetNodeFromName(nodeName))->Value();
+    std::unique_ptr<float[]> values(value.CopyToArray());
+    return std::vector<float>(values.get(), values.get() + value.GetNumElements());
+}
+
+BOOST_AUTO_TEST_SUITE(PreComputeNodesSuite)
+
+// the statistics accumulated over parts of the data, summed up, give the mean and standard deviation of all of it
+// (as with distributedPreCompute, or a statistics cache)
+BOOST_AUTO_TEST_CASE(MergeAccumulatedStatistics)
+{
+    const size_t numSamples = 1000;
+    const size_t mbSize = 64;
+    const size_t numSubsets = 3;
+
+    auto net = BuildTestNetwork<float>(1, /*normalizeFeatures=*/true);
+    MemoryDataReader<float> reader(numSamples, 1);
+    PreComputeStatistics(net, reader, mbSize);
+
+    // accumulate each subset in a network of its own, and sum up their statistics
+    std::vector<std::vector<double>> mergedStats;
+    for (size_t subsetNum = 0; subsetNum < numSubsets; subsetNum++)
+    {
+        auto subsetNet = BuildTestNetwork<float>(1, /*normalizeFeatures=*/true);
+        auto nodes = AccumulateStatistics(subsetNet, reader, mbSize, subsetNum, numSubsets);
+        BOOST_REQUIRE_EQUAL(nodes.size(), 2);
+        mergedStats.resize(nodes.size());
+        auto mergedIter = mergedStats.begin();
+        for (const auto& node : nodes)
+        {
+            std::vector<double> stats;
+            static_pointer_cast<PreComputedNodeBase<float>>(node)->GetAccumulatedStatistics(stats);
+            if (mergedIter->empty())
+                mergedIter->assign(stats.size(), 0);
+            BOOST_REQUIRE_EQUAL(mergedIter->size(), stats.size());
+            for (size_t i = 0; i < stats.size(); i++)
+                (*mergedIter)[i] += stats[i];
+            mergedIter++;
+        }
+    }
+
+    // continue from the summed statistics in a network that has not seen any data
+    auto mergedNet = BuildTestNetwork<float>(1, /*normalizeFeatures=*/true);
+    auto nodes = mergedNet->GetNodesRequiringPreComputation();
+    auto mergedIter = mergedStats.begin();
+    for (const auto& nodeBase : nodes)
+    {
+        auto node = static_pointer_cast<PreComputedNodeBase<float>>(nodeBase);
+        node->MarkComputed(false);
+        node->SetAccumulatedStatistics(*mergedIter);
+        BOOST_CHECK_EQUAL((size_t) (*mergedIter)[0], numSamples);
+
+        // (the statistics round-trip, up to the precision of the node values)
+        std::vector<double> stats;
+        node->GetAccumulatedStatistics(stats);
+        BOOST_REQUIRE_EQUAL(stats.size(), mergedIter->size());
+        for (size_t i = 0; i < stats.size(); i++)
+            BOOST_CHECK_SMALL(stats[i] - (*mergedIter)[i], 1e-2);
+        mergedIter++;
+
+        node->MarkComputed(true);
+    }
+
+    for (const auto& nodeName : {L"featureMean", L"featureInvStdDev"})
+    {
+        auto expected = NodeValue(net, nodeName);
+        auto merged = NodeValue(mergedNet, nodeName);
+        BOOST_REQUIRE_EQUAL(merged.size(), c_featDim);
+        BOOST_REQUIRE_EQUAL(expected.size(), c_featDim);
+        for (size_t i = 0; i < c_featDim; i++)
+            BOOST_CHECK_SMALL(merged[i] - expected[i], 1e-5f);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,124 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "LinearAlgebraNodes.h"
+#include <functional>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+typedef shared_ptr<ComputationNode<float>> NodePtr;
+
+// the classifier of BuildTestNetwork(), with 'transform' applied to its hidden layer 'H1'; the result has 'transformedDim' rows
+static ComputationNetworkPtr BuildTransformedNetwork(unsigned long seed, size_t transformedDim, const std::function<NodePtr(ComputationNetworkBuilder<float>&, NodePtr)>& transform)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<float> builder(*net);
+
+    auto features = builder.CreateInputNode(L"features", c_featDim);
+    net->FeatureNodes().push_back(features);
+    auto labels = builder.CreateInputNode(L"labels", c_labelDim);
+    net->LabelNodes().push_back(labels);
+
+    auto w0 = builder.CreateLearnableParameter(L"W0", c_hiddenDim, c_featDim);
+    net->InitLearnableParameters(w0, true, seed, 1.0f);
+    auto b0 = builder.CreateLearnableParameter(L"B0", c_hiddenDim, 1);
+    net->InitLearnableParameters(b0, true, seed + 1, 1.0f);
+    auto h1 = builder.Sigmoid(builder.Plus(builder.Times(w0, features, L"W0*features"), b0, L"W0*features+B0"), L"H1");
+
+    auto w1 = builder.CreateLearnableParameter(L"W1", c_labelDim, transformedDim);
+    net->InitLearnableParameters(w1, true, seed + 2, 1.0f);
+    auto b1 = builder.CreateLearnableParameter(L"B1", c_labelDim, 1);
+    net->InitLearnableParameters(b1, true, seed + 3, 1.0f);
+    auto z = builder.Plus(builder.Times(w1, transform(builder, h1), L"W1*H1"), b1, L"z");
+
+    net->FinalCriterionNodes().push_back(builder.CrossEntropyWithSoftmax(labels, z, L"ce"));
+    net->EvaluationNodes().push_back(builder.ErrorPrediction(labels, z, L"err"));
+
+    net->CompileNetwork();
+    return net;
+}
+
+static NodePtr GetNode(const ComputationNetworkPtr& net, const std::wstring& nodeName)
+{
+    return dynamic_pointer_cast<ComputationNode<float>>(net->GetNodeFromName(nodeName));
+}
+
+static void CheckGradientsClose(const std::map<std::wstring, std::vector<float>>& gradients, const std::map<std::wstring, std::vector<float>>& expected)
+{
+    BOOST_REQUIRE_EQUAL(gradients.size(), expected.size());
+    for (const auto& iter : expected)
+    {
+        const auto& gradient = gradients.at(iter.first);
+        BOOST_REQUIRE_EQUAL(gradient.size(), iter.second.size());
+        for (size_t i = 0; i < gradient.size(); i++)
+            BOOST_CHECK_SMALL(gradient[i] - iter.second[i], 1e-6f);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(ReshapingNodesSuite)
+
+// Reshape nodes are views: they get no matrices of their own from the memory planner, but share their input's,
+// also when reshaping another view, and the gradients are those of the network without them
+BOOST_AUTO_TEST_CASE(ReshapeSharesInputMatrices)
+{
+    const size_t mbSize = 64;
+
+    auto net = BuildTransformedNetwork(1, c_hiddenDim, [](ComputationNetworkBuilder<float>& builder, NodePtr h1)
+    {
+        return builder.Reshape(builder.Reshape(h1, TensorShape(4, c_hiddenDim / 4), L"H1grid"), TensorShape(c_hiddenDim), L"H1flat");
+    });
+    MemoryDataReader<float> reader(mbSize, 1);
+    auto gradients = ComputeGradients(net, reader, mbSize);
+
+    auto h1 = GetNode(net, L"H1");
+    for (const auto& nodeName : {L"H1grid", L"H1flat"})
+    {
+        auto view = GetNode(net, nodeName);
+        BOOST_CHECK_EQUAL(&view->Value(), &h1->Value());
+        BOOST_CHECK_EQUAL(&view->Gradient(), &h1->Gradient());
+    }
+
+    auto plainNet = BuildTransformedNetwork(1, c_hiddenDim, [](ComputationNetworkBuilder<float>&, NodePtr h1)
+    {
+        return h1;
+    });
+    MemoryDataReader<float> plainReader(mbSize, 1);
+    CheckGradientsClose(gradients, ComputeGradients(plainNet, plainReader, mbSize));
+}
+
+// RowSlice reads and accumulates its rows of the input in place; the same as multiplying with a selection matrix
+// (here transposed, through the transpose flag of Times)
+BOOST_AUTO_TEST_CASE(RowSliceMatchesSelection)
+{
+    const size_t mbSize = 64;
+    const size_t startIndex = 8;
+    const size_t numRows = 16;
+
+    auto net = BuildTransformedNetwork(1, numRows, [=](ComputationNetworkBuilder<float>& builder, NodePtr h1)
+    {
+        return builder.RowSlice(h1, startIndex, numRows, L"H1slice");
+    });
+    MemoryDataReader<float> reader(mbSize, 1);
+    auto gradients = ComputeGradients(net, reader, mbSize);
+
+    auto selectionNet = BuildTransformedNetwork(1, numRows, [=](ComputationNetworkBuilder<float>& builder, NodePtr h1)
+    {
+        std::vector<float> values(c_hiddenDim * numRows, 0); // [c_hiddenDim x numRows], column-major
+        for (size_t i = 0; i < numRows; i++)
+            values[i * c_hiddenDim + startIndex + i] = 1;
+        auto selection = builder.CreateLearnableParameter(L"Selection", c_hiddenDim, numRows);
+        selection->Value().SetValue(c_hiddenDim, numRows, CPUDEVICE, values.data());
+        selection->SetParameterUpdateRequired(false);
+        return builder.Times(selection, h1, L"Selection'*H1", /*transpose=*/true);
+    });
+    BOOST_CHECK(selectionNet->GetNodeFromName(L"Selection'*H1")->OperationName() == OperationNameOf(TransposeTimesNode));
+    MemoryDataReader<float> selectionReader(mbSize, 1);
+    CheckGradientsClose(gradients, ComputeGradients(selectionNet, selectionReader, mbSize));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,134 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "TaskGraphExecutor.h"
+#include <random>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// a random DAG over 'numTasks' tasks, each depending on up to 'maxPredecessors' earlier ones (possibly the same one twice)
+static TaskGraph CreateRandomTaskGraph(size_t numTasks, size_t maxPredecessors, std::mt19937& rng)
+{
+    TaskGraph graph(numTasks);
+    for (size_t to = 1; to < numTasks; to++)
+    {
+        const size_t numPredecessors = rng() % (maxPredecessors + 1);
+        for (size_t i = 0; i < numPredecessors; i++)
+            graph.AddEdge(rng() % to, to);
+    }
+    return graph;
+}
+
+// what happened to the tasks of one Run(): how often each ran, and when (in a sequence shared by all threads) it started and finished
+struct TaskLog
+{
+    std::unique_ptr<std::atomic<size_t>[]> numRuns;
+    std::vector<size_t> start, finish;
+    std::atomic<size_t> clock;
+
+    TaskLog(size_t numTasks)
+        : numRuns(new std::atomic<size_t>[numTasks]), start(numTasks, SIZE_MAX), finish(numTasks, SIZE_MAX), clock(0)
+    {
+        for (size_t t = 0; t < numTasks; t++)
+            numRuns[t] = 0;
+    }
+    void Record(size_t task)
+    {
+        start[task] = clock++;
+        std::this_thread::yield(); // (give the other threads a chance to run something they must not)
+        numRuns[task]++;
+        finish[task] = clock++;
+    }
+};
+
+BOOST_AUTO_TEST_SUITE(TaskGraphExecutorSuite)
+
+// every task of a random DAG runs exactly once, and only after all of its predecessors have finished, for any number of
+// threads, also when the executor is reused
+BOOST_AUTO_TEST_CASE(TaskGraphExecutorRandomDags)
+{
+    const size_t numTasks = 300;
+    std::mt19937 rng(1);
+
+    for (size_t numThreads : {1, 2, 4, 8})
+    {
+        TaskGraphExecutor executor(numThreads);
+        BOOST_REQUIRE_EQUAL(executor.NumThreads(), numThreads);
+        executor.Run(TaskGraph(), [](size_t)
+                     {
+                         BOOST_ERROR("a task of an empty graph ran");
+                     });
+        for (size_t run = 0; run < 5; run++)
+        {
+            auto graph = CreateRandomTaskGraph(numTasks, run, rng); // (run 0: no edges at all)
+            TaskLog log(numTasks);
+            executor.Run(graph, [&](size_t t)
+                         {
+                             log.Record(t);
+                         });
+            for (size_t from = 0; from < numTasks; from++)
+            {
+                BOOST_CHECK_EQUAL(log.numRuns[from], 1);
+                for (size_t to : graph.Successors(from))
+                    BOOST_CHECK_LT(log.finish[from], log.start[to]);
+            }
+        }
+    }
+}
+
+// a failing task stops the run: Run() rethrows its exception, and none of the tasks depending on it run; the executor
+// remains usable
+BOOST_AUTO_TEST_CASE(TaskGraphExecutorException)
+{
+    const size_t numTasks = 100;
+    const size_t numChains = 10;
+    const size_t failingTask = 15;
+
+    // 10 independent chains t, t + 10, t + 20, ...
+    TaskGraph graph(numTasks);
+    for (size_t t = numChains; t < numTasks; t++)
+        graph.AddEdge(t - numChains, t);
+
+    TaskGraphExecutor executor(4);
+    TaskLog log(numTasks);
+    BOOST_CHECK_THROW(executor.Run(graph, [&](size_t t)
+                                   {
+                                       if (t == failingTask)
+                                           RuntimeError("task %d failed", (int) t);
+                                       log.Record(t);
+                                   }),
+                      std::runtime_error);
+    for (size_t t = failingTask; t < numTasks; t += numChains)
+        BOOST_CHECK_EQUAL(log.numRuns[t], 0);
+    for (size_t t = 0; t < numTasks; t++)
+        BOOST_CHECK_LE(log.numRuns[t], 1);
+
+    TaskLog rerunLog(numTasks);
+    executor.Run(graph, [&](size_t t)
+                 {
+                     rerunLog.Record(t);
+                 });
+    for (size_t t = 0; t < numTasks; t++)
+        BOOST_CHECK_EQUAL(rerunLog.numRuns[t], 1);
+}
+
+// Run() must not be called from one of its tasks
+BOOST_AUTO_TEST_CASE(TaskGraphExecutorNotReentrant)
+{
+    TaskGraphExecutor executor(2);
+    TaskGraph graph(1);
+    BOOST_CHECK_THROW(executor.Run(graph, [&](size_t)
+                                   {
+                                       executor.Run(graph, [](size_t)
+                                                    {
+                                                    });
+                                   }),
+                      std::logic_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
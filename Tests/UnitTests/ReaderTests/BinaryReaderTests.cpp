@@ -0,0 +1,291 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "BinaryReader.h"
+#include "fileutil.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(BinaryReaderSuite)
+
+// write a data section through a moving element window, then map the file again read-only and check it
+BOOST_AUTO_TEST_CASE(BinaryReaderSectionFileRoundTrip)
+{
+    const std::wstring fileName = L"BinaryReaderSectionFileRoundTrip.bin";
+    const size_t records = 100000;
+    const size_t dim = 3;
+    const size_t chunk = 1000;
+    _wunlink(fileName.c_str());
+
+    {
+        SectionFile file(fileName, fileOptionsReadWrite, 16 * 1024 * 1024);
+        Section* parent = file.FileSection();
+        parent->SetElementCount(records);
+
+        const size_t dataSize = records * dim * sizeof(float) + sectionHeaderMin;
+        Section* section = new Section(&file, parent, file.RoundUp(file.GetFilePositionMax()), mappingElementWindow, dataSize);
+        section->InitHeader(sectionTypeData, "features:Data Section", sectionDataFloat, sizeof(float));
+        section->SetElementsPerRecord(dim);
+        section->SetElementCount(records * dim);
+        section->SetSize(dataSize);
+        section->SetSizeAll(dataSize);
+        file.SetFilePositionMax(section->GetFilePosition() + dataSize);
+        parent->AddSection(section);
+
+        for (size_t r = 0; r < records; r += chunk)
+        {
+            float* data = (float*) section->EnsureElements(r * dim, chunk * dim * sizeof(float));
+            for (size_t i = 0; i < chunk * dim; i++)
+                data[i] = (float) (r * dim + i) * 0.5f;
+        }
+    }
+
+    {
+        SectionFile file(fileName, fileOptionsRead);
+        Section* parent = file.FileSection();
+        BOOST_CHECK_EQUAL(parent->GetRecordCount(), records);
+        BOOST_REQUIRE_EQUAL(parent->GetSectionCount(), 1);
+
+        // use a different window size than for writing, so that views are remapped at other offsets
+        Section* section = parent->ReadSection(0, mappingElementWindow, 777);
+        BOOST_CHECK(section->GetSectionType() == sectionTypeData);
+        BOOST_CHECK(section->GetName() == L"features");
+        BOOST_CHECK_EQUAL(section->GetElementCount(), records * dim);
+
+        size_t mismatches = 0;
+        for (size_t r = 0; r < records; r += chunk / 2)
+        {
+            const float* data = (const float*) section->EnsureElements(r * dim, chunk / 2 * dim * sizeof(float));
+            for (size_t i = 0; i < chunk / 2 * dim; i++)
+                mismatches += data[i] != (float) (r * dim + i) * 0.5f;
+        }
+        BOOST_CHECK_EQUAL(mismatches, 0);
+    }
+
+    _wunlink(fileName.c_str());
+}
+
+// a reader of 'numRecords' frame-mode samples, with features (dim 3) and labels (dim 2) that encode the record index
+class CountingReader : public IDataReader<float>
+{
+    size_t m_numRecords, m_mbSize, m_next, m_end, m_subsetNum, m_numSubsets, m_mbRecords;
+
+public:
+    size_t m_numMinibatchesRead;
+    CountingReader(size_t numRecords)
+        : m_numRecords(numRecords), m_mbSize(0), m_next(0), m_end(0), m_subsetNum(0), m_numSubsets(1), m_mbRecords(0), m_numMinibatchesRead(0)
+    {
+    }
+    static float Value(size_t record, size_t row)
+    {
+        return (float) (record * 10 + row);
+    }
+    virtual void Init(const ConfigParameters&) override
+    {
+    }
+    virtual void Init(const ScriptableObjects::IConfigRecord&) override
+    {
+    }
+    virtual void Destroy() override
+    {
+        delete this;
+    }
+    virtual void StartMinibatchLoop(size_t mbSize, size_t epoch, size_t requestedEpochSamples = requestDataSize) override
+    {
+        StartDistributedMinibatchLoop(mbSize, epoch, 0, 1, requestedEpochSamples);
+    }
+    virtual bool SupportsDistributedMBRead() const override
+    {
+        return true;
+    }
+    virtual void StartDistributedMinibatchLoop(size_t mbSize, size_t /*epoch*/, size_t subsetNum, size_t numSubsets, size_t requestedEpochSamples = requestDataSize) override
+    {
+        m_mbSize = mbSize;
+        m_next = 0;
+        m_end = requestedEpochSamples == requestDataSize ? m_numRecords : std::min(requestedEpochSamples, m_numRecords);
+        m_subsetNum = subsetNum;
+        m_numSubsets = numSubsets;
+    }
+    virtual bool GetMinibatch(std::map<std::wstring, Matrix<float>*>& matrices) override
+    {
+        if (m_next >= m_end)
+            return false;
+        const size_t mbSize = std::min(m_mbSize, m_end - m_next);
+        const size_t begin = m_next + mbSize * m_subsetNum / m_numSubsets;
+        m_mbRecords = m_next + mbSize * (m_subsetNum + 1) / m_numSubsets - begin;
+        for (auto& iter : matrices)
+        {
+            const size_t dim = iter.first == L"features" ? 3 : 2;
+            std::vector<float> data(dim * m_mbRecords);
+            for (size_t j = 0; j < m_mbRecords; j++)
+                for (size_t i = 0; i < dim; i++)
+                    data[j * dim + i] = Value(begin + j, i);
+            iter.second->SetValue(dim, m_mbRecords, iter.second->GetDeviceId(), data.data());
+        }
+        m_next += mbSize;
+        m_numMinibatchesRead++;
+        return true;
+    }
+    virtual size_t GetNumParallelSequences() override
+    {
+        return m_mbRecords;
+    }
+    virtual void CopyMBLayoutTo(MBLayoutPtr pMBLayout) override
+    {
+        pMBLayout->InitAsFrameMode(m_mbRecords);
+    }
+    virtual bool DataEnd(EndDataType) override
+    {
+        return m_next >= m_end;
+    }
+};
+
+// read a pass; returns the record index of each sample, and checks that the features and labels are those of the record
+static std::vector<size_t> ReadPass(IDataReader<float>& reader, size_t mbSize, size_t epoch, size_t subsetNum = 0, size_t numSubsets = 1)
+{
+    Matrix<float> features(CPUDEVICE), labels(CPUDEVICE);
+    std::map<std::wstring, Matrix<float>*> matrices = {{L"features", &features}, {L"labels", &labels}};
+    std::vector<size_t> records;
+    reader.StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets);
+    while (reader.GetMinibatch(matrices))
+    {
+        BOOST_REQUIRE_EQUAL(features.GetNumCols(), labels.GetNumCols());
+        BOOST_REQUIRE_EQUAL(reader.GetNumParallelSequences(), features.GetNumCols());
+        for (size_t j = 0; j < features.GetNumCols(); j++)
+        {
+            const size_t record = (size_t) features(0, j) / 10;
+            for (size_t i = 0; i < 3; i++)
+                BOOST_REQUIRE_EQUAL(features(i, j), CountingReader::Value(record, i));
+            for (size_t i = 0; i < 2; i++)
+                BOOST_REQUIRE_EQUAL(labels(i, j), CountingReader::Value(record, i));
+            records.push_back(record);
+        }
+    }
+    return records;
+}
+
+// the first full pass is written to the cache file, further passes (also of a new reader) are read from it, here in the
+// same order; passes that do not cover the whole dataset, and datasets larger than 'maxRecords', are not cached
+BOOST_AUTO_TEST_CASE(BinaryReaderCachingReader)
+{
+    const std::wstring fileName = L"BinaryReaderCachingReader.bin";
+    const size_t numRecords = 1000;
+    _wunlink(fileName.c_str());
+    ConfigParameters config;
+    config.Insert(L"file", msra::strfun::utf8(fileName));
+    config.Insert(L"maxRecords", "1000");
+    config.Insert(L"randomize", "None");
+
+    std::vector<size_t> allRecords(numRecords);
+    for (size_t i = 0; i < numRecords; i++)
+        allRecords[i] = i;
+
+    {
+        auto source = new CountingReader(numRecords);
+        auto reader = new CachingReader<float>(source);
+        reader->Init(config);
+        BOOST_CHECK(!reader->IsCached());
+
+        // a partial pass is not cached
+        Matrix<float> features(CPUDEVICE);
+        std::map<std::wstring, Matrix<float>*> matrices = {{L"features", &features}};
+        reader->StartMinibatchLoop(128, 0, 256);
+        while (reader->GetMinibatch(matrices))
+            ;
+        BOOST_CHECK(!reader->IsCached());
+
+        // an interrupted full pass is not either
+        reader->StartMinibatchLoop(128, 0);
+        BOOST_CHECK(reader->GetMinibatch(matrices));
+        BOOST_CHECK(!reader->IsCached());
+
+        BOOST_CHECK(ReadPass(*reader, 128, 0) == allRecords);
+        BOOST_CHECK(reader->IsCached());
+        BOOST_CHECK(fexists(fileName));
+
+        const size_t numMinibatchesRead = source->m_numMinibatchesRead;
+        BOOST_CHECK(ReadPass(*reader, 100, 1) == allRecords);
+        std::vector<size_t> subset = ReadPass(*reader, 100, 2, 1, 2);
+        BOOST_CHECK_EQUAL(subset.size(), numRecords / 2);
+        BOOST_CHECK_EQUAL(subset.front(), 50);
+        BOOST_CHECK_EQUAL(source->m_numMinibatchesRead, numMinibatchesRead);
+        reader->Destroy();
+    }
+
+    {
+        auto source = new CountingReader(numRecords);
+        auto reader = new CachingReader<float>(source);
+        reader->Init(config);
+        BOOST_CHECK(reader->IsCached());
+        BOOST_CHECK(ReadPass(*reader, 64, 0) == allRecords);
+        BOOST_CHECK_EQUAL(source->m_numMinibatchesRead, 0);
+        reader->Destroy();
+    }
+    _wunlink(fileName.c_str());
+
+    {
+        auto source = new CountingReader(numRecords + 1);
+        auto reader = new CachingReader<float>(source);
+        reader->Init(config);
+        BOOST_CHECK_EQUAL(ReadPass(*reader, 128, 0).size(), numRecords + 1);
+        BOOST_CHECK_EQUAL(ReadPass(*reader, 128, 1).size(), numRecords + 1);
+        BOOST_CHECK(!reader->IsCached());
+        BOOST_CHECK(!fexists(fileName));
+        reader->Destroy();
+    }
+}
+
+// by default, the cached records are reshuffled for every sweep, the same way by every reader of the cache file, and
+// distributed passes split the shuffled minibatches
+BOOST_AUTO_TEST_CASE(BinaryReaderCachingReaderRandomizes)
+{
+    const std::wstring fileName = L"BinaryReaderCachingReaderRandomizes.bin";
+    const size_t numRecords = 1000;
+    _wunlink(fileName.c_str());
+    ConfigParameters config;
+    config.Insert(L"file", msra::strfun::utf8(fileName));
+    config.Insert(L"maxRecords", "1000");
+
+    std::vector<size_t> allRecords(numRecords);
+    for (size_t i = 0; i < numRecords; i++)
+        allRecords[i] = i;
+
+    std::vector<std::vector<size_t>> epochs;
+    {
+        auto reader = new CachingReader<float>(new CountingReader(numRecords));
+        reader->Init(config);
+        BOOST_CHECK(ReadPass(*reader, 128, 0) == allRecords); // (written to the cache, as delivered by the wrapped reader)
+        BOOST_REQUIRE(reader->IsCached());
+        for (size_t epoch = 1; epoch <= 2; epoch++)
+        {
+            epochs.push_back(ReadPass(*reader, 128, epoch));
+            BOOST_CHECK(epochs.back() != allRecords);
+            auto sorted = epochs.back();
+            std::sort(sorted.begin(), sorted.end());
+            BOOST_CHECK(sorted == allRecords);
+        }
+        BOOST_CHECK(epochs[0] != epochs[1]);
+        reader->Destroy();
+    }
+
+    {
+        auto reader = new CachingReader<float>(new CountingReader(numRecords));
+        reader->Init(config);
+        BOOST_REQUIRE(reader->IsCached());
+        BOOST_CHECK(ReadPass(*reader, 128, 2) == epochs[1]);
+        auto subset0 = ReadPass(*reader, 128, 1, 0, 2);
+        auto subset1 = ReadPass(*reader, 128, 1, 1, 2);
+        BOOST_REQUIRE_EQUAL(subset0.size() + subset1.size(), numRecords);
+        BOOST_CHECK(std::equal(subset0.begin(), subset0.begin() + 64, epochs[0].begin()));
+        BOOST_CHECK(std::equal(subset1.begin(), subset1.begin() + 64, epochs[0].begin() + 64));
+        reader->Destroy();
+    }
+    _wunlink(fileName.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
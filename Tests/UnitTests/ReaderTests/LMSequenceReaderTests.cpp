@@ -0,0 +1,215 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "CorpusCache.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+struct LMSequenceReaderFixture : ReaderFixture
+{
+    LMSequenceReaderFixture()
+        : ReaderFixture("/Data")
+    {
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(ReaderTestSuite, LMSequenceReaderFixture)
+
+// ReadSentences - read an epoch, one sentence per minibatch, as its words (the inputs and the last next-word label)
+// The reader shuffles the sentences, so they are returned sorted.
+static std::vector<std::vector<std::string>> ReadSentences(DataReader<float>& reader, const std::vector<std::string>& words, size_t subsetNum, size_t numSubsets)
+{
+    Matrix<float> features(CPUDEVICE), labelIn(CPUDEVICE), labels(CPUDEVICE);
+    std::map<std::wstring, Matrix<float>*> matrices = {{L"features", &features}, {L"labelIn", &labelIn}, {L"labels", &labels}};
+    std::vector<std::vector<std::string>> sentences;
+    reader.StartDistributedMinibatchLoop(100, 0, subsetNum, numSubsets);
+    while (reader.GetMinibatch(matrices))
+    {
+        std::vector<std::string> sentence;
+        for (size_t j = 0; j < features.GetNumCols(); j++)
+        {
+            for (size_t i = 0; i < features.GetNumRows(); i++)
+            {
+                if (features(i, j) == 1)
+                    sentence.push_back(words[i]);
+            }
+        }
+        sentence.push_back(words[(size_t) labels(0, labels.GetNumCols() - 1)]);
+        sentences.push_back(sentence);
+        reader.DataEnd(endDataSentence);
+    }
+    std::sort(sentences.begin(), sentences.end());
+    return sentences;
+}
+
+// LoadConfig - parse a config file into 'config'
+// (Sections keep a reference to their parent, so 'config' must outlive the sections taken from it.)
+static void LoadConfig(const std::string& configFileName, ConfigParameters& config)
+{
+    std::wstring configFileCommand(L"configFile=" + std::wstring(configFileName.begin(), configFileName.end()));
+    wchar_t* arg[2]{L"CNTK", &configFileCommand[0]};
+    const std::string rawConfigString = ConfigParameters::ParseCommandLine(2, arg, config);
+    config.ResolveVariables(rawConfigString);
+}
+
+// ReadWords - the words of a label mapping file, by id
+static std::vector<std::string> ReadWords(const std::string& mappingFileName)
+{
+    std::vector<std::string> words;
+    std::ifstream mappingFile(mappingFileName);
+    for (std::string word; std::getline(mappingFile, word);)
+        words.push_back(word);
+    return words;
+}
+
+// ReadTextSentences - the sentences of a text corpus that the reader returns, that is those with at least 3 words, in file order
+static std::vector<std::vector<std::string>> ReadTextSentences(const std::string& textFileName)
+{
+    std::vector<std::vector<std::string>> sentences;
+    std::ifstream textFile(textFileName);
+    for (std::string line; std::getline(textFile, line);)
+    {
+        std::vector<std::string> sentence;
+        std::istringstream tokens(line);
+        for (std::string word; tokens >> word;)
+            sentence.push_back(word);
+        if (sentence.size() >= 3)
+            sentences.push_back(sentence);
+    }
+    return sentences;
+}
+
+// RoundRobinShare - the sentences that worker 'subsetNum' of 'numSubsets' gets, sorted
+static std::vector<std::vector<std::string>> RoundRobinShare(const std::vector<std::vector<std::string>>& sentences, size_t subsetNum, size_t numSubsets)
+{
+    std::vector<std::vector<std::string>> share;
+    for (size_t i = subsetNum; i < sentences.size(); i += numSubsets)
+        share.push_back(sentences[i]);
+    std::sort(share.begin(), share.end());
+    return share;
+}
+
+// the sentences of the text file are distributed round robin (the same way as with a corpus cache);
+// the file has an empty line and one with too few words, which are skipped by all trainers alike
+BOOST_AUTO_TEST_CASE(LMSequenceReaderDistributedSentences)
+{
+    ConfigParameters config;
+    LoadConfig(testDataPath() + "/Config/LMSequenceReaderDistributed_Config.txt", config);
+    const ConfigParameters testConfig = config("Simple_Test");
+    const ConfigParameters readerConfig = testConfig("reader");
+    const std::vector<std::string> words = ReadWords("LMSequenceReaderDistributed_Mapping.txt");
+    std::vector<std::vector<std::string>> fileSentences = ReadTextSentences("LMSequenceReaderDistributed_Train.txt");
+    BOOST_REQUIRE_EQUAL(fileSentences.size(), 38);
+
+    const size_t numSubsets = 3;
+    for (size_t subsetNum = 0; subsetNum < numSubsets; subsetNum++)
+    {
+        DataReader<float> reader(readerConfig);
+        BOOST_CHECK(ReadSentences(reader, words, subsetNum, numSubsets) == RoundRobinShare(fileSentences, subsetNum, numSubsets));
+    }
+
+    std::sort(fileSentences.begin(), fileSentences.end());
+    DataReader<float> reader(readerConfig);
+    BOOST_CHECK(ReadSentences(reader, words, 0, 1) == fileSentences);
+}
+
+// WriteCorpusCache - write a corpus cache with the given key, sentences and vocabulary
+static void WriteCorpusCache(const std::wstring& cachePath, uint64_t key, const std::vector<std::vector<std::string>>& sentences,
+                             const std::vector<std::string>& words, const std::vector<CorpusCache::VocabEntry>& vocab)
+{
+    _wunlink(cachePath.c_str()); // (a writer keeps an existing cache with the same key)
+    CorpusCache::Writer writer(cachePath, key);
+    for (const auto& sentence : sentences)
+    {
+        std::vector<uint32_t> ids;
+        for (const auto& word : sentence)
+            ids.push_back((uint32_t)(std::find(words.begin(), words.end(), word) - words.begin()));
+        writer.AddSentence(ids);
+    }
+    writer.Close(vocab);
+}
+
+// the corpus cache is built on first use, and then read instead of the text, also by share; a cache whose vocabulary
+// does not fit the reader settings is rejected, and one that is out of date with the text is rebuilt
+BOOST_AUTO_TEST_CASE(LMSequenceReaderCorpusCache)
+{
+    const std::string textFileName = "LMSequenceReaderCorpusCache_Train.txt";
+    const std::wstring cachePath = L"LMSequenceReaderCorpusCache.bin";
+    {
+        std::ifstream source("LMSequenceReaderDistributed_Train.txt", std::ios::binary);
+        std::ofstream copy(textFileName, std::ios::binary);
+        copy << source.rdbuf();
+    }
+    _wunlink(cachePath.c_str());
+
+    ConfigParameters config;
+    LoadConfig(testDataPath() + "/Config/LMSequenceReaderCorpusCache_Config.txt", config);
+    const ConfigParameters testConfig = config("Simple_Test");
+    const ConfigParameters readerConfig = testConfig("reader");
+    const std::vector<std::string> words = ReadWords("LMSequenceReaderDistributed_Mapping.txt");
+    auto fileSentences = ReadTextSentences(textFileName);
+
+    // build
+    {
+        DataReader<float> reader(readerConfig);
+        BOOST_REQUIRE(fexists(cachePath));
+        const size_t numSubsets = 3;
+        for (size_t subsetNum = 0; subsetNum < numSubsets; subsetNum++)
+            BOOST_CHECK(ReadSentences(reader, words, subsetNum, numSubsets) == RoundRobinShare(fileSentences, subsetNum, numSubsets));
+        BOOST_CHECK(ReadSentences(reader, words, 0, 1) == RoundRobinShare(fileSentences, 0, 1));
+    }
+    uint64_t key;
+    std::vector<CorpusCache::VocabEntry> vocab;
+    {
+        CorpusCache cache(cachePath);
+        key = cache.Key();
+        vocab = cache.ReadVocabulary();
+    }
+    BOOST_REQUIRE_EQUAL(vocab.size(), words.size());
+
+    // reopen: a current cache is read instead of the text, so here one of the first five sentences only
+    const std::vector<std::vector<std::string>> firstSentences(fileSentences.begin(), fileSentences.begin() + 5);
+    WriteCorpusCache(cachePath, key, firstSentences, words, vocab);
+    {
+        DataReader<float> reader(readerConfig);
+        BOOST_CHECK(ReadSentences(reader, words, 0, 1) == RoundRobinShare(firstSentences, 0, 1));
+        BOOST_CHECK(ReadSentences(reader, words, 1, 2) == RoundRobinShare(firstSentences, 1, 2));
+    }
+
+    // the vocabulary from the cache is checked like the word class file: it must cover labelDim and have the unk symbol
+    auto smallVocab = vocab;
+    smallVocab.pop_back();
+    WriteCorpusCache(cachePath, key, firstSentences, words, smallVocab);
+    BOOST_CHECK_THROW(DataReader<float> reader(readerConfig), std::exception);
+    auto noUnkVocab = vocab;
+    for (auto& entry : noUnkVocab)
+    {
+        if (entry.word == "<unk>")
+            entry.word = "<oov>";
+    }
+    WriteCorpusCache(cachePath, key, firstSentences, words, noUnkVocab);
+    BOOST_CHECK_THROW(DataReader<float> reader(readerConfig), std::exception);
+
+    // a stale cache is rebuilt
+    {
+        std::ofstream text(textFileName, std::ios::app);
+        text << "</s> j i h g f e </s>\n";
+    }
+    fileSentences.push_back({"</s>", "j", "i", "h", "g", "f", "e", "</s>"});
+    {
+        DataReader<float> reader(readerConfig);
+        BOOST_CHECK(ReadSentences(reader, words, 0, 1) == RoundRobinShare(fileSentences, 0, 1));
+        BOOST_CHECK(ReadSentences(reader, words, 1, 2) == RoundRobinShare(fileSentences, 1, 2));
+    }
+    BOOST_CHECK(CorpusCache(cachePath).Key() != key);
+
+    _wunlink(cachePath.c_str());
+    _wunlink(std::wstring(textFileName.begin(), textFileName.end()).c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,103 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "ssematrix.h"
+#include "packedchunkarchive.h"
+#include <numeric>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+const size_t c_archiveFeatDim = 3;
+
+// the frames of a chunk of 'numFrames' frames: dimension 0 varies smoothly over [-40, 40], dimension 1 is noisy and
+// dimension 2 constant
+static msra::dbn::matrix CreateChunkFrames(size_t numFrames, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> noise(-3.0f, 5.0f);
+    msra::dbn::matrix frames(c_archiveFeatDim, numFrames);
+    for (size_t t = 0; t < numFrames; t++)
+    {
+        frames(0, t) = 40.0f * sinf(0.01f * t);
+        frames(1, t) = noise(rng);
+        frames(2, t) = 0.25f;
+    }
+    return frames;
+}
+
+// write two chunks of 3 and 2 utterances, read them back, and return the largest error per dimension, in units of the
+// 16-bit quantization step of the chunk (its range of the dimension / 65534), or absolute if the dimension is constant
+static std::vector<float> PackedChunkArchiveRoundTrip(const std::wstring& path, bool compressed)
+{
+    const std::vector<std::vector<std::wstring>> keys = {{L"a", L"b", L"c"}, {L"d", L"e"}};
+    const std::vector<std::vector<size_t>> uttFrames = {{1000, 2500, 700}, {3000, 1}};
+    std::vector<msra::dbn::matrix> chunks;
+    _wunlink(path.c_str());
+    {
+        msra::asr::packedchunkarchivewriter writer(path, "USER", c_archiveFeatDim, 100000, compressed);
+        for (size_t c = 0; c < keys.size(); c++)
+        {
+            chunks.push_back(CreateChunkFrames(std::accumulate(uttFrames[c].begin(), uttFrames[c].end(), (size_t) 0), (unsigned int) c));
+            writer.writechunk(keys[c], uttFrames[c], chunks.back());
+        }
+        writer.close();
+    }
+
+    msra::asr::packedchunkarchive archive(path);
+    BOOST_CHECK_EQUAL(archive.getfeatkind(), "USER");
+    BOOST_CHECK_EQUAL(archive.getfeatdim(), c_archiveFeatDim);
+    BOOST_CHECK_EQUAL(archive.getsampperiod(), 100000);
+    BOOST_CHECK_EQUAL(archive.iscompressed(), compressed);
+    BOOST_REQUIRE_EQUAL(archive.numchunks(), keys.size());
+
+    std::vector<float> maxErrors(c_archiveFeatDim, 0);
+    for (size_t c = archive.numchunks(); c-- > 0;) // (in reverse, to seek back)
+    {
+        BOOST_CHECK(archive.chunkkeys(c) == keys[c]);
+        BOOST_CHECK(archive.chunkuttframes(c) == uttFrames[c]);
+        const auto& expected = chunks[c];
+        msra::dbn::matrix frames(c_archiveFeatDim, expected.cols());
+        archive.readchunk(c, frames);
+        for (size_t k = 0; k < c_archiveFeatDim; k++)
+        {
+            float minVal = expected(k, 0), maxVal = expected(k, 0), maxError = 0;
+            for (size_t t = 0; t < expected.cols(); t++)
+            {
+                maxError = max(maxError, fabs(frames(k, t) - expected(k, t)));
+                minVal = min(minVal, expected(k, t));
+                maxVal = max(maxVal, expected(k, t));
+            }
+            const float step = maxVal > minVal ? (maxVal - minVal) / 65534 : 1.0f;
+            maxErrors[k] = max(maxErrors[k], maxError / step);
+        }
+    }
+    _wunlink(path.c_str());
+    return maxErrors;
+}
+
+BOOST_AUTO_TEST_SUITE(PackedChunkArchiveSuite)
+
+// an uncompressed archive gives back the frames exactly, with the chunking and utterances it was written with
+BOOST_AUTO_TEST_CASE(PackedChunkArchiveRoundTripExact)
+{
+    auto maxErrors = PackedChunkArchiveRoundTrip(L"PackedChunkArchiveRoundTripExact.pchk", /*compressed=*/false);
+    for (size_t k = 0; k < c_archiveFeatDim; k++)
+        BOOST_CHECK_EQUAL(maxErrors[k], 0);
+}
+
+// 16-bit quantization is off by at most half a step (plus float rounding); a constant dimension is exact
+BOOST_AUTO_TEST_CASE(PackedChunkArchiveRoundTripCompressed)
+{
+    auto maxErrors = PackedChunkArchiveRoundTrip(L"PackedChunkArchiveRoundTripCompressed.pchk", /*compressed=*/true);
+    for (size_t k = 0; k < c_archiveFeatDim; k++)
+        BOOST_CHECK_LE(maxErrors[k], 0.51f);
+    BOOST_CHECK_GT(maxErrors[0], 0.1f);
+    BOOST_CHECK_EQUAL(maxErrors[2], 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -18,6 +18,86 @@ struct UCIReaderFixture : ReaderFixture
 
 BOOST_FIXTURE_TEST_SUITE(ReaderTestSuite, UCIReaderFixture)
 
+// the second of two parallel trainers gets the second half of each minibatch of the single-trainer test
+BOOST_AUTO_TEST_CASE(UCIFastReaderSimpleDataLoopDistributed)
+{
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/UCIFastReaderSimpleDataLoop_Config.txt",
+        testDataPath() + "/Control/UCIFastReaderSimpleDataLoop_Subset1of2_Control.txt",
+        testDataPath() + "/Control/UCIFastReaderSimpleDataLoop_Subset1of2_Output.txt",
+        "Simple_Test",
+        "reader",
+        500,
+        250,
+        2,
+        1,
+        1,
+        1,
+        2);
+}
+
+// every parallel trainer gets its columns of the single-trainer minibatches, also in epochs 2 and 3, where
+// the dataset was read to its end before, and so only the records of the trainer's own subset are parsed
+BOOST_AUTO_TEST_CASE(UCIFastReaderDistributedSubsetParsing)
+{
+    const string configFileName = testDataPath() + "/Config/UCIFastReaderSimpleDataLoop_Config.txt";
+    std::wstring configFileCommand(L"configFile=" + std::wstring(configFileName.begin(), configFileName.end()));
+    wchar_t* arg[2]{L"CNTK", &configFileCommand[0]};
+    ConfigParameters config;
+    const std::string rawConfigString = ConfigParameters::ParseCommandLine(2, arg, config);
+    config.ResolveVariables(rawConfigString);
+    const ConfigParameters testConfig = config("Simple_Test");
+    const ConfigParameters readerConfig = testConfig("reader");
+
+    const size_t epochSize = 5000, mbSize = 250, epochs = 4, numSubsets = 3;
+    DataReader<float> reader(readerConfig);
+    Matrix<float> features(CPUDEVICE), labels(CPUDEVICE);
+    std::map<std::wstring, Matrix<float>*> matrices = {{L"features", &features}, {L"labels", &labels}};
+
+    std::vector<std::unique_ptr<DataReader<float>>> subsetReaders;
+    std::vector<std::unique_ptr<Matrix<float>>> subsetFeatures, subsetLabels;
+    std::vector<std::map<std::wstring, Matrix<float>*>> subsetMatrices;
+    for (size_t subsetNum = 0; subsetNum < numSubsets; subsetNum++)
+    {
+        subsetReaders.emplace_back(new DataReader<float>(readerConfig));
+        subsetFeatures.emplace_back(new Matrix<float>(CPUDEVICE));
+        subsetLabels.emplace_back(new Matrix<float>(CPUDEVICE));
+        subsetMatrices.push_back({{L"features", subsetFeatures.back().get()}, {L"labels", subsetLabels.back().get()}});
+    }
+
+    for (size_t epoch = 0; epoch < epochs; epoch++)
+    {
+        reader.StartMinibatchLoop(mbSize, epoch, epochSize);
+        for (size_t subsetNum = 0; subsetNum < numSubsets; subsetNum++)
+            subsetReaders[subsetNum]->StartDistributedMinibatchLoop(mbSize, epoch, subsetNum, numSubsets, epochSize);
+
+        size_t numMinibatches = 0;
+        for (; reader.GetMinibatch(matrices); numMinibatches++)
+        {
+            const size_t numCols = features.GetNumCols();
+            for (size_t subsetNum = 0; subsetNum < numSubsets; subsetNum++)
+            {
+                BOOST_REQUIRE(subsetReaders[subsetNum]->GetMinibatch(subsetMatrices[subsetNum]));
+                const Matrix<float>& f = *subsetFeatures[subsetNum];
+                const Matrix<float>& l = *subsetLabels[subsetNum];
+                const size_t startCol = numCols * subsetNum / numSubsets;
+                BOOST_REQUIRE_EQUAL(f.GetNumCols(), numCols * (subsetNum + 1) / numSubsets - startCol);
+                BOOST_REQUIRE_EQUAL(l.GetNumCols(), f.GetNumCols());
+                for (size_t j = 0; j < f.GetNumCols(); j++)
+                {
+                    for (size_t i = 0; i < f.GetNumRows(); i++)
+                        BOOST_REQUIRE_EQUAL(f(i, j), features(i, startCol + j));
+                    for (size_t i = 0; i < l.GetNumRows(); i++)
+                        BOOST_REQUIRE_EQUAL(l(i, j), labels(i, startCol + j));
+                }
+            }
+        }
+        BOOST_CHECK_EQUAL(numMinibatches, epochSize / mbSize);
+        for (size_t subsetNum = 0; subsetNum < numSubsets; subsetNum++)
+            BOOST_CHECK(!subsetReaders[subsetNum]->GetMinibatch(subsetMatrices[subsetNum]));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(UCIFastReaderSimpleDataLoop)
 {
     HelperRunReaderTest<float>(
@@ -0,0 +1,111 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "htkfeatio.h"
+#include "latticesource.h"
+#include "biggrowablevectors.h"
+#include "utterancesourcemulti.h"
+#include <thread>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// a corpus of 'numUtterances' utterances of 'uttFrames' frames each, in one HTK archive of dimension 1 whose value is the
+// frame index in the archive; returns the SCP lines
+static std::vector<std::wstring> WriteCountingCorpus(const std::wstring& archivePath, size_t numUtterances, size_t uttFrames)
+{
+    msra::asr::htkfeatwriter writer(archivePath, "USER", 1, 100000);
+    std::vector<float> frame(1);
+    std::vector<std::wstring> scpLines;
+    for (size_t u = 0; u < numUtterances; u++)
+    {
+        for (size_t t = 0; t < uttFrames; t++)
+        {
+            frame[0] = (float) (u * uttFrames + t);
+            writer.write(frame);
+        }
+        scpLines.push_back(msra::strfun::wstrprintf(L"utt%d.feat=%ls[%d,%d]", (int) u, archivePath.c_str(), (int) (u * uttFrames), (int) ((u + 1) * uttFrames - 1)));
+    }
+    writer.close(numUtterances * uttFrames);
+    return scpLines;
+}
+
+// unsupervised utterance-mode source over 'scpLines', randomizing within about three chunks
+static std::unique_ptr<msra::dbn::minibatchutterancesourcemulti> CreateUtteranceSource(const std::vector<std::wstring>& scpLines, const msra::dbn::latticesource& lattices,
+                                                                                       const std::map<std::wstring, msra::lattices::lattice::htkmlfwordsequence>& wordTranscripts)
+{
+    const std::vector<std::map<std::wstring, std::vector<msra::asr::htkmlfentry>>> noLabels;
+    std::unique_ptr<msra::dbn::minibatchutterancesourcemulti> source(new msra::dbn::minibatchutterancesourcemulti(
+        {scpLines}, noLabels, {1}, {}, {0}, {0}, /*randomizationrange=*/200000, lattices, wordTranscripts, /*framemode=*/false));
+    source->setverbosity(0);
+    return source;
+}
+
+// the frames of the utterances of epoch 'epoch' that start in its frame range [fromFrame, toFrame), one utterance per getbatch() call
+static std::vector<float> ReadEpoch(msra::dbn::minibatchutterancesourcemulti& source, size_t epoch, size_t fromFrame, size_t toFrame)
+{
+    const size_t epochFrames = source.totalframes();
+    std::vector<msra::dbn::matrix> feat;
+    std::vector<std::vector<size_t>> uids;
+    std::vector<const_array_ref<msra::lattices::lattice::htkmlfwordsequence::word>> transcripts;
+    std::vector<std::shared_ptr<const msra::dbn::latticesource::latticepair>> lattices;
+    std::vector<std::vector<size_t>> sentEndMark, phoneBoundaries;
+    std::vector<float> frames;
+    for (size_t ts = source.firstvalidglobalts(epoch * epochFrames + fromFrame); ts < epoch * epochFrames + toFrame; ts += feat[0].cols())
+    {
+        source.getbatch(ts, 1, feat, uids, transcripts, lattices, sentEndMark, phoneBoundaries);
+        for (size_t t = 0; t < feat[0].cols(); t++)
+            frames.push_back(feat[0](0, t));
+    }
+    return frames;
+}
+
+BOOST_AUTO_TEST_SUITE(UtteranceSourceSuite)
+
+// read-ahead pages in up to the configured number of chunks beyond the window, also with fewer page-ins outstanding at a
+// time, and gives the same data as paging on demand, also when epochs are switched while chunks are being read ahead
+BOOST_AUTO_TEST_CASE(UtteranceSourceReadAhead)
+{
+    const std::wstring archivePath = L"UtteranceSourceReadAhead.feat";
+    const size_t uttFrames = 5000; // (18 utterances per chunk)
+    const size_t readAheadChunks = 4;
+    auto scpLines = WriteCountingCorpus(archivePath, 200, uttFrames);
+
+    msra::dbn::latticesource lattices(std::make_pair(std::vector<std::wstring>(), std::vector<std::wstring>()), std::unordered_map<std::string, size_t>(), L"");
+    std::map<std::wstring, msra::lattices::lattice::htkmlfwordsequence> wordTranscripts;
+    auto reference = CreateUtteranceSource(scpLines, lattices, wordTranscripts);
+    auto source = CreateUtteranceSource(scpLines, lattices, wordTranscripts);
+    source->setreadahead(readAheadChunks, 1);
+    const size_t epochFrames = reference->totalframes();
+
+    for (size_t epoch = 0; epoch < 2; epoch++)
+    {
+        auto expected = ReadEpoch(*reference, epoch, 0, epochFrames);
+        BOOST_REQUIRE_EQUAL(expected.size(), epochFrames);
+        std::vector<float> frames;
+        for (size_t ts = 0; ts < epochFrames; ts += uttFrames) // (give the read-aheads time to complete)
+        {
+            auto utterance = ReadEpoch(*source, epoch, ts, ts + 1);
+            frames.insert(frames.end(), utterance.begin(), utterance.end());
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        BOOST_CHECK(frames == expected);
+    }
+    BOOST_CHECK_GE(source->getmaxreadaheaddepth(), readAheadChunks);
+
+    // switching epochs (and thus randomization) in the middle releases all chunks, including those still being read ahead
+    for (size_t epoch = 5; epoch > 2; epoch--)
+    {
+        auto expected = ReadEpoch(*reference, epoch, 0, epochFrames / 2);
+        BOOST_CHECK(ReadEpoch(*source, epoch, 0, epochFrames / 2) == expected);
+    }
+
+    source.reset();
+    _wunlink(archivePath.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }